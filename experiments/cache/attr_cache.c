@@ -0,0 +1,177 @@
+/*
+ * Filename:         attr_cache.c
+ * Description:      Inode attribute cache
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "attr_cache.h"
+
+struct attr_cache_entry {
+	/* First, freed by cache_core.c */
+	struct cache_entry entry;
+	uint64_t ino;
+	struct stat st;
+};
+
+/* Inode numbers are mostly sequential, mix their bits */
+static uint64_t ino_hash(uint64_t ino)
+{
+	return ino * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool ino_match(const struct cache_entry *e, const void *key)
+{
+	return ((const struct attr_cache_entry *)e)->ino ==
+		*(const uint64_t *)key;
+}
+
+int attr_cache_init(struct attr_cache *cache, uint32_t nr_shards,
+		    uint32_t capacity, uint64_t ttl_us)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->ac_ttl_us = ttl_us;
+
+	return cache_core_init(&cache->ac_core, nr_shards, capacity);
+}
+
+void attr_cache_fini(struct attr_cache *cache)
+{
+	cache_core_fini(&cache->ac_core);
+}
+
+int attr_cache_get(struct attr_cache *cache, uint64_t ino, struct stat *st)
+{
+	uint64_t hash = ino_hash(ino);
+	struct cache_shard *shard = cache_shard_of(&cache->ac_core, hash);
+	struct cache_entry *e;
+	int rc = -ENOENT;
+
+	pthread_mutex_lock(&shard->cs_lock);
+	e = cache_shard_find(shard, hash, ino_match, &ino);
+	if (e != NULL) {
+		*st = ((struct attr_cache_entry *)e)->st;
+		cache_shard_touch(shard, e);
+		shard->cs_stats.hits++;
+		rc = 0;
+	} else {
+		shard->cs_stats.misses++;
+	}
+	pthread_mutex_unlock(&shard->cs_lock);
+
+	return rc;
+}
+
+uint64_t attr_cache_gen(struct attr_cache *cache, uint64_t ino)
+{
+	return cache_core_gen(&cache->ac_core, ino_hash(ino));
+}
+
+int attr_cache_put(struct attr_cache *cache, uint64_t ino,
+		   const struct stat *st, uint64_t ttl_us, uint64_t gen)
+{
+	uint64_t hash = ino_hash(ino);
+	struct cache_shard *shard = cache_shard_of(&cache->ac_core, hash);
+	struct attr_cache_entry *ae;
+	struct cache_entry *e;
+	int rc = 0;
+
+	if (ttl_us == 0)
+		ttl_us = cache->ac_ttl_us;
+
+	pthread_mutex_lock(&shard->cs_lock);
+	if (gen != CACHE_GEN_ANY && gen != shard->cs_gen) {
+		rc = -ESTALE;
+		goto out;
+	}
+
+	e = cache_shard_find(shard, hash, ino_match, &ino);
+	if (e != NULL) {
+		cache_shard_touch(shard, e);
+	} else {
+		ae = malloc(sizeof(*ae));
+		if (ae == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+		ae->ino = ino;
+		e = &ae->entry;
+		e->ce_hash = hash;
+		cache_shard_insert(shard, e);
+	}
+
+	((struct attr_cache_entry *)e)->st = *st;
+	e->ce_expires_us = cache_now_us() + ttl_us;
+out:
+	pthread_mutex_unlock(&shard->cs_lock);
+	return rc;
+}
+
+void attr_cache_invalidate(struct attr_cache *cache, uint64_t ino)
+{
+	uint64_t hash = ino_hash(ino);
+	struct cache_shard *shard = cache_shard_of(&cache->ac_core, hash);
+
+	pthread_mutex_lock(&shard->cs_lock);
+	cache_shard_invalidate(shard,
+			       cache_shard_find(shard, hash, ino_match, &ino));
+	pthread_mutex_unlock(&shard->cs_lock);
+}
+
+void attr_cache_invalidate_all(struct attr_cache *cache)
+{
+	cache_core_invalidate_all(&cache->ac_core, NULL, NULL);
+}
+
+void attr_cache_stats_get(struct attr_cache *cache,
+			  struct attr_cache_stats *stats)
+{
+	struct cache_stats cs;
+
+	cache_core_stats_get(&cache->ac_core, &cs);
+	stats->hits = cs.hits;
+	stats->misses = cs.misses;
+	stats->evictions = cs.evictions;
+	stats->expirations = cs.expirations;
+	stats->invalidations = cs.invalidations;
+}
+
+void attr_cache_stats_print(struct attr_cache *cache, const char *msg)
+{
+	struct attr_cache_stats stats;
+
+	attr_cache_stats_get(cache, &stats);
+	printf("%s: %llu hits, %llu misses (%llu expired), %llu evictions,"
+	       " %llu invalidations\n", msg,
+	       (unsigned long long)stats.hits,
+	       (unsigned long long)stats.misses,
+	       (unsigned long long)stats.expirations,
+	       (unsigned long long)stats.evictions,
+	       (unsigned long long)stats.invalidations);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,110 @@
+/*
+ * Filename:         attr_cache.h
+ * Description:      Inode attribute cache
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* In-process cache of the "struct stat" of inodes, so that a getattr right
+ * after a create, lookup or setattr does not go back to the KV store.
+ *
+ * - Entries are spread over shards by inode number, each shard has its own
+ *   lock, hash table and LRU list, and holds at most capacity / nr_shards
+ *   entries. The least recently used entry of a shard is evicted when it
+ *   is full (cache_core.h).
+ * - Every entry expires after its TTL. In a multi-node deployment the TTL
+ *   works as a lease: another node may change the inode, the cached copy
+ *   is never trusted longer than that.
+ * - attr_cache_invalidate() and attr_cache_invalidate_all() drop entries
+ *   before their TTL, e.g. when another node reports a change.
+ * - A getattr from the KV store racing with a setattr must not cache the
+ *   attributes from before it: attr_cache_put() is given the generation
+ *   read by attr_cache_gen() before the getattr, and puts nothing when an
+ *   invalidation came in between.
+ */
+
+#ifndef _ATTR_CACHE_H
+#define _ATTR_CACHE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "cache_core.h"
+
+struct attr_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	/* Entries dropped to make room for new ones */
+	uint64_t evictions;
+	/* Entries found but too old, counted in misses as well */
+	uint64_t expirations;
+	uint64_t invalidations;
+};
+
+struct attr_cache {
+	struct cache_core ac_core;
+	/* Default TTL of the entries, in microseconds */
+	uint64_t ac_ttl_us;
+};
+
+/**
+ * Create a cache of up to capacity entries spread over nr_shards shards.
+ * Entries live ttl_us unless attr_cache_put() says otherwise.
+ */
+int attr_cache_init(struct attr_cache *cache, uint32_t nr_shards,
+		    uint32_t capacity, uint64_t ttl_us);
+
+void attr_cache_fini(struct attr_cache *cache);
+
+/**
+ * Copy the cached attributes of ino to st.
+ * Return 0 on a hit, -ENOENT when ino is not cached or its entry expired.
+ */
+int attr_cache_get(struct attr_cache *cache, uint64_t ino, struct stat *st);
+
+/**
+ * Generation of the entry of ino, to be read before getting its attributes
+ * from the KV store.
+ */
+uint64_t attr_cache_gen(struct attr_cache *cache, uint64_t ino);
+
+/**
+ * Insert or replace the attributes of ino, valid for ttl_us microseconds
+ * (0 for the default TTL of the cache).
+ * gen is what attr_cache_gen() returned before the attributes were read,
+ * or CACHE_GEN_ANY for attributes this process just stored. Return
+ * -ESTALE when ino was invalidated since gen.
+ */
+int attr_cache_put(struct attr_cache *cache, uint64_t ino,
+		   const struct stat *st, uint64_t ttl_us, uint64_t gen);
+
+/**
+ * Drop the entry of ino, if any.
+ */
+void attr_cache_invalidate(struct attr_cache *cache, uint64_t ino);
+
+/**
+ * Drop all the entries.
+ */
+void attr_cache_invalidate_all(struct attr_cache *cache);
+
+/**
+ * Sum of the counters of all the shards.
+ */
+void attr_cache_stats_get(struct attr_cache *cache,
+			  struct attr_cache_stats *stats);
+
+void attr_cache_stats_print(struct attr_cache *cache, const char *msg);
+
+#endif /* _ATTR_CACHE_H */
@@ -0,0 +1,241 @@
+/*
+ * Filename:         cache_core.c
+ * Description:      Sharded LRU core of the in-process caches
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "cache_core.h"
+
+uint64_t cache_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static struct cache_entry **bucket_of(struct cache_shard *shard,
+				      uint64_t hash)
+{
+	return &shard->cs_buckets[hash % shard->cs_nr_buckets];
+}
+
+static void lru_del(struct cache_entry *e)
+{
+	e->ce_lru_prev->ce_lru_next = e->ce_lru_next;
+	e->ce_lru_next->ce_lru_prev = e->ce_lru_prev;
+}
+
+static void lru_add_head(struct cache_shard *shard, struct cache_entry *e)
+{
+	e->ce_lru_next = shard->cs_lru.ce_lru_next;
+	e->ce_lru_prev = &shard->cs_lru;
+	shard->cs_lru.ce_lru_next->ce_lru_prev = e;
+	shard->cs_lru.ce_lru_next = e;
+}
+
+/* Called with the shard lock held */
+static void entry_remove(struct cache_shard *shard, struct cache_entry *e)
+{
+	struct cache_entry **pe = bucket_of(shard, e->ce_hash);
+
+	while (*pe != e)
+		pe = &(*pe)->ce_hnext;
+	*pe = e->ce_hnext;
+
+	lru_del(e);
+	shard->cs_nr--;
+	free(e);
+}
+
+int cache_core_init(struct cache_core *core, uint32_t nr_shards,
+		    uint32_t capacity)
+{
+	struct cache_shard *shard;
+	uint32_t i;
+	int rc;
+
+	if (nr_shards == 0 || capacity < nr_shards)
+		return -EINVAL;
+
+	memset(core, 0, sizeof(*core));
+
+	core->cc_shards = calloc(nr_shards, sizeof(*core->cc_shards));
+	if (core->cc_shards == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_shards; i++) {
+		shard = &core->cc_shards[i];
+		shard->cs_max = capacity / nr_shards;
+		shard->cs_nr_buckets = shard->cs_max;
+		shard->cs_lru.ce_lru_next = shard->cs_lru.ce_lru_prev =
+			&shard->cs_lru;
+
+		shard->cs_buckets = calloc(shard->cs_nr_buckets,
+					   sizeof(*shard->cs_buckets));
+		if (shard->cs_buckets == NULL) {
+			rc = -ENOMEM;
+			goto err;
+		}
+
+		rc = -pthread_mutex_init(&shard->cs_lock, NULL);
+		if (rc != 0) {
+			free(shard->cs_buckets);
+			goto err;
+		}
+		core->cc_nr_shards++;
+	}
+
+	return 0;
+
+err:
+	cache_core_fini(core);
+	return rc;
+}
+
+void cache_core_fini(struct cache_core *core)
+{
+	struct cache_shard *shard;
+	uint32_t i;
+
+	for (i = 0; i < core->cc_nr_shards; i++) {
+		shard = &core->cc_shards[i];
+		while (shard->cs_nr != 0)
+			entry_remove(shard, shard->cs_lru.ce_lru_next);
+		pthread_mutex_destroy(&shard->cs_lock);
+		free(shard->cs_buckets);
+	}
+	free(core->cc_shards);
+	core->cc_shards = NULL;
+	core->cc_nr_shards = 0;
+}
+
+uint64_t cache_core_gen(struct cache_core *core, uint64_t hash)
+{
+	struct cache_shard *shard = cache_shard_of(core, hash);
+	uint64_t gen;
+
+	pthread_mutex_lock(&shard->cs_lock);
+	gen = shard->cs_gen;
+	pthread_mutex_unlock(&shard->cs_lock);
+
+	return gen;
+}
+
+struct cache_entry *cache_shard_find(struct cache_shard *shard, uint64_t hash,
+				     cache_match_t match, const void *key)
+{
+	struct cache_entry *e;
+
+	for (e = *bucket_of(shard, hash); e != NULL; e = e->ce_hnext)
+		if (e->ce_hash == hash && match(e, key))
+			break;
+
+	if (e != NULL && e->ce_expires_us <= cache_now_us()) {
+		entry_remove(shard, e);
+		shard->cs_stats.expirations++;
+		e = NULL;
+	}
+	return e;
+}
+
+void cache_shard_touch(struct cache_shard *shard, struct cache_entry *e)
+{
+	lru_del(e);
+	lru_add_head(shard, e);
+}
+
+void cache_shard_insert(struct cache_shard *shard, struct cache_entry *e)
+{
+	struct cache_entry **bucket = bucket_of(shard, e->ce_hash);
+
+	if (shard->cs_nr == shard->cs_max) {
+		/* Least recently used entry */
+		entry_remove(shard, shard->cs_lru.ce_lru_prev);
+		shard->cs_stats.evictions++;
+	}
+
+	e->ce_hnext = *bucket;
+	*bucket = e;
+	lru_add_head(shard, e);
+	shard->cs_nr++;
+}
+
+void cache_shard_invalidate(struct cache_shard *shard, struct cache_entry *e)
+{
+	shard->cs_gen++;
+	if (e != NULL) {
+		entry_remove(shard, e);
+		shard->cs_stats.invalidations++;
+	}
+}
+
+void cache_core_invalidate_all(struct cache_core *core, cache_match_t match,
+			       const void *key)
+{
+	struct cache_shard *shard;
+	struct cache_entry *e, *next;
+	uint32_t i;
+
+	for (i = 0; i < core->cc_nr_shards; i++) {
+		shard = &core->cc_shards[i];
+		pthread_mutex_lock(&shard->cs_lock);
+		shard->cs_gen++;
+		for (e = shard->cs_lru.ce_lru_next; e != &shard->cs_lru;
+		     e = next) {
+			next = e->ce_lru_next;
+			if (match == NULL || match(e, key)) {
+				entry_remove(shard, e);
+				shard->cs_stats.invalidations++;
+			}
+		}
+		pthread_mutex_unlock(&shard->cs_lock);
+	}
+}
+
+void cache_core_stats_get(struct cache_core *core, struct cache_stats *stats)
+{
+	struct cache_shard *shard;
+	uint32_t i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < core->cc_nr_shards; i++) {
+		shard = &core->cc_shards[i];
+		pthread_mutex_lock(&shard->cs_lock);
+		stats->hits += shard->cs_stats.hits;
+		stats->negative_hits += shard->cs_stats.negative_hits;
+		stats->misses += shard->cs_stats.misses;
+		stats->evictions += shard->cs_stats.evictions;
+		stats->expirations += shard->cs_stats.expirations;
+		stats->invalidations += shard->cs_stats.invalidations;
+		pthread_mutex_unlock(&shard->cs_lock);
+	}
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,148 @@
+/*
+ * Filename:         cache_core.h
+ * Description:      Sharded LRU core of the in-process caches
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Sharded LRU cache with TTLs, shared by attr_cache.c and dentry_cache.c.
+ *
+ * - Entries are spread over shards by hash, each shard has its own lock,
+ *   hash table and LRU list, and holds at most capacity / nr_shards
+ *   entries. The least recently used entry of a shard is evicted when it
+ *   is full.
+ * - Every entry expires at ce_expires_us (CLOCK_MONOTONIC, cache_now_us()).
+ * - Every shard has a generation, bumped by each invalidation in it, even
+ *   of an entry not cached. A caller filling the cache from the KV store
+ *   reads the generation before its lookup and only inserts the outcome
+ *   when it did not change: an invalidation made meanwhile may be about a
+ *   change the lookup did not see.
+ *
+ * The caches embed struct cache_entry first in their entries, allocated
+ * with malloc(), and provide the key comparison. The cache_shard_*()
+ * functions are called with cs_lock held.
+ */
+
+#ifndef _CACHE_CORE_H
+#define _CACHE_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Generation of the callers that keep the cache coherent themselves */
+#define CACHE_GEN_ANY UINT64_MAX
+
+struct cache_entry {
+	uint64_t ce_hash;
+	uint64_t ce_expires_us;
+	/* Hash chain of the shard */
+	struct cache_entry *ce_hnext;
+	/* LRU list of the shard, most recently used first */
+	struct cache_entry *ce_lru_prev;
+	struct cache_entry *ce_lru_next;
+};
+
+struct cache_stats {
+	uint64_t hits;
+	/* Hits on entries recording that something does not exist */
+	uint64_t negative_hits;
+	uint64_t misses;
+	/* Entries dropped to make room for new ones */
+	uint64_t evictions;
+	/* Entries found but too old, counted in misses as well */
+	uint64_t expirations;
+	uint64_t invalidations;
+};
+
+struct cache_shard {
+	pthread_mutex_t cs_lock;
+	struct cache_entry **cs_buckets;
+	uint32_t cs_nr_buckets;
+	/* Sentinel of the LRU list */
+	struct cache_entry cs_lru;
+	uint32_t cs_nr;
+	uint32_t cs_max;
+	uint64_t cs_gen;
+	struct cache_stats cs_stats;
+};
+
+struct cache_core {
+	struct cache_shard *cc_shards;
+	uint32_t cc_nr_shards;
+};
+
+/**
+ * Whether e is the entry of key.
+ */
+typedef bool (*cache_match_t)(const struct cache_entry *e, const void *key);
+
+uint64_t cache_now_us(void);
+
+int cache_core_init(struct cache_core *core, uint32_t nr_shards,
+		    uint32_t capacity);
+
+/**
+ * Free all the entries.
+ */
+void cache_core_fini(struct cache_core *core);
+
+static inline struct cache_shard *cache_shard_of(struct cache_core *core,
+						 uint64_t hash)
+{
+	return &core->cc_shards[(hash >> 32) % core->cc_nr_shards];
+}
+
+/**
+ * Generation of the shard of hash, see CACHE_GEN_ANY.
+ */
+uint64_t cache_core_gen(struct cache_core *core, uint64_t hash);
+
+/**
+ * Find the entry of key, NULL when it is not cached. An expired entry is
+ * freed and counted.
+ */
+struct cache_entry *cache_shard_find(struct cache_shard *shard, uint64_t hash,
+				     cache_match_t match, const void *key);
+
+/**
+ * Make e the most recently used entry.
+ */
+void cache_shard_touch(struct cache_shard *shard, struct cache_entry *e);
+
+/**
+ * Add e, with ce_hash and ce_expires_us set, evicting the least recently
+ * used entry of a full shard.
+ */
+void cache_shard_insert(struct cache_shard *shard, struct cache_entry *e);
+
+/**
+ * Bump the generation, and free e unless it is NULL.
+ */
+void cache_shard_invalidate(struct cache_shard *shard, struct cache_entry *e);
+
+/**
+ * Drop all the entries of all the shards for which match() is true, or
+ * all of them when match is NULL.
+ */
+void cache_core_invalidate_all(struct cache_core *core, cache_match_t match,
+			       const void *key);
+
+/**
+ * Sum of the counters of all the shards.
+ */
+void cache_core_stats_get(struct cache_core *core, struct cache_stats *stats);
+
+#endif /* _CACHE_CORE_H */
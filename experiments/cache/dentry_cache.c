@@ -0,0 +1,259 @@
+/*
+ * Filename:         dentry_cache.c
+ * Description:      Positive and negative dentry cache
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "dentry_cache.h"
+
+struct dentry_cache_entry {
+	/* First, freed by cache_core.c */
+	struct cache_entry entry;
+	uint64_t parent;
+	/* 0 for a negative entry */
+	uint64_t ino;
+	size_t nlen;
+	char name[];
+};
+
+struct dentry_key {
+	uint64_t parent;
+	const char *name;
+	size_t nlen;
+};
+
+/* FNV-1a of the name, seeded with the parent */
+static uint64_t dentry_hash(uint64_t parent, const char *name, size_t nlen)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	hash ^= parent * 0x9E3779B97F4A7C15ULL;
+
+	for (i = 0; i < nlen; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static bool dentry_match(const struct cache_entry *e, const void *key)
+{
+	const struct dentry_cache_entry *de = (const void *)e;
+	const struct dentry_key *k = key;
+
+	return de->parent == k->parent && de->nlen == k->nlen &&
+		memcmp(de->name, k->name, k->nlen) == 0;
+}
+
+static bool dentry_match_dir(const struct cache_entry *e, const void *key)
+{
+	return ((const struct dentry_cache_entry *)e)->parent ==
+		*(const uint64_t *)key;
+}
+
+int dentry_cache_init(struct dentry_cache *cache, uint32_t nr_shards,
+		      uint32_t capacity, uint64_t ttl_us,
+		      uint64_t negative_ttl_us)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->dc_ttl_us = ttl_us;
+	cache->dc_negative_ttl_us = negative_ttl_us;
+
+	return cache_core_init(&cache->dc_core, nr_shards, capacity);
+}
+
+void dentry_cache_fini(struct dentry_cache *cache)
+{
+	cache_core_fini(&cache->dc_core);
+}
+
+int dentry_cache_lookup(struct dentry_cache *cache, uint64_t parent,
+			const char *name, uint64_t *ino)
+{
+	struct dentry_key key = { parent, name, strlen(name) };
+	uint64_t hash = dentry_hash(parent, name, key.nlen);
+	struct cache_shard *shard = cache_shard_of(&cache->dc_core, hash);
+	struct cache_entry *e;
+	uint64_t found;
+	int rc = -ENODATA;
+
+	pthread_mutex_lock(&shard->cs_lock);
+	e = cache_shard_find(shard, hash, dentry_match, &key);
+	if (e == NULL) {
+		shard->cs_stats.misses++;
+	} else {
+		cache_shard_touch(shard, e);
+		found = ((struct dentry_cache_entry *)e)->ino;
+		if (found != 0) {
+			*ino = found;
+			shard->cs_stats.hits++;
+			rc = 0;
+		} else {
+			shard->cs_stats.negative_hits++;
+			rc = -ENOENT;
+		}
+	}
+	pthread_mutex_unlock(&shard->cs_lock);
+
+	return rc;
+}
+
+uint64_t dentry_cache_gen(struct dentry_cache *cache, uint64_t parent,
+			  const char *name)
+{
+	return cache_core_gen(&cache->dc_core,
+			      dentry_hash(parent, name, strlen(name)));
+}
+
+/**
+ * Set the entry of name. A change made by this process (gen is
+ * CACHE_GEN_ANY) bumps the generation, so that the lookups in flight do
+ * not add what they found before it.
+ */
+static int entry_set(struct dentry_cache *cache, uint64_t parent,
+		     const char *name, uint64_t ino, uint64_t gen)
+{
+	struct dentry_key key = { parent, name, strlen(name) };
+	uint64_t hash = dentry_hash(parent, name, key.nlen);
+	struct cache_shard *shard = cache_shard_of(&cache->dc_core, hash);
+	struct dentry_cache_entry *de;
+	struct cache_entry *e;
+	int rc = 0;
+
+	pthread_mutex_lock(&shard->cs_lock);
+	if (gen == CACHE_GEN_ANY) {
+		shard->cs_gen++;
+	} else if (gen != shard->cs_gen) {
+		rc = -ESTALE;
+		goto out;
+	}
+
+	e = cache_shard_find(shard, hash, dentry_match, &key);
+	if (e != NULL) {
+		cache_shard_touch(shard, e);
+	} else {
+		de = malloc(sizeof(*de) + key.nlen);
+		if (de == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+		de->parent = parent;
+		de->nlen = key.nlen;
+		memcpy(de->name, name, key.nlen);
+		e = &de->entry;
+		e->ce_hash = hash;
+		cache_shard_insert(shard, e);
+	}
+
+	((struct dentry_cache_entry *)e)->ino = ino;
+	e->ce_expires_us = cache_now_us() +
+		(ino != 0 ? cache->dc_ttl_us : cache->dc_negative_ttl_us);
+out:
+	pthread_mutex_unlock(&shard->cs_lock);
+	return rc;
+}
+
+int dentry_cache_add(struct dentry_cache *cache, uint64_t parent,
+		     const char *name, uint64_t ino, uint64_t gen)
+{
+	return entry_set(cache, parent, name, ino, gen);
+}
+
+void dentry_cache_invalidate(struct dentry_cache *cache, uint64_t parent,
+			     const char *name)
+{
+	struct dentry_key key = { parent, name, strlen(name) };
+	uint64_t hash = dentry_hash(parent, name, key.nlen);
+	struct cache_shard *shard = cache_shard_of(&cache->dc_core, hash);
+
+	pthread_mutex_lock(&shard->cs_lock);
+	cache_shard_invalidate(shard, cache_shard_find(shard, hash,
+						       dentry_match, &key));
+	pthread_mutex_unlock(&shard->cs_lock);
+}
+
+void dentry_cache_invalidate_dir(struct dentry_cache *cache, uint64_t parent)
+{
+	/* Entries of a directory are spread over all shards */
+	cache_core_invalidate_all(&cache->dc_core, dentry_match_dir, &parent);
+}
+
+void dentry_cache_on_create(struct dentry_cache *cache, uint64_t parent,
+			    const char *name, uint64_t ino)
+{
+	/* Replaces a negative entry, the name exists now */
+	if (entry_set(cache, parent, name, ino, CACHE_GEN_ANY) != 0)
+		dentry_cache_invalidate(cache, parent, name);
+}
+
+void dentry_cache_on_unlink(struct dentry_cache *cache, uint64_t parent,
+			    const char *name)
+{
+	if (entry_set(cache, parent, name, 0, CACHE_GEN_ANY) != 0)
+		dentry_cache_invalidate(cache, parent, name);
+}
+
+void dentry_cache_on_rename(struct dentry_cache *cache, uint64_t sparent,
+			    const char *sname, uint64_t dparent,
+			    const char *dname, uint64_t ino)
+{
+	dentry_cache_on_unlink(cache, sparent, sname);
+	dentry_cache_on_create(cache, dparent, dname, ino);
+}
+
+void dentry_cache_stats_get(struct dentry_cache *cache,
+			    struct dentry_cache_stats *stats)
+{
+	struct cache_stats cs;
+
+	cache_core_stats_get(&cache->dc_core, &cs);
+	stats->hits = cs.hits;
+	stats->negative_hits = cs.negative_hits;
+	stats->misses = cs.misses;
+	stats->evictions = cs.evictions;
+	stats->expirations = cs.expirations;
+	stats->invalidations = cs.invalidations;
+}
+
+void dentry_cache_stats_print(struct dentry_cache *cache, const char *msg)
+{
+	struct dentry_cache_stats stats;
+
+	dentry_cache_stats_get(cache, &stats);
+	printf("%s: %llu hits, %llu negative hits, %llu misses"
+	       " (%llu expired), %llu evictions, %llu invalidations\n", msg,
+	       (unsigned long long)stats.hits,
+	       (unsigned long long)stats.negative_hits,
+	       (unsigned long long)stats.misses,
+	       (unsigned long long)stats.expirations,
+	       (unsigned long long)stats.evictions,
+	       (unsigned long long)stats.invalidations);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
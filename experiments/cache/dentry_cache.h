@@ -0,0 +1,117 @@
+/*
+ * Filename:         dentry_cache.h
+ * Description:      Positive and negative dentry cache
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* In-process cache of lookups: (parent inode, name) -> child inode, so that
+ * a path walk does not need one KV GET per component.
+ *
+ * - Negative entries remember names that do not exist, NFS clients look
+ *   those up again and again (compilers probing include paths, ...).
+ * - Sharding, LRU eviction and TTLs work like in attr_cache.h
+ *   (cache_core.h). Negative entries have a TTL of their own, usually
+ *   shorter.
+ * - The namespace operations of this process keep the cache coherent
+ *   through dentry_cache_on_create(), dentry_cache_on_unlink() and
+ *   dentry_cache_on_rename(). Changes made by other processes or nodes are
+ *   only seen once the entries expire or are invalidated.
+ * - A lookup in the KV store racing with such a change must not cache what
+ *   it found before the change: dentry_cache_add() is given the generation
+ *   read by dentry_cache_gen() before the lookup, and adds nothing when a
+ *   change or invalidation came in between.
+ */
+
+#ifndef _DENTRY_CACHE_H
+#define _DENTRY_CACHE_H
+
+#include <stdint.h>
+#include "cache_core.h"
+
+struct dentry_cache_stats {
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t evictions;
+	/* Entries found but too old, counted in misses as well */
+	uint64_t expirations;
+	uint64_t invalidations;
+};
+
+struct dentry_cache {
+	struct cache_core dc_core;
+	/* TTL of positive and negative entries, in microseconds */
+	uint64_t dc_ttl_us;
+	uint64_t dc_negative_ttl_us;
+};
+
+int dentry_cache_init(struct dentry_cache *cache, uint32_t nr_shards,
+		      uint32_t capacity, uint64_t ttl_us,
+		      uint64_t negative_ttl_us);
+
+void dentry_cache_fini(struct dentry_cache *cache);
+
+/**
+ * Look name up in directory parent.
+ * Return 0 and set *ino when the entry is cached, -ENOENT when the name is
+ * known not to exist and -ENODATA when the cache does not know.
+ */
+int dentry_cache_lookup(struct dentry_cache *cache, uint64_t parent,
+			const char *name, uint64_t *ino);
+
+/**
+ * Generation of the entry of name, to be read before looking it up in the
+ * KV store.
+ */
+uint64_t dentry_cache_gen(struct dentry_cache *cache, uint64_t parent,
+			  const char *name);
+
+/**
+ * Remember the outcome of a lookup in the KV store: name is a link to ino,
+ * or does not exist when ino is 0. gen is what dentry_cache_gen() returned
+ * before the lookup, -ESTALE when the entry may have changed since.
+ */
+int dentry_cache_add(struct dentry_cache *cache, uint64_t parent,
+		     const char *name, uint64_t ino, uint64_t gen);
+
+/**
+ * Drop the entry of name, if any.
+ */
+void dentry_cache_invalidate(struct dentry_cache *cache, uint64_t parent,
+			     const char *name);
+
+/**
+ * Drop all the entries of directory parent, e.g. when it is removed.
+ */
+void dentry_cache_invalidate_dir(struct dentry_cache *cache, uint64_t parent);
+
+/* Hooks for the namespace operations of this process, to be called once the
+ * operation succeeded. A failed one should invalidate the names involved.
+ */
+void dentry_cache_on_create(struct dentry_cache *cache, uint64_t parent,
+			    const char *name, uint64_t ino);
+void dentry_cache_on_unlink(struct dentry_cache *cache, uint64_t parent,
+			    const char *name);
+void dentry_cache_on_rename(struct dentry_cache *cache, uint64_t sparent,
+			    const char *sname, uint64_t dparent,
+			    const char *dname, uint64_t ino);
+
+void dentry_cache_stats_get(struct dentry_cache *cache,
+			    struct dentry_cache_stats *stats);
+
+void dentry_cache_stats_print(struct dentry_cache *cache, const char *msg);
+
+#endif /* _DENTRY_CACHE_H */
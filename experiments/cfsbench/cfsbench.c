@@ -0,0 +1,698 @@
+/*
+ * Filename:         cfsbench.c
+ * Description:      Metadata and data benchmark of the cfs API
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* mdtest-style benchmark of the cfs_* API, replacing the timing loops of
+ * getattr_profiling.c, readdir_profiling.c and the xattr experiments.
+ *
+ * Every thread works on -n files in a directory of its own and all threads
+ * go through the selected phases together, in this order:
+ *   create, stat, setattr, readdir, xattr_set, xattr_get, xattr_list,
+ *   write, read, unlink
+ * Files are created and removed even when create/unlink are not selected,
+ * those phases are then not reported.
+ *
+ * For each phase the throughput of all threads and the latency distribution
+ * of single operations (experiments/perf/lat_hist.h) are reported, as text
+ * and optionally as JSON. Every call is also recorded in perf_stats.h and,
+ * with -H, served on 127.0.0.1:port while the benchmark runs (perf_http.h).
+ * With -T N, one call out of N per thread is traced (trace.h) and the trace
+ * is written to the -o file, CFSBENCH_TRACE_FILE by default.
+ *
+ * Usage: cfsbench [-t threads] [-n files per thread] [-p phase,...]
+ *                 [-s io size] [-x xattrs per file] [-j json file|-]
+ *                 [-H stats port] [-T trace 1 in N] [-o trace file]
+ */
+
+#include "ut_cortxfs_helper.h"
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <json-c/json.h>
+#include "perf/lat_hist.h"
+#include "perf/perf_stats.h"
+#include "perf/perf_http.h"
+#include "perf/trace.h"
+
+#define CFSBENCH_THREADS 4
+#define CFSBENCH_FILES 1000
+#define CFSBENCH_IO_SIZE 4096
+#define CFSBENCH_XATTRS 4
+#define CFSBENCH_XATTR_VALUE_LEN 64
+#define CFSBENCH_READDIR_LOOPS 10
+#define CFSBENCH_NAME_LEN 64
+#define CFSBENCH_TRACE_FILE "cfsbench.trace.json"
+
+enum cfsbench_phase {
+	PHASE_CREATE,
+	PHASE_STAT,
+	PHASE_SETATTR,
+	PHASE_READDIR,
+	PHASE_XATTR_SET,
+	PHASE_XATTR_GET,
+	PHASE_XATTR_LIST,
+	PHASE_WRITE,
+	PHASE_READ,
+	PHASE_UNLINK,
+	PHASE_NR,
+};
+
+static const char *phase_names[PHASE_NR] = {
+	[PHASE_CREATE] = "create",
+	[PHASE_STAT] = "stat",
+	[PHASE_SETATTR] = "setattr",
+	[PHASE_READDIR] = "readdir",
+	[PHASE_XATTR_SET] = "xattr_set",
+	[PHASE_XATTR_GET] = "xattr_get",
+	[PHASE_XATTR_LIST] = "xattr_list",
+	[PHASE_WRITE] = "write",
+	[PHASE_READ] = "read",
+	[PHASE_UNLINK] = "unlink",
+};
+
+static const enum perf_op phase_perf_ops[PHASE_NR] = {
+	[PHASE_CREATE] = PERF_OP_CREATE,
+	[PHASE_STAT] = PERF_OP_GETATTR,
+	[PHASE_SETATTR] = PERF_OP_SETATTR,
+	[PHASE_READDIR] = PERF_OP_READDIR,
+	[PHASE_XATTR_SET] = PERF_OP_SETXATTR,
+	[PHASE_XATTR_GET] = PERF_OP_GETXATTR,
+	[PHASE_XATTR_LIST] = PERF_OP_LISTXATTR,
+	[PHASE_WRITE] = PERF_OP_WRITE,
+	[PHASE_READ] = PERF_OP_READ,
+	[PHASE_UNLINK] = PERF_OP_UNLINK,
+};
+
+static const char *phase_trace_names[PHASE_NR] = {
+	[PHASE_CREATE] = "cfs.creat",
+	[PHASE_STAT] = "cfs.getattr",
+	[PHASE_SETATTR] = "cfs.setattr",
+	[PHASE_READDIR] = "cfs.readdir",
+	[PHASE_XATTR_SET] = "cfs.setxattr",
+	[PHASE_XATTR_GET] = "cfs.getxattr",
+	[PHASE_XATTR_LIST] = "cfs.listxattr",
+	[PHASE_WRITE] = "cfs.write",
+	[PHASE_READ] = "cfs.read",
+	[PHASE_UNLINK] = "cfs.unlink",
+};
+
+struct cfsbench_conf {
+	int threads;
+	int files;
+	size_t io_size;
+	int xattrs;
+	/* Bit mask of the reported phases */
+	uint32_t phases;
+	/* NULL: no JSON, "-": stdout */
+	const char *json_path;
+	/* 0: no stats endpoint */
+	uint16_t stats_port;
+	/* Trace one call out of trace_sample, 0: no tracing */
+	uint32_t trace_sample;
+	const char *trace_path;
+};
+
+struct cfsbench_thread {
+	pthread_t thread;
+	int id;
+	char dir_name[CFSBENCH_NAME_LEN];
+	cfs_ino_t dir;
+	cfs_ino_t *inos;
+	char *buf;
+	/* Current phase */
+	enum cfsbench_phase phase;
+	struct lat_hist hist;
+	uint64_t errors;
+};
+
+struct cfsbench_result {
+	bool ran;
+	uint64_t elapsed_ns;
+	uint64_t errors;
+	struct lat_hist hist;
+};
+
+/* State of ut_cfs_fs_setup(), fs and credentials shared by all threads */
+struct cfsbench_env {
+	struct ut_cfs_params ut_cfs_obj;
+};
+
+static struct cfsbench_conf conf = {
+	.threads = CFSBENCH_THREADS,
+	.files = CFSBENCH_FILES,
+	.io_size = CFSBENCH_IO_SIZE,
+	.xattrs = CFSBENCH_XATTRS,
+	.phases = (1 << PHASE_NR) - 1,
+	.trace_path = CFSBENCH_TRACE_FILE,
+};
+
+static struct ut_cfs_params *cfs;
+static pthread_barrier_t start_barrier;
+
+static void file_name(char *name, int i)
+{
+	snprintf(name, CFSBENCH_NAME_LEN, "f%d", i);
+}
+
+static void xattr_name(char *name, int j)
+{
+	snprintf(name, CFSBENCH_NAME_LEN, "user.cfsbench.%d", j);
+}
+
+static bool readdir_count_cb(void *ctx, const char *name, const cfs_ino_t *ino)
+{
+	(*(int *)ctx)++;
+	return true;
+}
+
+/**
+ * Run operation i of the current phase, that is one cfs_* call.
+ */
+static int cfsbench_op(struct cfsbench_thread *thr, int i)
+{
+	char name[CFSBENCH_NAME_LEN];
+	char value[CFSBENCH_XATTR_VALUE_LEN];
+	char list[CFSBENCH_XATTRS * CFSBENCH_NAME_LEN];
+	cfs_file_open_t fd;
+	struct stat st;
+	size_t size, count;
+	ssize_t io;
+	int file, entries = 0, rc;
+
+	/* xattr set/get operations go through every xattr of every file */
+	file = thr->phase == PHASE_XATTR_SET || thr->phase == PHASE_XATTR_GET ?
+		i / conf.xattrs : i;
+
+	switch (thr->phase) {
+	case PHASE_CREATE:
+		file_name(name, file);
+		return cfs_creat(cfs->cfs_fs, &cfs->cred, &thr->dir, name,
+				 S_IFREG | 0644, &thr->inos[file]);
+	case PHASE_STAT:
+		return cfs_getattr(cfs->cfs_fs, &cfs->cred, &thr->inos[file],
+				   &st);
+	case PHASE_SETATTR:
+		memset(&st, 0, sizeof(st));
+		clock_gettime(CLOCK_REALTIME, &st.st_mtim);
+		return cfs_setattr(cfs->cfs_fs, &cfs->cred, &thr->inos[file],
+				   &st, STAT_MTIME_SET);
+	case PHASE_READDIR:
+		rc = cfs_readdir(cfs->cfs_fs, &cfs->cred, &thr->dir,
+				 readdir_count_cb, &entries);
+		if (rc == 0 && entries != conf.files)
+			rc = -EINVAL;
+		return rc;
+	case PHASE_XATTR_SET:
+		xattr_name(name, i % conf.xattrs);
+		memset(value, 'x', sizeof(value));
+		return cfs_setxattr(cfs->cfs_fs, &cfs->cred, &thr->inos[file],
+				    name, value, sizeof(value), 0);
+	case PHASE_XATTR_GET:
+		xattr_name(name, i % conf.xattrs);
+		size = sizeof(value);
+		rc = cfs_getxattr(cfs->cfs_fs, &cfs->cred, &thr->inos[file],
+				  name, value, &size);
+		if (rc >= 0 && size != sizeof(value))
+			rc = -EINVAL;
+		return rc < 0 ? rc : 0;
+	case PHASE_XATTR_LIST:
+		size = sizeof(list);
+		count = 0;
+		rc = cfs_listxattr(cfs->cfs_fs, &cfs->cred, &thr->inos[file],
+				   list, &count, &size);
+		if (rc >= 0 && count != (size_t)conf.xattrs)
+			rc = -EINVAL;
+		return rc < 0 ? rc : 0;
+	case PHASE_WRITE:
+	case PHASE_READ:
+		memset(&fd, 0, sizeof(fd));
+		fd.ino = thr->inos[file];
+		fd.flags = O_RDWR;
+		io = thr->phase == PHASE_WRITE ?
+			cfs_write(cfs->cfs_fs, &cfs->cred, &fd, thr->buf,
+				  conf.io_size, 0) :
+			cfs_read(cfs->cfs_fs, &cfs->cred, &fd, thr->buf,
+				 conf.io_size, 0);
+		if (io < 0)
+			return io;
+		return (size_t)io == conf.io_size ? 0 : -EIO;
+	case PHASE_UNLINK:
+		file_name(name, file);
+		return cfs_unlink(cfs->cfs_fs, &cfs->cred, &thr->dir,
+				  &thr->inos[file], name);
+	default:
+		return -EINVAL;
+	}
+}
+
+static int phase_ops(enum cfsbench_phase phase)
+{
+	switch (phase) {
+	case PHASE_READDIR:
+		return CFSBENCH_READDIR_LOOPS;
+	case PHASE_XATTR_SET:
+	case PHASE_XATTR_GET:
+		return conf.files * conf.xattrs;
+	default:
+		return conf.files;
+	}
+}
+
+static void *cfsbench_thread_run(void *arg)
+{
+	struct cfsbench_thread *thr = arg;
+	int nr = phase_ops(thr->phase);
+	uint64_t start, trace_start;
+	int i, rc;
+
+	lat_hist_reset(&thr->hist);
+	thr->errors = 0;
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < nr; i++) {
+		start = perf_stats_start();
+		trace_start = trace_request_begin();
+		rc = cfsbench_op(thr, i);
+		trace_request_end(phase_trace_names[thr->phase], trace_start);
+		if (rc != 0)
+			thr->errors++;
+		lat_hist_record(&thr->hist, lat_hist_now_ns() - start);
+		perf_stats_record(phase_perf_ops[thr->phase], start, rc);
+	}
+
+	return NULL;
+}
+
+/**
+ * Run one phase on all threads and merge their histograms into result.
+ */
+static int phase_run(struct cfsbench_thread *threads,
+		     enum cfsbench_phase phase, struct cfsbench_result *result)
+{
+	uint64_t start;
+	int rc = 0, i, started;
+
+	rc = -pthread_barrier_init(&start_barrier, NULL, conf.threads + 1);
+	if (rc != 0)
+		return rc;
+
+	for (started = 0; started < conf.threads; started++) {
+		threads[started].phase = phase;
+		rc = -pthread_create(&threads[started].thread, NULL,
+				     cfsbench_thread_run, &threads[started]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+
+	/* Threads started can only go past the barrier all together */
+	if (rc != 0) {
+		for (i = 0; i < started; i++)
+			pthread_cancel(threads[i].thread);
+		for (i = 0; i < started; i++)
+			pthread_join(threads[i].thread, NULL);
+		pthread_barrier_destroy(&start_barrier);
+		return rc;
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	start = lat_hist_now_ns();
+
+	for (i = 0; i < conf.threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	result->elapsed_ns = lat_hist_now_ns() - start;
+	pthread_barrier_destroy(&start_barrier);
+
+	result->ran = true;
+	lat_hist_reset(&result->hist);
+	result->errors = 0;
+	for (i = 0; i < conf.threads; i++) {
+		lat_hist_merge(&result->hist, &threads[i].hist);
+		result->errors += threads[i].errors;
+	}
+
+	return 0;
+}
+
+static void result_print(enum cfsbench_phase phase,
+			 const struct cfsbench_result *result)
+{
+	char msg[128];
+
+	snprintf(msg, sizeof(msg), "%-10s %9.0f ops/s, %llu errors",
+		 phase_names[phase],
+		 result->elapsed_ns != 0 ?
+		 result->hist.count * 1e9 / result->elapsed_ns : 0.0,
+		 (unsigned long long)result->errors);
+	lat_hist_print(&result->hist, stdout, msg);
+}
+
+static struct json_object *json_usecs(uint64_t ns)
+{
+	return json_object_new_double(ns / 1000.0);
+}
+
+static int results_json(const struct cfsbench_result *results)
+{
+	struct json_object *root, *phases, *phase, *lat;
+	const struct lat_hist *hist;
+	FILE *out = stdout;
+	int p, rc = 0;
+
+	root = json_object_new_object();
+	json_object_object_add(root, "threads",
+			       json_object_new_int64(conf.threads));
+	json_object_object_add(root, "files_per_thread",
+			       json_object_new_int64(conf.files));
+	json_object_object_add(root, "io_size",
+			       json_object_new_int64(conf.io_size));
+	json_object_object_add(root, "xattrs_per_file",
+			       json_object_new_int64(conf.xattrs));
+
+	phases = json_object_new_array();
+	for (p = 0; p < PHASE_NR; p++) {
+		if (!results[p].ran || !(conf.phases & (1 << p)))
+			continue;
+
+		hist = &results[p].hist;
+		lat = json_object_new_object();
+		json_object_object_add(lat, "mean", json_usecs(hist->count ?
+				       hist->sum_ns / hist->count : 0));
+		json_object_object_add(lat, "p50",
+				       json_usecs(lat_hist_percentile(hist, 50)));
+		json_object_object_add(lat, "p99",
+				       json_usecs(lat_hist_percentile(hist, 99)));
+		json_object_object_add(lat, "p999",
+				       json_usecs(lat_hist_percentile(hist,
+								      99.9)));
+		json_object_object_add(lat, "max", json_usecs(hist->max_ns));
+
+		phase = json_object_new_object();
+		json_object_object_add(phase, "name",
+				       json_object_new_string(phase_names[p]));
+		json_object_object_add(phase, "ops",
+				       json_object_new_int64(hist->count));
+		json_object_object_add(phase, "errors",
+				       json_object_new_int64(results[p].errors));
+		json_object_object_add(phase, "elapsed_usecs",
+				       json_usecs(results[p].elapsed_ns));
+		json_object_object_add(phase, "ops_per_sec",
+				       json_object_new_double(
+					       results[p].elapsed_ns != 0 ?
+					       hist->count * 1e9 /
+					       results[p].elapsed_ns : 0.0));
+		json_object_object_add(phase, "latency_usecs", lat);
+		json_object_array_add(phases, phase);
+	}
+	json_object_object_add(root, "phases", phases);
+
+	if (strcmp(conf.json_path, "-") != 0) {
+		out = fopen(conf.json_path, "w");
+		if (out == NULL) {
+			rc = -errno;
+			fprintf(stderr, "cannot open %s: %d\n", conf.json_path,
+				rc);
+			goto out;
+		}
+	}
+
+	fprintf(out, "%s\n",
+		json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY));
+	if (out != stdout)
+		fclose(out);
+
+out:
+	json_object_put(root);
+	return rc;
+}
+
+static int threads_setup(struct cfsbench_thread *threads)
+{
+	cfs_ino_t root = CFS_ROOT_INODE;
+	int i, rc;
+
+	for (i = 0; i < conf.threads; i++) {
+		threads[i].id = i;
+		snprintf(threads[i].dir_name, CFSBENCH_NAME_LEN,
+			 "cfsbench.%d.%d", getpid(), i);
+		threads[i].inos = calloc(conf.files, sizeof(cfs_ino_t));
+		threads[i].buf = malloc(conf.io_size);
+		if (threads[i].inos == NULL || threads[i].buf == NULL)
+			return -ENOMEM;
+		memset(threads[i].buf, 'a' + i % 26, conf.io_size);
+
+		rc = cfs_mkdir(cfs->cfs_fs, &root, threads[i].dir_name,
+			       &cfs->cred, S_IFDIR | 0755, &threads[i].dir);
+		if (rc != 0) {
+			fprintf(stderr, "cfs_mkdir %s failed: %d\n",
+				threads[i].dir_name, rc);
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+static void threads_teardown(struct cfsbench_thread *threads)
+{
+	cfs_ino_t root = CFS_ROOT_INODE;
+	int i;
+
+	for (i = 0; i < conf.threads; i++) {
+		if (threads[i].dir != 0 &&
+		    cfs_rmdir(cfs->cfs_fs, &cfs->cred, &root,
+			      threads[i].dir_name) != 0)
+			fprintf(stderr, "cfs_rmdir %s failed\n",
+				threads[i].dir_name);
+		free(threads[i].inos);
+		free(threads[i].buf);
+	}
+}
+
+static int cfsbench_run(void)
+{
+	struct cfsbench_thread *threads;
+	struct cfsbench_result *results;
+	int rc, p;
+
+	threads = calloc(conf.threads, sizeof(*threads));
+	results = calloc(PHASE_NR, sizeof(*results));
+	if (threads == NULL || results == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	rc = threads_setup(threads);
+	if (rc != 0)
+		goto teardown;
+
+	for (p = 0; p < PHASE_NR; p++) {
+		/* Files must exist for every other phase and be removed */
+		if (!(conf.phases & (1 << p)) && p != PHASE_CREATE &&
+		    p != PHASE_UNLINK)
+			continue;
+		if (conf.xattrs == 0 &&
+		    (p == PHASE_XATTR_SET || p == PHASE_XATTR_GET))
+			continue;
+
+		rc = phase_run(threads, p, &results[p]);
+		if (rc != 0)
+			break;
+		if (conf.phases & (1 << p))
+			result_print(p, &results[p]);
+
+		/* Nothing to measure on files that were not created */
+		if (p == PHASE_CREATE && results[p].errors != 0) {
+			fprintf(stderr, "%llu files could not be created\n",
+				(unsigned long long)results[p].errors);
+			rc = -EIO;
+			p = PHASE_UNLINK - 1;
+		}
+	}
+
+	if (rc == 0 && conf.json_path != NULL)
+		rc = results_json(results);
+
+teardown:
+	threads_teardown(threads);
+out:
+	free(results);
+	free(threads);
+	return rc;
+}
+
+static int phases_parse(char *list)
+{
+	char *name, *saveptr = NULL;
+	int p;
+
+	conf.phases = 0;
+	for (name = strtok_r(list, ",", &saveptr); name != NULL;
+	     name = strtok_r(NULL, ",", &saveptr)) {
+		for (p = 0; p < PHASE_NR; p++)
+			if (strcmp(name, phase_names[p]) == 0)
+				break;
+		if (p == PHASE_NR) {
+			fprintf(stderr, "unknown phase %s\n", name);
+			return -EINVAL;
+		}
+		conf.phases |= 1 << p;
+	}
+
+	return conf.phases != 0 ? 0 : -EINVAL;
+}
+
+static void usage(const char *prog)
+{
+	int p;
+
+	fprintf(stderr, "Usage: %s [-t threads] [-n files per thread]"
+		" [-p phase,...] [-s io size] [-x xattrs per file]"
+		" [-j json file|-] [-H stats port] [-T trace 1 in N]"
+		" [-o trace file]\n", prog);
+	fprintf(stderr, "Phases:");
+	for (p = 0; p < PHASE_NR; p++)
+		fprintf(stderr, " %s", phase_names[p]);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	int rc = 0, opt;
+	char *test_log = "/var/log/cortx/test/ut/ut_cortxfs.log";
+	struct cfsbench_env *env;
+	void *state;
+
+	while ((opt = getopt(argc, argv, "t:n:p:s:x:j:H:T:o:h")) != -1) {
+		switch (opt) {
+		case 't':
+			conf.threads = atoi(optarg);
+			break;
+		case 'n':
+			conf.files = atoi(optarg);
+			break;
+		case 'p':
+			if (phases_parse(optarg) != 0) {
+				usage(argv[0]);
+				return -EINVAL;
+			}
+			break;
+		case 's':
+			conf.io_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			conf.xattrs = atoi(optarg);
+			break;
+		case 'j':
+			conf.json_path = optarg;
+			break;
+		case 'H':
+			conf.stats_port = atoi(optarg);
+			break;
+		case 'T':
+			conf.trace_sample = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			conf.trace_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (conf.threads <= 0 || conf.files <= 0 || conf.io_size == 0 ||
+	    conf.xattrs < 0 || conf.xattrs > CFSBENCH_XATTRS) {
+		fprintf(stderr, "invalid arguments, at most %d xattrs\n",
+			CFSBENCH_XATTRS);
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	rc = ut_load_config(CONF_FILE);
+	if (rc != 0) {
+		printf("ut_load_config: err = %d\n", rc);
+		goto end;
+	}
+
+	test_log = ut_get_config("cortxfs", "log_path", test_log);
+
+	rc = ut_init(test_log);
+	if (rc != 0) {
+		printf("ut_init failed, log path=%s, rc=%d.\n", test_log, rc);
+		goto out;
+	}
+
+	env = calloc(1, sizeof(*env));
+	if (env == NULL) {
+		rc = -ENOMEM;
+		goto fini;
+	}
+
+	state = env;
+	rc = ut_cfs_fs_setup(&state);
+	if (rc != 0) {
+		printf("ut_cfs_fs_setup failed, rc=%d.\n", rc);
+		goto free_env;
+	}
+	cfs = &env->ut_cfs_obj;
+
+	if (conf.stats_port != 0) {
+		rc = perf_http_start("127.0.0.1", conf.stats_port);
+		if (rc != 0) {
+			printf("perf_http_start failed, rc=%d.\n", rc);
+			goto teardown;
+		}
+	}
+
+	trace_init(conf.trace_sample, 0);
+
+	rc = cfsbench_run();
+
+	if (conf.trace_sample != 0 && trace_dump_file(conf.trace_path) != 0)
+		fprintf(stderr, "cannot write the trace to %s\n",
+			conf.trace_path);
+	trace_fini();
+	perf_http_stop();
+	perf_stats_fini();
+teardown:
+	if (ut_cfs_fs_teardown(&state) != 0 && rc == 0)
+		rc = -EIO;
+
+free_env:
+	free(env);
+fini:
+	ut_fini();
+out:
+	free(test_log);
+end:
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,501 @@
+/*
+ * Filename:         readahead.c
+ * Description:      Sequential read-ahead for the DSAL read path
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "readahead.h"
+
+#define RA_BUF_ALIGN 4096
+
+struct readahead_unit {
+	struct readahead_file *ru_file;
+	uint64_t ru_no;
+	void *ru_buf;
+	/* Bytes read or -errno, once ru_done */
+	ssize_t ru_len;
+	bool ru_done;
+	/*
+	 * Dropped by the file, released by the worker that completes it or
+	 * the reader that pinned it
+	 */
+	bool ru_cancelled;
+	/* The reader waits for it or copies it without re_lock */
+	bool ru_pinned;
+	/* Already counted as a hit */
+	bool ru_hit;
+	struct readahead_unit *ru_next;
+	struct readahead_unit *ru_qnext;
+};
+
+/* All the helpers below are called with re_lock held */
+
+static void *buf_get(struct readahead_engine *eng)
+{
+	if (eng->re_free_bufs == 0)
+		return NULL;
+	return eng->re_bufs[--eng->re_free_bufs];
+}
+
+static void buf_put(struct readahead_engine *eng, void *buf)
+{
+	eng->re_bufs[eng->re_free_bufs++] = buf;
+}
+
+static struct readahead_unit *unit_find(struct readahead_file *file,
+					uint64_t no)
+{
+	struct readahead_unit *unit;
+
+	for (unit = file->rf_units; unit != NULL; unit = unit->ru_next)
+		if (unit->ru_no == no)
+			return unit;
+	return NULL;
+}
+
+static void unit_unlink(struct readahead_file *file,
+			struct readahead_unit *unit)
+{
+	struct readahead_unit **pu;
+
+	for (pu = &file->rf_units; *pu != NULL; pu = &(*pu)->ru_next) {
+		if (*pu == unit) {
+			*pu = unit->ru_next;
+			return;
+		}
+	}
+}
+
+static void unit_free(struct readahead_engine *eng,
+		      struct readahead_unit *unit)
+{
+	buf_put(eng, unit->ru_buf);
+	free(unit);
+}
+
+/**
+ * Drop a unit of the file, the worker releases it if it is in flight, the
+ * reader if it pinned it.
+ */
+static void unit_drop(struct readahead_file *file,
+		      struct readahead_unit *unit)
+{
+	struct readahead_engine *eng = file->rf_engine;
+
+	unit_unlink(file, unit);
+	if (!unit->ru_hit)
+		eng->re_stats.wasted++;
+
+	if (unit->ru_done && !unit->ru_pinned)
+		unit_free(eng, unit);
+	else
+		unit->ru_cancelled = true;
+}
+
+static void cancel_all(struct readahead_file *file)
+{
+	if (file->rf_units != NULL)
+		file->rf_engine->re_stats.cancels++;
+
+	while (file->rf_units != NULL)
+		unit_drop(file, file->rf_units);
+
+	/* The file may have grown since, look for its end again */
+	file->rf_eof = false;
+	file->rf_eof_unit = 0;
+}
+
+/**
+ * Read ahead the window of units following unit next.
+ */
+static void issue(struct readahead_file *file, uint64_t next)
+{
+	struct readahead_engine *eng = file->rf_engine;
+	struct readahead_unit *unit, *tmp;
+	uint64_t no;
+	bool queued = false;
+
+	/* Units behind the reader will not be read anymore */
+	for (unit = file->rf_units; unit != NULL; unit = tmp) {
+		tmp = unit->ru_next;
+		if (unit->ru_no < next)
+			unit_drop(file, unit);
+	}
+
+	if (file->rf_ra_next < next)
+		file->rf_ra_next = next;
+
+	for (no = file->rf_ra_next; no < next + file->rf_window; no++) {
+		if (file->rf_eof && no > file->rf_eof_unit)
+			break;
+		if (unit_find(file, no) != NULL)
+			continue;
+
+		unit = calloc(1, sizeof(*unit));
+		if (unit == NULL)
+			break;
+		unit->ru_buf = buf_get(eng);
+		if (unit->ru_buf == NULL) {
+			eng->re_stats.no_buffer++;
+			free(unit);
+			break;
+		}
+
+		unit->ru_file = file;
+		unit->ru_no = no;
+		unit->ru_next = file->rf_units;
+		file->rf_units = unit;
+		file->rf_inflight++;
+
+		*eng->re_queue_tail = unit;
+		eng->re_queue_tail = &unit->ru_qnext;
+		eng->re_stats.issued++;
+		queued = true;
+	}
+	file->rf_ra_next = no;
+
+	if (queued)
+		pthread_cond_broadcast(&eng->re_work_cond);
+}
+
+static void *worker(void *arg)
+{
+	struct readahead_engine *eng = arg;
+	struct readahead_unit *unit;
+	struct readahead_file *file;
+	ssize_t len;
+
+	pthread_mutex_lock(&eng->re_lock);
+	for (;;) {
+		while (eng->re_queue == NULL && !eng->re_stop)
+			pthread_cond_wait(&eng->re_work_cond, &eng->re_lock);
+		if (eng->re_queue == NULL)
+			break;
+
+		unit = eng->re_queue;
+		eng->re_queue = unit->ru_qnext;
+		if (eng->re_queue == NULL)
+			eng->re_queue_tail = &eng->re_queue;
+		file = unit->ru_file;
+
+		/* Nobody wants it anymore, do not read it */
+		len = -ECANCELED;
+		if (!unit->ru_cancelled) {
+			pthread_mutex_unlock(&eng->re_lock);
+			len = eng->re_read(file->rf_backend_file, unit->ru_buf,
+					   eng->re_unit_size,
+					   unit->ru_no * eng->re_unit_size);
+			pthread_mutex_lock(&eng->re_lock);
+		}
+
+		unit->ru_len = len;
+		unit->ru_done = true;
+		if (!unit->ru_cancelled && len >= 0 &&
+		    (size_t)len < eng->re_unit_size && !file->rf_eof) {
+			file->rf_eof = true;
+			file->rf_eof_unit = unit->ru_no;
+		}
+		file->rf_inflight--;
+
+		if (unit->ru_cancelled && !unit->ru_pinned)
+			unit_free(eng, unit);
+
+		pthread_cond_broadcast(&eng->re_done_cond);
+	}
+	pthread_mutex_unlock(&eng->re_lock);
+
+	return NULL;
+}
+
+int readahead_init(struct readahead_engine *eng, readahead_backend_t read,
+		   size_t unit_size, uint32_t nr_bufs, uint32_t max_window,
+		   uint32_t nr_workers)
+{
+	uint32_t i;
+	int rc;
+
+	if (unit_size == 0 || nr_bufs == 0 || max_window < RA_WINDOW_MIN ||
+	    nr_workers == 0)
+		return -EINVAL;
+
+	memset(eng, 0, sizeof(*eng));
+	eng->re_read = read;
+	eng->re_unit_size = unit_size;
+	eng->re_max_window = max_window;
+	eng->re_queue_tail = &eng->re_queue;
+
+	eng->re_bufs = calloc(nr_bufs, sizeof(void *));
+	eng->re_workers = calloc(nr_workers, sizeof(pthread_t));
+	if (eng->re_bufs == NULL || eng->re_workers == NULL) {
+		rc = -ENOMEM;
+		goto free_bufs;
+	}
+
+	for (i = 0; i < nr_bufs; i++) {
+		rc = -posix_memalign(&eng->re_bufs[i], RA_BUF_ALIGN,
+				     unit_size);
+		if (rc != 0)
+			goto free_bufs;
+		eng->re_nr_bufs++;
+	}
+	eng->re_free_bufs = nr_bufs;
+
+	pthread_mutex_init(&eng->re_lock, NULL);
+	pthread_cond_init(&eng->re_work_cond, NULL);
+	pthread_cond_init(&eng->re_done_cond, NULL);
+
+	for (i = 0; i < nr_workers; i++) {
+		rc = -pthread_create(&eng->re_workers[i], NULL, worker, eng);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+		eng->re_nr_workers++;
+	}
+
+	if (rc != 0) {
+		readahead_fini(eng);
+		return rc;
+	}
+
+	return 0;
+
+free_bufs:
+	for (i = 0; i < eng->re_nr_bufs; i++)
+		free(eng->re_bufs[i]);
+	free(eng->re_bufs);
+	free(eng->re_workers);
+	return rc;
+}
+
+void readahead_fini(struct readahead_engine *eng)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&eng->re_lock);
+	eng->re_stop = true;
+	pthread_cond_broadcast(&eng->re_work_cond);
+	pthread_mutex_unlock(&eng->re_lock);
+
+	for (i = 0; i < eng->re_nr_workers; i++)
+		pthread_join(eng->re_workers[i], NULL);
+
+	pthread_cond_destroy(&eng->re_done_cond);
+	pthread_cond_destroy(&eng->re_work_cond);
+	pthread_mutex_destroy(&eng->re_lock);
+
+	/* Every buffer is back in the pool once the files are closed */
+	for (i = 0; i < eng->re_nr_bufs; i++)
+		free(eng->re_bufs[i]);
+	free(eng->re_bufs);
+	free(eng->re_workers);
+}
+
+void readahead_open(struct readahead_engine *eng, struct readahead_file *file,
+		    void *backend_file)
+{
+	memset(file, 0, sizeof(*file));
+	file->rf_engine = eng;
+	file->rf_backend_file = backend_file;
+	file->rf_next = -1;
+	file->rf_window = RA_WINDOW_MIN;
+}
+
+void readahead_close(struct readahead_file *file)
+{
+	struct readahead_engine *eng = file->rf_engine;
+
+	pthread_mutex_lock(&eng->re_lock);
+	cancel_all(file);
+	while (file->rf_inflight > 0)
+		pthread_cond_wait(&eng->re_done_cond, &eng->re_lock);
+	pthread_mutex_unlock(&eng->re_lock);
+}
+
+/**
+ * Copy what unit holds from byte uoff, up to want bytes, into buf.
+ * Return the bytes copied, 0 past the end of the file, -ESTALE when the
+ * unit was invalidated while in flight, or -errno.
+ */
+static ssize_t unit_copy(struct readahead_file *file,
+			 struct readahead_unit *unit, char *buf, size_t uoff,
+			 size_t want)
+{
+	struct readahead_engine *eng = file->rf_engine;
+	ssize_t len;
+
+	if (!unit->ru_hit) {
+		unit->ru_hit = true;
+		eng->re_stats.hits++;
+		/* Read-ahead pays off, read further ahead */
+		if (file->rf_window < eng->re_max_window)
+			file->rf_window = file->rf_window * 2 <
+				eng->re_max_window ? file->rf_window * 2 :
+				eng->re_max_window;
+	}
+
+	if (!unit->ru_done) {
+		eng->re_stats.waits++;
+		unit->ru_pinned = true;
+		while (!unit->ru_done)
+			pthread_cond_wait(&eng->re_done_cond, &eng->re_lock);
+		unit->ru_pinned = false;
+
+		/* Invalidated meanwhile, it may hold the old data */
+		if (unit->ru_cancelled) {
+			unit_free(eng, unit);
+			return -ESTALE;
+		}
+	}
+
+	len = unit->ru_len;
+	if (len < 0) {
+		/* Read it again synchronously if the caller retries */
+		unit_drop(file, unit);
+		return len;
+	}
+	if ((size_t)len <= uoff)
+		return 0;
+
+	/*
+	 * A completed unit is not modified anymore, readahead_invalidate()
+	 * may only drop it meanwhile
+	 */
+	if (want > len - uoff)
+		want = len - uoff;
+	unit->ru_pinned = true;
+	pthread_mutex_unlock(&eng->re_lock);
+	memcpy(buf, (char *)unit->ru_buf + uoff, want);
+	pthread_mutex_lock(&eng->re_lock);
+	unit->ru_pinned = false;
+
+	/* Copied before the write completed, as a read racing with it */
+	if (unit->ru_cancelled) {
+		unit_free(eng, unit);
+		return want;
+	}
+
+	/* Consumed up to its end */
+	if (uoff + want == (size_t)len)
+		unit_drop(file, unit);
+	return want;
+}
+
+ssize_t readahead_read(struct readahead_file *file, void *buf, size_t count,
+		       off_t off)
+{
+	struct readahead_engine *eng = file->rf_engine;
+	size_t us = eng->re_unit_size;
+	struct readahead_unit *unit;
+	size_t done = 0, uoff, want;
+	ssize_t n = 0;
+	uint64_t no;
+
+	pthread_mutex_lock(&eng->re_lock);
+	if (off == file->rf_next) {
+		file->rf_seq++;
+	} else {
+		cancel_all(file);
+		file->rf_seq = 1;
+		file->rf_window = RA_WINDOW_MIN;
+		file->rf_ra_next = 0;
+	}
+
+	while (done < count) {
+		no = (off + done) / us;
+		uoff = (off + done) % us;
+		want = count - done < us - uoff ? count - done : us - uoff;
+
+		unit = unit_find(file, no);
+		n = -ESTALE;
+		if (unit != NULL)
+			n = unit_copy(file, unit, (char *)buf + done, uoff,
+				      want);
+		if (n == -ESTALE) {
+			eng->re_stats.misses++;
+			pthread_mutex_unlock(&eng->re_lock);
+			n = eng->re_read(file->rf_backend_file,
+					 (char *)buf + done, want, off + done);
+			pthread_mutex_lock(&eng->re_lock);
+		}
+
+		if (n <= 0)
+			break;
+		done += n;
+		if ((size_t)n < want)
+			break;
+	}
+
+	file->rf_next = off + done;
+	if (n >= 0 && file->rf_seq >= RA_SEQ_TRIGGER)
+		issue(file, file->rf_next / us);
+	pthread_mutex_unlock(&eng->re_lock);
+
+	return done > 0 || n >= 0 ? (ssize_t)done : n;
+}
+
+void readahead_invalidate(struct readahead_file *file, off_t off, size_t len)
+{
+	struct readahead_engine *eng = file->rf_engine;
+	struct readahead_unit *unit, *tmp;
+	uint64_t first, last;
+
+	if (len == 0)
+		return;
+
+	first = off / eng->re_unit_size;
+	last = (off + (len - 1)) / eng->re_unit_size;
+	if (last < first)
+		last = UINT64_MAX;
+
+	pthread_mutex_lock(&eng->re_lock);
+	/* In flight ones may have read the old data */
+	for (unit = file->rf_units; unit != NULL; unit = tmp) {
+		tmp = unit->ru_next;
+		if (unit->ru_no >= first && unit->ru_no <= last)
+			unit_drop(file, unit);
+	}
+
+	/* Read them again if the stream gets there */
+	if (file->rf_ra_next > first)
+		file->rf_ra_next = first;
+	/* A write may have moved the end of the file */
+	file->rf_eof = false;
+	file->rf_eof_unit = 0;
+	pthread_mutex_unlock(&eng->re_lock);
+}
+
+void readahead_stats_get(struct readahead_engine *eng,
+			 struct readahead_stats *stats)
+{
+	pthread_mutex_lock(&eng->re_lock);
+	*stats = eng->re_stats;
+	pthread_mutex_unlock(&eng->re_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
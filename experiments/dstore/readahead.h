@@ -0,0 +1,152 @@
+/*
+ * Filename:         readahead.h
+ * Description:      Sequential read-ahead for the DSAL read path
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Read-ahead of sequential streams, in front of a synchronous backend
+ * read function (DSAL's dstore read, pread() in readahead_bench.c).
+ *
+ * - Files are read in units of unit_size bytes (the object block size).
+ * - Every open file has a readahead_file tracking where its last read
+ *   ended. A read starting there is sequential; after RA_SEQ_TRIGGER
+ *   sequential reads the next window units are read ahead by the worker
+ *   threads of the engine into buffers of a pool shared by all files.
+ * - The window starts at RA_WINDOW_MIN units and doubles, up to
+ *   max_window, every time a read is served from read-ahead buffers.
+ * - A read anywhere else cancels the read-ahead of the file: buffers
+ *   already filled are released, reads in flight are dropped when they
+ *   complete, and the window goes back to RA_WINDOW_MIN.
+ * - When the pool is exhausted read-ahead is skipped, reads never wait for
+ *   a buffer.
+ * - Writes bypass the engine: the writer calls readahead_invalidate() for
+ *   the range it changed.
+ *
+ * readahead_read() returns what the backend returns: a short count at the
+ * end of the file, a negative errno on failure. A file is read by one
+ * thread at a time, as NFS-Ganesha does for the reads of a state.
+ */
+
+#ifndef _READAHEAD_H
+#define _READAHEAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#define RA_WINDOW_MIN 2
+#define RA_SEQ_TRIGGER 2
+
+/**
+ * Read count bytes at off into buf, like pread().
+ */
+typedef ssize_t (*readahead_backend_t)(void *file, void *buf, size_t count,
+				       off_t off);
+
+struct readahead_unit;
+
+struct readahead_stats {
+	/* Units served from read-ahead buffers */
+	uint64_t hits;
+	/* Units read by the caller itself */
+	uint64_t misses;
+	/* Hits that had to wait for the read in flight */
+	uint64_t waits;
+	uint64_t issued;
+	/* Units read ahead and never used */
+	uint64_t wasted;
+	/* Read-ahead skipped for lack of buffers */
+	uint64_t no_buffer;
+	uint64_t cancels;
+};
+
+struct readahead_engine {
+	readahead_backend_t re_read;
+	size_t re_unit_size;
+	uint32_t re_max_window;
+	pthread_mutex_t re_lock;
+	/* Signaled when work is queued or the engine stops */
+	pthread_cond_t re_work_cond;
+	/* Broadcast when a unit completes */
+	pthread_cond_t re_done_cond;
+	pthread_t *re_workers;
+	uint32_t re_nr_workers;
+	/* Units to read, in issue order */
+	struct readahead_unit *re_queue;
+	struct readahead_unit **re_queue_tail;
+	bool re_stop;
+	/* Free buffers of the pool */
+	void **re_bufs;
+	uint32_t re_nr_bufs;
+	uint32_t re_free_bufs;
+	struct readahead_stats re_stats;
+};
+
+struct readahead_file {
+	struct readahead_engine *rf_engine;
+	void *rf_backend_file;
+	/* End of the last read, and sequential reads in a row */
+	off_t rf_next;
+	uint32_t rf_seq;
+	uint32_t rf_window;
+	/* Units read ahead or in flight */
+	struct readahead_unit *rf_units;
+	/* Units the workers still have to complete, cancelled ones included */
+	uint32_t rf_inflight;
+	/* Next unit to read ahead */
+	uint64_t rf_ra_next;
+	/* Set once the backend returned a short read */
+	bool rf_eof;
+	uint64_t rf_eof_unit;
+};
+
+/**
+ * Start nr_workers threads reading ahead into nr_bufs buffers of
+ * unit_size bytes, at most max_window units per file.
+ */
+int readahead_init(struct readahead_engine *eng, readahead_backend_t read,
+		   size_t unit_size, uint32_t nr_bufs, uint32_t max_window,
+		   uint32_t nr_workers);
+
+/**
+ * Stop the workers, all files must have been closed.
+ */
+void readahead_fini(struct readahead_engine *eng);
+
+void readahead_open(struct readahead_engine *eng, struct readahead_file *file,
+		    void *backend_file);
+
+/**
+ * Cancel the read-ahead of the file and wait for its reads in flight.
+ */
+void readahead_close(struct readahead_file *file);
+
+ssize_t readahead_read(struct readahead_file *file, void *buf, size_t count,
+		       off_t off);
+
+/**
+ * Drop the units read ahead or in flight that overlap the len bytes at off,
+ * to be called once they were written or truncated. The next reads go to
+ * the backend for them. May run while another thread is in
+ * readahead_read() on the file.
+ */
+void readahead_invalidate(struct readahead_file *file, off_t off, size_t len);
+
+void readahead_stats_get(struct readahead_engine *eng,
+			 struct readahead_stats *stats);
+
+#endif /* _READAHEAD_H */
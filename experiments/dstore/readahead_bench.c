@@ -0,0 +1,328 @@
+/*
+ * Filename:         readahead_bench.c
+ * Description:      Benchmark of the sequential read-ahead engine
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Write a file of -f MiB, then read it through a backend adding -l usecs
+ *   to every pread(), like a round trip to the object store would
+ * - Read it sequentially in -s bytes requests, without read-ahead (every
+ *   read goes to the backend) and through readahead.h
+ * - Read it again at random offsets through readahead.h: read-ahead must
+ *   stay out of the way, the pool must not fill with wasted units
+ *
+ * Build:
+ *   gcc -o readahead_bench readahead_bench.c readahead.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "readahead.h"
+
+#define MiB (1024 * 1024)
+
+static struct {
+	size_t file_size;
+	size_t unit_size;
+	size_t io_size;
+	uint32_t latency_us;
+	uint32_t nr_bufs;
+	uint32_t max_window;
+	uint32_t nr_workers;
+	const char *path;
+} conf = {
+	.file_size = 256 * MiB,
+	.unit_size = MiB,
+	.io_size = 128 * 1024,
+	.latency_us = 500,
+	.nr_bufs = 64,
+	.max_window = 16,
+	.nr_workers = 8,
+	.path = "/tmp/readahead_bench.dat",
+};
+
+struct bench_file {
+	int fd;
+};
+
+static ssize_t backend_read(void *file, void *buf, size_t count, off_t off)
+{
+	struct bench_file *bf = file;
+	ssize_t rc;
+
+	if (conf.latency_us != 0)
+		usleep(conf.latency_us);
+
+	rc = pread(bf->fd, buf, count, off);
+	return rc < 0 ? -errno : rc;
+}
+
+static long elapsed_us(const struct timeval *start, const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L +
+		end->tv_usec - start->tv_usec;
+}
+
+static int file_create(struct bench_file *bf)
+{
+	char *buf;
+	size_t done;
+	ssize_t n;
+	int rc = 0;
+
+	bf->fd = open(conf.path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (bf->fd < 0) {
+		rc = -errno;
+		fprintf(stderr, "error(%d): open %s\n", rc, conf.path);
+		return rc;
+	}
+
+	buf = malloc(MiB);
+	if (buf == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (done = 0; done < conf.file_size; done += n) {
+		memset(buf, (int)(done / MiB), MiB);
+		n = pwrite(bf->fd, buf, MiB, done);
+		if (n < 0) {
+			rc = -errno;
+			fprintf(stderr, "error(%d): pwrite\n", rc);
+			break;
+		}
+	}
+
+	free(buf);
+out:
+	if (rc != 0)
+		close(bf->fd);
+	return rc;
+}
+
+/* Check that buf holds what file_create() wrote at off, one byte in
+ * CHECK_STRIDE so that the check does not dominate the copy.
+ */
+#define CHECK_STRIDE 512
+
+static int check(const char *buf, size_t len, off_t off)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += CHECK_STRIDE) {
+		if (buf[i] != (char)((off + i) / MiB)) {
+			fprintf(stderr, "mismatch at %zu\n", off + i);
+			return -EIO;
+		}
+	}
+	return 0;
+}
+
+/* Print the throughput, and the read-ahead stats accumulated since *prev
+ * when eng is set.
+ */
+static void report(const char *msg, size_t bytes, long us,
+		   struct readahead_engine *eng,
+		   const struct readahead_stats *prev)
+{
+	struct readahead_stats st;
+
+	printf("%-24s %8.1f MB/s (%ld usecs)", msg,
+	       us > 0 ? (double)bytes / us : 0.0, us);
+
+	if (eng != NULL) {
+		readahead_stats_get(eng, &st);
+		printf(" hits %lu misses %lu waits %lu issued %lu wasted %lu"
+		       " no_buffer %lu cancels %lu",
+		       (unsigned long)(st.hits - prev->hits),
+		       (unsigned long)(st.misses - prev->misses),
+		       (unsigned long)(st.waits - prev->waits),
+		       (unsigned long)(st.issued - prev->issued),
+		       (unsigned long)(st.wasted - prev->wasted),
+		       (unsigned long)(st.no_buffer - prev->no_buffer),
+		       (unsigned long)(st.cancels - prev->cancels));
+	}
+	printf("\n");
+}
+
+static int read_direct(struct bench_file *bf, char *buf)
+{
+	struct timeval start, end;
+	size_t off;
+	ssize_t n;
+
+	gettimeofday(&start, NULL);
+	for (off = 0; off < conf.file_size; off += n) {
+		n = backend_read(bf, buf, conf.io_size, off);
+		if (n <= 0)
+			return n < 0 ? n : -EIO;
+	}
+	gettimeofday(&end, NULL);
+
+	report("sequential, direct", conf.file_size, elapsed_us(&start, &end),
+	       NULL, NULL);
+	return 0;
+}
+
+static int read_ahead(struct readahead_engine *eng, struct bench_file *bf,
+		      char *buf, bool random)
+{
+	struct readahead_file file;
+	struct readahead_stats prev;
+	struct timeval start, end;
+	size_t off = 0, bytes = 0;
+	size_t nr_ios = conf.file_size / conf.io_size;
+	ssize_t n;
+	int rc = 0;
+
+	readahead_stats_get(eng, &prev);
+	readahead_open(eng, &file, bf);
+
+	gettimeofday(&start, NULL);
+	while (bytes < conf.file_size) {
+		if (random)
+			off = (size_t)(rand() % nr_ios) * conf.io_size;
+
+		n = readahead_read(&file, buf, conf.io_size, off);
+		if (n <= 0) {
+			rc = n < 0 ? n : -EIO;
+			break;
+		}
+
+		rc = check(buf, n, off);
+		if (rc != 0)
+			break;
+
+		off += n;
+		bytes += n;
+	}
+	gettimeofday(&end, NULL);
+
+	readahead_close(&file);
+
+	if (rc == 0)
+		report(random ? "random, read-ahead" :
+		       "sequential, read-ahead", bytes,
+		       elapsed_us(&start, &end), eng, &prev);
+	else
+		fprintf(stderr, "error(%d): readahead_read\n", rc);
+	return rc;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f file MiB] [-u unit size] [-s io size]"
+		" [-l backend latency usecs] [-b buffers] [-w max window]"
+		" [-t workers] [-p path]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct readahead_engine eng;
+	struct bench_file bf;
+	char *buf;
+	int rc, opt;
+
+	while ((opt = getopt(argc, argv, "f:u:s:l:b:w:t:p:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			conf.file_size = strtoul(optarg, NULL, 0) * MiB;
+			break;
+		case 'u':
+			conf.unit_size = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			conf.io_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			conf.latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			conf.nr_bufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			conf.max_window = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			conf.nr_workers = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			conf.path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (conf.file_size == 0 || conf.io_size == 0 ||
+	    conf.file_size % conf.io_size != 0) {
+		fprintf(stderr, "the file size must be a multiple of the io"
+			" size\n");
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	buf = malloc(conf.io_size);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	rc = file_create(&bf);
+	if (rc != 0)
+		goto free_buf;
+
+	rc = readahead_init(&eng, backend_read, conf.unit_size, conf.nr_bufs,
+			    conf.max_window, conf.nr_workers);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): readahead_init\n", rc);
+		goto close_file;
+	}
+
+	printf("file %zu MiB, unit %zu, io %zu, latency %u usecs\n",
+	       conf.file_size / MiB, conf.unit_size, conf.io_size,
+	       conf.latency_us);
+
+	rc = read_direct(&bf, buf);
+	if (rc == 0)
+		rc = read_ahead(&eng, &bf, buf, false);
+	if (rc == 0)
+		rc = read_ahead(&eng, &bf, buf, true);
+
+	readahead_fini(&eng);
+close_file:
+	close(bf.fd);
+	unlink(conf.path);
+free_buf:
+	free(buf);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
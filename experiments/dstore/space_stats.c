@@ -0,0 +1,309 @@
+/*
+ * Filename:         space_stats.c
+ * Description:      Cached file system usage counters for statfs
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "space_stats.h"
+
+/* Slot of the calling thread, assigned on its first update */
+static __thread int thread_slot = -1;
+static int next_slot;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void counter_inc(uint64_t *counter)
+{
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+static void usage_add(struct space_stats *ss, int64_t bytes, int64_t inodes)
+{
+	struct space_stats_slot *slot;
+
+	if (thread_slot < 0)
+		thread_slot = __atomic_fetch_add(&next_slot, 1,
+						 __ATOMIC_RELAXED) %
+			SPACE_STATS_SLOTS;
+
+	slot = &ss->ss_slots[thread_slot];
+	if (bytes != 0)
+		__atomic_add_fetch(&slot->bytes, bytes, __ATOMIC_RELAXED);
+	if (inodes != 0)
+		__atomic_add_fetch(&slot->inodes, inodes, __ATOMIC_RELAXED);
+}
+
+static void usage_sum(struct space_stats *ss, struct space_usage *usage)
+{
+	int i;
+
+	usage->bytes = 0;
+	usage->inodes = 0;
+	for (i = 0; i < SPACE_STATS_SLOTS; i++) {
+		usage->bytes += __atomic_load_n(&ss->ss_slots[i].bytes,
+						__ATOMIC_RELAXED);
+		usage->inodes += __atomic_load_n(&ss->ss_slots[i].inodes,
+						 __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * Take a new snapshot. Called with ss_lock held.
+ */
+static void snapshot_take(struct space_stats *ss)
+{
+	usage_sum(ss, &ss->ss_snapshot);
+	ss->ss_snapshot_ns = now_ns();
+}
+
+/**
+ * Store the current usage if it changed since last stored. Called by the
+ * persister, then by space_stats_fini() once it stopped: the store()
+ * round trip is made without ss_lock, statfs never waits for it.
+ */
+static int usage_store(struct space_stats *ss, bool clean)
+{
+	struct space_usage usage;
+	int rc;
+
+	pthread_mutex_lock(&ss->ss_lock);
+	snapshot_take(ss);
+	usage = ss->ss_snapshot;
+	pthread_mutex_unlock(&ss->ss_lock);
+
+	if (!clean && usage.bytes == ss->ss_stored.bytes &&
+	    usage.inodes == ss->ss_stored.inodes)
+		return 0;
+
+	rc = ss->ss_ops->store(ss->ss_ctx, &usage, clean);
+	if (rc != 0) {
+		counter_inc(&ss->ss_counters.errors);
+		return rc;
+	}
+
+	ss->ss_stored = usage;
+	counter_inc(&ss->ss_counters.persists);
+	return 0;
+}
+
+static void *persister(void *arg)
+{
+	struct space_stats *ss = arg;
+	struct timespec ts;
+	uint64_t period = ss->ss_persist_ms * 1000000ULL;
+	int rc;
+
+	pthread_mutex_lock(&ss->ss_lock);
+	while (!ss->ss_stop) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += period % 1000000000;
+		ts.tv_sec += period / 1000000000 + ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+		pthread_cond_timedwait(&ss->ss_cond, &ss->ss_lock, &ts);
+		if (ss->ss_stop)
+			break;
+		pthread_mutex_unlock(&ss->ss_lock);
+
+		/* Retried at the next period on failure */
+		rc = usage_store(ss, false);
+		if (rc != 0)
+			fprintf(stderr, "error(%d): space stats store\n", rc);
+
+		pthread_mutex_lock(&ss->ss_lock);
+	}
+	pthread_mutex_unlock(&ss->ss_lock);
+
+	return NULL;
+}
+
+int space_stats_init(struct space_stats *ss, const struct space_stats_ops *ops,
+		     void *ctx, uint32_t persist_ms)
+{
+	struct space_usage usage;
+	bool clean = false;
+	int rc;
+
+	if (persist_ms == 0)
+		return -EINVAL;
+
+	memset(ss, 0, sizeof(*ss));
+	ss->ss_ops = ops;
+	ss->ss_ctx = ctx;
+	ss->ss_persist_ms = persist_ms;
+
+	rc = ops->load(ctx, &usage, &clean);
+	if (rc != 0 && rc != -ENOENT)
+		return rc;
+
+	if (rc == -ENOENT || !clean) {
+		/* Never counted, or updates lost by a crash */
+		counter_inc(&ss->ss_counters.queries);
+		rc = ops->query(ctx, &usage);
+		if (rc != 0)
+			return rc;
+	}
+
+	/* Not clean until space_stats_fini() */
+	rc = ops->store(ctx, &usage, false);
+	if (rc != 0)
+		return rc;
+
+	ss->ss_slots[0].bytes = usage.bytes;
+	ss->ss_slots[0].inodes = usage.inodes;
+	ss->ss_stored = usage;
+	ss->ss_snapshot = usage;
+	ss->ss_snapshot_ns = now_ns();
+	ss->ss_counters.persists = 1;
+
+	pthread_mutex_init(&ss->ss_lock, NULL);
+	pthread_cond_init(&ss->ss_cond, NULL);
+
+	rc = -pthread_create(&ss->ss_persister, NULL, persister, ss);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): pthread_create\n", rc);
+		pthread_cond_destroy(&ss->ss_cond);
+		pthread_mutex_destroy(&ss->ss_lock);
+	}
+	return rc;
+}
+
+int space_stats_fini(struct space_stats *ss)
+{
+	int rc;
+
+	pthread_mutex_lock(&ss->ss_lock);
+	ss->ss_stop = true;
+	pthread_cond_signal(&ss->ss_cond);
+	pthread_mutex_unlock(&ss->ss_lock);
+
+	pthread_join(ss->ss_persister, NULL);
+
+	rc = usage_store(ss, true);
+	if (rc != 0)
+		fprintf(stderr, "error(%d): space stats store\n", rc);
+
+	pthread_cond_destroy(&ss->ss_cond);
+	pthread_mutex_destroy(&ss->ss_lock);
+	return rc;
+}
+
+void space_stats_create(struct space_stats *ss)
+{
+	usage_add(ss, 0, 1);
+}
+
+void space_stats_resize(struct space_stats *ss, uint64_t old_size,
+			uint64_t new_size)
+{
+	usage_add(ss, (int64_t)new_size - (int64_t)old_size, 0);
+}
+
+void space_stats_remove(struct space_stats *ss, uint64_t size)
+{
+	usage_add(ss, -(int64_t)size, -1);
+}
+
+int space_stats_statfs(struct space_stats *ss, int64_t max_age,
+		       struct space_usage *usage)
+{
+	uint64_t age;
+
+	counter_inc(&ss->ss_counters.statfs);
+
+	if (max_age == SPACE_STATS_QUERY) {
+		counter_inc(&ss->ss_counters.queries);
+		return ss->ss_ops->query(ss->ss_ctx, usage);
+	}
+	if (max_age < 0)
+		return -EINVAL;
+
+	if (max_age == 0) {
+		counter_inc(&ss->ss_counters.summed);
+		usage_sum(ss, usage);
+		return 0;
+	}
+
+	pthread_mutex_lock(&ss->ss_lock);
+	age = now_ns() - ss->ss_snapshot_ns;
+	if (age > max_age * 1000000ULL) {
+		counter_inc(&ss->ss_counters.summed);
+		snapshot_take(ss);
+	} else {
+		counter_inc(&ss->ss_counters.cached);
+	}
+	*usage = ss->ss_snapshot;
+	pthread_mutex_unlock(&ss->ss_lock);
+
+	return 0;
+}
+
+int space_stats_reconcile(struct space_stats *ss, struct space_usage *drift)
+{
+	struct space_usage actual, counted;
+	int rc;
+
+	counter_inc(&ss->ss_counters.queries);
+	rc = ss->ss_ops->query(ss->ss_ctx, &actual);
+	if (rc != 0)
+		return rc;
+
+	usage_sum(ss, &counted);
+	actual.bytes -= counted.bytes;
+	actual.inodes -= counted.inodes;
+	usage_add(ss, actual.bytes, actual.inodes);
+
+	if (drift != NULL)
+		*drift = actual;
+	return 0;
+}
+
+void space_stats_counters_get(struct space_stats *ss,
+			      struct space_stats_counters *counters)
+{
+	counters->statfs = __atomic_load_n(&ss->ss_counters.statfs,
+					   __ATOMIC_RELAXED);
+	counters->cached = __atomic_load_n(&ss->ss_counters.cached,
+					   __ATOMIC_RELAXED);
+	counters->summed = __atomic_load_n(&ss->ss_counters.summed,
+					   __ATOMIC_RELAXED);
+	counters->queries = __atomic_load_n(&ss->ss_counters.queries,
+					    __ATOMIC_RELAXED);
+	counters->persists = __atomic_load_n(&ss->ss_counters.persists,
+					     __ATOMIC_RELAXED);
+	counters->errors = __atomic_load_n(&ss->ss_counters.errors,
+					   __ATOMIC_RELAXED);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,147 @@
+/*
+ * Filename:         space_stats.h
+ * Description:      Cached file system usage counters for statfs
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Every statfs (NFS FSSTAT) asks the backend for the space and inodes in
+ * use, and clients and monitoring agents call it all the time.
+ *
+ * Here the usage of a file system is counted in memory instead:
+ * - The create, write/truncate and unlink paths call space_stats_create(),
+ *   space_stats_resize() and space_stats_remove(). Each thread adds to a
+ *   slot of its own, on a cache line of its own, so the writers do not
+ *   contend on one counter.
+ * - A persister stores the sum of the slots every persist_ms, through the
+ *   store() op, when it changed.
+ * - space_stats_statfs() with a max_age answers from a snapshot of the
+ *   sum no older than max_age ms, without any backend round trip. With
+ *   SPACE_STATS_QUERY it asks the backend, as statfs does today.
+ *
+ * The record is stored as "not clean" while the file system is mounted.
+ * space_stats_fini() stores it as clean. If space_stats_init() finds no
+ * record, or a record that is not clean (the server crashed), it counts
+ * the usage with the query() op, once.
+ *
+ * Bytes are the sum of the file sizes, so sparse files count in full.
+ * Only the updates made through this node are counted. Updates racing
+ * with space_stats_reconcile() may be counted twice or missed.
+ */
+
+#ifndef _SPACE_STATS_H
+#define _SPACE_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define SPACE_STATS_SLOTS 32
+/* max_age of space_stats_statfs() asking the backend */
+#define SPACE_STATS_QUERY (-1)
+
+struct space_usage {
+	int64_t bytes;
+	int64_t inodes;
+};
+
+struct space_stats_ops {
+	/* Read the stored usage, -ENOENT if there is none */
+	int (*load)(void *ctx, struct space_usage *usage, bool *clean);
+	int (*store)(void *ctx, const struct space_usage *usage, bool clean);
+	/* Count the usage on the backend */
+	int (*query)(void *ctx, struct space_usage *usage);
+};
+
+/* Updates of the threads using it */
+struct space_stats_slot {
+	int64_t bytes;
+	int64_t inodes;
+} __attribute__((aligned(64)));
+
+struct space_stats_counters {
+	uint64_t statfs;
+	/* statfs answered from the snapshot, and from a new sum of the
+	 * slots
+	 */
+	uint64_t cached;
+	uint64_t summed;
+	uint64_t queries;
+	uint64_t persists;
+	uint64_t errors;
+};
+
+struct space_stats {
+	const struct space_stats_ops *ss_ops;
+	void *ss_ctx;
+	uint32_t ss_persist_ms;
+	struct space_stats_slot ss_slots[SPACE_STATS_SLOTS];
+	/* Protects the snapshot */
+	pthread_mutex_t ss_lock;
+	/* Signaled when the persister must stop */
+	pthread_cond_t ss_cond;
+	pthread_t ss_persister;
+	bool ss_stop;
+	struct space_usage ss_snapshot;
+	/* When the snapshot was taken, CLOCK_MONOTONIC nanoseconds */
+	uint64_t ss_snapshot_ns;
+	/* Last usage stored, by the persister */
+	struct space_usage ss_stored;
+	/* Updated atomically */
+	struct space_stats_counters ss_counters;
+};
+
+/**
+ * Load the usage stored by ops (or count it, see above) and start the
+ * persister.
+ */
+int space_stats_init(struct space_stats *ss, const struct space_stats_ops *ops,
+		     void *ctx, uint32_t persist_ms);
+
+/**
+ * Stop the persister and store the usage as clean.
+ */
+int space_stats_fini(struct space_stats *ss);
+
+void space_stats_create(struct space_stats *ss);
+
+/**
+ * A file went from old_size to new_size bytes, by a write or a truncate.
+ */
+void space_stats_resize(struct space_stats *ss, uint64_t old_size,
+			uint64_t new_size);
+
+/**
+ * The last link of a file of size bytes was removed.
+ */
+void space_stats_remove(struct space_stats *ss, uint64_t size);
+
+/**
+ * Usage as of at most max_age ms ago, 0 for the current counters, or as
+ * counted by the backend with SPACE_STATS_QUERY.
+ */
+int space_stats_statfs(struct space_stats *ss, int64_t max_age,
+		       struct space_usage *usage);
+
+/**
+ * Count the usage on the backend and correct the counters, drift (when not
+ * NULL) receives the correction.
+ */
+int space_stats_reconcile(struct space_stats *ss, struct space_usage *drift);
+
+void space_stats_counters_get(struct space_stats *ss,
+			      struct space_stats_counters *counters);
+
+#endif /* _SPACE_STATS_H */
@@ -0,0 +1,452 @@
+/*
+ * Filename:         space_stats_bench.c
+ * Description:      statfs from cached counters versus backend queries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - -w writer threads create, extend, truncate and remove files of their
+ *   own, reporting every change to space_stats.h
+ * - -s threads call statfs meanwhile, one run per mode:
+ *   a) SPACE_STATS_QUERY: the backend counts the usage, taking -l usecs
+ *      plus a walk over all files, like the query statfs makes today
+ *   b) max_age 0: sum of the in-memory counters
+ *   c) max_age -a ms: snapshot of the counters
+ * - After every run the counters must match what the backend counts
+ * - Then a crash is simulated: the record stored by the persister (not
+ *   clean) is loaded again and must be recounted from the backend
+ *
+ * Build:
+ *   gcc -o space_stats_bench space_stats_bench.c space_stats.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "space_stats.h"
+
+static struct {
+	uint32_t writers;
+	uint32_t statfs_threads;
+	uint32_t files;
+	uint32_t ops;
+	uint32_t latency_us;
+	uint32_t max_age_ms;
+	uint32_t persist_ms;
+} conf = {
+	.writers = 8,
+	.statfs_threads = 4,
+	.files = 1000,
+	.ops = 100000,
+	.latency_us = 500,
+	.max_age_ms = 100,
+	.persist_ms = 50,
+};
+
+/* The files and the stored record, as the backend holds them */
+static struct {
+	/* Size of every file, -1 when it does not exist */
+	int64_t *sizes;
+	uint32_t nr_files;
+	pthread_mutex_t lock;
+	struct space_usage stored;
+	bool stored_clean;
+	bool has_record;
+	unsigned long stores;
+	unsigned long queries;
+} backend;
+
+static int backend_load(void *ctx, struct space_usage *su, bool *clean)
+{
+	int rc = -ENOENT;
+
+	(void)ctx;
+
+	pthread_mutex_lock(&backend.lock);
+	if (backend.has_record) {
+		*su = backend.stored;
+		*clean = backend.stored_clean;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&backend.lock);
+	return rc;
+}
+
+static int backend_store(void *ctx, const struct space_usage *su, bool clean)
+{
+	(void)ctx;
+
+	if (conf.latency_us != 0)
+		usleep(conf.latency_us);
+
+	pthread_mutex_lock(&backend.lock);
+	backend.stored = *su;
+	backend.stored_clean = clean;
+	backend.has_record = true;
+	backend.stores++;
+	pthread_mutex_unlock(&backend.lock);
+	return 0;
+}
+
+static int backend_query(void *ctx, struct space_usage *su)
+{
+	int64_t size;
+	uint32_t i;
+
+	(void)ctx;
+
+	if (conf.latency_us != 0)
+		usleep(conf.latency_us);
+
+	su->bytes = 0;
+	su->inodes = 0;
+	for (i = 0; i < backend.nr_files; i++) {
+		size = __atomic_load_n(&backend.sizes[i], __ATOMIC_RELAXED);
+		if (size < 0)
+			continue;
+		su->bytes += size;
+		su->inodes++;
+	}
+
+	pthread_mutex_lock(&backend.lock);
+	backend.queries++;
+	pthread_mutex_unlock(&backend.lock);
+	return 0;
+}
+
+static const struct space_stats_ops bench_ops = {
+	.load = backend_load,
+	.store = backend_store,
+	.query = backend_query,
+};
+
+struct worker {
+	pthread_t thread;
+	struct space_stats *ss;
+	/* Files [first, first + nr) for a writer, statfs mode otherwise */
+	uint32_t first;
+	uint32_t nr;
+	int64_t max_age;
+	/* Statfs calls and their total time */
+	unsigned long calls;
+	long usecs;
+	int rc;
+};
+
+static bool stop_statfs;
+
+/**
+ * Apply conf.ops random changes to the files of the worker.
+ */
+static void *writer_run(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->first;
+	int64_t size, new_size, *file;
+	uint32_t i;
+
+	for (i = 0; i < conf.ops; i++) {
+		file = &backend.sizes[w->first + rand_r(&seed) % w->nr];
+		size = __atomic_load_n(file, __ATOMIC_RELAXED);
+
+		if (size < 0) {
+			space_stats_create(w->ss);
+			new_size = 0;
+		} else if (rand_r(&seed) % 10 == 0) {
+			space_stats_remove(w->ss, size);
+			new_size = -1;
+		} else if (rand_r(&seed) % 4 == 0) {
+			/* Truncate */
+			new_size = size / 2;
+			space_stats_resize(w->ss, size, new_size);
+		} else {
+			/* Append */
+			new_size = size + rand_r(&seed) % 65536;
+			space_stats_resize(w->ss, size, new_size);
+		}
+		__atomic_store_n(file, new_size, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static void *statfs_run(void *arg)
+{
+	struct worker *w = arg;
+	struct space_usage su;
+	struct timeval start1, end1;
+
+	while (!__atomic_load_n(&stop_statfs, __ATOMIC_RELAXED)) {
+		gettimeofday(&start1, NULL);
+		w->rc = space_stats_statfs(w->ss, w->max_age, &su);
+		gettimeofday(&end1, NULL);
+		if (w->rc != 0)
+			break;
+		w->usecs += (end1.tv_sec - start1.tv_sec) * 1000000L +
+			(end1.tv_usec - start1.tv_usec);
+		w->calls++;
+	}
+	return NULL;
+}
+
+/**
+ * Check that the counters match the files, nothing running.
+ */
+static int check_usage(struct space_stats *ss)
+{
+	struct space_usage counted, actual;
+	int rc;
+
+	rc = space_stats_statfs(ss, 0, &counted);
+	if (rc == 0)
+		rc = backend_query(NULL, &actual);
+	if (rc != 0)
+		return rc;
+
+	if (counted.bytes != actual.bytes || counted.inodes != actual.inodes) {
+		fprintf(stderr, "counted %lld bytes %lld inodes, backend has "
+			"%lld bytes %lld inodes\n", (long long)counted.bytes,
+			(long long)counted.inodes, (long long)actual.bytes,
+			(long long)actual.inodes);
+		return -EIO;
+	}
+	return 0;
+}
+
+static int run(struct space_stats *ss, int64_t max_age, const char *msg)
+{
+	struct worker *workers;
+	struct timeval start1, end1;
+	uint32_t nr = conf.writers + conf.statfs_threads;
+	uint32_t i, started, per_writer = conf.files / conf.writers;
+	unsigned long calls = 0, queries;
+	long usecs = 0, elapsed;
+	int rc = 0;
+
+	workers = calloc(nr, sizeof(*workers));
+	if (workers == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&backend.lock);
+	queries = backend.queries;
+	pthread_mutex_unlock(&backend.lock);
+
+	stop_statfs = false;
+	gettimeofday(&start1, NULL);
+	for (started = 0; started < nr; started++) {
+		workers[started].ss = ss;
+		workers[started].first = started * per_writer;
+		workers[started].nr = per_writer;
+		workers[started].max_age = max_age;
+		rc = -pthread_create(&workers[started].thread, NULL,
+				     started < conf.writers ? writer_run :
+				     statfs_run, &workers[started]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+
+	for (i = 0; i < started && i < conf.writers; i++)
+		pthread_join(workers[i].thread, NULL);
+	gettimeofday(&end1, NULL);
+	__atomic_store_n(&stop_statfs, true, __ATOMIC_RELAXED);
+	for (; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (rc == 0)
+			rc = workers[i].rc;
+		calls += workers[i].calls;
+		usecs += workers[i].usecs;
+	}
+	free(workers);
+	if (rc != 0)
+		return rc;
+
+	elapsed = (end1.tv_sec - start1.tv_sec) * 1000000L +
+		(end1.tv_usec - start1.tv_usec);
+	pthread_mutex_lock(&backend.lock);
+	queries = backend.queries - queries;
+	pthread_mutex_unlock(&backend.lock);
+
+	printf("%-16s writes %u x %u in %ld usecs, statfs %lu calls "
+	       "(%.1f usecs each), %lu backend queries\n", msg, conf.writers,
+	       conf.ops, elapsed, calls,
+	       calls != 0 ? (double)usecs / calls : 0.0, queries);
+
+	return check_usage(ss);
+}
+
+/**
+ * Reload the record as the persister left it, as after a crash.
+ */
+static int run_crash(void)
+{
+	struct space_stats ss;
+	struct space_usage su;
+	int64_t size;
+	bool clean;
+	unsigned long queries;
+	int rc;
+
+	rc = space_stats_init(&ss, &bench_ops, NULL, conf.persist_ms);
+	if (rc != 0)
+		return rc;
+
+	/* Let the persister store an update, then crash */
+	size = backend.sizes[0];
+	if (size < 0) {
+		space_stats_create(&ss);
+		size = 0;
+	}
+	space_stats_resize(&ss, size, size + 12345);
+	backend.sizes[0] = size + 12345;
+	usleep(3 * conf.persist_ms * 1000);
+	backend_load(NULL, &su, &clean);
+
+	rc = space_stats_fini(&ss);
+	if (rc != 0)
+		return rc;
+	pthread_mutex_lock(&backend.lock);
+	backend.stored = su;
+	backend.stored_clean = clean;
+	queries = backend.queries;
+	pthread_mutex_unlock(&backend.lock);
+
+	rc = space_stats_init(&ss, &bench_ops, NULL, conf.persist_ms);
+	if (rc != 0)
+		return rc;
+	rc = check_usage(&ss);
+	if (rc == 0 && (clean || backend.queries != queries + 2)) {
+		fprintf(stderr, "the usage was not recounted\n");
+		rc = -EIO;
+	}
+	if (rc == 0)
+		printf("crash: stored usage not clean, recounted\n");
+
+	if (space_stats_fini(&ss) != 0 && rc == 0)
+		rc = -EIO;
+	return rc;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-w writers] [-s statfs threads] [-f files]"
+		" [-o ops per writer] [-l backend latency usecs]"
+		" [-a max age ms] [-p persist ms]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct space_stats ss;
+	struct space_stats_counters st;
+	uint32_t i;
+	int rc, opt;
+
+	while ((opt = getopt(argc, argv, "w:s:f:o:l:a:p:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			conf.writers = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			conf.statfs_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			conf.files = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			conf.ops = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			conf.latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			conf.max_age_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			conf.persist_ms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (conf.writers == 0 || conf.files < conf.writers ||
+	    conf.max_age_ms == 0 || conf.persist_ms == 0) {
+		fprintf(stderr, "at least one file per writer, max age and "
+			"persist period must not be 0\n");
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	backend.nr_files = conf.files;
+	backend.sizes = malloc(conf.files * sizeof(*backend.sizes));
+	if (backend.sizes == NULL)
+		return -ENOMEM;
+	for (i = 0; i < conf.files; i++)
+		backend.sizes[i] = -1;
+	pthread_mutex_init(&backend.lock, NULL);
+
+	printf("%u writers, %u statfs threads, %u files, latency %u usecs\n",
+	       conf.writers, conf.statfs_threads, conf.files, conf.latency_us);
+
+	rc = space_stats_init(&ss, &bench_ops, NULL, conf.persist_ms);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): space_stats_init\n", rc);
+		goto out;
+	}
+
+	rc = run(&ss, SPACE_STATS_QUERY, "backend query");
+	if (rc == 0)
+		rc = run(&ss, 0, "counters");
+	if (rc == 0)
+		rc = run(&ss, conf.max_age_ms, "snapshot");
+
+	space_stats_counters_get(&ss, &st);
+	printf("statfs %lu cached %lu summed %lu queries %lu persists %lu"
+	       " errors %lu\n", (unsigned long)st.statfs,
+	       (unsigned long)st.cached, (unsigned long)st.summed,
+	       (unsigned long)st.queries, (unsigned long)st.persists,
+	       (unsigned long)st.errors);
+
+	if (space_stats_fini(&ss) != 0 && rc == 0)
+		rc = -EIO;
+	if (rc == 0 && !backend.stored_clean)
+		rc = -EIO;
+
+	if (rc == 0)
+		rc = run_crash();
+out:
+	if (rc != 0)
+		fprintf(stderr, "error(%d)\n", rc);
+	pthread_mutex_destroy(&backend.lock);
+	free(backend.sizes);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
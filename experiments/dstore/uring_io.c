@@ -0,0 +1,497 @@
+/*
+ * Filename:         uring_io.c
+ * Description:      io_uring engine of the posix dstore
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <liburing.h>
+#include "uring_io.h"
+
+/* Ring of one thread */
+struct uring_io_ring {
+	struct io_uring ur_ring;
+	struct uring_io_engine *ur_eng;
+	/* nr_bufs * buf_size bytes, and the iovecs registered */
+	char *ur_bufs;
+	struct iovec *ur_iovs;
+	bool ur_registered;
+	/* Indexes of the free buffers */
+	int *ur_free;
+	uint32_t ur_nr_free;
+	/* Requests queued and not submitted, and not reaped */
+	uint32_t ur_queued;
+	uint32_t ur_inflight;
+	/* Updated by the owner, read by uring_io_stats_get() */
+	struct uring_io_stats ur_stats;
+	struct uring_io_ring *ur_next;
+	struct uring_io_ring **ur_prev;
+};
+
+static void stat_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static void stats_sum(struct uring_io_stats *sum,
+		      struct uring_io_stats *stats)
+{
+	sum->requests += __atomic_load_n(&stats->requests, __ATOMIC_RELAXED);
+	sum->submits += __atomic_load_n(&stats->submits, __ATOMIC_RELAXED);
+	sum->waits += __atomic_load_n(&stats->waits, __ATOMIC_RELAXED);
+	sum->fixed += __atomic_load_n(&stats->fixed, __ATOMIC_RELAXED);
+	sum->direct += __atomic_load_n(&stats->direct, __ATOMIC_RELAXED);
+}
+
+/**
+ * Wait for the requests in flight, their completions are dropped: the
+ * thread that queued them is gone.
+ */
+static void ring_drain(struct uring_io_ring *ring)
+{
+	struct io_uring_cqe *cqe;
+	int rc;
+
+	while (ring->ur_inflight != 0) {
+		rc = io_uring_submit_and_wait(&ring->ur_ring, 1);
+		if (rc < 0 && rc != -EINTR)
+			break;
+		ring->ur_queued = 0;
+		while (io_uring_peek_cqe(&ring->ur_ring, &cqe) == 0) {
+			io_uring_cqe_seen(&ring->ur_ring, cqe);
+			ring->ur_inflight--;
+		}
+	}
+}
+
+static void ring_destroy(struct uring_io_ring *ring)
+{
+	ring_drain(ring);
+	/* Also unregisters the buffers */
+	io_uring_queue_exit(&ring->ur_ring);
+	free(ring->ur_free);
+	free(ring->ur_iovs);
+	free(ring->ur_bufs);
+	free(ring);
+}
+
+/**
+ * Destructor of ue_key, when a thread exits.
+ */
+static void ring_release(void *arg)
+{
+	struct uring_io_ring *ring = arg;
+	struct uring_io_engine *eng = ring->ur_eng;
+
+	pthread_mutex_lock(&eng->ue_lock);
+	*ring->ur_prev = ring->ur_next;
+	if (ring->ur_next != NULL)
+		ring->ur_next->ur_prev = ring->ur_prev;
+	stats_sum(&eng->ue_stats, &ring->ur_stats);
+	pthread_mutex_unlock(&eng->ue_lock);
+
+	ring_destroy(ring);
+}
+
+static int ring_create(struct uring_io_engine *eng,
+		       struct uring_io_ring **out)
+{
+	struct uring_io_ring *ring;
+	uint32_t i;
+	int rc;
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL)
+		return -ENOMEM;
+	ring->ur_eng = eng;
+
+	rc = io_uring_queue_init(eng->ue_depth, &ring->ur_ring, 0);
+	if (rc != 0)
+		goto free_ring;
+
+	if (eng->ue_nr_bufs != 0) {
+		rc = -posix_memalign((void **)&ring->ur_bufs, URING_IO_ALIGN,
+				     eng->ue_nr_bufs * eng->ue_buf_size);
+		if (rc != 0)
+			goto exit_ring;
+		ring->ur_iovs = calloc(eng->ue_nr_bufs, sizeof(*ring->ur_iovs));
+		ring->ur_free = calloc(eng->ue_nr_bufs, sizeof(*ring->ur_free));
+		if (ring->ur_iovs == NULL || ring->ur_free == NULL) {
+			rc = -ENOMEM;
+			goto free_bufs;
+		}
+		for (i = 0; i < eng->ue_nr_bufs; i++) {
+			ring->ur_iovs[i].iov_base = ring->ur_bufs +
+				i * eng->ue_buf_size;
+			ring->ur_iovs[i].iov_len = eng->ue_buf_size;
+			/* Lowest indexes first */
+			ring->ur_free[i] = eng->ue_nr_bufs - 1 - i;
+		}
+		ring->ur_nr_free = eng->ue_nr_bufs;
+
+		/* Without locked memory to pin them, the buffers are used
+		 * like any other.
+		 */
+		ring->ur_registered = io_uring_register_buffers(
+			&ring->ur_ring, ring->ur_iovs, eng->ue_nr_bufs) == 0;
+	}
+
+	rc = -pthread_setspecific(eng->ue_key, ring);
+	if (rc != 0)
+		goto free_bufs;
+
+	pthread_mutex_lock(&eng->ue_lock);
+	ring->ur_next = eng->ue_rings;
+	if (ring->ur_next != NULL)
+		ring->ur_next->ur_prev = &ring->ur_next;
+	ring->ur_prev = &eng->ue_rings;
+	eng->ue_rings = ring;
+	pthread_mutex_unlock(&eng->ue_lock);
+
+	*out = ring;
+	return 0;
+
+free_bufs:
+	free(ring->ur_free);
+	free(ring->ur_iovs);
+	free(ring->ur_bufs);
+exit_ring:
+	io_uring_queue_exit(&ring->ur_ring);
+free_ring:
+	free(ring);
+	return rc;
+}
+
+/**
+ * Ring of the calling thread, created by its first request.
+ */
+static int ring_get(struct uring_io_engine *eng, struct uring_io_ring **out)
+{
+	*out = pthread_getspecific(eng->ue_key);
+	if (*out != NULL)
+		return 0;
+	return ring_create(eng, out);
+}
+
+int uring_io_init(struct uring_io_engine *eng, uint32_t depth,
+		  uint32_t nr_bufs, size_t buf_size)
+{
+	int rc;
+
+	if (depth == 0 || (nr_bufs != 0 &&
+			   (buf_size == 0 || buf_size % URING_IO_ALIGN != 0)))
+		return -EINVAL;
+
+	memset(eng, 0, sizeof(*eng));
+	eng->ue_depth = depth;
+	eng->ue_nr_bufs = nr_bufs;
+	eng->ue_buf_size = buf_size;
+
+	rc = -pthread_key_create(&eng->ue_key, ring_release);
+	if (rc != 0)
+		return rc;
+
+	rc = -pthread_mutex_init(&eng->ue_lock, NULL);
+	if (rc != 0)
+		pthread_key_delete(eng->ue_key);
+	return rc;
+}
+
+void uring_io_fini(struct uring_io_engine *eng)
+{
+	struct uring_io_ring *ring;
+
+	/* No destructor runs for the threads still there */
+	pthread_key_delete(eng->ue_key);
+
+	while ((ring = eng->ue_rings) != NULL) {
+		eng->ue_rings = ring->ur_next;
+		stats_sum(&eng->ue_stats, &ring->ur_stats);
+		ring_destroy(ring);
+	}
+	pthread_mutex_destroy(&eng->ue_lock);
+}
+
+int uring_io_open(struct uring_io_file *file, const char *path, int flags,
+		  mode_t mode, bool direct)
+{
+	int rc;
+
+	file->uf_direct_fd = -1;
+	file->uf_fd = open(path, flags, mode);
+	if (file->uf_fd < 0)
+		return -errno;
+
+	if (!direct)
+		return 0;
+
+	/* The file exists now, only the access mode matters */
+	file->uf_direct_fd = open(path, (flags & O_ACCMODE) | O_DIRECT);
+	if (file->uf_direct_fd < 0) {
+		rc = -errno;
+		/* Not supported by the file system: buffered I/O only */
+		if (rc == -EINVAL)
+			return 0;
+		close(file->uf_fd);
+		file->uf_fd = -1;
+		return rc;
+	}
+	return 0;
+}
+
+void uring_io_close(struct uring_io_file *file)
+{
+	if (file->uf_direct_fd >= 0)
+		close(file->uf_direct_fd);
+	close(file->uf_fd);
+	file->uf_fd = -1;
+	file->uf_direct_fd = -1;
+}
+
+void *uring_io_buf_get(struct uring_io_engine *eng, int *index)
+{
+	struct uring_io_ring *ring;
+
+	if (ring_get(eng, &ring) != 0 || ring->ur_nr_free == 0)
+		return NULL;
+
+	*index = ring->ur_free[--ring->ur_nr_free];
+	return ring->ur_iovs[*index].iov_base;
+}
+
+void uring_io_buf_put(struct uring_io_engine *eng, int index)
+{
+	struct uring_io_ring *ring = pthread_getspecific(eng->ue_key);
+
+	ring->ur_free[ring->ur_nr_free++] = index;
+}
+
+static bool req_aligned(const struct uring_io_req *req)
+{
+	return ((uintptr_t)req->ur_buf | (uintptr_t)req->ur_off |
+		req->ur_count) % URING_IO_ALIGN == 0;
+}
+
+int uring_io_queue(struct uring_io_engine *eng, struct uring_io_req *req)
+{
+	struct uring_io_ring *ring;
+	struct io_uring_sqe *sqe;
+	struct iovec *iov;
+	bool fixed = false, direct = false;
+	int fd = req->ur_file->uf_fd;
+	int rc;
+
+	rc = ring_get(eng, &ring);
+	if (rc != 0)
+		return rc;
+
+	if (ring->ur_inflight >= eng->ue_depth)
+		return -EBUSY;
+
+	if (req->ur_buf_index >= 0) {
+		if ((uint32_t)req->ur_buf_index >= eng->ue_nr_bufs)
+			return -EINVAL;
+		iov = &ring->ur_iovs[req->ur_buf_index];
+		if ((char *)req->ur_buf < (char *)iov->iov_base ||
+		    (char *)req->ur_buf + req->ur_count >
+		    (char *)iov->iov_base + iov->iov_len)
+			return -EINVAL;
+		fixed = ring->ur_registered;
+	}
+
+	if (req->ur_file->uf_direct_fd >= 0 &&
+	    req->ur_count >= URING_IO_DIRECT_MIN && req_aligned(req)) {
+		fd = req->ur_file->uf_direct_fd;
+		direct = true;
+	}
+
+	sqe = io_uring_get_sqe(&ring->ur_ring);
+	if (sqe == NULL) {
+		/* The ring is full of queued requests, send them */
+		rc = uring_io_submit(eng);
+		if (rc != 0)
+			return rc;
+		sqe = io_uring_get_sqe(&ring->ur_ring);
+		if (sqe == NULL)
+			return -EBUSY;
+	}
+
+	if (fixed && req->ur_write)
+		io_uring_prep_write_fixed(sqe, fd, req->ur_buf, req->ur_count,
+					  req->ur_off, req->ur_buf_index);
+	else if (fixed)
+		io_uring_prep_read_fixed(sqe, fd, req->ur_buf, req->ur_count,
+					 req->ur_off, req->ur_buf_index);
+	else if (req->ur_write)
+		io_uring_prep_write(sqe, fd, req->ur_buf, req->ur_count,
+				    req->ur_off);
+	else
+		io_uring_prep_read(sqe, fd, req->ur_buf, req->ur_count,
+				   req->ur_off);
+	io_uring_sqe_set_data(sqe, req);
+
+	ring->ur_queued++;
+	ring->ur_inflight++;
+	stat_add(&ring->ur_stats.requests, 1);
+	if (fixed)
+		stat_add(&ring->ur_stats.fixed, 1);
+	if (direct)
+		stat_add(&ring->ur_stats.direct, 1);
+	return 0;
+}
+
+int uring_io_submit(struct uring_io_engine *eng)
+{
+	struct uring_io_ring *ring = pthread_getspecific(eng->ue_key);
+	int rc;
+
+	if (ring == NULL || ring->ur_queued == 0)
+		return 0;
+
+	do {
+		rc = io_uring_submit(&ring->ur_ring);
+	} while (rc == -EINTR);
+	if (rc < 0)
+		return rc;
+
+	stat_add(&ring->ur_stats.submits, 1);
+	ring->ur_queued -= rc;
+	return 0;
+}
+
+int uring_io_reap(struct uring_io_engine *eng, struct uring_io_req **done,
+		  uint32_t min, uint32_t max)
+{
+	struct uring_io_ring *ring = pthread_getspecific(eng->ue_key);
+	struct io_uring_cqe *cqe;
+	struct uring_io_req *req;
+	uint32_t n = 0;
+	int rc;
+
+	if (ring == NULL)
+		return 0;
+
+	for (;;) {
+		while (n < max && io_uring_peek_cqe(&ring->ur_ring, &cqe) == 0) {
+			req = io_uring_cqe_get_data(cqe);
+			req->ur_result = cqe->res;
+			io_uring_cqe_seen(&ring->ur_ring, cqe);
+			ring->ur_inflight--;
+			done[n++] = req;
+		}
+		if (n >= min || n >= max || ring->ur_inflight == 0)
+			break;
+
+		/* Submit and wait with one call */
+		rc = io_uring_submit_and_wait(&ring->ur_ring,
+					      min - n < ring->ur_inflight ?
+					      min - n : ring->ur_inflight);
+		if (rc == -EINTR)
+			continue;
+		if (rc < 0)
+			return n != 0 ? (int)n : rc;
+		stat_add(ring->ur_queued != 0 ? &ring->ur_stats.submits :
+			 &ring->ur_stats.waits, 1);
+		ring->ur_queued -= rc;
+	}
+
+	rc = uring_io_submit(eng);
+	return n != 0 || rc == 0 ? (int)n : rc;
+}
+
+static ssize_t uring_io_rw(struct uring_io_engine *eng,
+			   struct uring_io_file *file, void *buf, size_t count,
+			   off_t off, bool write)
+{
+	struct uring_io_ring *ring;
+	struct uring_io_req req = {
+		.ur_file = file,
+		.ur_write = write,
+		.ur_buf_index = -1,
+	};
+	struct uring_io_req *done;
+	size_t total = 0;
+	int rc;
+
+	rc = ring_get(eng, &ring);
+	if (rc != 0)
+		return rc;
+	if (ring->ur_inflight != 0)
+		return -EBUSY;
+
+	while (total < count) {
+		req.ur_buf = (char *)buf + total;
+		req.ur_count = count - total;
+		req.ur_off = off + total;
+		rc = uring_io_queue(eng, &req);
+		if (rc != 0)
+			return total != 0 ? (ssize_t)total : rc;
+		rc = uring_io_reap(eng, &done, 1, 1);
+		if (rc < 0) {
+			/* req must not be completed after we return */
+			ring_drain(ring);
+			return total != 0 ? (ssize_t)total : rc;
+		}
+		if (req.ur_result < 0)
+			return total != 0 ? (ssize_t)total : req.ur_result;
+		if (req.ur_result == 0)
+			break;
+		total += req.ur_result;
+	}
+	return total;
+}
+
+ssize_t uring_io_pread(struct uring_io_engine *eng, struct uring_io_file *file,
+		       void *buf, size_t count, off_t off)
+{
+	return uring_io_rw(eng, file, buf, count, off, false);
+}
+
+ssize_t uring_io_pwrite(struct uring_io_engine *eng,
+			struct uring_io_file *file, const void *buf,
+			size_t count, off_t off)
+{
+	return uring_io_rw(eng, file, (void *)buf, count, off, true);
+}
+
+void uring_io_stats_get(struct uring_io_engine *eng,
+			struct uring_io_stats *stats)
+{
+	struct uring_io_ring *ring;
+
+	pthread_mutex_lock(&eng->ue_lock);
+	*stats = eng->ue_stats;
+	for (ring = eng->ue_rings; ring != NULL; ring = ring->ur_next)
+		stats_sum(stats, &ring->ur_stats);
+	pthread_mutex_unlock(&eng->ue_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,166 @@
+/*
+ * Filename:         uring_io.h
+ * Description:      io_uring engine of the posix dstore
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* The posix dstore (build.sh -e posix) reads and writes every request with
+ * a synchronous pread()/pwrite(): one system call per request and one
+ * request in flight per thread.
+ *
+ * This engine sends them through io_uring (liburing) instead:
+ * - Every thread has a ring of its own, of depth entries, created by its
+ *   first request and released when it exits: no lock on the I/O path.
+ * - uring_io_queue() only fills a submission entry. The entries queued
+ *   are submitted together by uring_io_submit(), by uring_io_reap(), or
+ *   when the ring is full: one io_uring_enter() for a batch of requests.
+ * - uring_io_reap() collects completed requests, so a thread keeps up to
+ *   depth requests in flight. uring_io_pread()/uring_io_pwrite() are the
+ *   synchronous calls on top.
+ * - Every ring registers nr_bufs buffers of buf_size bytes, aligned on
+ *   URING_IO_ALIGN, with the kernel. Requests on them (uring_io_buf_get())
+ *   are READ_FIXED/WRITE_FIXED: no page pinning per request.
+ * - A file opened with direct also gets an O_DIRECT descriptor. Requests
+ *   of at least URING_IO_DIRECT_MIN bytes whose buffer, offset and size
+ *   are aligned on URING_IO_ALIGN go through it and bypass the page
+ *   cache. The others use the buffered descriptor, and so does every
+ *   request when the file system refuses O_DIRECT (tmpfs).
+ *
+ * A request may complete short: result is what read()/write() returns,
+ * or a negative errno.
+ */
+
+#ifndef _URING_IO_H
+#define _URING_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#define URING_IO_ALIGN 4096
+#define URING_IO_DIRECT_MIN (64 * 1024)
+
+struct uring_io_ring;
+
+struct uring_io_stats {
+	uint64_t requests;
+	/* io_uring_enter() calls submitting requests, and only waiting */
+	uint64_t submits;
+	uint64_t waits;
+	/* Requests on registered buffers, and through O_DIRECT */
+	uint64_t fixed;
+	uint64_t direct;
+};
+
+struct uring_io_engine {
+	uint32_t ue_depth;
+	size_t ue_buf_size;
+	uint32_t ue_nr_bufs;
+	/* Ring of the calling thread */
+	pthread_key_t ue_key;
+	pthread_mutex_t ue_lock;
+	/* Rings of all threads, and the counters of the released ones */
+	struct uring_io_ring *ue_rings;
+	struct uring_io_stats ue_stats;
+};
+
+struct uring_io_file {
+	int uf_fd;
+	/* -1 without O_DIRECT */
+	int uf_direct_fd;
+};
+
+struct uring_io_req {
+	struct uring_io_file *ur_file;
+	/* A registered buffer or any other one */
+	void *ur_buf;
+	size_t ur_count;
+	off_t ur_off;
+	bool ur_write;
+	/* Set on completion */
+	ssize_t ur_result;
+	/* Free for the caller */
+	void *ur_ctx;
+	/* Registered buffer index, -1 for another buffer */
+	int ur_buf_index;
+};
+
+/**
+ * Prepare an engine whose threads keep up to depth requests in flight,
+ * with nr_bufs registered buffers of buf_size bytes each.
+ */
+int uring_io_init(struct uring_io_engine *eng, uint32_t depth,
+		  uint32_t nr_bufs, size_t buf_size);
+
+/**
+ * Release the rings. Threads that used the engine must have exited or be
+ * done with it: their rings are released here.
+ */
+void uring_io_fini(struct uring_io_engine *eng);
+
+/**
+ * open() path, and with direct an O_DIRECT descriptor for aligned I/O.
+ */
+int uring_io_open(struct uring_io_file *file, const char *path, int flags,
+		  mode_t mode, bool direct);
+
+void uring_io_close(struct uring_io_file *file);
+
+/**
+ * A registered buffer of the ring of the calling thread, NULL when none is
+ * free. Requests of this thread on it use it as is. Its index is stored
+ * in *index, for ur_buf_index.
+ */
+void *uring_io_buf_get(struct uring_io_engine *eng, int *index);
+
+void uring_io_buf_put(struct uring_io_engine *eng, int index);
+
+/**
+ * Queue req in the ring of the calling thread. It is submitted with the
+ * next batch, reaped by the same thread. -EBUSY when depth requests are
+ * in flight: reap some first.
+ */
+int uring_io_queue(struct uring_io_engine *eng, struct uring_io_req *req);
+
+/**
+ * Submit the requests queued by the calling thread.
+ */
+int uring_io_submit(struct uring_io_engine *eng);
+
+/**
+ * Submit what is queued, wait until at least min requests of the calling
+ * thread completed and store up to max of them in done.
+ * Returns the number of requests stored.
+ */
+int uring_io_reap(struct uring_io_engine *eng, struct uring_io_req **done,
+		  uint32_t min, uint32_t max);
+
+/**
+ * Like pread()/pwrite(), through the ring of the calling thread, repeated
+ * until count bytes are transferred, the end of file or an error.
+ * -EBUSY when the thread has requests in flight.
+ */
+ssize_t uring_io_pread(struct uring_io_engine *eng, struct uring_io_file *file,
+		       void *buf, size_t count, off_t off);
+ssize_t uring_io_pwrite(struct uring_io_engine *eng,
+			struct uring_io_file *file, const void *buf,
+			size_t count, off_t off);
+
+void uring_io_stats_get(struct uring_io_engine *eng,
+			struct uring_io_stats *stats);
+
+#endif /* _URING_IO_H */
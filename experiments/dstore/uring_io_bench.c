@@ -0,0 +1,529 @@
+/*
+ * Filename:         uring_io_bench.c
+ * Description:      Throughput of sync and io_uring I/O at various depths
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment, the
+ * throughput mode of the posix dstore I/O:
+ * - Write a file of -f MiB through uring_io_pwrite()
+ * - -t threads each rewrite their part of it sequentially, then read it
+ *   back at random offsets, in -s bytes requests
+ *   a) with pread()/pwrite(), one request at a time
+ *   b) through uring_io.h with up to QD requests in flight per thread, for
+ *      every QD of -q, on registered buffers
+ * - With -d requests of at least URING_IO_DIRECT_MIN bytes bypass the page
+ *   cache (O_DIRECT) in both cases
+ * - Report the throughput and the system calls made per request, and check
+ *   the data read
+ *
+ * Build:
+ *   gcc -o uring_io_bench uring_io_bench.c uring_io.c -luring -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "uring_io.h"
+
+#define MiB (1024 * 1024)
+#define MAX_DEPTHS 8
+
+static struct {
+	size_t file_size;
+	size_t io_size;
+	uint32_t nr_threads;
+	uint32_t depths[MAX_DEPTHS];
+	uint32_t nr_depths;
+	bool direct;
+	const char *path;
+} conf = {
+	.file_size = 256 * MiB,
+	.io_size = 128 * 1024,
+	.nr_threads = 4,
+	.depths = { 1, 4, 16, 64 },
+	.nr_depths = 4,
+	.path = "/tmp/uring_io_bench.dat",
+};
+
+struct worker {
+	pthread_t thread;
+	struct uring_io_file *file;
+	/* NULL: pread()/pwrite() */
+	struct uring_io_engine *eng;
+	uint32_t depth;
+	bool write;
+	/* Part of the file of the worker, in requests */
+	off_t first;
+	uint32_t nr;
+	/* Written in every word with the offset of the word */
+	uint64_t seed;
+	int rc;
+};
+
+static long elapsed_us(const struct timeval *start, const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L +
+		end->tv_usec - start->tv_usec;
+}
+
+static void fill(char *buf, size_t len, off_t off, uint64_t seed)
+{
+	uint64_t *word = (uint64_t *)buf;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*word); i++)
+		word[i] = (off + i * sizeof(*word)) ^ seed;
+}
+
+/* Check one word in CHECK_STRIDE, so that the check does not dominate */
+#define CHECK_STRIDE 64
+
+static int check(const char *buf, size_t len, off_t off, uint64_t seed)
+{
+	const uint64_t *word = (const uint64_t *)buf;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*word); i += CHECK_STRIDE) {
+		if (word[i] != ((off + i * sizeof(*word)) ^ seed)) {
+			fprintf(stderr, "mismatch at %zu\n",
+				off + i * sizeof(*word));
+			return -EIO;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Offset of the i-th request of a worker: in order for writes, shuffled
+ * for reads.
+ */
+static off_t req_offset(const struct worker *w, const uint32_t *order,
+			uint32_t i)
+{
+	return (w->first + (w->write ? i : order[i])) * conf.io_size;
+}
+
+static uint32_t *order_make(struct worker *w)
+{
+	unsigned int seed = w->first;
+	uint32_t *order;
+	uint32_t i, j, tmp;
+
+	order = malloc(w->nr * sizeof(*order));
+	if (order == NULL)
+		return NULL;
+	for (i = 0; i < w->nr; i++)
+		order[i] = i;
+	for (i = w->nr; i > 1; i--) {
+		j = rand_r(&seed) % i;
+		tmp = order[i - 1];
+		order[i - 1] = order[j];
+		order[j] = tmp;
+	}
+	return order;
+}
+
+static int sync_run(struct worker *w, const uint32_t *order)
+{
+	struct uring_io_file *file = w->file;
+	char *buf;
+	off_t off;
+	ssize_t n;
+	uint32_t i;
+	int fd, rc = 0;
+
+	rc = -posix_memalign((void **)&buf, URING_IO_ALIGN, conf.io_size);
+	if (rc != 0)
+		return rc;
+
+	/* Same choice of descriptor as uring_io_queue() */
+	fd = file->uf_direct_fd >= 0 && conf.io_size >= URING_IO_DIRECT_MIN ?
+		file->uf_direct_fd : file->uf_fd;
+
+	for (i = 0; rc == 0 && i < w->nr; i++) {
+		off = req_offset(w, order, i);
+		if (w->write) {
+			fill(buf, conf.io_size, off, w->seed);
+			n = pwrite(fd, buf, conf.io_size, off);
+		} else {
+			n = pread(fd, buf, conf.io_size, off);
+		}
+		if (n < 0)
+			rc = -errno;
+		else if (n != (ssize_t)conf.io_size)
+			rc = -EIO;
+		else if (!w->write)
+			rc = check(buf, conf.io_size, off, w->seed);
+	}
+
+	free(buf);
+	return rc;
+}
+
+static int uring_run(struct worker *w, const uint32_t *order)
+{
+	struct uring_io_req *reqs, *req;
+	struct uring_io_req **done;
+	uint32_t issued = 0, completed = 0, i;
+	int rc = 0, nr;
+
+	reqs = calloc(w->depth, sizeof(*reqs));
+	done = calloc(w->depth, sizeof(*done));
+	if (reqs == NULL || done == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < w->depth; i++) {
+		req = &reqs[i];
+		req->ur_buf = uring_io_buf_get(w->eng, &req->ur_buf_index);
+		if (req->ur_buf == NULL) {
+			rc = -ENOMEM;
+			goto put_bufs;
+		}
+		req->ur_file = w->file;
+		req->ur_count = conf.io_size;
+		req->ur_write = w->write;
+	}
+
+	/* Keep depth requests in flight, every reap sends the new ones */
+	for (i = 0; i < w->depth && issued < w->nr; i++, issued++) {
+		req = &reqs[i];
+		req->ur_off = req_offset(w, order, issued);
+		if (w->write)
+			fill(req->ur_buf, conf.io_size, req->ur_off, w->seed);
+		rc = uring_io_queue(w->eng, req);
+		if (rc != 0)
+			goto drain;
+	}
+
+	while (completed < issued) {
+		nr = uring_io_reap(w->eng, done, 1, w->depth);
+		if (nr < 0) {
+			rc = nr;
+			goto put_bufs;
+		}
+		for (i = 0; i < (uint32_t)nr; i++) {
+			req = done[i];
+			completed++;
+			if (rc != 0)
+				continue;
+			if (req->ur_result < 0)
+				rc = req->ur_result;
+			else if (req->ur_result != (ssize_t)conf.io_size)
+				rc = -EIO;
+			else if (!w->write)
+				rc = check(req->ur_buf, conf.io_size,
+					   req->ur_off, w->seed);
+			if (rc != 0 || issued == w->nr)
+				continue;
+
+			req->ur_off = req_offset(w, order, issued);
+			if (w->write)
+				fill(req->ur_buf, conf.io_size, req->ur_off,
+				     w->seed);
+			rc = uring_io_queue(w->eng, req);
+			if (rc == 0)
+				issued++;
+		}
+	}
+	goto put_bufs;
+
+drain:
+	/* The buffers may not be reused before their requests complete */
+	while (completed < issued) {
+		nr = uring_io_reap(w->eng, done, 1, w->depth);
+		if (nr < 0)
+			break;
+		completed += nr;
+	}
+put_bufs:
+	for (i = 0; i < w->depth && reqs[i].ur_buf != NULL; i++)
+		uring_io_buf_put(w->eng, reqs[i].ur_buf_index);
+out:
+	free(done);
+	free(reqs);
+	return rc;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	uint32_t *order;
+
+	order = order_make(w);
+	if (order == NULL) {
+		w->rc = -ENOMEM;
+		return NULL;
+	}
+
+	w->rc = w->eng == NULL ? sync_run(w, order) : uring_run(w, order);
+
+	free(order);
+	return NULL;
+}
+
+/**
+ * One pass of all threads over the file, eng NULL for pread()/pwrite().
+ */
+static int pass_run(struct uring_io_file *file, struct uring_io_engine *eng,
+		    uint32_t depth, bool write, uint64_t seed, const char *msg)
+{
+	struct worker workers[conf.nr_threads];
+	struct uring_io_stats st = {};
+	struct timeval start, end;
+	uint32_t per_thread = conf.file_size / conf.io_size / conf.nr_threads;
+	uint32_t i, started;
+	long us;
+	int rc = 0;
+
+	gettimeofday(&start, NULL);
+	for (started = 0; started < conf.nr_threads; started++) {
+		workers[started] = (struct worker) {
+			.file = file,
+			.eng = eng,
+			.depth = depth,
+			.write = write,
+			.first = started * per_thread,
+			.nr = per_thread,
+			.seed = seed,
+		};
+		rc = -pthread_create(&workers[started].thread, NULL,
+				     worker_run, &workers[started]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (rc == 0)
+			rc = workers[i].rc;
+	}
+	gettimeofday(&end, NULL);
+	us = elapsed_us(&start, &end);
+
+	if (rc != 0) {
+		fprintf(stderr, "%s failed rc=%d\n", msg, rc);
+		return rc;
+	}
+
+	printf("%-22s %-5s %8.1f MB/s (%ld usecs)", msg,
+	       write ? "write" : "read",
+	       us > 0 ? (double)per_thread * conf.nr_threads *
+	       conf.io_size / us : 0.0, us);
+	if (eng != NULL) {
+		/* Every thread of the pass has exited, its ring is released */
+		uring_io_stats_get(eng, &st);
+		printf(" %.2f syscalls per request, fixed %lu direct %lu",
+		       st.requests != 0 ?
+		       (double)(st.submits + st.waits) / st.requests : 0.0,
+		       (unsigned long)st.fixed, (unsigned long)st.direct);
+	}
+	printf("\n");
+	return 0;
+}
+
+/**
+ * Rewrite then read the file, with pread()/pwrite() when depth is 0.
+ */
+static int mode_run(struct uring_io_file *file, uint32_t depth,
+		    uint64_t seed)
+{
+	struct uring_io_engine eng;
+	char msg[32];
+	int rc;
+
+	if (depth == 0) {
+		rc = pass_run(file, NULL, 0, true, seed, "sync");
+		if (rc == 0)
+			rc = pass_run(file, NULL, 0, false, seed, "sync");
+		return rc;
+	}
+
+	snprintf(msg, sizeof(msg), "io_uring QD %u", depth);
+
+	/* A pass of each kind, the counters are per engine */
+	rc = uring_io_init(&eng, depth, depth, conf.io_size);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): uring_io_init\n", rc);
+		return rc;
+	}
+	rc = pass_run(file, &eng, depth, true, seed, msg);
+	uring_io_fini(&eng);
+	if (rc != 0)
+		return rc;
+
+	rc = uring_io_init(&eng, depth, depth, conf.io_size);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): uring_io_init\n", rc);
+		return rc;
+	}
+	rc = pass_run(file, &eng, depth, false, seed, msg);
+	uring_io_fini(&eng);
+	return rc;
+}
+
+static int file_create(struct uring_io_file *file)
+{
+	struct uring_io_engine eng;
+	char *buf;
+	size_t done;
+	ssize_t n;
+	int rc;
+
+	rc = uring_io_open(file, conf.path, O_RDWR | O_CREAT | O_TRUNC, 0600,
+			   conf.direct);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): open %s\n", rc, conf.path);
+		return rc;
+	}
+	if (conf.direct && file->uf_direct_fd < 0)
+		printf("O_DIRECT not supported by %s, buffered I/O only\n",
+		       conf.path);
+
+	rc = -posix_memalign((void **)&buf, URING_IO_ALIGN, MiB);
+	if (rc != 0)
+		goto close_file;
+
+	/* Synchronous calls of the engine, from this thread */
+	rc = uring_io_init(&eng, 1, 0, 0);
+	if (rc != 0)
+		goto free_buf;
+
+	for (done = 0; done < conf.file_size; done += n) {
+		fill(buf, MiB, done, 0);
+		n = uring_io_pwrite(&eng, file, buf, MiB, done);
+		if (n != MiB) {
+			rc = n < 0 ? n : -EIO;
+			fprintf(stderr, "error(%d): uring_io_pwrite\n", rc);
+			break;
+		}
+	}
+
+	uring_io_fini(&eng);
+free_buf:
+	free(buf);
+close_file:
+	if (rc != 0)
+		uring_io_close(file);
+	return rc;
+}
+
+static int depths_parse(char *str)
+{
+	char *tok, *save;
+
+	conf.nr_depths = 0;
+	for (tok = strtok_r(str, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (conf.nr_depths == MAX_DEPTHS)
+			return -EINVAL;
+		conf.depths[conf.nr_depths] = strtoul(tok, NULL, 0);
+		if (conf.depths[conf.nr_depths] == 0)
+			return -EINVAL;
+		conf.nr_depths++;
+	}
+	return conf.nr_depths != 0 ? 0 : -EINVAL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f file MiB] [-s io size] [-t threads]"
+		" [-q depth,depth...] [-d] [-p path]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct uring_io_file file;
+	uint32_t i;
+	int rc, opt;
+
+	while ((opt = getopt(argc, argv, "f:s:t:q:dp:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			conf.file_size = strtoul(optarg, NULL, 0) * MiB;
+			break;
+		case 's':
+			conf.io_size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			conf.nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			if (depths_parse(optarg) != 0) {
+				usage(argv[0]);
+				return -EINVAL;
+			}
+			break;
+		case 'd':
+			conf.direct = true;
+			break;
+		case 'p':
+			conf.path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	/* Registered buffers are multiples of URING_IO_ALIGN */
+	if (conf.io_size == 0 || conf.io_size % URING_IO_ALIGN != 0 ||
+	    conf.nr_threads == 0 ||
+	    conf.file_size % (conf.io_size * conf.nr_threads) != 0) {
+		fprintf(stderr, "the io size must be a multiple of %u and the"
+			" file size of io size x threads\n", URING_IO_ALIGN);
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	rc = file_create(&file);
+	if (rc != 0)
+		return rc;
+
+	printf("file %zu MiB, io %zu, %u threads%s\n", conf.file_size / MiB,
+	       conf.io_size, conf.nr_threads,
+	       file.uf_direct_fd >= 0 && conf.io_size >= URING_IO_DIRECT_MIN ?
+	       ", O_DIRECT" : "");
+
+	/* A new pattern every mode, so that reads check its own writes */
+	rc = mode_run(&file, 0, 1);
+	for (i = 0; rc == 0 && i < conf.nr_depths; i++)
+		rc = mode_run(&file, conf.depths[i], i + 2);
+
+	uring_io_close(&file);
+	unlink(conf.path);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
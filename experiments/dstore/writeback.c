@@ -0,0 +1,515 @@
+/*
+ * Filename:         writeback.c
+ * Description:      Write-back coalescing of small writes
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "writeback.h"
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static off_t unit_floor(struct writeback_engine *eng, off_t off)
+{
+	return off - off % eng->we_unit_size;
+}
+
+static off_t unit_ceil(struct writeback_engine *eng, off_t off)
+{
+	return unit_floor(eng, off + eng->we_unit_size - 1);
+}
+
+static size_t buf_size(struct writeback_engine *eng)
+{
+	return eng->we_unit_size * eng->we_nr_units;
+}
+
+/* All the helpers below are called with wf_lock held */
+
+/**
+ * Set the dirty range of the file and account for it.
+ */
+static void dirty_set(struct writeback_file *file, off_t lo, off_t hi)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	size_t old = file->wf_dirty_hi - file->wf_dirty_lo;
+
+	file->wf_dirty_lo = lo;
+	file->wf_dirty_hi = hi;
+
+	pthread_mutex_lock(&eng->we_lock);
+	eng->we_dirty += (hi - lo) - old;
+	if (hi == lo)
+		file->wf_dirty_since = 0;
+	else if (old == 0)
+		file->wf_dirty_since = now_ns();
+	pthread_mutex_unlock(&eng->we_lock);
+}
+
+static void buf_reset(struct writeback_file *file)
+{
+	dirty_set(file, 0, 0);
+	file->wf_lo = file->wf_hi = file->wf_filled = 0;
+}
+
+/**
+ * Read [from, to) of the file into the buffer, zeroes past its end.
+ */
+static int buf_fill(struct writeback_file *file, off_t from, off_t to)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	char *buf = file->wf_buf + (from - file->wf_base);
+	ssize_t n;
+
+	n = eng->we_ops->read(file->wf_backend_file, buf, to - from, from);
+	if (n < 0)
+		return n;
+	memset(buf + n, 0, to - from - n);
+	return 0;
+}
+
+/**
+ * Read [from, to) of the file into the buffer, except [wf_lo, wf_hi).
+ */
+static int buf_fill_around(struct writeback_file *file, off_t from, off_t to)
+{
+	size_t len = file->wf_hi - file->wf_lo;
+	char *data = file->wf_buf + (file->wf_lo - file->wf_base);
+	char *save;
+	int rc;
+
+	save = malloc(len);
+	if (save == NULL)
+		return -ENOMEM;
+
+	memcpy(save, data, len);
+	rc = buf_fill(file, from, to);
+	memcpy(data, save, len);
+
+	free(save);
+	return rc;
+}
+
+/**
+ * Write the dirty units of the buffer, or only those fully written so far
+ * unless all is set. The buffer is emptied when that fails.
+ */
+static int buf_flush(struct writeback_file *file, bool all)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	uint32_t rmw_reads = 0;
+	off_t first, end, from;
+	ssize_t n;
+	int rc = 0;
+
+	if (file->wf_dirty_lo == file->wf_dirty_hi)
+		return 0;
+
+	first = unit_floor(eng, file->wf_dirty_lo);
+	end = all ? unit_ceil(eng, file->wf_dirty_hi) :
+		unit_floor(eng, file->wf_dirty_hi);
+	if (end <= first)
+		return 0;
+
+	/* Complete the partial units with what the backend holds, in one
+	 * read when both ends need it, as a single small write does.
+	 */
+	from = file->wf_filled > file->wf_hi ? file->wf_filled : file->wf_hi;
+	if (first < file->wf_lo && end > from) {
+		rc = buf_fill_around(file, first, end);
+		if (rc != 0)
+			goto out;
+		file->wf_lo = first;
+		file->wf_filled = from = end;
+		rmw_reads++;
+	}
+
+	if (first < file->wf_lo) {
+		rc = buf_fill(file, first, file->wf_lo);
+		if (rc != 0)
+			goto out;
+		file->wf_lo = first;
+		rmw_reads++;
+	}
+
+	if (end > from) {
+		rc = buf_fill(file, from, end);
+		if (rc != 0)
+			goto out;
+		file->wf_filled = end;
+		rmw_reads++;
+	}
+
+	n = eng->we_ops->write(file->wf_backend_file,
+			       file->wf_buf + (first - file->wf_base),
+			       end - first, first);
+	if (n < 0)
+		rc = n;
+	else if (n != end - first)
+		rc = -EIO;
+
+out:
+	pthread_mutex_lock(&eng->we_lock);
+	eng->we_stats.rmw_reads += rmw_reads;
+	if (rc == 0)
+		eng->we_stats.unit_writes += (end - first) / eng->we_unit_size;
+	else
+		eng->we_stats.errors++;
+	pthread_mutex_unlock(&eng->we_lock);
+
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): writeback flush at %jd\n", rc,
+			(intmax_t)first);
+		buf_reset(file);
+	} else if (end >= file->wf_dirty_hi) {
+		dirty_set(file, 0, 0);
+	} else {
+		dirty_set(file, end, file->wf_dirty_hi);
+	}
+
+	return rc;
+}
+
+/**
+ * Drop the units before the first one still dirty or partially written,
+ * to make room for the writes that follow.
+ */
+static void buf_compact(struct writeback_file *file)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	off_t base, end;
+
+	if (file->wf_dirty_lo != file->wf_dirty_hi)
+		base = unit_floor(eng, file->wf_dirty_lo);
+	else
+		base = unit_floor(eng, file->wf_hi);
+	if (base == file->wf_base)
+		return;
+
+	end = file->wf_filled > file->wf_hi ? file->wf_filled : file->wf_hi;
+	if (end > base)
+		memmove(file->wf_buf, file->wf_buf + (base - file->wf_base),
+			end - base);
+
+	file->wf_base = base;
+	if (file->wf_lo < base)
+		file->wf_lo = base;
+}
+
+static void *flusher(void *arg)
+{
+	struct writeback_engine *eng = arg;
+	struct writeback_file *file;
+	struct timespec ts;
+	uint64_t now, age = eng->we_flush_ms * 1000000ULL;
+	int rc;
+
+	pthread_mutex_lock(&eng->we_lock);
+	while (!eng->we_stop) {
+		/* Wake up twice per flush period */
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += age / 2;
+		ts.tv_sec += ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+		pthread_cond_timedwait(&eng->we_cond, &eng->we_lock, &ts);
+
+		now = now_ns();
+		for (file = eng->we_files; file != NULL && !eng->we_stop;) {
+			if (file->wf_dirty_since == 0 || file->wf_busy ||
+			    now - file->wf_dirty_since < age) {
+				file = file->wf_next;
+				continue;
+			}
+
+			file->wf_busy = true;
+			pthread_mutex_unlock(&eng->we_lock);
+
+			pthread_mutex_lock(&file->wf_lock);
+			rc = buf_flush(file, true);
+			if (rc != 0 && file->wf_error == 0)
+				file->wf_error = rc;
+			pthread_mutex_unlock(&file->wf_lock);
+
+			pthread_mutex_lock(&eng->we_lock);
+			file->wf_busy = false;
+			eng->we_stats.timer_flushes++;
+			pthread_cond_broadcast(&eng->we_idle_cond);
+			/* The list may have changed meanwhile */
+			file = eng->we_files;
+		}
+	}
+	pthread_mutex_unlock(&eng->we_lock);
+
+	return NULL;
+}
+
+int writeback_init(struct writeback_engine *eng,
+		   const struct writeback_ops *ops, size_t unit_size,
+		   uint32_t nr_units, size_t max_dirty, uint32_t flush_ms)
+{
+	int rc;
+
+	if (unit_size == 0 || nr_units == 0 || flush_ms == 0)
+		return -EINVAL;
+
+	memset(eng, 0, sizeof(*eng));
+	eng->we_ops = ops;
+	eng->we_unit_size = unit_size;
+	eng->we_nr_units = nr_units;
+	eng->we_max_dirty = max_dirty;
+	eng->we_flush_ms = flush_ms;
+
+	pthread_mutex_init(&eng->we_lock, NULL);
+	pthread_cond_init(&eng->we_cond, NULL);
+	pthread_cond_init(&eng->we_idle_cond, NULL);
+
+	rc = -pthread_create(&eng->we_flusher, NULL, flusher, eng);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): pthread_create\n", rc);
+		pthread_cond_destroy(&eng->we_idle_cond);
+		pthread_cond_destroy(&eng->we_cond);
+		pthread_mutex_destroy(&eng->we_lock);
+	}
+
+	return rc;
+}
+
+void writeback_fini(struct writeback_engine *eng)
+{
+	pthread_mutex_lock(&eng->we_lock);
+	eng->we_stop = true;
+	pthread_cond_signal(&eng->we_cond);
+	pthread_mutex_unlock(&eng->we_lock);
+
+	pthread_join(eng->we_flusher, NULL);
+
+	pthread_cond_destroy(&eng->we_idle_cond);
+	pthread_cond_destroy(&eng->we_cond);
+	pthread_mutex_destroy(&eng->we_lock);
+}
+
+void writeback_open(struct writeback_engine *eng, struct writeback_file *file,
+		    void *backend_file)
+{
+	memset(file, 0, sizeof(*file));
+	file->wf_engine = eng;
+	file->wf_backend_file = backend_file;
+	pthread_mutex_init(&file->wf_lock, NULL);
+
+	pthread_mutex_lock(&eng->we_lock);
+	file->wf_next = eng->we_files;
+	eng->we_files = file;
+	pthread_mutex_unlock(&eng->we_lock);
+}
+
+int writeback_close(struct writeback_file *file)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	struct writeback_file **pf;
+	int rc;
+
+	pthread_mutex_lock(&eng->we_lock);
+	while (file->wf_busy)
+		pthread_cond_wait(&eng->we_idle_cond, &eng->we_lock);
+	for (pf = &eng->we_files; *pf != file; pf = &(*pf)->wf_next)
+		;
+	*pf = file->wf_next;
+	eng->we_stats.sync_flushes++;
+	pthread_mutex_unlock(&eng->we_lock);
+
+	pthread_mutex_lock(&file->wf_lock);
+	rc = buf_flush(file, true);
+	if (file->wf_error != 0)
+		rc = file->wf_error;
+	free(file->wf_buf);
+	file->wf_buf = NULL;
+	pthread_mutex_unlock(&file->wf_lock);
+
+	pthread_mutex_destroy(&file->wf_lock);
+	return rc;
+}
+
+static void stats_count(struct writeback_engine *eng, uint64_t *counter)
+{
+	pthread_mutex_lock(&eng->we_lock);
+	(*counter)++;
+	pthread_mutex_unlock(&eng->we_lock);
+}
+
+ssize_t writeback_write(struct writeback_file *file, const void *buf,
+			size_t count, off_t off, bool stable)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	off_t size = buf_size(eng);
+	size_t done = 0, n;
+	off_t o, end, lo, hi;
+	bool pressure;
+	int rc = 0;
+
+	pthread_mutex_lock(&file->wf_lock);
+	if (file->wf_buf == NULL) {
+		file->wf_buf = malloc(buf_size(eng));
+		if (file->wf_buf == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+	}
+
+	while (done < count) {
+		o = off + done;
+
+		/* Only writes contiguous with the buffer are coalesced */
+		if (file->wf_lo != file->wf_hi &&
+		    (o < file->wf_lo || o > file->wf_hi)) {
+			stats_count(eng, &eng->we_stats.sync_flushes);
+			rc = buf_flush(file, true);
+			buf_reset(file);
+			if (rc != 0)
+				goto out;
+		}
+
+		if (file->wf_lo == file->wf_hi) {
+			file->wf_base = unit_floor(eng, o);
+			file->wf_lo = file->wf_hi = file->wf_filled = o;
+		}
+
+		if (o >= file->wf_base + size) {
+			stats_count(eng, &eng->we_stats.full_flushes);
+			rc = buf_flush(file, false);
+			if (rc != 0)
+				goto out;
+			buf_compact(file);
+			/* Partial units everywhere, write them all */
+			if (o >= file->wf_base + size) {
+				rc = buf_flush(file, true);
+				buf_reset(file);
+				if (rc != 0)
+					goto out;
+			}
+			continue;
+		}
+
+		n = file->wf_base + size - o;
+		if (n > count - done)
+			n = count - done;
+		memcpy(file->wf_buf + (o - file->wf_base),
+		       (const char *)buf + done, n);
+
+		end = o + n;
+		lo = file->wf_dirty_lo;
+		hi = file->wf_dirty_hi;
+		if (lo == hi || o < lo)
+			lo = o;
+		if (lo == hi || end > hi)
+			hi = end;
+		dirty_set(file, lo, hi);
+		if (file->wf_hi < end)
+			file->wf_hi = end;
+		done += n;
+	}
+
+	pthread_mutex_lock(&eng->we_lock);
+	eng->we_stats.writes++;
+	eng->we_stats.bytes += count;
+	pressure = eng->we_dirty > eng->we_max_dirty;
+	if (stable)
+		eng->we_stats.sync_flushes++;
+	else if (pressure)
+		eng->we_stats.pressure_flushes++;
+	pthread_mutex_unlock(&eng->we_lock);
+
+	if (stable || pressure)
+		rc = buf_flush(file, true);
+
+out:
+	pthread_mutex_unlock(&file->wf_lock);
+	return rc != 0 ? rc : (ssize_t)count;
+}
+
+ssize_t writeback_read(struct writeback_file *file, void *buf, size_t count,
+		       off_t off)
+{
+	struct writeback_engine *eng = file->wf_engine;
+	off_t end = off + count;
+	off_t lo, hi;
+	ssize_t n;
+
+	pthread_mutex_lock(&file->wf_lock);
+	n = eng->we_ops->read(file->wf_backend_file, buf, count, off);
+	if (n < 0)
+		goto out;
+
+	/* The buffer is more recent than the backend */
+	lo = file->wf_lo > off ? file->wf_lo : off;
+	hi = file->wf_hi < end ? file->wf_hi : end;
+	if (lo < hi) {
+		if (off + n < lo)
+			memset((char *)buf + n, 0, lo - off - n);
+		memcpy((char *)buf + (lo - off),
+		       file->wf_buf + (lo - file->wf_base), hi - lo);
+		if (off + n < hi)
+			n = hi - off;
+	}
+
+out:
+	pthread_mutex_unlock(&file->wf_lock);
+	return n;
+}
+
+int writeback_commit(struct writeback_file *file)
+{
+	int rc;
+
+	stats_count(file->wf_engine, &file->wf_engine->we_stats.sync_flushes);
+
+	pthread_mutex_lock(&file->wf_lock);
+	rc = buf_flush(file, true);
+	if (file->wf_error != 0) {
+		rc = file->wf_error;
+		file->wf_error = 0;
+	}
+	pthread_mutex_unlock(&file->wf_lock);
+
+	return rc;
+}
+
+void writeback_stats_get(struct writeback_engine *eng,
+			 struct writeback_stats *stats)
+{
+	pthread_mutex_lock(&eng->we_lock);
+	*stats = eng->we_stats;
+	pthread_mutex_unlock(&eng->we_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,162 @@
+/*
+ * Filename:         writeback.h
+ * Description:      Write-back coalescing of small writes
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Write-back buffering of small writes, in front of a backend that stores
+ * whole units (DSAL's object writes, pwrite() in writeback_bench.c).
+ *
+ * - Writing part of a unit to the backend costs a read-modify-write of the
+ *   unit. Every open file therefore has a buffer of nr_units units where
+ *   contiguous writes accumulate, and only full units are written while
+ *   the writes keep coming (log appends, sequential copies).
+ * - The dirty part of the buffer is written, partial units included, by
+ *   writeback_commit() (NFS COMMIT), a stable write (FILE_SYNC/DATA_SYNC),
+ *   writeback_close(), a write that is not contiguous with the buffer, and
+ *   by the flusher thread once it has been dirty for flush_ms.
+ * - When the dirty bytes of all files exceed max_dirty, the writer flushes
+ *   its own file before returning.
+ * - Unstable writes are lost if the server crashes before they are
+ *   flushed, as NFS allows until COMMIT returns. A failure to flush in the
+ *   background is kept and returned by the next commit or close, so that
+ *   the client resends its writes.
+ *
+ * writeback_read() returns the buffered data over what the backend holds.
+ * Calls on a file are serialized by its lock, files are independent.
+ */
+
+#ifndef _WRITEBACK_H
+#define _WRITEBACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+struct writeback_ops {
+	/* Like pread(), short at the end of the object */
+	ssize_t (*read)(void *file, void *buf, size_t count, off_t off);
+	/* Write whole units: off and count are multiples of the unit size */
+	ssize_t (*write)(void *file, const void *buf, size_t count,
+			 off_t off);
+};
+
+struct writeback_stats {
+	uint64_t writes;
+	uint64_t bytes;
+	/* Units written to the backend */
+	uint64_t unit_writes;
+	/* Backend reads to complete partially written units */
+	uint64_t rmw_reads;
+	/* Flushes by cause, sync: commit, stable write, close or a write
+	 * elsewhere than the end of the buffer
+	 */
+	uint64_t full_flushes;
+	uint64_t sync_flushes;
+	uint64_t timer_flushes;
+	uint64_t pressure_flushes;
+	uint64_t errors;
+};
+
+struct writeback_file;
+
+struct writeback_engine {
+	const struct writeback_ops *we_ops;
+	size_t we_unit_size;
+	uint32_t we_nr_units;
+	size_t we_max_dirty;
+	uint32_t we_flush_ms;
+	pthread_mutex_t we_lock;
+	/* Signaled when the flusher must stop */
+	pthread_cond_t we_cond;
+	/* Broadcast when the flusher is done with a file */
+	pthread_cond_t we_idle_cond;
+	pthread_t we_flusher;
+	bool we_stop;
+	/* Open files and their dirty bytes */
+	struct writeback_file *we_files;
+	size_t we_dirty;
+	struct writeback_stats we_stats;
+};
+
+struct writeback_file {
+	struct writeback_engine *wf_engine;
+	void *wf_backend_file;
+	pthread_mutex_t wf_lock;
+	/* nr_units units mirroring the file from wf_base, allocated by the
+	 * first write.
+	 */
+	char *wf_buf;
+	off_t wf_base;
+	/* Data of the file held by the buffer, empty when lo == hi */
+	off_t wf_lo;
+	off_t wf_hi;
+	/* Bytes after wf_hi read from the backend by the last flush */
+	off_t wf_filled;
+	/* Part not written to the backend yet, empty when lo == hi */
+	off_t wf_dirty_lo;
+	off_t wf_dirty_hi;
+	/* When the buffer became dirty, in CLOCK_MONOTONIC nanoseconds */
+	uint64_t wf_dirty_since;
+	/* First error of a background flush, not reported yet */
+	int wf_error;
+	/* Held by the flusher, protected by we_lock */
+	bool wf_busy;
+	struct writeback_file *wf_next;
+};
+
+/**
+ * Start the flusher of an engine buffering nr_units units of unit_size
+ * bytes per file, and at most max_dirty dirty bytes overall.
+ */
+int writeback_init(struct writeback_engine *eng,
+		   const struct writeback_ops *ops, size_t unit_size,
+		   uint32_t nr_units, size_t max_dirty, uint32_t flush_ms);
+
+/**
+ * Stop the flusher, all files must have been closed.
+ */
+void writeback_fini(struct writeback_engine *eng);
+
+void writeback_open(struct writeback_engine *eng, struct writeback_file *file,
+		    void *backend_file);
+
+/**
+ * Flush the file and forget it. Returns the first error not reported yet.
+ */
+int writeback_close(struct writeback_file *file);
+
+/**
+ * Buffer a write, written through before returning when stable is set.
+ * Returns count, or the error of a flush that it required.
+ */
+ssize_t writeback_write(struct writeback_file *file, const void *buf,
+			size_t count, off_t off, bool stable);
+
+ssize_t writeback_read(struct writeback_file *file, void *buf, size_t count,
+		       off_t off);
+
+/**
+ * Write the dirty data of the file (NFS COMMIT).
+ * Returns the first error not reported yet.
+ */
+int writeback_commit(struct writeback_file *file);
+
+void writeback_stats_get(struct writeback_engine *eng,
+			 struct writeback_stats *stats);
+
+#endif /* _WRITEBACK_H */
@@ -0,0 +1,394 @@
+/*
+ * Filename:         writeback_bench.c
+ * Description:      Benchmark of the write-back coalescing of small writes
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Append -f MiB to a file in -s bytes unstable writes, with a COMMIT
+ *   every -c MiB, the way NFS clients write logs
+ * - Backend: whole-unit pwrite()/pread() taking -l usecs each, like a
+ *   round trip to the object store would
+ * - Direct: every write is a read-modify-write of the units it touches
+ * - Write-back: the writes go through writeback.h
+ * - Then overwrite random -s bytes blocks with stable writes through
+ *   writeback.h, which must cost no more than the direct path
+ * - The content of the file is checked after every run
+ *
+ * Build:
+ *   gcc -o writeback_bench writeback_bench.c writeback.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "writeback.h"
+
+#define MiB (1024 * 1024)
+#define RANDOM_WRITES 256
+
+static struct {
+	size_t file_size;
+	size_t unit_size;
+	size_t io_size;
+	size_t commit_size;
+	uint32_t latency_us;
+	uint32_t nr_units;
+	const char *path;
+} conf = {
+	.file_size = 64 * MiB,
+	.unit_size = MiB,
+	.io_size = 4096,
+	.commit_size = 8 * MiB,
+	.latency_us = 500,
+	.nr_units = 4,
+	.path = "/tmp/writeback_bench.dat",
+};
+
+struct bench_file {
+	int fd;
+	/* Backend calls, to count round trips */
+	unsigned long reads;
+	unsigned long writes;
+};
+
+static ssize_t backend_read(void *file, void *buf, size_t count, off_t off)
+{
+	struct bench_file *bf = file;
+	ssize_t rc;
+
+	if (conf.latency_us != 0)
+		usleep(conf.latency_us);
+
+	__atomic_add_fetch(&bf->reads, 1, __ATOMIC_RELAXED);
+	rc = pread(bf->fd, buf, count, off);
+	return rc < 0 ? -errno : rc;
+}
+
+static ssize_t backend_write(void *file, const void *buf, size_t count,
+			     off_t off)
+{
+	struct bench_file *bf = file;
+	ssize_t rc;
+
+	if (off % conf.unit_size != 0 || count % conf.unit_size != 0) {
+		fprintf(stderr, "unaligned backend write %zu at %jd\n", count,
+			(intmax_t)off);
+		return -EINVAL;
+	}
+
+	if (conf.latency_us != 0)
+		usleep(conf.latency_us);
+
+	__atomic_add_fetch(&bf->writes, 1, __ATOMIC_RELAXED);
+	rc = pwrite(bf->fd, buf, count, off);
+	return rc < 0 ? -errno : rc;
+}
+
+static const struct writeback_ops bench_ops = {
+	.read = backend_read,
+	.write = backend_write,
+};
+
+static long elapsed_us(const struct timeval *start, const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L +
+		end->tv_usec - start->tv_usec;
+}
+
+static char pattern(off_t off)
+{
+	return (char)(off % 251);
+}
+
+static void fill(char *buf, size_t len, off_t off)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = pattern(off + i);
+}
+
+/* Read-modify-write of the units touched by the write */
+static int direct_write(struct bench_file *bf, char *unit, const char *buf,
+			size_t count, off_t off)
+{
+	off_t first = off - off % conf.unit_size;
+	size_t len = off + count - first;
+	ssize_t n;
+
+	len += (conf.unit_size - len % conf.unit_size) % conf.unit_size;
+	n = backend_read(bf, unit, len, first);
+	if (n < 0)
+		return n;
+	memset(unit + n, 0, len - n);
+	memcpy(unit + (off - first), buf, count);
+
+	n = backend_write(bf, unit, len, first);
+	return n < 0 ? n : 0;
+}
+
+static int bench_open(struct bench_file *bf)
+{
+	memset(bf, 0, sizeof(*bf));
+	bf->fd = open(conf.path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (bf->fd < 0) {
+		fprintf(stderr, "error(%d): open %s\n", -errno, conf.path);
+		return -errno;
+	}
+	return 0;
+}
+
+/* Check that the first len bytes of the file are the pattern */
+static int verify(struct bench_file *bf, size_t len)
+{
+	char *buf;
+	size_t off, i;
+	ssize_t n = 0;
+	int rc = 0;
+
+	buf = malloc(MiB);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	for (off = 0; off < len && rc == 0; off += n) {
+		n = pread(bf->fd, buf, MiB, off);
+		if (n <= 0) {
+			rc = -EIO;
+			break;
+		}
+		for (i = 0; i < (size_t)n && off + i < len; i++) {
+			if (buf[i] != pattern(off + i)) {
+				fprintf(stderr, "mismatch at %zu\n", off + i);
+				rc = -EIO;
+				break;
+			}
+		}
+	}
+
+	free(buf);
+	return rc;
+}
+
+static void report(const char *msg, struct bench_file *bf, size_t bytes,
+		   long us)
+{
+	printf("%-24s %8.1f MB/s (%ld usecs) backend reads %lu writes %lu\n",
+	       msg, us > 0 ? (double)bytes / us : 0.0, us, bf->reads,
+	       bf->writes);
+}
+
+static int run_direct(char *buf, char *unit)
+{
+	struct bench_file bf;
+	struct timeval start, end;
+	size_t off;
+	int rc;
+
+	rc = bench_open(&bf);
+	if (rc != 0)
+		return rc;
+
+	gettimeofday(&start, NULL);
+	for (off = 0; off < conf.file_size && rc == 0; off += conf.io_size) {
+		fill(buf, conf.io_size, off);
+		rc = direct_write(&bf, unit, buf, conf.io_size, off);
+	}
+	gettimeofday(&end, NULL);
+
+	if (rc == 0)
+		rc = verify(&bf, conf.file_size);
+	if (rc == 0)
+		report("append, direct", &bf, conf.file_size,
+		       elapsed_us(&start, &end));
+	close(bf.fd);
+	return rc;
+}
+
+static int run_writeback(struct writeback_engine *eng, char *buf)
+{
+	struct writeback_file file;
+	struct bench_file bf;
+	struct timeval start, end;
+	size_t off;
+	ssize_t n = 0;
+	int rc, rc2, i;
+
+	rc = bench_open(&bf);
+	if (rc != 0)
+		return rc;
+
+	writeback_open(eng, &file, &bf);
+
+	gettimeofday(&start, NULL);
+	for (off = 0; off < conf.file_size && rc == 0; off += conf.io_size) {
+		fill(buf, conf.io_size, off);
+		n = writeback_write(&file, buf, conf.io_size, off, false);
+		if (n < 0)
+			rc = n;
+		else if ((off + conf.io_size) % conf.commit_size == 0)
+			rc = writeback_commit(&file);
+	}
+	if (rc == 0)
+		rc = writeback_commit(&file);
+	gettimeofday(&end, NULL);
+
+	if (rc == 0) {
+		rc = verify(&bf, conf.file_size);
+		report("append, write-back", &bf, conf.file_size,
+		       elapsed_us(&start, &end));
+	}
+
+	/* Stable overwrites, read back through the buffer */
+	bf.reads = bf.writes = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < RANDOM_WRITES && rc == 0; i++) {
+		off = (size_t)(rand() % (conf.file_size / conf.io_size)) *
+			conf.io_size;
+		fill(buf, conf.io_size, off);
+		n = writeback_write(&file, buf, conf.io_size, off, true);
+		if (n < 0)
+			rc = n;
+	}
+	gettimeofday(&end, NULL);
+
+	if (rc == 0) {
+		n = writeback_read(&file, buf, conf.io_size, off);
+		if (n != (ssize_t)conf.io_size || buf[0] != pattern(off))
+			rc = -EIO;
+	}
+
+	rc2 = writeback_close(&file);
+	if (rc == 0)
+		rc = rc2;
+	if (rc == 0)
+		rc = verify(&bf, conf.file_size);
+	if (rc == 0)
+		report("random stable writes", &bf,
+		       RANDOM_WRITES * conf.io_size, elapsed_us(&start, &end));
+	close(bf.fd);
+	return rc;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f file MiB] [-u unit size] [-s io size]"
+		" [-c commit MiB] [-l backend latency usecs]"
+		" [-n buffered units] [-p path]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct writeback_engine eng;
+	struct writeback_stats st;
+	char *buf, *unit;
+	int rc, opt;
+
+	while ((opt = getopt(argc, argv, "f:u:s:c:l:n:p:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			conf.file_size = strtoul(optarg, NULL, 0) * MiB;
+			break;
+		case 'u':
+			conf.unit_size = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			conf.io_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			conf.commit_size = strtoul(optarg, NULL, 0) * MiB;
+			break;
+		case 'l':
+			conf.latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			conf.nr_units = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			conf.path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (conf.file_size == 0 || conf.io_size == 0 || conf.unit_size == 0 ||
+	    conf.commit_size == 0 || conf.file_size % conf.io_size != 0) {
+		fprintf(stderr, "the file size must be a multiple of the io"
+			" size\n");
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	buf = malloc(conf.io_size);
+	/* Room for the units touched by one direct write */
+	unit = malloc(conf.io_size + 2 * conf.unit_size);
+	if (buf == NULL || unit == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	printf("file %zu MiB, unit %zu, io %zu, commit every %zu MiB,"
+	       " latency %u usecs\n", conf.file_size / MiB, conf.unit_size,
+	       conf.io_size, conf.commit_size / MiB, conf.latency_us);
+
+	rc = run_direct(buf, unit);
+	if (rc != 0)
+		goto out;
+
+	rc = writeback_init(&eng, &bench_ops, conf.unit_size, conf.nr_units,
+			    64 * conf.unit_size, 100);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): writeback_init\n", rc);
+		goto out;
+	}
+
+	rc = run_writeback(&eng, buf);
+
+	writeback_stats_get(&eng, &st);
+	printf("writes %lu bytes %lu unit_writes %lu rmw_reads %lu"
+	       " flushes full %lu sync %lu timer %lu pressure %lu errors %lu\n",
+	       (unsigned long)st.writes, (unsigned long)st.bytes,
+	       (unsigned long)st.unit_writes, (unsigned long)st.rmw_reads,
+	       (unsigned long)st.full_flushes, (unsigned long)st.sync_flushes,
+	       (unsigned long)st.timer_flushes,
+	       (unsigned long)st.pressure_flushes, (unsigned long)st.errors);
+
+	writeback_fini(&eng);
+out:
+	if (rc != 0)
+		fprintf(stderr, "error(%d)\n", rc);
+	unlink(conf.path);
+	free(unit);
+	free(buf);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
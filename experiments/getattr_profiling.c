@@ -20,10 +20,17 @@
 /* This file has the implementation for the following experiment.
  * - set and get attributes for NUM_FILES
  * - Calculate time taken to get attributes for NUM_FILES
+ * - With --cached, getattr is served by an attribute cache populated on
+ *   create and setattr with the attributes read back from the KV store
+ *   (cache/attr_cache.c), and the time taken without the cache is
+ *   reported as well
+ *
+ * Usage: getattr_profiling [--cached]
  */
 
 #include "ut_cortxfs_helper.h"
 #include <sys/time.h>
+#include "cache/attr_cache.h"
 #define NUM_FILES 10
 #define MAX_FILENAME_LENGTH 10
 #define DIR_ENV_FROM_STATE(__state) (*((struct ut_dir_env **)__state))
@@ -34,6 +41,109 @@ struct ut_dir_env{
 	cfs_ino_t *file_inode;
 };
 
+#define ATTR_CACHE_SHARDS 16
+#define ATTR_CACHE_SIZE 4096
+#define ATTR_CACHE_TTL_US 30000000
+
+/* NULL unless --cached */
+static struct attr_cache *attr_cache;
+
+/**
+ * Read the attributes of the inode back from the KV store into the cache,
+ * gen as for attr_cache_put().
+ */
+static void attr_fill(struct ut_cfs_params *ut_cfs_objs, uint64_t gen)
+{
+	struct stat st;
+
+	if (cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
+			&ut_cfs_objs->file_inode, &st) == 0)
+		attr_cache_put(attr_cache, ut_cfs_objs->file_inode, &st, 0,
+			       gen);
+}
+
+/**
+ * cfs_setattr(), then the attributes it stored are read back into the
+ * cache: they are not patched here, the ctime set by cfs_setattr() is not
+ * known.
+ */
+static int attr_setattr(struct ut_cfs_params *ut_cfs_objs,
+			struct stat *stat_in, int flag)
+{
+	int rc;
+
+	rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
+			 &ut_cfs_objs->file_inode, stat_in, flag);
+	if (attr_cache == NULL)
+		return rc;
+
+	/* After the store, even on failure: the outcome may be unknown */
+	attr_cache_invalidate(attr_cache, ut_cfs_objs->file_inode);
+	if (rc != 0)
+		return rc;
+
+	/* A later setattr bumps it, its own read back wins */
+	attr_fill(ut_cfs_objs,
+		  attr_cache_gen(attr_cache, ut_cfs_objs->file_inode));
+	return rc;
+}
+
+/**
+ * cfs_getattr(), served by the attribute cache when possible.
+ */
+static int attr_getattr(struct ut_cfs_params *ut_cfs_objs,
+			struct stat *stat_out)
+{
+	uint64_t gen = 0;
+	int rc;
+
+	if (attr_cache != NULL) {
+		if (attr_cache_get(attr_cache, ut_cfs_objs->file_inode,
+				   stat_out) == 0)
+			return 0;
+		/* Before the getattr, a setattr made meanwhile bumps it */
+		gen = attr_cache_gen(attr_cache, ut_cfs_objs->file_inode);
+	}
+
+	rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
+			 &ut_cfs_objs->file_inode, stat_out);
+	if (rc == 0 && attr_cache != NULL)
+		attr_cache_put(attr_cache, ut_cfs_objs->file_inode, stat_out,
+			       0, gen);
+	return rc;
+}
+
+/**
+ * Print the time taken by a getattr loop. With the cache, time the same
+ * loop straight from the KV store for comparison.
+ */
+static void getattr_report(struct ut_dir_env *ut_dir_obj, const char *msg,
+			   int elapsed)
+{
+	struct ut_cfs_params *ut_cfs_objs = &ut_dir_obj->ut_cfs_objs;
+	struct stat stat_out;
+	struct timeval st, et;
+	int rc, i, uncached;
+
+	if (attr_cache == NULL) {
+		printf("%s:Get Attribute took %d usecs\n", msg, elapsed);
+		return;
+	}
+
+	gettimeofday(&st, NULL);
+	for (i = 0; i < NUM_FILES; i++) {
+		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
+				 &ut_dir_obj->file_inode[i], &stat_out);
+		ut_assert_int_equal(rc, 0);
+	}
+	gettimeofday(&et, NULL);
+	uncached = ((et.tv_sec - st.tv_sec) * 1000000) +
+		(et.tv_usec - st.tv_usec);
+
+	printf("%s:Get Attribute took %d usecs cached, %d usecs uncached\n",
+	       msg, elapsed, uncached);
+}
+
 /**
  * Test to set creation time
  * Description: Set creation time for file.
@@ -74,8 +184,7 @@ static void set_ctime(void **state)
 
 		stat_in.st_ctim.tv_sec = new_ctime;
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_in, flag);
+		rc = attr_setattr(ut_cfs_objs, &stat_in, flag);
 		ut_assert_int_equal(rc, 0);
 	}
 
@@ -87,15 +196,14 @@ static void set_ctime(void **state)
 	{
 		memset(&stat_out, 0, sizeof(stat_out));
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_out);
+		rc = attr_getattr(ut_cfs_objs, &stat_out);
 		ut_assert_int_equal(rc, 0);
 
 		ut_assert_int_equal(0, difftime(new_ctime, stat_out.st_ctime));
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_ctime:get attribute took %d seconds\n", elapsed);
+	getattr_report(ut_dir_obj, "set_ctime", elapsed);
 
 	time(&end_time);
 	printf("set_ctime:End time %s\n",ctime(&end_time));	
@@ -145,8 +253,7 @@ static void set_mtime(void **state)
 
 		time(&cur_time[i]);
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				 &ut_cfs_objs->file_inode, &stat_in, flag);
+		rc = attr_setattr(ut_cfs_objs, &stat_in, flag);
 
 		ut_assert_int_equal(rc, 0);
 	}
@@ -158,8 +265,7 @@ static void set_mtime(void **state)
 	{
 		memset(&stat_out, 0, sizeof(stat_out));
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				 &ut_cfs_objs->file_inode, &stat_out);
+		rc = attr_getattr(ut_cfs_objs, &stat_out);
 
 		ut_assert_int_equal(rc, 0);
 		ut_assert_int_equal(0, difftime(new_mtime, stat_out.st_mtime));
@@ -171,7 +277,7 @@ static void set_mtime(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_mtime:Get Attribute took %d seconds\n", elapsed);
+	getattr_report(ut_dir_obj, "set_mtime", elapsed);
 
 	time(&end_time);
 	printf("set_mtime:End time %s\n",ctime(&end_time));	
@@ -218,8 +324,7 @@ static void set_atime(void **state)
 		time(&cur_time[i]);
 
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				 &ut_cfs_objs->file_inode, &stat_in, flag);
+		rc = attr_setattr(ut_cfs_objs, &stat_in, flag);
 		ut_assert_int_equal(rc, 0);
 	}
 	time(&set_time);
@@ -230,8 +335,7 @@ static void set_atime(void **state)
 	{
 		memset(&stat_out, 0, sizeof(stat_out));
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_out);
+		rc = attr_getattr(ut_cfs_objs, &stat_out);
 		ut_assert_int_equal(rc, 0);
 		ut_assert_int_equal(0, difftime(new_atime, stat_out.st_atime));
 
@@ -242,7 +346,7 @@ static void set_atime(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_atime:Get Attribute took %d seconds\n", elapsed);
+	getattr_report(ut_dir_obj, "set_atime", elapsed);
 
 	time(&end_time);
 	printf("set_atime:End time %s\n",ctime(&end_time));	
@@ -284,8 +388,7 @@ static void set_gid(void **state)
 		time(&cur_time);
 
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_in, flag);
+		rc = attr_setattr(ut_cfs_objs, &stat_in, flag);
 
 		ut_assert_int_equal(rc, 0);
 	}
@@ -296,8 +399,7 @@ static void set_gid(void **state)
 	for (i=0;i<NUM_FILES;i++)
 	{
 		memset(&stat_out, 0, sizeof(stat_out));
-		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_out);
+		rc = attr_getattr(ut_cfs_objs, &stat_out);
 
 		ut_assert_int_equal(rc, 0);
 
@@ -310,7 +412,7 @@ static void set_gid(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_gid:Get Attribute took %d seconds\n", elapsed);
+	getattr_report(ut_dir_obj, "set_gid", elapsed);
 
 	time(&end_time);
 	printf("set_gid:End time %s\n",ctime(&end_time));	
@@ -350,8 +452,7 @@ static void set_uid(void **state)
 		time(&cur_time[i]);
 
 		ut_cfs_objs->file_inode=ut_dir_obj->file_inode[i];
-		rc = cfs_setattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_in, flag);
+		rc = attr_setattr(ut_cfs_objs, &stat_in, flag);
 		ut_assert_int_equal(rc, 0);
 	}
 	time(&set_time);
@@ -361,8 +462,7 @@ static void set_uid(void **state)
 	for (i=0;i<NUM_FILES;i++)
 	{
 		memset(&stat_out, 0, sizeof(stat_out));
-		rc = cfs_getattr(ut_cfs_objs->cfs_fs, &ut_cfs_objs->cred,
-				&ut_cfs_objs->file_inode, &stat_out);
+		rc = attr_getattr(ut_cfs_objs, &stat_out);
 
 		ut_assert_int_equal(rc, 0);
 
@@ -373,7 +473,7 @@ static void set_uid(void **state)
 	}
 	gettimeofday(&et,NULL);
 	int elapsed = ((et.tv_sec - st.tv_sec)*1000000)+(et.tv_usec-st.tv_usec);
-	printf("set_uid:Get Attribute took %d seconds\n", elapsed);
+	getattr_report(ut_dir_obj, "set_uid", elapsed);
 
 	time(&end_time);
 	printf("set_uid:End time %s\n",ctime(&end_time));	
@@ -421,6 +521,10 @@ static int attr_test_setup(void **state)
 
 		ut_dir_obj->file_inode[i] = ut_dir_obj->ut_cfs_objs.file_inode;
 		ut_assert_int_equal(rc, 0);
+
+		/* Nobody else knows the new inode yet */
+		if (attr_cache != NULL)
+			attr_fill(&ut_dir_obj->ut_cfs_objs, CACHE_GEN_ANY);
 	}
 	return rc;
 }
@@ -438,6 +542,9 @@ static int attr_test_teardown(void **state)
 		ut_dir_obj->ut_cfs_objs.file_name=ut_dir_obj->name_list[i];
 		rc = ut_file_delete(state);
 		ut_assert_int_equal(rc, 0);
+		if (attr_cache != NULL)
+			attr_cache_invalidate(attr_cache,
+					      ut_dir_obj->file_inode[i]);
 	}
 
 	rc = ut_cfs_fs_teardown(state);
@@ -454,10 +561,26 @@ static int attr_test_teardown(void **state)
 	return rc;
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
 	int rc = 0;
 	char *test_log = "/var/log/cortx/test/ut/ut_cortxfs.log";
+	static struct attr_cache cache;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "--cached") != 0)) {
+		fprintf(stderr, "Usage: %s [--cached]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	if (argc == 2) {
+		rc = attr_cache_init(&cache, ATTR_CACHE_SHARDS,
+				     ATTR_CACHE_SIZE, ATTR_CACHE_TTL_US);
+		if (rc != 0) {
+			printf("attr_cache_init: err = %d\n", rc);
+			return rc;
+		}
+		attr_cache = &cache;
+	}
 
 	printf("Attribute Tests\n");
 
@@ -493,9 +616,14 @@ int main(void)
 
 	ut_summary(test_count, test_failed);
 
+	if (attr_cache != NULL)
+		attr_cache_stats_print(attr_cache, "attribute cache");
+
 out:
 	free(test_log);
 
 end:
+	if (attr_cache != NULL)
+		attr_cache_fini(attr_cache);
 	return rc;
 }
@@ -0,0 +1,561 @@
+/*
+ * Filename:         bulk_create.c
+ * Description:      Bulk file create and unlink
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Create NUM_FILES files in a directory and remove them
+ *   a) one at a time, like create_files_setup() and
+ *      create_files_teardown() in experiments/readdir_profiling.c: every
+ *      file costs a lookup, a dentry PUT/DEL, a stat PUT/DEL and a
+ *      read-modify-write of the parent stat record
+ *   b) with create_many()/unlink_many(), which look BULK_BATCH names up
+ *      with one multi-key GET, write all their dentry and stat records
+ *      with one multi-key PUT/DEL and update the parent once per call
+ * - Calculate time taken and round trips of both
+ *
+ * Usage: bulk_create [number of files]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <time.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+
+#define NUM_FILES 1000
+/* Names handled per GET and PUT/DEL of create_many()/unlink_many() */
+#define BULK_BATCH 100
+#define DIR_INO 0x4000ULL
+#define FIRST_INO 0x40000ULL
+
+static int round_trips;
+static cfs_ino_t next_ino = FIRST_INO;
+
+static int kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+		  struct m0_bufvec *vals, int *rcs, uint32_t flags)
+{
+	round_trips++;
+	return md_kvs_op(opcode, keys, vals, rcs, flags);
+}
+
+static void stat_init(struct stat *st, cfs_ino_t ino, mode_t mode)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = mode;
+	st->st_nlink = S_ISDIR(mode) ? 2 : 1;
+	clock_gettime(CLOCK_REALTIME, &st->st_atim);
+	st->st_mtim = st->st_ctim = st->st_atim;
+}
+
+/**
+ * Store (M0_IC_PUT) or remove (M0_IC_DEL) the stat record of ino alone.
+ */
+static int stat_write(enum m0_idx_opcode opcode, const struct stat *st)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct md_stat_key skey;
+	void *kbuf = &skey, *vbuf = (void *)st;
+	m0_bcount_t klen = sizeof(skey), vlen = sizeof(*st);
+
+	MD_STAT_KEY_INIT(&skey, st->st_ino);
+	kvs_vec_wrap(&key, &kbuf, &klen, 1);
+	kvs_vec_wrap(&val, &vbuf, &vlen, 1);
+
+	return kvs_op(opcode, &key, opcode == M0_IC_PUT ? &val : NULL, NULL,
+		      M0_OIF_OVERWRITE);
+}
+
+/**
+ * Update mtime and ctime of directory dir: one GET and one PUT.
+ */
+static int parent_touch(cfs_ino_t dir)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct stat st;
+	int rc;
+
+	rc = m0_bufvec_alloc(&key, 1, sizeof(struct md_stat_key));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc != 0) {
+		m0_bufvec_free(&key);
+		return rc;
+	}
+
+	MD_STAT_KEY_INIT((struct md_stat_key *)key.ov_buf[0], dir);
+
+	rc = kvs_op(M0_IC_GET, &key, &val, NULL, 0);
+	if (rc == 0 && val.ov_vec.v_count[0] != sizeof(st))
+		rc = -EINVAL;
+	if (rc != 0)
+		goto out;
+
+	memcpy(&st, val.ov_buf[0], sizeof(st));
+	clock_gettime(CLOCK_REALTIME, &st.st_mtim);
+	st.st_ctim = st.st_mtim;
+	rc = stat_write(M0_IC_PUT, &st);
+
+out:
+	m0_bufvec_free(&key);
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+/**
+ * Look nr names of dir up with one GET.
+ * rcs[i] is 0 and inos[i] set when names[i] exists, -ENOENT otherwise.
+ */
+static int dentries_get(cfs_ino_t dir, char **names, int nr, cfs_ino_t *inos,
+			int *rcs)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	size_t len;
+	int rc, i;
+
+	rc = m0_bufvec_alloc(&key, nr, sizeof(struct md_dentry_key));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, nr);
+	if (rc != 0) {
+		m0_bufvec_free(&key);
+		return rc;
+	}
+
+	for (i = 0; i < nr; i++) {
+		len = strlen(names[i]);
+		MD_DENTRY_KEY_INIT((struct md_dentry_key *)key.ov_buf[i], dir,
+				   names[i], len);
+		key.ov_vec.v_count[i] = MD_DENTRY_KEY_LEN(len);
+	}
+
+	rc = kvs_op(M0_IC_GET, &key, &val, rcs, 0);
+	for (i = 0; rc == 0 && i < nr; i++) {
+		if (rcs[i] != 0)
+			continue;
+		if (val.ov_vec.v_count[i] != sizeof(cfs_ino_t))
+			rcs[i] = -EINVAL;
+		else
+			memcpy(&inos[i], val.ov_buf[i], sizeof(cfs_ino_t));
+	}
+
+	m0_bufvec_free(&key);
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+/**
+ * Store or remove the dentry and stat records of files names[sel[i]] of
+ * dir, i < nr, with a single operation.
+ */
+static int records_write(enum m0_idx_opcode opcode, cfs_ino_t dir,
+			 char **names, const cfs_ino_t *inos, const int *sel,
+			 int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	size_t len;
+	int rc, i;
+
+	rc = m0_bufvec_alloc(&key, 2 * nr, sizeof(struct md_dentry_key));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_alloc(&val, 2 * nr, sizeof(struct stat));
+	if (rc != 0) {
+		m0_bufvec_free(&key);
+		return rc;
+	}
+
+	for (i = 0; i < nr; i++) {
+		len = strlen(names[sel[i]]);
+		MD_DENTRY_KEY_INIT((struct md_dentry_key *)key.ov_buf[2 * i],
+				   dir, names[sel[i]], len);
+		key.ov_vec.v_count[2 * i] = MD_DENTRY_KEY_LEN(len);
+		memcpy(val.ov_buf[2 * i], &inos[sel[i]], sizeof(cfs_ino_t));
+		val.ov_vec.v_count[2 * i] = sizeof(cfs_ino_t);
+
+		MD_STAT_KEY_INIT((struct md_stat_key *)key.ov_buf[2 * i + 1],
+				 inos[sel[i]]);
+		key.ov_vec.v_count[2 * i + 1] = sizeof(struct md_stat_key);
+		stat_init(val.ov_buf[2 * i + 1], inos[sel[i]], S_IFREG | 0644);
+	}
+
+	rc = kvs_op(opcode, &key, opcode == M0_IC_PUT ? &val : NULL, NULL,
+		    M0_OIF_OVERWRITE);
+
+	m0_bufvec_free(&key);
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+/**
+ * Whether name is one of names[sel[i]], i < nr.
+ */
+static bool name_selected(char **names, const int *sel, int nr,
+			  const char *name)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (strcmp(names[sel[i]], name) == 0)
+			return true;
+	return false;
+}
+
+/**
+ * Create nr files in dir. rcs[i] is 0 and inos[i] the new inode when
+ * names[i] was created, -EEXIST when it already existed or appears
+ * earlier in names.
+ * The parent is updated once, whatever nr is.
+ */
+static int create_many(cfs_ino_t dir, char **names, int nr, cfs_ino_t *inos,
+		       int *rcs)
+{
+	int sel[BULK_BATCH];
+	int rc = 0, i, n, cnt, done, created = 0;
+
+	for (done = 0; rc == 0 && done < nr; done += cnt) {
+		cnt = nr - done < BULK_BATCH ? nr - done : BULK_BATCH;
+
+		rc = dentries_get(dir, names + done, cnt, inos + done,
+				  rcs + done);
+		if (rc != 0)
+			break;
+
+		for (i = done, n = 0; i < done + cnt; i++) {
+			/*
+			 * A duplicate in an earlier batch was created, the GET
+			 * found it; one in this batch gets no inode
+			 */
+			if (rcs[i] == 0 ||
+			    (rcs[i] == -ENOENT &&
+			     name_selected(names, sel, n, names[i]))) {
+				rcs[i] = -EEXIST;
+			} else if (rcs[i] == -ENOENT) {
+				rcs[i] = 0;
+				inos[i] = next_ino++;
+				sel[n++] = i;
+			}
+		}
+		if (n == 0)
+			continue;
+
+		rc = records_write(M0_IC_PUT, dir, names, inos, sel, n);
+		if (rc != 0) {
+			for (i = 0; i < n; i++)
+				rcs[sel[i]] = rc;
+			break;
+		}
+		created += n;
+	}
+
+	if (created != 0 && parent_touch(dir) != 0 && rc == 0)
+		rc = -EIO;
+	return rc;
+}
+
+/**
+ * Remove nr files of dir. rcs[i] is -ENOENT when names[i] did not exist or
+ * appears earlier in names.
+ * The parent is updated once, whatever nr is.
+ */
+static int unlink_many(cfs_ino_t dir, char **names, int nr, int *rcs)
+{
+	cfs_ino_t inos[BULK_BATCH];
+	int sel[BULK_BATCH];
+	int rc = 0, i, n, cnt, done, removed = 0;
+
+	for (done = 0; rc == 0 && done < nr; done += cnt) {
+		cnt = nr - done < BULK_BATCH ? nr - done : BULK_BATCH;
+
+		rc = dentries_get(dir, names + done, cnt, inos, rcs + done);
+		if (rc != 0)
+			break;
+
+		for (i = 0, n = 0; i < cnt; i++) {
+			if (rcs[done + i] != 0)
+				continue;
+			if (name_selected(names + done, sel, n,
+					  names[done + i]))
+				rcs[done + i] = -ENOENT;
+			else
+				sel[n++] = i;
+		}
+		if (n == 0)
+			continue;
+
+		rc = records_write(M0_IC_DEL, dir, names + done, inos, sel, n);
+		if (rc != 0) {
+			for (i = 0; i < n; i++)
+				rcs[done + sel[i]] = rc;
+			break;
+		}
+		removed += n;
+	}
+
+	if (removed != 0 && parent_touch(dir) != 0 && rc == 0)
+		rc = -EIO;
+	return rc;
+}
+
+/**
+ * One file at a time, each with its own parent update.
+ */
+static int create_one(cfs_ino_t dir, char *name, cfs_ino_t *ino)
+{
+	int sel = 0;
+	int rc, found;
+
+	rc = dentries_get(dir, &name, 1, ino, &found);
+	if (rc == 0 && found != -ENOENT)
+		rc = found == 0 ? -EEXIST : found;
+	if (rc != 0)
+		return rc;
+
+	*ino = next_ino++;
+	rc = records_write(M0_IC_PUT, dir, &name, ino, &sel, 1);
+	if (rc == 0)
+		rc = parent_touch(dir);
+	return rc;
+}
+
+static int unlink_one(cfs_ino_t dir, char *name)
+{
+	cfs_ino_t ino;
+	int sel = 0;
+	int rc, found;
+
+	rc = dentries_get(dir, &name, 1, &ino, &found);
+	if (rc == 0)
+		rc = found;
+	if (rc != 0)
+		return rc;
+
+	rc = records_write(M0_IC_DEL, dir, &name, &ino, &sel, 1);
+	if (rc == 0)
+		rc = parent_touch(dir);
+	return rc;
+}
+
+static void report(const char *msg, int nr, struct timeval *start1)
+{
+	struct timeval end1;
+
+	gettimeofday(&end1, NULL);
+	printf("%s: %d files in %ld usecs, %d round trips\n", msg, nr,
+	       md_kvs_elapsed_us(start1, &end1), round_trips);
+}
+
+static int first_error(const int *rcs, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (rcs[i] != 0)
+			return rcs[i];
+	return 0;
+}
+
+static int bulk_compare(int nr)
+{
+	struct timeval start1;
+	struct stat dir_st;
+	char **names;
+	cfs_ino_t *inos;
+	int *rcs;
+	int rc, i;
+
+	names = calloc(nr, sizeof(char *));
+	inos = calloc(nr, sizeof(cfs_ino_t));
+	rcs = calloc(nr, sizeof(int));
+	if (names == NULL || inos == NULL || rcs == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		names[i] = malloc(NAME_MAX + 1);
+		if (names[i] == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+		snprintf(names[i], NAME_MAX + 1, "file%d", i);
+	}
+
+	stat_init(&dir_st, DIR_INO, S_IFDIR | 0755);
+	rc = stat_write(M0_IC_PUT, &dir_st);
+	if (rc != 0)
+		goto out;
+
+	round_trips = 0;
+	gettimeofday(&start1, NULL);
+	for (i = 0; rc == 0 && i < nr; i++)
+		rc = create_one(DIR_INO, names[i], &inos[i]);
+	if (rc != 0) {
+		fprintf(stderr, "create_one failed rc=%d\n", rc);
+		goto cleanup;
+	}
+	report("create one at a time", nr, &start1);
+
+	round_trips = 0;
+	gettimeofday(&start1, NULL);
+	for (i = 0; rc == 0 && i < nr; i++)
+		rc = unlink_one(DIR_INO, names[i]);
+	if (rc != 0) {
+		fprintf(stderr, "unlink_one failed rc=%d\n", rc);
+		goto cleanup;
+	}
+	report("unlink one at a time", nr, &start1);
+
+	round_trips = 0;
+	gettimeofday(&start1, NULL);
+	rc = create_many(DIR_INO, names, nr, inos, rcs);
+	if (rc == 0)
+		rc = first_error(rcs, nr);
+	if (rc != 0) {
+		fprintf(stderr, "create_many failed rc=%d\n", rc);
+		goto cleanup;
+	}
+	report("create_many", nr, &start1);
+
+	/* Every name exists now */
+	rc = create_many(DIR_INO, names, nr, inos, rcs);
+	for (i = 0; rc == 0 && i < nr; i++)
+		if (rcs[i] != -EEXIST)
+			rc = -EINVAL;
+	if (rc != 0) {
+		fprintf(stderr, "create_many of existing names rc=%d\n", rc);
+		goto cleanup;
+	}
+
+	round_trips = 0;
+	gettimeofday(&start1, NULL);
+	rc = unlink_many(DIR_INO, names, nr, rcs);
+	if (rc == 0)
+		rc = first_error(rcs, nr);
+	if (rc != 0) {
+		fprintf(stderr, "unlink_many failed rc=%d\n", rc);
+		goto cleanup;
+	}
+	report("unlink_many", nr, &start1);
+
+cleanup:
+	/* Leftovers of a failed step */
+	if (rc != 0)
+		unlink_many(DIR_INO, names, nr, rcs);
+	if (stat_write(M0_IC_DEL, &dir_st) != 0)
+		fprintf(stderr, "failed to remove directory stat record\n");
+out:
+	for (i = 0; names != NULL && i < nr; i++)
+		free(names[i]);
+	free(names);
+	free(inos);
+	free(rcs);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int nr = NUM_FILES;
+	int rc;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [number of files]\n", basename(argv[0]));
+		return -1;
+	}
+
+	if (argc > 1)
+		nr = atoi(argv[1]);
+	if (nr <= 0) {
+		fprintf(stderr, "invalid number of files\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = bulk_compare(nr);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,485 @@
+/*
+ * Filename:         dentry_shard.c
+ * Description:      Hash-sharded directory entries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include "dentry_shard.h"
+
+/* Entries moved per PUT/DEL pair by dshard_reshard() */
+#define RESHARD_BATCH 64
+
+/* Key of the shard count of a directory, absent for one shard */
+struct dshard_meta_key {
+	cfs_ino_t ino;
+	char type;
+} __attribute((packed));
+
+static struct dshard_stats dshard_stats;
+
+static void stats_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+uint64_t dshard_hash(const char *name, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	/* FNV-1a, then the murmur3 finalizer to spread it over all bits */
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	/* Cookies are 63 bits, the same for every number of shards */
+	h >>= 1;
+	return h < DSHARD_COOKIE_MIN ? h + DSHARD_COOKIE_MIN : h;
+}
+
+static uint32_t shard_of(uint64_t hash, uint32_t nr_shards)
+{
+	return hash % nr_shards;
+}
+
+/**
+ * Encode the key of name in shard, return its length.
+ */
+static size_t key_init(struct md_hdentry_key *key, cfs_ino_t pino,
+		       uint32_t shard, uint64_t hash, const char *name,
+		       size_t len)
+{
+	key->pino = pino;
+	key->type = MD_KEY_TYPE_HDIRENT;
+	key->shard = htobe16(shard);
+	key->hash = htobe64(hash);
+	memcpy(key->name, name, len);
+	return MD_HDENTRY_KEY_LEN(len);
+}
+
+static int meta_op(enum m0_idx_opcode opcode, cfs_ino_t ino,
+		   uint32_t *nr_shards)
+{
+	struct dshard_meta_key key = { .ino = ino,
+				       .type = MD_KEY_TYPE_DIR_SHARDS };
+	struct m0_bufvec keys, vals;
+	void *kbuf = &key, *vbuf = nr_shards;
+	m0_bcount_t klen = sizeof(key), vlen = sizeof(*nr_shards);
+	int rc;
+
+	kvs_vec_wrap(&keys, &kbuf, &klen, 1);
+	/* GET hands out a value allocated by the store */
+	if (opcode == M0_IC_GET)
+		kvs_vec_borrow(&vals, &vbuf, &vlen, 1);
+	else
+		kvs_vec_wrap(&vals, &vbuf, &vlen, 1);
+	rc = md_kvs_op(opcode, &keys, opcode == M0_IC_DEL ? NULL : &vals,
+		       NULL, M0_OIF_OVERWRITE);
+	if (opcode == M0_IC_GET) {
+		if (rc == 0 && vlen != sizeof(*nr_shards))
+			rc = -EINVAL;
+		if (rc == 0)
+			memcpy(nr_shards, vbuf, sizeof(*nr_shards));
+		kvs_vec_release(&vals);
+	}
+	return rc;
+}
+
+int dshard_open(struct dshard_dir *dir, cfs_ino_t ino, uint64_t threshold,
+		uint32_t nr_shards)
+{
+	uint32_t stored = 1;
+	int rc;
+
+	if (nr_shards == 0 || nr_shards > DSHARD_MAX)
+		return -EINVAL;
+
+	rc = meta_op(M0_IC_GET, ino, &stored);
+	if (rc == -ENOENT)
+		rc = 0;
+	else if (rc == 0 && (stored == 0 || stored > DSHARD_MAX))
+		rc = -EINVAL;
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): shards of %llu\n", rc, ino);
+		return rc;
+	}
+
+	memset(dir, 0, sizeof(*dir));
+	dir->ds_ino = ino;
+	dir->ds_nr_shards = stored;
+	dir->ds_threshold = threshold;
+	dir->ds_target_shards = nr_shards;
+	pthread_rwlock_init(&dir->ds_lock, NULL);
+	return 0;
+}
+
+void dshard_close(struct dshard_dir *dir)
+{
+	pthread_rwlock_destroy(&dir->ds_lock);
+}
+
+/**
+ * Execute opcode on the entry name, with the value ino.
+ */
+static int entry_op(struct dshard_dir *dir, enum m0_idx_opcode opcode,
+		    const char *name, cfs_ino_t *ino, uint32_t flags)
+{
+	struct md_hdentry_key key;
+	struct m0_bufvec keys, vals;
+	void *kbuf = &key, *vbuf = ino;
+	m0_bcount_t klen, vlen = sizeof(*ino);
+	size_t len = strlen(name);
+	uint64_t hash;
+	int rc;
+
+	if (len == 0 || len > NAME_MAX)
+		return -EINVAL;
+
+	hash = dshard_hash(name, len);
+
+	pthread_rwlock_rdlock(&dir->ds_lock);
+	klen = key_init(&key, dir->ds_ino, shard_of(hash, dir->ds_nr_shards),
+			hash, name, len);
+	kvs_vec_wrap(&keys, &kbuf, &klen, 1);
+	if (opcode == M0_IC_GET)
+		kvs_vec_borrow(&vals, &vbuf, &vlen, 1);
+	else
+		kvs_vec_wrap(&vals, &vbuf, &vlen, 1);
+	rc = md_kvs_op(opcode, &keys, opcode == M0_IC_DEL ? NULL : &vals,
+		       NULL, flags);
+	pthread_rwlock_unlock(&dir->ds_lock);
+
+	if (opcode == M0_IC_GET) {
+		if (rc == 0 && vlen != sizeof(*ino))
+			rc = -EINVAL;
+		if (rc == 0)
+			memcpy(ino, vbuf, sizeof(*ino));
+		kvs_vec_release(&vals);
+	}
+	return rc;
+}
+
+int dshard_link(struct dshard_dir *dir, const char *name, cfs_ino_t ino)
+{
+	uint64_t entries;
+	int rc;
+
+	/* No overwrite: an existing name fails with -EEXIST */
+	rc = entry_op(dir, M0_IC_PUT, name, &ino, 0);
+	if (rc != 0)
+		return rc;
+
+	/* cortxfs would look at the link count of the directory instead */
+	entries = __atomic_add_fetch(&dir->ds_entries, 1, __ATOMIC_RELAXED);
+	if (dir->ds_threshold != 0 && entries == dir->ds_threshold)
+		rc = dshard_reshard(dir, dir->ds_target_shards);
+
+	return rc;
+}
+
+int dshard_unlink(struct dshard_dir *dir, const char *name)
+{
+	return entry_op(dir, M0_IC_DEL, name, NULL, 0);
+}
+
+int dshard_lookup(struct dshard_dir *dir, const char *name, cfs_ino_t *ino)
+{
+	return entry_op(dir, M0_IC_GET, name, ino, 0);
+}
+
+static uint64_t key_hash(const void *key)
+{
+	return be64toh(((const struct md_hdentry_key *)key)->hash);
+}
+
+static int iter_init(struct md_kvs_iter *it, cfs_ino_t pino, uint32_t shard,
+		     uint64_t from, uint32_t cap)
+{
+	struct md_hdentry_key start;
+
+	/* Shorter than the keys of hash from, sorts before all of them */
+	key_init(&start, pino, shard, from, "", 0);
+	return md_kvs_iter_init(it, &start, MD_HDENTRY_KEY_LEN(0),
+				MD_HDENTRY_SHARD_PREFIX_LEN, cap,
+				sizeof(struct md_hdentry_key),
+				sizeof(cfs_ino_t));
+}
+
+/**
+ * Move the entries of shard to the shard of nr_shards they belong to.
+ */
+static int reshard_one(struct dshard_dir *dir, uint32_t shard,
+		       uint32_t nr_shards)
+{
+	struct md_hdentry_key *moved;
+	cfs_ino_t inos[RESHARD_BATCH];
+	void *kbufs[2 * RESHARD_BATCH], *vbufs[RESHARD_BATCH];
+	m0_bcount_t klens[2 * RESHARD_BATCH], vlens[RESHARD_BATCH];
+	struct m0_bufvec keys, vals;
+	struct md_kvs_iter it;
+	const struct md_hdentry_key *key;
+	const void *kptr, *vptr;
+	size_t klen, vlen;
+	uint32_t i, nr = 0;
+	uint64_t hash;
+	int rc;
+
+	/* New keys first, old ones after */
+	moved = malloc(2 * RESHARD_BATCH * sizeof(*moved));
+	if (moved == NULL)
+		return -ENOMEM;
+
+	rc = iter_init(&it, dir->ds_ino, shard, 0, RESHARD_BATCH);
+	if (rc != 0)
+		goto out;
+
+	do {
+		rc = md_kvs_iter_next(&it);
+		if (rc != 0)
+			break;
+
+		for (i = 0; i < it.nr; i++) {
+			md_kvs_iter_rec(&it, i, &kptr, &klen, &vptr, &vlen);
+			key = kptr;
+			hash = key_hash(key);
+			if (shard_of(hash, nr_shards) == shard)
+				continue;
+
+			klens[nr] = key_init(&moved[nr], dir->ds_ino,
+					     shard_of(hash, nr_shards), hash,
+					     key->name,
+					     klen - MD_HDENTRY_KEY_LEN(0));
+			memcpy(&moved[RESHARD_BATCH + nr], key, klen);
+			klens[RESHARD_BATCH + nr] = klen;
+			memcpy(&inos[nr], vptr, sizeof(inos[nr]));
+			nr++;
+		}
+
+		if (nr == 0)
+			continue;
+
+		for (i = 0; i < nr; i++) {
+			kbufs[i] = &moved[i];
+			kbufs[RESHARD_BATCH + i] = &moved[RESHARD_BATCH + i];
+			vbufs[i] = &inos[i];
+			vlens[i] = sizeof(inos[i]);
+		}
+		kvs_vec_wrap(&keys, kbufs, klens, nr);
+		kvs_vec_wrap(&vals, vbufs, vlens, nr);
+		rc = md_kvs_op(M0_IC_PUT, &keys, &vals, NULL,
+			       M0_OIF_OVERWRITE);
+		if (rc == 0) {
+			kvs_vec_wrap(&keys, kbufs + RESHARD_BATCH,
+				     klens + RESHARD_BATCH, nr);
+			rc = md_kvs_op(M0_IC_DEL, &keys, NULL, NULL, 0);
+		}
+		stats_add(&dshard_stats.moved, nr);
+		nr = 0;
+	} while (rc == 0 && !it.eof);
+
+	md_kvs_iter_fini(&it);
+out:
+	free(moved);
+	return rc;
+}
+
+int dshard_reshard(struct dshard_dir *dir, uint32_t nr_shards)
+{
+	uint32_t shard;
+	int rc = 0;
+
+	if (nr_shards == 0 || nr_shards > DSHARD_MAX)
+		return -EINVAL;
+
+	pthread_rwlock_wrlock(&dir->ds_lock);
+	if (nr_shards == dir->ds_nr_shards)
+		goto out;
+
+	for (shard = 0; rc == 0 && shard < dir->ds_nr_shards; shard++)
+		rc = reshard_one(dir, shard, nr_shards);
+
+	/* Entries are in place, switch lookups to the new layout */
+	if (rc == 0)
+		rc = meta_op(M0_IC_PUT, dir->ds_ino, &nr_shards);
+	if (rc == 0) {
+		dir->ds_nr_shards = nr_shards;
+		stats_add(&dshard_stats.reshards, 1);
+	} else {
+		fprintf(stderr, "error(%d): reshard of %llu to %u shards\n",
+			rc, dir->ds_ino, nr_shards);
+	}
+
+out:
+	pthread_rwlock_unlock(&dir->ds_lock);
+	return rc;
+}
+
+int dshard_readdir(struct dshard_dir *dir, uint64_t cookie,
+		   dshard_readdir_cb_t cb, void *ctx)
+{
+	struct md_kvs_iter *its;
+	uint32_t *pos;
+	bool *refill;
+	const struct md_hdentry_key *key;
+	const void *kptr, *vptr;
+	size_t klen, vlen;
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	uint32_t nr, s, min, inited = 0;
+	uint64_t hash, min_hash = 0, round_trips = 0, waves = 0;
+	bool drained;
+	int rc = 0;
+
+	if (cookie == UINT64_MAX)
+		return 0;
+
+	pthread_rwlock_rdlock(&dir->ds_lock);
+	nr = dir->ds_nr_shards;
+
+	its = calloc(nr, sizeof(*its));
+	pos = calloc(nr, sizeof(*pos));
+	refill = calloc(nr, sizeof(*refill));
+	if (its == NULL || pos == NULL || refill == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (; inited < nr; inited++) {
+		rc = iter_init(&its[inited], dir->ds_ino, inited, cookie + 1,
+			       DSHARD_READDIR_CAP);
+		if (rc != 0)
+			goto out;
+		refill[inited] = true;
+	}
+
+	for (;;) {
+		/* One wave: the NEXT of every drained shard in flight */
+		for (s = 0; rc == 0 && s < nr; s++)
+			if (refill[s])
+				rc = md_kvs_iter_launch(&its[s]);
+		for (s = 0; s < nr; s++) {
+			if (refill[s] && its[s].pending) {
+				if (rc == 0)
+					rc = md_kvs_iter_wait(&its[s]);
+				else
+					(void)md_kvs_iter_wait(&its[s]);
+			}
+			if (refill[s])
+				pos[s] = 0;
+			refill[s] = false;
+		}
+		if (rc != 0)
+			break;
+		waves++;
+
+		/* Merge until a shard that is not exhausted runs dry */
+		for (;;) {
+			drained = false;
+			min = nr;
+			for (s = 0; s < nr; s++) {
+				if (pos[s] == its[s].nr) {
+					refill[s] = !its[s].eof;
+					drained |= refill[s];
+					continue;
+				}
+				hash = key_hash(its[s].keys.ov_buf[pos[s]]);
+				if (min == nr || hash < min_hash) {
+					min = s;
+					min_hash = hash;
+				}
+			}
+			if (drained || min == nr)
+				break;
+
+			md_kvs_iter_rec(&its[min], pos[min], &kptr, &klen,
+					&vptr, &vlen);
+			key = kptr;
+			klen -= MD_HDENTRY_KEY_LEN(0);
+			memcpy(name, key->name, klen);
+			name[klen] = '\0';
+			memcpy(&ino, vptr, sizeof(ino));
+			pos[min]++;
+
+			if (!cb(ctx, name, ino, min_hash))
+				goto done;
+		}
+
+		/* Every shard exhausted */
+		if (!drained)
+			break;
+
+		/* Refill the others in the same wave, from their first
+		 * record not merged yet, rather than in a wave of their own
+		 * as soon as they run dry.
+		 */
+		for (s = 0; s < nr; s++) {
+			if (refill[s] || pos[s] == its[s].nr)
+				continue;
+			md_kvs_iter_rec(&its[s], pos[s], &kptr, &klen, &vptr,
+					&vlen);
+			md_kvs_iter_seek(&its[s], kptr, klen, false);
+			refill[s] = true;
+		}
+	}
+
+done:
+	for (s = 0; s < inited; s++)
+		round_trips += its[s].round_trips;
+	stats_add(&dshard_stats.readdirs, 1);
+	stats_add(&dshard_stats.round_trips, round_trips);
+	stats_add(&dshard_stats.waves, waves);
+out:
+	for (s = 0; s < inited; s++)
+		md_kvs_iter_fini(&its[s]);
+	free(refill);
+	free(pos);
+	free(its);
+	pthread_rwlock_unlock(&dir->ds_lock);
+	return rc;
+}
+
+void dshard_stats_get(struct dshard_stats *stats)
+{
+	stats->readdirs = __atomic_load_n(&dshard_stats.readdirs,
+					  __ATOMIC_RELAXED);
+	stats->round_trips = __atomic_load_n(&dshard_stats.round_trips,
+					     __ATOMIC_RELAXED);
+	stats->waves = __atomic_load_n(&dshard_stats.waves, __ATOMIC_RELAXED);
+	stats->reshards = __atomic_load_n(&dshard_stats.reshards,
+					  __ATOMIC_RELAXED);
+	stats->moved = __atomic_load_n(&dshard_stats.moved, __ATOMIC_RELAXED);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,136 @@
+/*
+ * Filename:         dentry_shard.h
+ * Description:      Hash-sharded directory entries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* All the entries of a directory share one key prefix, so the creates of a
+ * huge directory all land in one key range and readdir is one long chain
+ * of NEXT requests.
+ *
+ * Here every entry is keyed by the hash of its name and spread over the
+ * shards of its directory:
+ *   { pino, 'H', shard (big endian), hash (big endian), name }
+ * with shard = hash % nr_shards, so that each shard is a key range of its
+ * own, ordered by hash.
+ *
+ * - A directory starts with one shard. When the entries linked through its
+ *   dshard_dir reach the threshold, dshard_link() moves it to nr_shards
+ *   shards: the entries whose shard changes are moved, then the new count
+ *   is stored in the { pino, 'K' } record.
+ * - dshard_readdir() scans the shards in parallel, launching the NEXT of
+ *   every shard whose batch was consumed before waiting for any of them
+ *   (a "wave"), and merges them in hash order.
+ * - The cookie of an entry is its hash: it does not depend on the number
+ *   of shards and stays valid across resharding, creates and removals.
+ *   Hashes start at DSHARD_COOKIE_MIN, below are "." and "..". Two names
+ *   with the same 63-bit hash would share a cookie; a readdir resuming
+ *   there would skip the second one.
+ *
+ * Resharding is not atomic and assumes no other user of the directory
+ * meanwhile; cortxfs would hold the directory lock and log it.
+ */
+
+#ifndef _DENTRY_SHARD_H
+#define _DENTRY_SHARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "md_kvs.h"
+
+#define DSHARD_MAX 1024
+#define DSHARD_COOKIE_MIN 3
+/* Records fetched per NEXT of a shard during readdir */
+#define DSHARD_READDIR_CAP 64
+
+struct md_hdentry_key {
+	cfs_ino_t pino;
+	char type;
+	uint16_t shard;
+	uint64_t hash;
+	char name[NAME_MAX];
+} __attribute((packed));
+
+/* Keys of a shard share the first MD_HDENTRY_SHARD_PREFIX_LEN bytes */
+#define MD_HDENTRY_SHARD_PREFIX_LEN offsetof(struct md_hdentry_key, hash)
+#define MD_HDENTRY_KEY_LEN(name_len) \
+	(offsetof(struct md_hdentry_key, name) + (name_len))
+
+struct dshard_dir {
+	cfs_ino_t ds_ino;
+	/* Held for reading by link/unlink/lookup/readdir, for writing by
+	 * dshard_reshard().
+	 */
+	pthread_rwlock_t ds_lock;
+	uint32_t ds_nr_shards;
+	/* Entries linked through this dshard_dir, see dshard_link() */
+	uint64_t ds_entries;
+	uint64_t ds_threshold;
+	uint32_t ds_target_shards;
+};
+
+struct dshard_stats {
+	uint64_t readdirs;
+	/* NEXT requests, and rounds of NEXT requests in flight together */
+	uint64_t round_trips;
+	uint64_t waves;
+	uint64_t reshards;
+	/* Entries moved to another shard by resharding */
+	uint64_t moved;
+};
+
+/**
+ * Callback of dshard_readdir(), returns false to stop.
+ */
+typedef bool (*dshard_readdir_cb_t)(void *ctx, const char *name,
+				    cfs_ino_t ino, uint64_t cookie);
+
+/**
+ * Hash of a name, the cookie of its entry.
+ */
+uint64_t dshard_hash(const char *name, size_t len);
+
+/**
+ * Load the layout of directory ino. Once threshold entries are linked
+ * through dir it is resharded to nr_shards; threshold 0 never reshards.
+ */
+int dshard_open(struct dshard_dir *dir, cfs_ino_t ino, uint64_t threshold,
+		uint32_t nr_shards);
+
+void dshard_close(struct dshard_dir *dir);
+
+int dshard_link(struct dshard_dir *dir, const char *name, cfs_ino_t ino);
+
+int dshard_unlink(struct dshard_dir *dir, const char *name);
+
+int dshard_lookup(struct dshard_dir *dir, const char *name, cfs_ino_t *ino);
+
+/**
+ * Call cb for the entries following cookie (0 for the first one), in
+ * cookie order.
+ */
+int dshard_readdir(struct dshard_dir *dir, uint64_t cookie,
+		   dshard_readdir_cb_t cb, void *ctx);
+
+/**
+ * Spread the entries of the directory over nr_shards shards.
+ */
+int dshard_reshard(struct dshard_dir *dir, uint32_t nr_shards);
+
+void dshard_stats_get(struct dshard_stats *stats);
+
+#endif /* _DENTRY_SHARD_H */
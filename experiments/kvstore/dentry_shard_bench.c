@@ -0,0 +1,346 @@
+/*
+ * Filename:         dentry_shard_bench.c
+ * Description:      Benchmark of hash-sharded directory entries
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Link NUM_FILES entries into one directory from NUM_THREADS threads,
+ *   a) with a single shard, like the dentries of md_kvs.h today
+ *   b) resharded to NUM_SHARDS shards once NUM_FILES / 10 are linked
+ * - Read the directory in one go and page by page (PAGE_SIZE entries,
+ *   resuming from the cookie of the last entry), check that every entry
+ *   comes back exactly once and in cookie order
+ * - Look every entry up, then unlink them all
+ * - Report the time taken, NEXT round trips and waves: the rounds of NEXT
+ *   requests in flight together. The in-memory backend executes requests
+ *   as they are launched, its readdir time adds up the round trips; a
+ *   store serving them concurrently waits once per wave.
+ *
+ * Usage: dentry_shard_bench [entries] [threads] [shards]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+#include "dentry_shard.h"
+
+#define NUM_FILES 100000
+#define NUM_THREADS 8
+#define NUM_SHARDS 16
+#define PAGE_SIZE 1000
+#define DIR_INO 0x3000ULL
+#define FIRST_INO 0x300000ULL
+
+struct worker {
+	pthread_t thread;
+	struct dshard_dir *dir;
+	enum m0_idx_opcode opcode;
+	int first;
+	int nr;
+	int rc;
+};
+
+/* What a readdir saw */
+struct readdir_check {
+	uint8_t *seen;
+	int nr_files;
+	int count;
+	int limit;
+	uint64_t cookie;
+	int rc;
+};
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct m0_thread thread;
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	int i;
+
+	w->rc = md_kvs_thread_enter(&thread);
+	if (w->rc != 0)
+		return NULL;
+
+	for (i = w->first; w->rc == 0 && i < w->first + w->nr; i++) {
+		snprintf(name, sizeof(name), "file.%d", i);
+		switch (w->opcode) {
+		case M0_IC_PUT:
+			w->rc = dshard_link(w->dir, name, FIRST_INO + i);
+			break;
+		case M0_IC_GET:
+			w->rc = dshard_lookup(w->dir, name, &ino);
+			if (w->rc == 0 && ino != FIRST_INO + i)
+				w->rc = -EIO;
+			break;
+		default:
+			w->rc = dshard_unlink(w->dir, name);
+			break;
+		}
+	}
+
+	md_kvs_thread_leave();
+	return NULL;
+}
+
+static int workers_run(struct dshard_dir *dir, int nr_files, int nr_threads,
+		       enum m0_idx_opcode opcode, const char *msg)
+{
+	struct worker *workers;
+	struct timeval start1, end1;
+	long elapsed;
+	int rc = 0, i, started, per_thread;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (workers == NULL)
+		return -ENOMEM;
+
+	per_thread = (nr_files + nr_threads - 1) / nr_threads;
+	gettimeofday(&start1, NULL);
+	for (started = 0; started < nr_threads; started++) {
+		workers[started].dir = dir;
+		workers[started].opcode = opcode;
+		workers[started].first = started * per_thread;
+		workers[started].nr = nr_files - workers[started].first;
+		if (workers[started].nr > per_thread)
+			workers[started].nr = per_thread;
+		if (workers[started].nr < 0)
+			workers[started].nr = 0;
+		rc = -pthread_create(&workers[started].thread, NULL,
+				     worker_run, &workers[started]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (rc == 0)
+			rc = workers[i].rc;
+	}
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	free(workers);
+
+	if (rc != 0) {
+		fprintf(stderr, "%s failed rc=%d\n", msg, rc);
+		return rc;
+	}
+
+	printf("  %-8s %d entries in %ld usecs, %.0f entries/s\n", msg,
+	       nr_files, elapsed,
+	       elapsed > 0 ? nr_files * 1e6 / elapsed : 0.0);
+	return 0;
+}
+
+static bool readdir_cb(void *ctx, const char *name, cfs_ino_t ino,
+		       uint64_t cookie)
+{
+	struct readdir_check *check = ctx;
+	int i;
+
+	if (sscanf(name, "file.%d", &i) != 1 || i < 0 ||
+	    i >= check->nr_files || ino != FIRST_INO + i ||
+	    check->seen[i] || cookie <= check->cookie) {
+		fprintf(stderr, "unexpected entry %s, cookie %llu\n", name,
+			(unsigned long long)cookie);
+		check->rc = -EIO;
+		return false;
+	}
+
+	check->seen[i] = 1;
+	check->cookie = cookie;
+	check->count++;
+	return check->limit == 0 || check->count % check->limit != 0;
+}
+
+/**
+ * Read the whole directory, in pages of page_size entries unless 0.
+ */
+static int readdir_run(struct dshard_dir *dir, int nr_files, int page_size,
+		       const char *msg)
+{
+	struct readdir_check check = { .nr_files = nr_files,
+				       .limit = page_size };
+	struct dshard_stats before, after;
+	struct timeval start1, end1;
+	int rc = 0, pages = 0, count;
+
+	check.seen = calloc(nr_files, 1);
+	if (check.seen == NULL)
+		return -ENOMEM;
+
+	dshard_stats_get(&before);
+	gettimeofday(&start1, NULL);
+	do {
+		count = check.count;
+		rc = dshard_readdir(dir, check.cookie, readdir_cb, &check);
+		if (rc == 0)
+			rc = check.rc;
+		pages++;
+	} while (rc == 0 && check.count != count && check.count < nr_files);
+	gettimeofday(&end1, NULL);
+	dshard_stats_get(&after);
+	free(check.seen);
+
+	if (rc == 0 && check.count != nr_files)
+		rc = -EIO;
+	if (rc != 0) {
+		fprintf(stderr, "%s failed rc=%d, %d entries\n", msg, rc,
+			check.count);
+		return rc;
+	}
+
+	printf("  %-8s %d entries, %d pages in %ld usecs, %lu round trips,"
+	       " %lu waves\n", msg, check.count, pages,
+	       md_kvs_elapsed_us(&start1, &end1),
+	       (unsigned long)(after.round_trips - before.round_trips),
+	       (unsigned long)(after.waves - before.waves));
+	return 0;
+}
+
+static int shard_run(cfs_ino_t dir_ino, int nr_files, int nr_threads,
+		     uint32_t nr_shards)
+{
+	struct dshard_dir dir;
+	struct dshard_stats stats;
+	int rc;
+
+	printf("%u shard(s):\n", nr_shards);
+
+	rc = dshard_open(&dir, dir_ino, nr_shards > 1 ? nr_files / 10 : 0,
+			 nr_shards);
+	if (rc != 0)
+		return rc;
+
+	rc = workers_run(&dir, nr_files, nr_threads, M0_IC_PUT, "link");
+	if (rc == 0)
+		rc = readdir_run(&dir, nr_files, 0, "readdir");
+	if (rc == 0)
+		rc = readdir_run(&dir, nr_files, PAGE_SIZE, "paged");
+	if (rc == 0)
+		rc = workers_run(&dir, nr_files, nr_threads, M0_IC_GET,
+				 "lookup");
+	if (rc == 0)
+		rc = workers_run(&dir, nr_files, nr_threads, M0_IC_DEL,
+				 "unlink");
+
+	dshard_stats_get(&stats);
+	printf("  now %u shard(s), %lu reshards so far, %lu entries moved\n",
+	       dir.ds_nr_shards, (unsigned long)stats.reshards,
+	       (unsigned long)stats.moved);
+
+	dshard_close(&dir);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int nr_files = NUM_FILES;
+	int nr_threads = NUM_THREADS;
+	int nr_shards = NUM_SHARDS;
+	int rc;
+
+	if (argc > 4) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [entries] [threads] [shards]\n",
+			basename(argv[0]));
+		return -1;
+	}
+
+	if (argc > 1)
+		nr_files = atoi(argv[1]);
+	if (argc > 2)
+		nr_threads = atoi(argv[2]);
+	if (argc > 3)
+		nr_shards = atoi(argv[3]);
+	if (nr_files < 10 || nr_threads <= 0 || nr_shards <= 1 ||
+	    nr_shards > DSHARD_MAX) {
+		fprintf(stderr, "invalid entries, threads or shards\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = shard_run(DIR_INO, nr_files, nr_threads, 1);
+	if (rc == 0)
+		rc = shard_run(DIR_INO + 1, nr_files, nr_threads, nr_shards);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,648 @@
+/*
+ * Filename:         dir_stats.c
+ * Description:      Incremental entry counts and sizes of directories
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "motr/client.h"
+#include "md_kvs.h"
+#include "dir_stats.h"
+#include "../perf/trace.h"
+
+/* Changes of a directory not applied to its record yet */
+struct dir_stats_delta {
+	cfs_ino_t dd_ino;
+	int64_t dd_entries;
+	int64_t dd_bytes;
+	int64_t dd_tree_entries;
+	int64_t dd_tree_bytes;
+	struct dir_stats_delta *dd_next;
+};
+
+struct dir_stats_batch {
+	struct dir_stats_delta *db_deltas[DIR_STATS_BATCH];
+	struct md_dir_stats_key db_keys[DIR_STATS_BATCH];
+	struct md_dir_stats db_recs[DIR_STATS_BATCH];
+	void *db_bufs[2 * DIR_STATS_BATCH];
+	m0_bcount_t db_counts[2 * DIR_STATS_BATCH];
+	int db_rcs[DIR_STATS_BATCH];
+};
+
+static uint32_t bucket_of(cfs_ino_t ino)
+{
+	return (ino * 0x9e3779b97f4a7c15ULL) >> 54;
+}
+
+/**
+ * Add d to the delta of its directory, d is consumed.
+ * Called with ds_lock held.
+ */
+static void delta_merge(struct dir_stats *ds, struct dir_stats_delta *d)
+{
+	struct dir_stats_delta **head = &ds->ds_buckets[bucket_of(d->dd_ino)];
+	struct dir_stats_delta *cur;
+
+	for (cur = *head; cur != NULL; cur = cur->dd_next)
+		if (cur->dd_ino == d->dd_ino)
+			break;
+
+	if (cur == NULL) {
+		d->dd_next = *head;
+		*head = d;
+		ds->ds_pending++;
+		/* Wake the flusher once, when the table gets full */
+		if (ds->ds_pending == ds->ds_max_pending)
+			pthread_cond_signal(&ds->ds_cond);
+		return;
+	}
+
+	cur->dd_entries += d->dd_entries;
+	cur->dd_bytes += d->dd_bytes;
+	cur->dd_tree_entries += d->dd_tree_entries;
+	cur->dd_tree_bytes += d->dd_tree_bytes;
+	free(d);
+}
+
+/**
+ * Queue a change of directory ino: entries and bytes apply to the
+ * directory itself, tree_entries and tree_bytes to it and its ancestors.
+ */
+static int delta_queue(struct dir_stats *ds, cfs_ino_t ino, int64_t entries,
+		       int64_t bytes, int64_t tree_entries, int64_t tree_bytes)
+{
+	struct dir_stats_delta *d;
+
+	if (entries == 0 && bytes == 0 && tree_entries == 0 && tree_bytes == 0)
+		return 0;
+
+	d = malloc(sizeof(*d));
+	if (d == NULL)
+		return -ENOMEM;
+
+	d->dd_ino = ino;
+	d->dd_entries = entries;
+	d->dd_bytes = bytes;
+	d->dd_tree_entries = tree_entries;
+	d->dd_tree_bytes = tree_bytes;
+
+	pthread_mutex_lock(&ds->ds_lock);
+	delta_merge(ds, d);
+	ds->ds_updates++;
+	pthread_mutex_unlock(&ds->ds_lock);
+	return 0;
+}
+
+/**
+ * Detach the delta of ino from the table, NULL if it has none.
+ * Called with ds_lock held.
+ */
+static struct dir_stats_delta *delta_take(struct dir_stats *ds,
+					  cfs_ino_t ino)
+{
+	struct dir_stats_delta **prev = &ds->ds_buckets[bucket_of(ino)];
+	struct dir_stats_delta *d;
+
+	for (; (d = *prev) != NULL; prev = &d->dd_next) {
+		if (d->dd_ino == ino) {
+			*prev = d->dd_next;
+			ds->ds_pending--;
+			return d;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Detach the whole table as a list.
+ * Called with ds_lock held.
+ */
+static struct dir_stats_delta *table_take(struct dir_stats *ds)
+{
+	struct dir_stats_delta *list = NULL, *d, *next;
+	uint32_t b;
+
+	for (b = 0; b < DIR_STATS_BUCKETS; b++) {
+		for (d = ds->ds_buckets[b]; d != NULL; d = next) {
+			next = d->dd_next;
+			d->dd_next = list;
+			list = d;
+		}
+		ds->ds_buckets[b] = NULL;
+	}
+	ds->ds_pending = 0;
+	return list;
+}
+
+/**
+ * Put the deltas of list back in the table, after a failed flush.
+ */
+static void table_requeue(struct dir_stats *ds, struct dir_stats_delta *list)
+{
+	struct dir_stats_delta *next;
+
+	pthread_mutex_lock(&ds->ds_lock);
+	for (; list != NULL; list = next) {
+		next = list->dd_next;
+		delta_merge(ds, list);
+	}
+	pthread_mutex_unlock(&ds->ds_lock);
+}
+
+/**
+ * Execute opcode on the stats records of the nr directories of
+ * ds_batch->db_keys, with the values db_recs. A GET copies the records
+ * found into db_recs and sets db_rcs, -EINVAL for a record of the wrong
+ * size.
+ */
+static int batch_op(struct dir_stats_batch *batch, enum m0_idx_opcode opcode,
+		    uint32_t nr, uint32_t flags)
+{
+	struct m0_bufvec keys, vals;
+	void **vbufs = batch->db_bufs + DIR_STATS_BATCH;
+	m0_bcount_t *vcounts = batch->db_counts + DIR_STATS_BATCH;
+	uint32_t i;
+	int rc;
+
+	for (i = 0; i < nr; i++) {
+		batch->db_bufs[i] = &batch->db_keys[i];
+		batch->db_counts[i] = sizeof(batch->db_keys[i]);
+		vbufs[i] = &batch->db_recs[i];
+		vcounts[i] = sizeof(batch->db_recs[i]);
+	}
+
+	kvs_vec_wrap(&keys, batch->db_bufs, batch->db_counts, nr);
+	if (opcode != M0_IC_GET) {
+		kvs_vec_wrap(&vals, vbufs, vcounts, nr);
+		return md_kvs_op(opcode, &keys, &vals, NULL, flags);
+	}
+
+	/* GET hands out values allocated by the store */
+	kvs_vec_borrow(&vals, vbufs, vcounts, nr);
+	rc = md_kvs_op(opcode, &keys, &vals, batch->db_rcs, flags);
+	for (i = 0; rc == 0 && i < nr; i++) {
+		if (batch->db_rcs[i] != 0)
+			continue;
+		if (vcounts[i] != sizeof(batch->db_recs[i]))
+			batch->db_rcs[i] = -EINVAL;
+		else
+			memcpy(&batch->db_recs[i], vbufs[i],
+			       sizeof(batch->db_recs[i]));
+	}
+	kvs_vec_release(&vals);
+	return rc;
+}
+
+/**
+ * Apply the deltas of *list to their records, DIR_STATS_BATCH at a time,
+ * and queue their tree deltas for the parents. *forwarded is set to the
+ * number of parents updated. On failure the deltas not applied are left
+ * in *list.
+ */
+static int flush_round(struct dir_stats *ds, struct dir_stats_delta **list,
+		       uint32_t *forwarded)
+{
+	struct dir_stats_batch *batch = ds->ds_batch;
+	struct dir_stats_delta *d;
+	struct md_dir_stats *rec;
+	uint32_t i, nr, put;
+	int rc = 0;
+
+	*forwarded = 0;
+	while (*list != NULL) {
+		for (nr = 0; nr < DIR_STATS_BATCH && *list != NULL; nr++) {
+			d = *list;
+			*list = d->dd_next;
+			d->dd_next = NULL;
+			batch->db_deltas[nr] = d;
+			MD_DIR_STATS_KEY_INIT(&batch->db_keys[nr], d->dd_ino);
+		}
+
+		rc = batch_op(batch, M0_IC_GET, nr, 0);
+		if (rc != 0)
+			goto requeue;
+
+		for (i = 0; i < nr; i++) {
+			if (batch->db_rcs[i] == -ENOENT)
+				continue;
+			if (batch->db_rcs[i] != 0) {
+				rc = batch->db_rcs[i];
+				fprintf(stderr, "error(%d): stats of %llu\n",
+					rc, batch->db_deltas[i]->dd_ino);
+				goto requeue;
+			}
+		}
+
+		/* Apply the deltas, packing the records to write */
+		for (i = 0, put = 0; i < nr; i++) {
+			d = batch->db_deltas[i];
+			if (batch->db_rcs[i] == -ENOENT) {
+				/* Removed, or created before stats existed */
+				ds->ds_orphans++;
+				free(d);
+				continue;
+			}
+
+			rec = &batch->db_recs[put];
+			*rec = batch->db_recs[i];
+			rec->entries += d->dd_entries;
+			rec->bytes += d->dd_bytes;
+			rec->tree_entries += d->dd_tree_entries;
+			rec->tree_bytes += d->dd_tree_bytes;
+			batch->db_keys[put] = batch->db_keys[i];
+			batch->db_deltas[put] = d;
+			put++;
+		}
+		nr = put;
+
+		/* Every delta may have been an orphan */
+		if (nr == 0)
+			continue;
+		rc = batch_op(batch, M0_IC_PUT, nr, M0_OIF_OVERWRITE);
+		if (rc != 0)
+			goto requeue;
+		ds->ds_records += nr;
+
+		for (i = 0; i < nr; i++) {
+			d = batch->db_deltas[i];
+			rec = &batch->db_recs[i];
+			if (rec->parent != 0 && (d->dd_tree_entries != 0 ||
+						 d->dd_tree_bytes != 0)) {
+				/* d becomes the delta of the parent */
+				d->dd_ino = rec->parent;
+				d->dd_entries = 0;
+				d->dd_bytes = 0;
+				pthread_mutex_lock(&ds->ds_lock);
+				delta_merge(ds, d);
+				pthread_mutex_unlock(&ds->ds_lock);
+				(*forwarded)++;
+			} else {
+				free(d);
+			}
+		}
+	}
+	return 0;
+
+requeue:
+	/* A failed PUT may have been applied in part: the deltas of the
+	 * records written would then be applied twice.
+	 */
+	for (i = nr; i > 0; i--) {
+		d = batch->db_deltas[i - 1];
+		d->dd_next = *list;
+		*list = d;
+	}
+	return rc;
+}
+
+/**
+ * Called with ds_flush_lock held.
+ */
+static int flush_locked(struct dir_stats *ds)
+{
+	struct dir_stats_delta *list;
+	uint64_t trace_start;
+	uint32_t forwarded;
+	int rc = 0;
+
+	trace_start = trace_request_begin();
+	ds->ds_flushes++;
+	/* A round applies what the previous one forwarded to the parents,
+	 * and whatever was queued meanwhile. The updates queued before the
+	 * flush reached the root once a round forwards nothing.
+	 */
+	do {
+		pthread_mutex_lock(&ds->ds_lock);
+		list = table_take(ds);
+		pthread_mutex_unlock(&ds->ds_lock);
+		if (list == NULL)
+			break;
+
+		ds->ds_rounds++;
+		rc = flush_round(ds, &list, &forwarded);
+		if (rc != 0) {
+			table_requeue(ds, list);
+			break;
+		}
+	} while (forwarded != 0);
+	trace_request_end("ds.flush", trace_start);
+
+	return rc;
+}
+
+int dir_stats_flush(struct dir_stats *ds)
+{
+	int rc;
+
+	pthread_mutex_lock(&ds->ds_flush_lock);
+	rc = flush_locked(ds);
+	pthread_mutex_unlock(&ds->ds_flush_lock);
+	return rc;
+}
+
+static void *flusher(void *arg)
+{
+	struct dir_stats *ds = arg;
+	struct timespec deadline;
+	struct m0_thread thread;
+	bool stop = false, failed = false;
+	int rc;
+
+	rc = md_kvs_thread_enter(&thread);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): dir stats flusher\n", rc);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ds->ds_lock);
+	while (!stop) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += ds->ds_interval_us / 1000000;
+		deadline.tv_nsec += (ds->ds_interval_us % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		/* After a failure, wait for the interval whatever is pending */
+		while (!ds->ds_stop &&
+		       (failed || ds->ds_pending < ds->ds_max_pending)) {
+			if (ds->ds_interval_us == 0)
+				pthread_cond_wait(&ds->ds_cond, &ds->ds_lock);
+			else if (pthread_cond_timedwait(&ds->ds_cond,
+							&ds->ds_lock,
+							&deadline) == ETIMEDOUT)
+				break;
+		}
+		stop = ds->ds_stop;
+		pthread_mutex_unlock(&ds->ds_lock);
+
+		rc = dir_stats_flush(ds);
+		failed = rc != 0;
+		if (failed)
+			fprintf(stderr, "error(%d): dir stats flush\n", rc);
+
+		pthread_mutex_lock(&ds->ds_lock);
+	}
+	pthread_mutex_unlock(&ds->ds_lock);
+
+	md_kvs_thread_leave();
+	return NULL;
+}
+
+int dir_stats_init(struct dir_stats *ds, uint64_t interval_us,
+		   uint32_t max_pending)
+{
+	int rc;
+
+	if (max_pending == 0)
+		return -EINVAL;
+
+	memset(ds, 0, sizeof(*ds));
+	ds->ds_interval_us = interval_us;
+	ds->ds_max_pending = max_pending;
+
+	M0_ALLOC_PTR(ds->ds_batch);
+	if (ds->ds_batch == NULL)
+		return -ENOMEM;
+
+	rc = -pthread_mutex_init(&ds->ds_lock, NULL);
+	if (rc != 0)
+		goto free_batch;
+
+	rc = -pthread_cond_init(&ds->ds_cond, NULL);
+	if (rc != 0)
+		goto destroy_lock;
+
+	rc = -pthread_mutex_init(&ds->ds_flush_lock, NULL);
+	if (rc != 0)
+		goto destroy_cond;
+
+	rc = -pthread_create(&ds->ds_thread, NULL, flusher, ds);
+	if (rc != 0)
+		goto destroy_flush_lock;
+
+	return 0;
+
+destroy_flush_lock:
+	pthread_mutex_destroy(&ds->ds_flush_lock);
+destroy_cond:
+	pthread_cond_destroy(&ds->ds_cond);
+destroy_lock:
+	pthread_mutex_destroy(&ds->ds_lock);
+free_batch:
+	m0_free(ds->ds_batch);
+	return rc;
+}
+
+void dir_stats_fini(struct dir_stats *ds)
+{
+	struct dir_stats_delta *list, *next;
+	uint32_t pending;
+
+	pthread_mutex_lock(&ds->ds_lock);
+	ds->ds_stop = true;
+	pthread_cond_signal(&ds->ds_cond);
+	pthread_mutex_unlock(&ds->ds_lock);
+
+	/* The flusher flushes once more before it exits */
+	pthread_join(ds->ds_thread, NULL);
+
+	/* Left by a failed flush */
+	pending = ds->ds_pending;
+	list = table_take(ds);
+	if (list != NULL)
+		fprintf(stderr, "dir stats: %u directories not flushed\n",
+			pending);
+	for (; list != NULL; list = next) {
+		next = list->dd_next;
+		free(list);
+	}
+
+	pthread_mutex_destroy(&ds->ds_flush_lock);
+	pthread_cond_destroy(&ds->ds_cond);
+	pthread_mutex_destroy(&ds->ds_lock);
+	m0_free(ds->ds_batch);
+}
+
+/**
+ * Execute opcode on the stats record of ino, with the value stats.
+ */
+static int rec_op(enum m0_idx_opcode opcode, cfs_ino_t ino,
+		  struct md_dir_stats *stats, uint32_t flags)
+{
+	struct md_dir_stats_key key;
+	struct m0_bufvec keys, vals;
+	void *kbuf = &key, *vbuf = stats;
+	m0_bcount_t klen = sizeof(key), vlen = sizeof(*stats);
+	int rc;
+
+	MD_DIR_STATS_KEY_INIT(&key, ino);
+	kvs_vec_wrap(&keys, &kbuf, &klen, 1);
+	/* GET hands out a value allocated by the store */
+	if (opcode == M0_IC_GET)
+		kvs_vec_borrow(&vals, &vbuf, &vlen, 1);
+	else
+		kvs_vec_wrap(&vals, &vbuf, &vlen, 1);
+
+	rc = md_kvs_op(opcode, &keys, opcode == M0_IC_DEL ? NULL : &vals,
+		       NULL, flags);
+	if (opcode == M0_IC_GET) {
+		if (rc == 0 && vlen != sizeof(*stats))
+			rc = -EINVAL;
+		if (rc == 0)
+			memcpy(stats, vbuf, sizeof(*stats));
+		kvs_vec_release(&vals);
+	}
+	return rc;
+}
+
+int dir_stats_mkdir(struct dir_stats *ds, cfs_ino_t parent, cfs_ino_t ino)
+{
+	struct md_dir_stats stats = { .parent = parent };
+	int rc;
+
+	/* No overwrite: a record left by a directory not removed through
+	 * dir_stats_rmdir() would carry stale totals.
+	 */
+	rc = rec_op(M0_IC_PUT, ino, &stats, 0);
+	if (rc != 0)
+		return rc;
+
+	return parent == 0 ? 0 : delta_queue(ds, parent, 1, 0, 1, 0);
+}
+
+int dir_stats_rmdir(struct dir_stats *ds, cfs_ino_t parent, cfs_ino_t ino)
+{
+	struct dir_stats_delta *d;
+	int rc;
+
+	pthread_mutex_lock(&ds->ds_flush_lock);
+
+	rc = rec_op(M0_IC_DEL, ino, NULL, 0);
+	if (rc != 0)
+		goto out;
+
+	/* The changes below ino not applied yet still count in its
+	 * ancestors: they must reach the parent, which is what a flush would
+	 * have done.
+	 */
+	pthread_mutex_lock(&ds->ds_lock);
+	d = delta_take(ds, ino);
+	pthread_mutex_unlock(&ds->ds_lock);
+
+	if (parent != 0)
+		rc = delta_queue(ds, parent, -1, 0,
+				 -1 + (d != NULL ? d->dd_tree_entries : 0),
+				 d != NULL ? d->dd_tree_bytes : 0);
+	free(d);
+out:
+	pthread_mutex_unlock(&ds->ds_flush_lock);
+	return rc;
+}
+
+int dir_stats_create(struct dir_stats *ds, cfs_ino_t dir, uint64_t size)
+{
+	return delta_queue(ds, dir, 1, size, 1, size);
+}
+
+int dir_stats_unlink(struct dir_stats *ds, cfs_ino_t dir, uint64_t size)
+{
+	return delta_queue(ds, dir, -1, -(int64_t)size, -1, -(int64_t)size);
+}
+
+int dir_stats_resize(struct dir_stats *ds, cfs_ino_t dir, uint64_t old_size,
+		     uint64_t new_size)
+{
+	int64_t diff = (int64_t)new_size - (int64_t)old_size;
+
+	return delta_queue(ds, dir, 0, diff, 0, diff);
+}
+
+int dir_stats_rename(struct dir_stats *ds, cfs_ino_t src, cfs_ino_t dst,
+		     cfs_ino_t ino, uint64_t size)
+{
+	struct md_dir_stats stats;
+	int rc;
+
+	if (src == dst)
+		return 0;
+
+	if (ino == 0) {
+		rc = dir_stats_unlink(ds, src, size);
+		return rc != 0 ? rc : dir_stats_create(ds, dst, size);
+	}
+
+	/* The totals of ino move from src to dst as stored: what is pending
+	 * for ino and below is forwarded to its parent of the time of the
+	 * flush, dst. No flush may run in between.
+	 */
+	pthread_mutex_lock(&ds->ds_flush_lock);
+
+	rc = rec_op(M0_IC_GET, ino, &stats, 0);
+	if (rc != 0)
+		goto out;
+
+	stats.parent = dst;
+	rc = rec_op(M0_IC_PUT, ino, &stats, M0_OIF_OVERWRITE);
+	if (rc != 0)
+		goto out;
+
+	rc = delta_queue(ds, src, -1, 0, -1 - stats.tree_entries,
+			 -stats.tree_bytes);
+	if (rc == 0)
+		rc = delta_queue(ds, dst, 1, 0, 1 + stats.tree_entries,
+				 stats.tree_bytes);
+out:
+	pthread_mutex_unlock(&ds->ds_flush_lock);
+	return rc;
+}
+
+int dir_stats_get(cfs_ino_t ino, struct md_dir_stats *stats)
+{
+	return rec_op(M0_IC_GET, ino, stats, 0);
+}
+
+void dir_stats_stats_print(struct dir_stats *ds, const char *msg)
+{
+	pthread_mutex_lock(&ds->ds_flush_lock);
+	pthread_mutex_lock(&ds->ds_lock);
+	printf("%s: %llu updates, %llu flushes in %llu rounds, %llu records "
+	       "written (%.1f updates per record), %llu orphans, %u pending\n",
+	       msg, (unsigned long long)ds->ds_updates,
+	       (unsigned long long)ds->ds_flushes,
+	       (unsigned long long)ds->ds_rounds,
+	       (unsigned long long)ds->ds_records,
+	       ds->ds_records != 0 ?
+	       (double)ds->ds_updates / ds->ds_records : 0.0,
+	       (unsigned long long)ds->ds_orphans, ds->ds_pending);
+	pthread_mutex_unlock(&ds->ds_lock);
+	pthread_mutex_unlock(&ds->ds_flush_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,170 @@
+/*
+ * Filename:         dir_stats.h
+ * Description:      Incremental entry counts and sizes of directories
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* The number of entries of a directory, let alone the size of a tree, is
+ * only known by listing it: du, quota checks and the dashboards walk whole
+ * trees with one NEXT per batch of entries and one GET per entry.
+ *
+ * Here every directory has a { ino, 'T' } record with its direct entry
+ * count and byte total, and the same for the whole tree below it:
+ * - cfs_creat/unlink/rename/write/truncate call dir_stats_create(),
+ *   dir_stats_unlink(), dir_stats_rename() or dir_stats_resize(), which
+ *   only add a delta to the directory in memory.
+ * - A flusher wakes up every interval_us (or once max_pending directories
+ *   have deltas), applies the deltas with one GET and one PUT per
+ *   DIR_STATS_BATCH directories, and adds the tree deltas to the parents.
+ *   The parents are updated by the next round of the same flush, level by
+ *   level up to the root, so many updates below a directory cost it one
+ *   PUT.
+ * - dir_stats_get() is then a single GET, whatever the size of the tree.
+ *
+ * The totals are eventually consistent: a record lags the updates by at
+ * most one interval. dir_stats_flush() makes them exact for the updates
+ * done before it was called. A file with several links is counted in
+ * every directory linking it.
+ */
+
+#ifndef _DIR_STATS_H
+#define _DIR_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "md_kvs.h"
+
+/* Directories read and written per operation of a flush */
+#define DIR_STATS_BATCH 128
+/* Buckets of the table of pending deltas */
+#define DIR_STATS_BUCKETS 1024
+
+/* Key of the stats record of a directory */
+struct md_dir_stats_key {
+	cfs_ino_t ino;
+	char type;
+} __attribute((packed));
+
+#define MD_DIR_STATS_KEY_INIT(key, ino2)		\
+{							\
+	(key)->ino = ino2;				\
+	(key)->type = MD_KEY_TYPE_DIR_STATS;		\
+}
+
+/* Value of the stats record. The tree totals include the direct ones;
+ * a subdirectory counts as one entry of its parent.
+ */
+struct md_dir_stats {
+	/* Directory the tree totals are added to, 0 for the root */
+	cfs_ino_t parent;
+	int64_t entries;
+	int64_t bytes;
+	int64_t tree_entries;
+	int64_t tree_bytes;
+};
+
+struct dir_stats_delta;
+struct dir_stats_batch;
+
+struct dir_stats {
+	/* Protects the table of pending deltas */
+	pthread_mutex_t ds_lock;
+	/* Signaled when max_pending is reached or the flusher must stop */
+	pthread_cond_t ds_cond;
+	/* Held by a flush, and by the updates that read a record */
+	pthread_mutex_t ds_flush_lock;
+	pthread_t ds_thread;
+	uint64_t ds_interval_us;
+	uint32_t ds_max_pending;
+	struct dir_stats_delta *ds_buckets[DIR_STATS_BUCKETS];
+	/* Directories with a delta */
+	uint32_t ds_pending;
+	bool ds_stop;
+	/* Scratch records and vectors of a flush, see flush_round() */
+	struct dir_stats_batch *ds_batch;
+	/* Counters */
+	uint64_t ds_updates;
+	uint64_t ds_flushes;
+	uint64_t ds_rounds;
+	uint64_t ds_records;
+	/* Deltas of directories without a record, dropped */
+	uint64_t ds_orphans;
+};
+
+/**
+ * Start a flusher applying the pending deltas every interval_us, or as
+ * soon as max_pending directories have some.
+ * md_kvs_init() must have been called before.
+ */
+int dir_stats_init(struct dir_stats *ds, uint64_t interval_us,
+		   uint32_t max_pending);
+
+/**
+ * Flush the pending deltas and stop the flusher.
+ */
+void dir_stats_fini(struct dir_stats *ds);
+
+/**
+ * Create the record of the new directory ino and count it in parent
+ * (0 for the root of a file system).
+ */
+int dir_stats_mkdir(struct dir_stats *ds, cfs_ino_t parent, cfs_ino_t ino);
+
+/**
+ * Remove the record of the empty directory ino, an entry of parent.
+ */
+int dir_stats_rmdir(struct dir_stats *ds, cfs_ino_t parent, cfs_ino_t ino);
+
+/**
+ * A file of size bytes was linked into (created in) dir.
+ * Like dir_stats_unlink() and dir_stats_resize(), it only fails with
+ * -ENOMEM, when the delta cannot be queued.
+ */
+int dir_stats_create(struct dir_stats *ds, cfs_ino_t dir, uint64_t size);
+
+/**
+ * A file of size bytes was unlinked from dir.
+ */
+int dir_stats_unlink(struct dir_stats *ds, cfs_ino_t dir, uint64_t size);
+
+/**
+ * The size of a file of dir changed from old_size to new_size, by a write
+ * or a truncate.
+ */
+int dir_stats_resize(struct dir_stats *ds, cfs_ino_t dir, uint64_t old_size,
+		     uint64_t new_size);
+
+/**
+ * An entry moved from src to dst. ino is the directory moved, with its
+ * whole tree, or 0 for a file of size bytes.
+ */
+int dir_stats_rename(struct dir_stats *ds, cfs_ino_t src, cfs_ino_t dst,
+		     cfs_ino_t ino, uint64_t size);
+
+/**
+ * Read the stats of directory ino, as of the last flush.
+ */
+int dir_stats_get(cfs_ino_t ino, struct md_dir_stats *stats);
+
+/**
+ * Apply the pending deltas up to the root.
+ */
+int dir_stats_flush(struct dir_stats *ds);
+
+void dir_stats_stats_print(struct dir_stats *ds, const char *msg);
+
+#endif /* _DIR_STATS_H */
@@ -0,0 +1,634 @@
+/*
+ * Filename:         dir_stats_bench.c
+ * Description:      Directory totals: incremental records versus a tree walk
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Build a tree of directories, FANOUT subdirectories per directory over
+ *   DEPTH levels, with FILES files each, from NUM_THREADS threads, and
+ *   account every create in dir_stats.h
+ * - Compute the size of the whole tree the way du does, listing every
+ *   directory and reading the stat record of every entry, and compare it
+ *   with a single dir_stats_get() of the root
+ * - Unlink, write, truncate and rename files from the threads while
+ *   directories are moved and created/removed, without touching the
+ *   records of the tree itself, then check the stats of every directory
+ *   against a model of the tree kept by the experiment
+ *
+ * Usage: dir_stats_bench [fanout] [depth] [files per dir] [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+#include "dir_stats.h"
+
+#define FANOUT 8
+#define DEPTH 3
+#define FILES 50
+#define NUM_THREADS 8
+#define INTERVAL_US 1000
+#define MAX_PENDING 256
+/* Entries listed and stat records read per operation of the tree walk */
+#define SCAN_BATCH 100
+/* dir_stats_get() calls timed */
+#define GET_LOOPS 1000
+#define DIR_INO(d) (0x4000ULL + (d))
+#define FILE_INO(f) (0x400000ULL + (f))
+#define TMP_INO(k) (0x40000000ULL + (k))
+
+/* What the experiment did to the tree, to check dir_stats against */
+struct tree {
+	int fanout;
+	int nr_dirs;
+	int files;
+	/* Parent of each directory, directory 0 is the root */
+	int *parent;
+	/* Directory, size and presence of each file */
+	int *file_dir;
+	uint64_t *size;
+	bool *alive;
+};
+
+enum phase {
+	PHASE_CREATE,
+	PHASE_MUTATE,
+	PHASE_REMOVE,
+};
+
+struct worker {
+	pthread_t thread;
+	struct dir_stats *ds;
+	struct tree *tree;
+	enum phase phase;
+	int id;
+	int nr_threads;
+	int rc;
+};
+
+static int dir_create(struct worker *w, int d)
+{
+	struct tree *tree = w->tree;
+	int rc, j, f;
+
+	rc = md_kvs_dir_populate(M0_IC_PUT, DIR_INO(d),
+				 FILE_INO(d * tree->files), tree->files);
+	for (j = 0; rc == 0 && j < tree->files; j++) {
+		/* md_kvs_dir_populate() sets st_size to the index */
+		f = d * tree->files + j;
+		tree->file_dir[f] = d;
+		tree->size[f] = j;
+		tree->alive[f] = true;
+		rc = dir_stats_create(w->ds, DIR_INO(d), j);
+	}
+	return rc;
+}
+
+/**
+ * Change the files created in d, the way a workload would: every file is
+ * unlinked, written, truncated, left alone or moved to the next directory.
+ */
+static int dir_mutate(struct worker *w, int d)
+{
+	struct tree *tree = w->tree;
+	int rc = 0, j, f, dst;
+	uint64_t size;
+
+	for (j = 0; rc == 0 && j < tree->files; j++) {
+		f = d * tree->files + j;
+		size = tree->size[f];
+		switch (j % 5) {
+		case 0:
+			rc = dir_stats_unlink(w->ds, DIR_INO(d), size);
+			tree->alive[f] = false;
+			break;
+		case 1:
+			tree->size[f] = size + 4096 * j;
+			rc = dir_stats_resize(w->ds, DIR_INO(d), size,
+					      tree->size[f]);
+			break;
+		case 2:
+			tree->size[f] = 0;
+			rc = dir_stats_resize(w->ds, DIR_INO(d), size, 0);
+			break;
+		case 3:
+			break;
+		default:
+			dst = (d + 1) % tree->nr_dirs;
+			rc = dir_stats_rename(w->ds, DIR_INO(d), DIR_INO(dst),
+					      0, size);
+			tree->file_dir[f] = dst;
+			break;
+		}
+	}
+	return rc;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct m0_thread thread;
+	int d;
+
+	w->rc = md_kvs_thread_enter(&thread);
+	if (w->rc != 0)
+		return NULL;
+
+	for (d = w->id; w->rc == 0 && d < w->tree->nr_dirs;
+	     d += w->nr_threads) {
+		switch (w->phase) {
+		case PHASE_CREATE:
+			w->rc = dir_create(w, d);
+			break;
+		case PHASE_MUTATE:
+			w->rc = dir_mutate(w, d);
+			break;
+		default:
+			w->rc = md_kvs_dir_populate(M0_IC_DEL, DIR_INO(d),
+				FILE_INO(d * w->tree->files), w->tree->files);
+			break;
+		}
+	}
+
+	md_kvs_thread_leave();
+	return NULL;
+}
+
+static int workers_start(struct worker *workers, int nr_threads,
+			 struct dir_stats *ds, struct tree *tree,
+			 enum phase phase)
+{
+	int rc, i;
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].ds = ds;
+		workers[i].tree = tree;
+		workers[i].phase = phase;
+		workers[i].id = i;
+		workers[i].nr_threads = nr_threads;
+		rc = -pthread_create(&workers[i].thread, NULL, worker_run,
+				     &workers[i]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+	return i;
+}
+
+static int workers_join(struct worker *workers, int started)
+{
+	int rc = 0, i;
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (rc == 0)
+			rc = workers[i].rc;
+	}
+	return rc;
+}
+
+/**
+ * Run one phase on every directory and report its time.
+ */
+static int workers_run(struct worker *workers, int nr_threads,
+		       struct dir_stats *ds, struct tree *tree,
+		       enum phase phase, const char *msg)
+{
+	struct timeval start1, end1;
+	int rc, started;
+
+	gettimeofday(&start1, NULL);
+	started = workers_start(workers, nr_threads, ds, tree, phase);
+	rc = workers_join(workers, started);
+	if (rc == 0 && started < nr_threads)
+		rc = -EAGAIN;
+	gettimeofday(&end1, NULL);
+
+	if (rc != 0) {
+		fprintf(stderr, "%s failed rc=%d\n", msg, rc);
+		return rc;
+	}
+
+	printf("%s: %d directories in %ld usecs\n", msg, tree->nr_dirs,
+	       md_kvs_elapsed_us(&start1, &end1));
+	return 0;
+}
+
+/**
+ * Move the first subdirectory of every directory of the first level to the
+ * next one, and create then remove a directory in each, while the workers
+ * update the files.
+ */
+static int tree_reshape(struct dir_stats *ds, struct tree *tree)
+{
+	int rc = 0, k, c, dst;
+
+	for (k = 1; rc == 0 && k <= tree->fanout; k++) {
+		rc = dir_stats_mkdir(ds, DIR_INO(k), TMP_INO(k));
+		if (rc == 0)
+			rc = dir_stats_create(ds, TMP_INO(k), 1 << 20);
+		if (rc == 0)
+			rc = dir_stats_unlink(ds, TMP_INO(k), 1 << 20);
+		if (rc == 0)
+			rc = dir_stats_rmdir(ds, DIR_INO(k), TMP_INO(k));
+
+		c = tree->fanout * k + 1;
+		if (rc != 0 || c >= tree->nr_dirs)
+			continue;
+		dst = k % tree->fanout + 1;
+		rc = dir_stats_rename(ds, DIR_INO(k), DIR_INO(dst), DIR_INO(c),
+				      0);
+		tree->parent[c] = dst;
+	}
+
+	if (rc != 0)
+		fprintf(stderr, "error(%d): tree_reshape\n", rc);
+	return rc;
+}
+
+/**
+ * Add the sizes of the nr entries of a dentry batch, read from their stat
+ * records with one GET.
+ */
+static int scan_batch(const struct md_kvs_iter *it, uint64_t *bytes)
+{
+	struct md_stat_key skeys[SCAN_BATCH];
+	struct m0_bufvec keys, vals;
+	void *kbufs[SCAN_BATCH], *vbufs[SCAN_BATCH];
+	m0_bcount_t klens[SCAN_BATCH], vlens[SCAN_BATCH];
+	int rcs[SCAN_BATCH];
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	uint32_t i;
+	int rc;
+
+	for (i = 0; i < it->nr; i++) {
+		md_dentry_decode(it, i, name, &ino);
+		MD_STAT_KEY_INIT(&skeys[i], ino);
+		kbufs[i] = &skeys[i];
+		klens[i] = sizeof(skeys[i]);
+	}
+	kvs_vec_wrap(&keys, kbufs, klens, it->nr);
+	kvs_vec_borrow(&vals, vbufs, vlens, it->nr);
+
+	rc = md_kvs_op(M0_IC_GET, &keys, &vals, rcs, 0);
+	for (i = 0; rc == 0 && i < it->nr; i++) {
+		rc = rcs[i];
+		if (rc == 0 && vlens[i] != sizeof(struct stat))
+			rc = -EINVAL;
+		if (rc == 0)
+			*bytes += ((struct stat *)vbufs[i])->st_size;
+	}
+
+	kvs_vec_release(&vals);
+	return rc;
+}
+
+/**
+ * Count the entries and bytes of the tree the way du does.
+ */
+static int tree_walk(const struct tree *tree, uint64_t *entries,
+		     uint64_t *bytes, uint64_t *ops)
+{
+	struct md_kvs_iter it;
+	int rc = 0, d;
+
+	/* The walk knows the subdirectories, only the files are listed */
+	*entries = tree->nr_dirs - 1;
+	*bytes = 0;
+	*ops = 0;
+	for (d = 0; rc == 0 && d < tree->nr_dirs; d++) {
+		rc = md_dentry_iter_init(&it, DIR_INO(d), SCAN_BATCH);
+		if (rc != 0)
+			break;
+
+		while (rc == 0 && !it.eof) {
+			rc = md_kvs_iter_next(&it);
+			(*ops)++;
+			if (rc != 0 || it.nr == 0)
+				break;
+			rc = scan_batch(&it, bytes);
+			(*ops)++;
+			*entries += it.nr;
+		}
+		md_kvs_iter_fini(&it);
+	}
+	return rc;
+}
+
+static int tree_total_compare(struct dir_stats *ds, const struct tree *tree)
+{
+	struct md_dir_stats stats;
+	struct timeval start1, end1;
+	uint64_t entries, bytes, ops;
+	long elapsed;
+	int rc, i;
+
+	rc = dir_stats_flush(ds);
+	if (rc != 0)
+		return rc;
+
+	gettimeofday(&start1, NULL);
+	rc = tree_walk(tree, &entries, &bytes, &ops);
+	gettimeofday(&end1, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): tree walk\n", rc);
+		return rc;
+	}
+	printf("tree walk: %llu entries, %llu bytes in %ld usecs, "
+	       "%llu operations\n", (unsigned long long)entries,
+	       (unsigned long long)bytes, md_kvs_elapsed_us(&start1, &end1),
+	       (unsigned long long)ops);
+
+	gettimeofday(&start1, NULL);
+	for (i = 0; rc == 0 && i < GET_LOOPS; i++)
+		rc = dir_stats_get(DIR_INO(0), &stats);
+	gettimeofday(&end1, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): dir_stats_get\n", rc);
+		return rc;
+	}
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	printf("dir stats: %lld entries, %lld bytes in %.1f usecs, "
+	       "1 operation\n", (long long)stats.tree_entries,
+	       (long long)stats.tree_bytes, (double)elapsed / GET_LOOPS);
+
+	if (stats.tree_entries != entries || stats.tree_bytes != bytes) {
+		fprintf(stderr, "dir stats differ from the tree walk\n");
+		return -EIO;
+	}
+	return 0;
+}
+
+/**
+ * Compare the stats of every directory with the model.
+ */
+static int tree_check(const struct tree *tree)
+{
+	struct md_dir_stats *expect, stats;
+	int rc = 0, d, f, bad = 0;
+
+	expect = calloc(tree->nr_dirs, sizeof(*expect));
+	if (expect == NULL)
+		return -ENOMEM;
+
+	for (f = 0; f < tree->nr_dirs * tree->files; f++) {
+		if (!tree->alive[f])
+			continue;
+		expect[tree->file_dir[f]].entries++;
+		expect[tree->file_dir[f]].bytes += tree->size[f];
+	}
+	for (d = 1; d < tree->nr_dirs; d++) {
+		expect[d].parent = DIR_INO(tree->parent[d]);
+		expect[tree->parent[d]].entries++;
+	}
+	for (d = 0; d < tree->nr_dirs; d++) {
+		expect[d].tree_entries = expect[d].entries;
+		expect[d].tree_bytes = expect[d].bytes;
+	}
+	/* A parent always has a lower index than its subdirectories */
+	for (d = tree->nr_dirs - 1; d > 0; d--) {
+		expect[tree->parent[d]].tree_entries += expect[d].tree_entries;
+		expect[tree->parent[d]].tree_bytes += expect[d].tree_bytes;
+	}
+
+	for (d = 0; rc == 0 && d < tree->nr_dirs; d++) {
+		rc = dir_stats_get(DIR_INO(d), &stats);
+		if (rc == 0 && memcmp(&stats, &expect[d], sizeof(stats)) != 0) {
+			if (bad++ < 5)
+				fprintf(stderr, "dir %d: %lld %lld %lld %lld, "
+					"expected %lld %lld %lld %lld\n", d,
+					(long long)stats.entries,
+					(long long)stats.bytes,
+					(long long)stats.tree_entries,
+					(long long)stats.tree_bytes,
+					(long long)expect[d].entries,
+					(long long)expect[d].bytes,
+					(long long)expect[d].tree_entries,
+					(long long)expect[d].tree_bytes);
+		}
+	}
+
+	free(expect);
+	if (rc == 0 && bad != 0) {
+		fprintf(stderr, "%d directories with wrong stats\n", bad);
+		rc = -EIO;
+	}
+	if (rc == 0)
+		printf("check: stats of %d directories match\n",
+		       tree->nr_dirs);
+	return rc;
+}
+
+static int tree_init(struct tree *tree, int fanout, int depth, int files)
+{
+	int level, width, d;
+
+	memset(tree, 0, sizeof(*tree));
+	tree->fanout = fanout;
+	tree->files = files;
+	for (level = 0, width = 1; level <= depth; level++, width *= fanout)
+		tree->nr_dirs += width;
+
+	tree->parent = calloc(tree->nr_dirs, sizeof(*tree->parent));
+	tree->file_dir = calloc(tree->nr_dirs * files,
+				sizeof(*tree->file_dir));
+	tree->size = calloc(tree->nr_dirs * files, sizeof(*tree->size));
+	tree->alive = calloc(tree->nr_dirs * files, sizeof(*tree->alive));
+	if (tree->parent == NULL || tree->file_dir == NULL ||
+	    tree->size == NULL || tree->alive == NULL)
+		return -ENOMEM;
+
+	/* Breadth first: the subdirectories of d are fanout * d + 1.. */
+	for (d = 1; d < tree->nr_dirs; d++)
+		tree->parent[d] = (d - 1) / fanout;
+	return 0;
+}
+
+static void tree_fini(struct tree *tree)
+{
+	free(tree->alive);
+	free(tree->size);
+	free(tree->file_dir);
+	free(tree->parent);
+}
+
+static int dir_stats_run(int fanout, int depth, int files, int nr_threads)
+{
+	struct dir_stats ds;
+	struct tree tree;
+	struct worker *workers;
+	int rc, rc2, d, started;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	rc = tree_init(&tree, fanout, depth, files);
+	if (rc == 0 && workers == NULL)
+		rc = -ENOMEM;
+	if (rc != 0)
+		goto out;
+
+	rc = dir_stats_init(&ds, INTERVAL_US, MAX_PENDING);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): dir_stats_init\n", rc);
+		goto out;
+	}
+
+	for (d = 0; rc == 0 && d < tree.nr_dirs; d++)
+		rc = dir_stats_mkdir(&ds, d == 0 ? 0 : DIR_INO(tree.parent[d]),
+				     DIR_INO(d));
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): dir_stats_mkdir\n", rc);
+		goto fini;
+	}
+
+	rc = workers_run(workers, nr_threads, &ds, &tree, PHASE_CREATE,
+			 "create");
+	if (rc == 0)
+		rc = tree_total_compare(&ds, &tree);
+	if (rc != 0)
+		goto remove;
+
+	/* Move directories while the files below them change */
+	started = workers_start(workers, nr_threads, &ds, &tree,
+				PHASE_MUTATE);
+	rc = tree_reshape(&ds, &tree);
+	rc2 = workers_join(workers, started);
+	if (rc == 0)
+		rc = rc2 != 0 ? rc2 : started < nr_threads ? -EAGAIN : 0;
+	if (rc == 0)
+		rc = dir_stats_flush(&ds);
+	if (rc == 0)
+		rc = tree_check(&tree);
+
+remove:
+	rc2 = workers_run(workers, nr_threads, &ds, &tree, PHASE_REMOVE,
+			  "remove");
+	if (rc == 0)
+		rc = rc2;
+	/* Subdirectories first, so that no record is left */
+	for (d = tree.nr_dirs - 1; d >= 0; d--) {
+		rc2 = dir_stats_rmdir(&ds, d == 0 ? 0 :
+				      DIR_INO(tree.parent[d]), DIR_INO(d));
+		if (rc == 0)
+			rc = rc2;
+	}
+fini:
+	dir_stats_stats_print(&ds, "dir stats");
+	dir_stats_fini(&ds);
+out:
+	tree_fini(&tree);
+	free(workers);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int fanout = FANOUT;
+	int depth = DEPTH;
+	int files = FILES;
+	int nr_threads = NUM_THREADS;
+	int rc;
+
+	if (argc > 5) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [fanout] [depth] [files per dir] "
+			"[threads]\n", basename(argv[0]));
+		return -1;
+	}
+
+	if (argc > 1)
+		fanout = atoi(argv[1]);
+	if (argc > 2)
+		depth = atoi(argv[2]);
+	if (argc > 3)
+		files = atoi(argv[3]);
+	if (argc > 4)
+		nr_threads = atoi(argv[4]);
+	if (fanout < 2 || depth < 1 || depth > 6 || files <= 0 ||
+	    nr_threads <= 0) {
+		fprintf(stderr, "invalid fanout, depth, files or threads\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = dir_stats_run(fanout, depth, files, nr_threads);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,336 @@
+/*
+ * Filename:         getattr_batch.c
+ * Description:      Batched multi-inode getattr against per-inode getattr
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Store stat records for 10, 1k and 100k inodes
+ * - Fetch them with one GET per inode, the way getattr_profiling.c
+ *   calls cfs_getattr() in a loop
+ * - Fetch them with getattr_batch(), which packs up to GETATTR_BATCH_MAX
+ *   keys into one multi-key GET (same m0_bufvec pattern as set_batch() in
+ *   experiments/xattr/approach1.c)
+ * - Compare time taken by both paths
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+
+/* Max keys shipped in a single GET/PUT/DEL */
+#define GETATTR_BATCH_MAX 1000
+#define FIRST_INO 0x10000ULL
+
+static const int test_sizes[] = { 10, 1000, 100000 };
+
+static void stat_fill(struct stat *st, cfs_ino_t ino)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = S_IFREG | 0644;
+	st->st_nlink = 1;
+	st->st_uid = 100;
+	st->st_gid = 100;
+	st->st_size = ino;
+}
+
+/**
+ * Store or remove stat records for inodes [first, first + nr)
+ */
+static int stat_records_update(enum m0_idx_opcode opcode, cfs_ino_t first,
+			       int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct md_stat_key *skey;
+	int rc = 0, i, cnt, done;
+
+	for (done = 0; rc == 0 && done < nr; done += cnt) {
+		cnt = nr - done < GETATTR_BATCH_MAX ?
+			nr - done : GETATTR_BATCH_MAX;
+
+		rc = m0_bufvec_alloc(&key, cnt, sizeof(struct md_stat_key));
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): m0_bufvec_alloc\n", rc);
+			break;
+		}
+
+		if (opcode == M0_IC_PUT) {
+			rc = m0_bufvec_alloc(&val, cnt, sizeof(struct stat));
+			if (rc != 0) {
+				fprintf(stderr, "error(%d): m0_bufvec_alloc\n",
+					rc);
+				m0_bufvec_free(&key);
+				break;
+			}
+		}
+
+		for (i = 0; i < cnt; i++) {
+			skey = key.ov_buf[i];
+			MD_STAT_KEY_INIT(skey, first + done + i);
+			if (opcode == M0_IC_PUT)
+				stat_fill(val.ov_buf[i], first + done + i);
+		}
+
+		rc = md_kvs_op(opcode, &key, opcode == M0_IC_PUT ? &val : NULL,
+			       NULL, M0_OIF_OVERWRITE);
+		if (rc != 0)
+			fprintf(stderr, "error(%d): md_kvs_op\n", rc);
+
+		m0_bufvec_free(&key);
+		if (opcode == M0_IC_PUT)
+			m0_bufvec_free(&val);
+	}
+
+	return rc;
+}
+
+/**
+ * Fetch attributes of a single inode, one round trip.
+ */
+static int getattr_one(cfs_ino_t ino, struct stat *st)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int rc;
+
+	rc = m0_bufvec_alloc(&key, 1, sizeof(struct md_stat_key));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc != 0) {
+		m0_bufvec_free(&key);
+		return rc;
+	}
+
+	MD_STAT_KEY_INIT((struct md_stat_key *)key.ov_buf[0], ino);
+
+	rc = md_kvs_op(M0_IC_GET, &key, &val, NULL, 0);
+	if (rc != 0)
+		goto out;
+
+	if (val.ov_vec.v_count[0] != sizeof(struct stat)) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	memcpy(st, val.ov_buf[0], sizeof(struct stat));
+
+out:
+	m0_bufvec_free(&key);
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+/**
+ * Fetch attributes of nr inodes using multi-key GETs.
+ * rcs[i] receives the status of inos[i] (-ENOENT for a missing inode);
+ * stats[i] is valid only when rcs[i] == 0.
+ * Returns a non-zero value only when an index operation failed as a whole.
+ */
+static int getattr_batch(const cfs_ino_t *inos, struct stat *stats, int *rcs,
+			 int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int rc = 0, i, cnt, done;
+
+	for (done = 0; done < nr; done += cnt) {
+		cnt = nr - done < GETATTR_BATCH_MAX ?
+			nr - done : GETATTR_BATCH_MAX;
+
+		rc = m0_bufvec_alloc(&key, cnt, sizeof(struct md_stat_key));
+		if (rc != 0)
+			break;
+
+		rc = m0_bufvec_empty_alloc(&val, cnt);
+		if (rc != 0) {
+			m0_bufvec_free(&key);
+			break;
+		}
+
+		for (i = 0; i < cnt; i++)
+			MD_STAT_KEY_INIT((struct md_stat_key *)key.ov_buf[i],
+					 inos[done + i]);
+
+		rc = md_kvs_op(M0_IC_GET, &key, &val, rcs + done, 0);
+		for (i = 0; rc == 0 && i < cnt; i++) {
+			if (rcs[done + i] != 0)
+				continue;
+			if (val.ov_vec.v_count[i] != sizeof(struct stat)) {
+				rcs[done + i] = -EINVAL;
+				continue;
+			}
+			memcpy(&stats[done + i], val.ov_buf[i],
+			       sizeof(struct stat));
+		}
+
+		m0_bufvec_free(&key);
+		m0_bufvec_free(&val);
+		if (rc != 0)
+			break;
+	}
+
+	return rc;
+}
+
+static int getattr_compare(int nr)
+{
+	cfs_ino_t *inos = NULL;
+	struct stat *stats = NULL;
+	struct stat st;
+	int *rcs = NULL;
+	struct timeval start1, end1;
+	long loop_us, batch_us;
+	int rc, i;
+
+	inos = calloc(nr, sizeof(*inos));
+	stats = calloc(nr, sizeof(*stats));
+	rcs = calloc(nr, sizeof(*rcs));
+	if (inos == NULL || stats == NULL || rcs == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++)
+		inos[i] = FIRST_INO + i;
+
+	rc = stat_records_update(M0_IC_PUT, FIRST_INO, nr);
+	if (rc != 0)
+		goto out;
+
+	gettimeofday(&start1, NULL);
+	for (i = 0; i < nr; i++) {
+		rc = getattr_one(inos[i], &st);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): getattr ino %llu\n", rc,
+				inos[i]);
+			goto cleanup;
+		}
+	}
+	gettimeofday(&end1, NULL);
+	loop_us = md_kvs_elapsed_us(&start1, &end1);
+
+	gettimeofday(&start1, NULL);
+	rc = getattr_batch(inos, stats, rcs, nr);
+	gettimeofday(&end1, NULL);
+	batch_us = md_kvs_elapsed_us(&start1, &end1);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): getattr_batch\n", rc);
+		goto cleanup;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (rcs[i] != 0 || stats[i].st_ino != inos[i]) {
+			fprintf(stderr, "getattr_batch: bad record for %llu,"
+				" rc=%d\n", inos[i], rcs[i]);
+			rc = -EINVAL;
+			goto cleanup;
+		}
+	}
+
+	printf("%6d inodes: per-inode %ld usecs (%ld usecs/inode),"
+	       " batched %ld usecs (%ld usecs/inode), %d GETs vs %d\n",
+	       nr, loop_us, loop_us / nr, batch_us, batch_us / nr, nr,
+	       (nr + GETATTR_BATCH_MAX - 1) / GETATTR_BATCH_MAX);
+
+cleanup:
+	if (stat_records_update(M0_IC_DEL, FIRST_INO, nr) != 0)
+		fprintf(stderr, "failed to remove stat records\n");
+out:
+	free(rcs);
+	free(stats);
+	free(inos);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int rc = 0;
+	size_t i;
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	for (i = 0; i < sizeof(test_sizes) / sizeof(test_sizes[0]); i++) {
+		rc = getattr_compare(test_sizes[i]);
+		if (rc != 0)
+			break;
+	}
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,350 @@
+/*
+ * Filename:         group_commit.c
+ * Description:      Group commit of small metadata updates
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "motr/client.h"
+#include "md_kvs.h"
+#include "group_commit.h"
+#include "../perf/trace.h"
+
+/* Queued record, lives on the stack of the thread waiting for it */
+struct group_commit_req {
+	enum m0_idx_opcode gr_opcode;
+	const void *gr_key;
+	size_t gr_klen;
+	const void *gr_val;
+	size_t gr_vlen;
+	/* CLOCK_REALTIME, as used by pthread_cond_timedwait() */
+	struct timespec gr_queued_at;
+	/* Trace context of the caller, adopted by the committer */
+	struct trace_ctx gr_trace;
+	int gr_rc;
+	bool gr_done;
+	struct group_commit_req *gr_next;
+};
+
+static bool req_same_key(const struct group_commit_req *a,
+			 const struct group_commit_req *b)
+{
+	return a->gr_klen == b->gr_klen &&
+		memcmp(a->gr_key, b->gr_key, a->gr_klen) == 0;
+}
+
+/**
+ * Detach the longest run of queued records that can share one operation.
+ * Called with gc_lock held.
+ */
+static struct group_commit_req *batch_take(struct group_commit *gc,
+					   uint32_t *nr)
+{
+	struct group_commit_req *head = gc->gc_head;
+	struct group_commit_req *req, *prev;
+	uint32_t n = 1;
+
+	for (req = head->gr_next; req != NULL && n < gc->gc_max_records;
+	     req = req->gr_next, n++) {
+		if (req->gr_opcode != head->gr_opcode)
+			break;
+		for (prev = head; prev != req; prev = prev->gr_next)
+			if (req_same_key(prev, req))
+				break;
+		if (prev != req)
+			break;
+	}
+
+	/* Cut the queue before req */
+	gc->gc_head = req;
+	if (req == NULL) {
+		gc->gc_tail = &gc->gc_head;
+	} else {
+		for (prev = head; prev->gr_next != req; prev = prev->gr_next)
+			;
+		prev->gr_next = NULL;
+	}
+	gc->gc_queued -= n;
+
+	*nr = n;
+	return head;
+}
+
+/**
+ * Write nr records with one operation and set the rc of each of them.
+ * keys and vals only point to the buffers of the callers, nothing is copied.
+ */
+static void batch_commit(struct group_commit *gc,
+			 struct group_commit_req *batch, uint32_t nr)
+{
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	void **bufs = gc->gc_bufs;
+	m0_bcount_t *counts = gc->gc_counts;
+	struct group_commit_req *req;
+	enum m0_idx_opcode opcode = batch->gr_opcode;
+	struct trace_ctx trace = {};
+	uint64_t trace_start;
+	uint32_t i;
+	int rc;
+
+	for (req = batch, i = 0; req != NULL; req = req->gr_next, i++) {
+		bufs[i] = (void *)req->gr_key;
+		counts[i] = req->gr_klen;
+		bufs[nr + i] = (void *)req->gr_val;
+		counts[nr + i] = req->gr_vlen;
+		if (trace.trace_id == 0)
+			trace = req->gr_trace;
+	}
+
+	kvs_vec_wrap(&keys, bufs, counts, nr);
+	kvs_vec_wrap(&vals, bufs + nr, counts + nr, nr);
+
+	/* The operation is traced with the first sampled request */
+	trace_ctx_set(trace);
+	trace_start = trace_request_begin();
+	rc = md_kvs_op(opcode, &keys, opcode == M0_IC_PUT ? &vals : NULL,
+		       gc->gc_rcs, M0_OIF_OVERWRITE);
+	trace_request_end("gc.commit", trace_start);
+	trace_ctx_set((struct trace_ctx) {});
+	if (rc != 0)
+		fprintf(stderr, "error(%d): group commit of %u records\n",
+			rc, nr);
+
+	for (req = batch, i = 0; req != NULL; req = req->gr_next, i++)
+		req->gr_rc = rc != 0 ? rc : gc->gc_rcs[i];
+}
+
+static void *committer(void *arg)
+{
+	struct group_commit *gc = arg;
+	struct group_commit_req *batch, *req, *next;
+	struct timespec deadline;
+	struct m0_thread thread;
+	uint32_t nr;
+	int rc;
+
+	rc = md_kvs_thread_enter(&thread);
+
+	pthread_mutex_lock(&gc->gc_lock);
+	for (;;) {
+		while (gc->gc_head == NULL && !gc->gc_stop)
+			pthread_cond_wait(&gc->gc_cond, &gc->gc_lock);
+		if (gc->gc_head == NULL)
+			break;
+
+		/* Give other threads until the window of the oldest record
+		 * expires to join the batch.
+		 */
+		deadline = gc->gc_head->gr_queued_at;
+		deadline.tv_sec += gc->gc_window_us / 1000000;
+		deadline.tv_nsec += (gc->gc_window_us % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (gc->gc_queued < gc->gc_max_records && !gc->gc_stop &&
+		       pthread_cond_timedwait(&gc->gc_cond, &gc->gc_lock,
+					      &deadline) != ETIMEDOUT)
+			;
+
+		batch = batch_take(gc, &nr);
+		pthread_mutex_unlock(&gc->gc_lock);
+
+		if (rc == 0) {
+			batch_commit(gc, batch, nr);
+		} else {
+			for (req = batch; req != NULL; req = req->gr_next)
+				req->gr_rc = rc;
+		}
+
+		pthread_mutex_lock(&gc->gc_lock);
+		/* Waiters may return as soon as gr_done is set */
+		for (req = batch; req != NULL; req = next) {
+			next = req->gr_next;
+			req->gr_done = true;
+		}
+		gc->gc_batches++;
+		gc->gc_records += nr;
+		pthread_cond_broadcast(&gc->gc_done_cond);
+	}
+	pthread_mutex_unlock(&gc->gc_lock);
+
+	if (rc == 0)
+		md_kvs_thread_leave();
+	return NULL;
+}
+
+int group_commit_init(struct group_commit *gc, uint32_t max_records,
+		      uint64_t window_us)
+{
+	int rc;
+
+	if (max_records == 0)
+		return -EINVAL;
+
+	memset(gc, 0, sizeof(*gc));
+	gc->gc_max_records = max_records;
+	gc->gc_window_us = window_us;
+	gc->gc_tail = &gc->gc_head;
+
+	/* Key and value pointers/lengths of a batch, then its rcs */
+	M0_ALLOC_ARR(gc->gc_bufs, 2 * max_records);
+	M0_ALLOC_ARR(gc->gc_counts, 2 * max_records);
+	M0_ALLOC_ARR(gc->gc_rcs, max_records);
+	if (gc->gc_bufs == NULL || gc->gc_counts == NULL ||
+	    gc->gc_rcs == NULL) {
+		rc = -ENOMEM;
+		goto free_arrays;
+	}
+
+	rc = -pthread_mutex_init(&gc->gc_lock, NULL);
+	if (rc != 0)
+		goto free_arrays;
+
+	rc = -pthread_cond_init(&gc->gc_cond, NULL);
+	if (rc != 0)
+		goto destroy_lock;
+
+	rc = -pthread_cond_init(&gc->gc_done_cond, NULL);
+	if (rc != 0)
+		goto destroy_cond;
+
+	rc = -pthread_create(&gc->gc_thread, NULL, committer, gc);
+	if (rc != 0)
+		goto destroy_done_cond;
+
+	return 0;
+
+destroy_done_cond:
+	pthread_cond_destroy(&gc->gc_done_cond);
+destroy_cond:
+	pthread_cond_destroy(&gc->gc_cond);
+destroy_lock:
+	pthread_mutex_destroy(&gc->gc_lock);
+free_arrays:
+	m0_free(gc->gc_rcs);
+	m0_free(gc->gc_counts);
+	m0_free(gc->gc_bufs);
+	return rc;
+}
+
+void group_commit_fini(struct group_commit *gc)
+{
+	pthread_mutex_lock(&gc->gc_lock);
+	gc->gc_stop = true;
+	pthread_cond_signal(&gc->gc_cond);
+	pthread_mutex_unlock(&gc->gc_lock);
+
+	pthread_join(gc->gc_thread, NULL);
+
+	pthread_cond_destroy(&gc->gc_done_cond);
+	pthread_cond_destroy(&gc->gc_cond);
+	pthread_mutex_destroy(&gc->gc_lock);
+	m0_free(gc->gc_rcs);
+	m0_free(gc->gc_counts);
+	m0_free(gc->gc_bufs);
+}
+
+static int group_commit_queue(struct group_commit *gc,
+			      struct group_commit_req *req)
+{
+	clock_gettime(CLOCK_REALTIME, &req->gr_queued_at);
+	req->gr_trace = trace_ctx_get();
+	req->gr_rc = 0;
+	req->gr_done = false;
+	req->gr_next = NULL;
+
+	pthread_mutex_lock(&gc->gc_lock);
+	if (gc->gc_stop) {
+		pthread_mutex_unlock(&gc->gc_lock);
+		return -ESHUTDOWN;
+	}
+
+	*gc->gc_tail = req;
+	gc->gc_tail = &req->gr_next;
+	gc->gc_queued++;
+
+	/* Wake the committer up for a new batch or a full one */
+	if (gc->gc_queued == 1 || gc->gc_queued >= gc->gc_max_records)
+		pthread_cond_signal(&gc->gc_cond);
+
+	while (!req->gr_done)
+		pthread_cond_wait(&gc->gc_done_cond, &gc->gc_lock);
+	pthread_mutex_unlock(&gc->gc_lock);
+
+	return req->gr_rc;
+}
+
+int group_commit_put(struct group_commit *gc, const void *key, size_t klen,
+		     const void *val, size_t vlen)
+{
+	struct group_commit_req req = {
+		.gr_opcode = M0_IC_PUT,
+		.gr_key = key,
+		.gr_klen = klen,
+		.gr_val = val,
+		.gr_vlen = vlen,
+	};
+	uint64_t trace_start;
+	int rc;
+
+	trace_start = trace_request_begin();
+	rc = group_commit_queue(gc, &req);
+	trace_request_end("gc.put", trace_start);
+	return rc;
+}
+
+int group_commit_del(struct group_commit *gc, const void *key, size_t klen)
+{
+	struct group_commit_req req = {
+		.gr_opcode = M0_IC_DEL,
+		.gr_key = key,
+		.gr_klen = klen,
+	};
+	uint64_t trace_start;
+	int rc;
+
+	trace_start = trace_request_begin();
+	rc = group_commit_queue(gc, &req);
+	trace_request_end("gc.del", trace_start);
+	return rc;
+}
+
+void group_commit_stats_print(struct group_commit *gc, const char *msg)
+{
+	pthread_mutex_lock(&gc->gc_lock);
+	printf("%s: %llu records in %llu operations (%.1f per operation)\n",
+	       msg, (unsigned long long)gc->gc_records,
+	       (unsigned long long)gc->gc_batches,
+	       gc->gc_batches != 0 ?
+	       (double)gc->gc_records / gc->gc_batches : 0.0);
+	pthread_mutex_unlock(&gc->gc_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,99 @@
+/*
+ * Filename:         group_commit.h
+ * Description:      Group commit of small metadata updates
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Every cfs_setattr()/cfs_creat() writes its records with a PUT of its own
+ * and waits for M0_OS_STABLE, so many concurrent small updates each pay the
+ * full stability latency.
+ *
+ * A group commit coalesces the updates of concurrent threads:
+ * - group_commit_put()/group_commit_del() queue one record and block.
+ * - A committer thread gathers queued records for up to window_us (or until
+ *   max_records are queued) and writes them with one multi-key operation,
+ *   like set_batch() in experiments/xattr/approach1.c.
+ * - Every caller returns the rc of its own record, once the whole operation
+ *   is stable.
+ *
+ * A batch only holds records of the same opcode and never the same key
+ * twice, so that the updates of a key are applied in the order they were
+ * queued. The next record closes the batch otherwise.
+ */
+
+#ifndef _GROUP_COMMIT_H
+#define _GROUP_COMMIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "motr/client.h"
+
+struct group_commit_req;
+
+struct group_commit {
+	pthread_mutex_t gc_lock;
+	/* Signaled when records are queued or the committer must stop */
+	pthread_cond_t gc_cond;
+	/* Broadcast when a batch is stable */
+	pthread_cond_t gc_done_cond;
+	pthread_t gc_thread;
+	uint32_t gc_max_records;
+	uint64_t gc_window_us;
+	/* Queued records, in arrival order */
+	struct group_commit_req *gc_head;
+	struct group_commit_req **gc_tail;
+	uint32_t gc_queued;
+	bool gc_stop;
+	/* Scratch arrays of the committer, see batch_commit() */
+	void **gc_bufs;
+	m0_bcount_t *gc_counts;
+	int *gc_rcs;
+	/* Counters */
+	uint64_t gc_batches;
+	uint64_t gc_records;
+};
+
+/**
+ * Start a committer writing up to max_records per operation and waiting up
+ * to window_us after the first record of a batch was queued.
+ * window_us == 0 writes whatever is queued right away.
+ * md_kvs_init() must have been called before.
+ */
+int group_commit_init(struct group_commit *gc, uint32_t max_records,
+		      uint64_t window_us);
+
+/**
+ * Write the records still queued and stop the committer.
+ */
+void group_commit_fini(struct group_commit *gc);
+
+/**
+ * Queue a PUT (overwrite) of one record, wait until it is stable and return
+ * its rc. key and val are not copied.
+ */
+int group_commit_put(struct group_commit *gc, const void *key, size_t klen,
+		     const void *val, size_t vlen);
+
+/**
+ * Same as group_commit_put() for a DEL.
+ */
+int group_commit_del(struct group_commit *gc, const void *key, size_t klen);
+
+void group_commit_stats_print(struct group_commit *gc, const char *msg);
+
+#endif /* _GROUP_COMMIT_H */
@@ -0,0 +1,283 @@
+/*
+ * Filename:         group_commit_bench.c
+ * Description:      Concurrent setattr with and without group commit
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Start NUM_THREADS threads, each updating the stat records of its own
+ *   UPDATES inodes one at a time, the way Ganesha workers call
+ *   cfs_setattr() during an untar
+ *   a) with one PUT per update, waiting for it to be stable
+ *   b) through a group commit (group_commit.c) gathering the updates of
+ *      all threads for up to WINDOW_US
+ * - Remove the records the same two ways
+ * - Calculate time taken, throughput and operations sent
+ *
+ * Usage: group_commit_bench [threads] [updates per thread] [window usecs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <pthread.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+#include "kvs_pool.h"
+#include "group_commit.h"
+#include "../perf/perf_stats.h"
+
+#define NUM_THREADS 16
+#define UPDATES 100
+#define WINDOW_US 500
+#define GROUP_COMMIT_MAX 100
+#define FIRST_INO 0x30000ULL
+
+struct worker {
+	pthread_t thread;
+	/* NULL: one operation per update */
+	struct group_commit *gc;
+	enum m0_idx_opcode opcode;
+	cfs_ino_t first_ino;
+	int nr;
+	int rc;
+};
+
+static int update_one(struct group_commit *gc, enum m0_idx_opcode opcode,
+		      cfs_ino_t ino)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct md_stat_key skey;
+	struct stat st;
+	void *kbuf = &skey, *vbuf = &st;
+	m0_bcount_t klen = sizeof(skey), vlen = sizeof(st);
+
+	MD_STAT_KEY_INIT(&skey, ino);
+	memset(&st, 0, sizeof(st));
+	st.st_ino = ino;
+	st.st_mode = S_IFREG | 0644;
+	st.st_nlink = 1;
+	st.st_mtime = time(NULL);
+
+	if (gc != NULL)
+		return opcode == M0_IC_PUT ?
+			group_commit_put(gc, &skey, klen, &st, vlen) :
+			group_commit_del(gc, &skey, klen);
+
+	/* Single record bufvecs on the stack, nothing to allocate */
+	kvs_vec_wrap(&key, &kbuf, &klen, 1);
+	kvs_vec_wrap(&val, &vbuf, &vlen, 1);
+
+	return md_kvs_op(opcode, &key, opcode == M0_IC_PUT ? &val : NULL, NULL,
+			 M0_OIF_OVERWRITE);
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct m0_thread thread;
+	int i;
+
+	w->rc = md_kvs_thread_enter(&thread);
+	if (w->rc != 0)
+		return NULL;
+
+	for (i = 0; w->rc == 0 && i < w->nr; i++)
+		w->rc = update_one(w->gc, w->opcode, w->first_ino + i);
+
+	md_kvs_thread_leave();
+
+	return NULL;
+}
+
+/**
+ * Run nr_threads workers, each doing updates operations, and report.
+ */
+static int workers_run(struct worker *workers, int nr_threads, int updates,
+		       struct group_commit *gc, enum m0_idx_opcode opcode,
+		       const char *msg)
+{
+	struct timeval start1, end1;
+	long elapsed;
+	int rc = 0, i, started;
+
+	gettimeofday(&start1, NULL);
+	for (started = 0; started < nr_threads; started++) {
+		workers[started].gc = gc;
+		workers[started].opcode = opcode;
+		workers[started].first_ino = FIRST_INO + started * updates;
+		workers[started].nr = updates;
+		rc = -pthread_create(&workers[started].thread, NULL,
+				     worker_run, &workers[started]);
+		if (rc != 0) {
+			fprintf(stderr, "error(%d): pthread_create\n", rc);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (rc == 0)
+			rc = workers[i].rc;
+	}
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+
+	if (rc != 0) {
+		fprintf(stderr, "%s failed rc=%d\n", msg, rc);
+		return rc;
+	}
+
+	printf("%s: %d threads x %d updates in %ld usecs, %.0f updates/s\n",
+	       msg, nr_threads, updates, elapsed,
+	       elapsed > 0 ? nr_threads * updates * 1e6 / elapsed : 0.0);
+	return 0;
+}
+
+static int group_commit_compare(int nr_threads, int updates, long window_us)
+{
+	struct group_commit gc;
+	struct worker *workers;
+	int rc;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (workers == NULL)
+		return -ENOMEM;
+
+	rc = workers_run(workers, nr_threads, updates, NULL, M0_IC_PUT,
+			 "PUT one at a time");
+	if (rc == 0)
+		rc = workers_run(workers, nr_threads, updates, NULL, M0_IC_DEL,
+				 "DEL one at a time");
+	if (rc != 0)
+		goto out;
+
+	rc = group_commit_init(&gc, GROUP_COMMIT_MAX, window_us);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): group_commit_init\n", rc);
+		goto out;
+	}
+
+	rc = workers_run(workers, nr_threads, updates, &gc, M0_IC_PUT,
+			 "PUT group commit");
+	/* Remove whatever was written even if some PUT failed */
+	if (workers_run(workers, nr_threads, updates, &gc, M0_IC_DEL,
+			"DEL group commit") != 0 && rc == 0)
+		rc = -EIO;
+	group_commit_stats_print(&gc, "group commit");
+
+	group_commit_fini(&gc);
+out:
+	free(workers);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int nr_threads = NUM_THREADS;
+	int updates = UPDATES;
+	long window_us = WINDOW_US;
+	int rc;
+
+	if (argc > 4) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [threads] [updates per thread]"
+			" [window usecs]\n", basename(argv[0]));
+		return -1;
+	}
+
+	if (argc > 1)
+		nr_threads = atoi(argv[1]);
+	if (argc > 2)
+		updates = atoi(argv[2]);
+	if (argc > 3)
+		window_us = atol(argv[3]);
+	if (nr_threads <= 0 || updates <= 0 || window_us < 0) {
+		fprintf(stderr, "invalid threads, updates or window\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = group_commit_compare(nr_threads, updates, window_us);
+
+	/* Latency of the index operations as the threads saw them */
+	printf("\nIndex operations:\n");
+	perf_stats_print(stdout);
+	perf_stats_fini();
+	kvs_pool_stats_print("Request buffers");
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
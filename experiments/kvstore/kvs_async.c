@@ -0,0 +1,231 @@
+/*
+ * Filename:         kvs_async.c
+ * Description:      Asynchronous KVS operation engine
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "kvs_async.h"
+#include "kvs_pool.h"
+
+struct kvs_async_req {
+	struct kvs_async_engine *ar_engine;
+	struct m0_op *ar_op;
+	int *ar_rcs;
+	uint32_t ar_nr;
+	kvs_async_cb_t ar_cb;
+	void *ar_cb_arg;
+	struct kvs_async_req *ar_next;
+};
+
+/* Called by Motr: only queue the request, it is released by reap() */
+static void kvs_async_op_done(struct m0_op *op)
+{
+	struct kvs_async_req *req = op->op_datum;
+	struct kvs_async_engine *eng = req->ar_engine;
+
+	pthread_mutex_lock(&eng->ae_lock);
+	req->ar_next = eng->ae_done;
+	eng->ae_done = req;
+	pthread_cond_broadcast(&eng->ae_cond);
+	pthread_mutex_unlock(&eng->ae_lock);
+}
+
+/* Motr keeps a pointer to the ops, they must outlive the operations */
+static const struct m0_op_ops kvs_async_op_ops = {
+	.oop_executed = NULL,
+	.oop_stable = kvs_async_op_done,
+	.oop_failed = kvs_async_op_done,
+};
+
+/* Called with ae_lock held */
+static struct kvs_async_req *done_pop(struct kvs_async_engine *eng)
+{
+	struct kvs_async_req *req = eng->ae_done;
+
+	if (req != NULL)
+		eng->ae_done = req->ar_next;
+	return req;
+}
+
+/* Called without ae_lock */
+static void reap(struct kvs_async_engine *eng, struct kvs_async_req *req)
+{
+	int rc;
+
+	rc = m0_rc(req->ar_op);
+	m0_op_fini(req->ar_op);
+	m0_op_free(req->ar_op);
+
+	req->ar_cb(req->ar_cb_arg, rc, req->ar_rcs, req->ar_nr);
+
+	kvs_pool_free(req->ar_rcs);
+	kvs_pool_free(req);
+
+	pthread_mutex_lock(&eng->ae_lock);
+	if (rc != 0)
+		eng->ae_failed++;
+	eng->ae_inflight--;
+	pthread_cond_broadcast(&eng->ae_cond);
+	pthread_mutex_unlock(&eng->ae_lock);
+}
+
+int kvs_async_init(struct kvs_async_engine *eng, struct m0_idx *idx,
+		   uint32_t window)
+{
+	int rc;
+
+	if (window == 0)
+		return -EINVAL;
+
+	memset(eng, 0, sizeof(*eng));
+	eng->ae_idx = idx;
+	eng->ae_window = window;
+
+	rc = pthread_mutex_init(&eng->ae_lock, NULL);
+	if (rc != 0)
+		return -rc;
+
+	rc = pthread_cond_init(&eng->ae_cond, NULL);
+	if (rc != 0) {
+		pthread_mutex_destroy(&eng->ae_lock);
+		return -rc;
+	}
+
+	return 0;
+}
+
+void kvs_async_fini(struct kvs_async_engine *eng)
+{
+	kvs_async_drain(eng);
+	pthread_cond_destroy(&eng->ae_cond);
+	pthread_mutex_destroy(&eng->ae_lock);
+}
+
+int kvs_async_submit(struct kvs_async_engine *eng, enum m0_idx_opcode opcode,
+		     struct m0_bufvec *keys, struct m0_bufvec *vals,
+		     uint32_t flags, kvs_async_cb_t cb, void *arg)
+{
+	struct kvs_async_req *req;
+	int rc;
+
+	pthread_mutex_lock(&eng->ae_lock);
+	while (eng->ae_inflight >= eng->ae_window) {
+		req = done_pop(eng);
+		if (req != NULL) {
+			pthread_mutex_unlock(&eng->ae_lock);
+			reap(eng, req);
+			pthread_mutex_lock(&eng->ae_lock);
+		} else {
+			pthread_cond_wait(&eng->ae_cond, &eng->ae_lock);
+		}
+	}
+	eng->ae_inflight++;
+	eng->ae_submitted++;
+	pthread_mutex_unlock(&eng->ae_lock);
+
+	/* Recycled, reap() may run in another thread than this one */
+	req = kvs_pool_zalloc(sizeof(*req));
+	if (req == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	req->ar_nr = keys->ov_vec.v_nr;
+	req->ar_rcs = kvs_pool_zalloc(req->ar_nr * sizeof(int));
+	if (req->ar_rcs == NULL) {
+		rc = -ENOMEM;
+		goto free_req;
+	}
+
+	req->ar_engine = eng;
+	req->ar_cb = cb;
+	req->ar_cb_arg = arg;
+
+	rc = m0_idx_op(eng->ae_idx, opcode, keys, vals, req->ar_rcs, flags,
+		       &req->ar_op);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): m0_idx_op\n", rc);
+		goto free_rcs;
+	}
+
+	req->ar_op->op_datum = req;
+	m0_op_setup(req->ar_op, &kvs_async_op_ops, 0);
+	m0_op_launch(&req->ar_op, 1);
+	return 0;
+
+free_rcs:
+	kvs_pool_free(req->ar_rcs);
+free_req:
+	kvs_pool_free(req);
+out:
+	pthread_mutex_lock(&eng->ae_lock);
+	eng->ae_inflight--;
+	eng->ae_submitted--;
+	pthread_cond_broadcast(&eng->ae_cond);
+	pthread_mutex_unlock(&eng->ae_lock);
+	return rc;
+}
+
+int kvs_async_poll(struct kvs_async_engine *eng)
+{
+	struct kvs_async_req *req;
+	int count = 0;
+
+	pthread_mutex_lock(&eng->ae_lock);
+	while ((req = done_pop(eng)) != NULL) {
+		pthread_mutex_unlock(&eng->ae_lock);
+		reap(eng, req);
+		count++;
+		pthread_mutex_lock(&eng->ae_lock);
+	}
+	pthread_mutex_unlock(&eng->ae_lock);
+
+	return count;
+}
+
+void kvs_async_drain(struct kvs_async_engine *eng)
+{
+	struct kvs_async_req *req;
+
+	pthread_mutex_lock(&eng->ae_lock);
+	while (eng->ae_inflight > 0) {
+		req = done_pop(eng);
+		if (req != NULL) {
+			pthread_mutex_unlock(&eng->ae_lock);
+			reap(eng, req);
+			pthread_mutex_lock(&eng->ae_lock);
+		} else {
+			pthread_cond_wait(&eng->ae_cond, &eng->ae_lock);
+		}
+	}
+	pthread_mutex_unlock(&eng->ae_lock);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
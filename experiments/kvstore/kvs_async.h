@@ -0,0 +1,93 @@
+/*
+ * Filename:         kvs_async.h
+ * Description:      Asynchronous KVS operation engine
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Index operations are launched with m0_op_setup() callbacks instead of
+ * being waited for one by one (see experiments/xattr/approach1_async.c).
+ *
+ * - kvs_async_submit() launches an operation and returns right away, unless
+ *   the engine already has its window of operations in flight; it then
+ *   waits for one of them to complete first.
+ * - Motr callbacks only queue the completed operation. Completions are
+ *   processed ("reaped") by the submitting threads, in kvs_async_submit(),
+ *   kvs_async_poll() and kvs_async_drain(): the operation is released and
+ *   the user callback is called with its status and per-record rcs.
+ * - keys and vals belong to the caller and must stay untouched until the
+ *   callback of their operation has been called.
+ *
+ * An engine can be shared by several threads. Requests and their rcs come
+ * from kvs_pool.h, programs link kvs_pool.c as well.
+ */
+
+#ifndef _KVS_ASYNC_H
+#define _KVS_ASYNC_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "motr/client.h"
+
+/**
+ * Completion callback.
+ * rc is the status of the operation as a whole, rcs the status of each of
+ * its nr records (valid only if rc == 0).
+ */
+typedef void (*kvs_async_cb_t)(void *arg, int rc, const int *rcs,
+			       uint32_t nr);
+
+struct kvs_async_req;
+
+struct kvs_async_engine {
+	struct m0_idx *ae_idx;
+	pthread_mutex_t ae_lock;
+	pthread_cond_t ae_cond;
+	/* Max operations launched and not reaped yet */
+	uint32_t ae_window;
+	uint32_t ae_inflight;
+	/* Completed operations waiting to be reaped */
+	struct kvs_async_req *ae_done;
+	uint64_t ae_submitted;
+	uint64_t ae_failed;
+};
+
+int kvs_async_init(struct kvs_async_engine *eng, struct m0_idx *idx,
+		   uint32_t window);
+
+/**
+ * Drain the engine and release its resources.
+ */
+void kvs_async_fini(struct kvs_async_engine *eng);
+
+/**
+ * Launch an index operation on all the records of keys (and vals).
+ * cb(arg, ...) is called exactly once when 0 is returned, never otherwise.
+ */
+int kvs_async_submit(struct kvs_async_engine *eng, enum m0_idx_opcode opcode,
+		     struct m0_bufvec *keys, struct m0_bufvec *vals,
+		     uint32_t flags, kvs_async_cb_t cb, void *arg);
+
+/**
+ * Process the completions available right now, return their number.
+ */
+int kvs_async_poll(struct kvs_async_engine *eng);
+
+/**
+ * Wait until every submitted operation has completed and been processed.
+ */
+void kvs_async_drain(struct kvs_async_engine *eng);
+
+#endif /* _KVS_ASYNC_H */
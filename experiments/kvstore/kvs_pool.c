@@ -0,0 +1,277 @@
+/*
+ * Filename:         kvs_pool.c
+ * Description:      Per-thread pools of KV request buffers
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "kvs_pool.h"
+
+/* 64 bytes to 256 KiB */
+#define KVS_POOL_CLASSES 13
+/* Class of the blocks allocated with malloc() */
+#define KVS_POOL_LARGE KVS_POOL_CLASSES
+
+/* In front of every block, keeps the blocks aligned like malloc() */
+struct kvs_pool_hdr {
+	uint32_t ph_class;
+} __attribute__((aligned(16)));
+
+/* A free block, linked through its first bytes */
+struct kvs_pool_block {
+	struct kvs_pool_block *pb_next;
+};
+
+struct kvs_pool_cache {
+	struct kvs_pool_block *pc_free[KVS_POOL_CLASSES];
+	size_t pc_cached;
+	struct kvs_pool_stats pc_stats;
+	/* Registered with pool_key, to be released when the thread exits */
+	bool pc_registered;
+};
+
+static __thread struct kvs_pool_cache pool_cache;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Counters of the threads that released their cache */
+static struct kvs_pool_stats pool_released;
+
+static size_t class_size(uint32_t class)
+{
+	return (size_t)KVS_POOL_MIN_SIZE << class;
+}
+
+static uint32_t size_class(size_t size)
+{
+	uint32_t class = 0;
+
+	while (class < KVS_POOL_CLASSES && class_size(class) < size)
+		class++;
+	return class;
+}
+
+static void cache_release(void *arg)
+{
+	struct kvs_pool_cache *cache = arg;
+	struct kvs_pool_block *block;
+	uint32_t class;
+
+	for (class = 0; class < KVS_POOL_CLASSES; class++) {
+		while ((block = cache->pc_free[class]) != NULL) {
+			cache->pc_free[class] = block->pb_next;
+			free((struct kvs_pool_hdr *)block - 1);
+		}
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	pool_released.allocs += cache->pc_stats.allocs;
+	pool_released.hits += cache->pc_stats.hits;
+	pool_released.trimmed += cache->pc_stats.trimmed;
+	pthread_mutex_unlock(&pool_lock);
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+static void pool_key_create(void)
+{
+	pthread_key_create(&pool_key, cache_release);
+}
+
+static struct kvs_pool_cache *cache_get(void)
+{
+	struct kvs_pool_cache *cache = &pool_cache;
+
+	if (!cache->pc_registered) {
+		pthread_once(&pool_once, pool_key_create);
+		pthread_setspecific(pool_key, cache);
+		cache->pc_registered = true;
+	}
+	return cache;
+}
+
+/**
+ * Release the largest cached blocks down to KVS_POOL_LOW_WATER.
+ */
+static void cache_trim(struct kvs_pool_cache *cache)
+{
+	struct kvs_pool_block *block;
+	int class;
+
+	for (class = KVS_POOL_CLASSES - 1;
+	     class >= 0 && cache->pc_cached > KVS_POOL_LOW_WATER; class--) {
+		while (cache->pc_cached > KVS_POOL_LOW_WATER &&
+		       (block = cache->pc_free[class]) != NULL) {
+			cache->pc_free[class] = block->pb_next;
+			cache->pc_cached -= class_size(class);
+			cache->pc_stats.trimmed++;
+			free((struct kvs_pool_hdr *)block - 1);
+		}
+	}
+}
+
+void *kvs_pool_alloc(size_t size)
+{
+	struct kvs_pool_cache *cache = cache_get();
+	struct kvs_pool_block *block;
+	struct kvs_pool_hdr *hdr;
+	uint32_t class = size_class(size);
+
+	cache->pc_stats.allocs++;
+
+	if (class != KVS_POOL_LARGE && cache->pc_free[class] != NULL) {
+		block = cache->pc_free[class];
+		cache->pc_free[class] = block->pb_next;
+		cache->pc_cached -= class_size(class);
+		cache->pc_stats.hits++;
+		return block;
+	}
+
+	hdr = malloc(sizeof(*hdr) +
+		     (class != KVS_POOL_LARGE ? class_size(class) : size));
+	if (hdr == NULL)
+		return NULL;
+
+	hdr->ph_class = class;
+	return hdr + 1;
+}
+
+void *kvs_pool_zalloc(size_t size)
+{
+	void *ptr = kvs_pool_alloc(size);
+
+	if (ptr != NULL)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+void kvs_pool_free(void *ptr)
+{
+	struct kvs_pool_cache *cache;
+	struct kvs_pool_block *block = ptr;
+	struct kvs_pool_hdr *hdr;
+
+	if (ptr == NULL)
+		return;
+
+	hdr = (struct kvs_pool_hdr *)ptr - 1;
+	if (hdr->ph_class == KVS_POOL_LARGE) {
+		free(hdr);
+		return;
+	}
+
+	cache = cache_get();
+	block->pb_next = cache->pc_free[hdr->ph_class];
+	cache->pc_free[hdr->ph_class] = block;
+	cache->pc_cached += class_size(hdr->ph_class);
+
+	if (cache->pc_cached > KVS_POOL_HIGH_WATER)
+		cache_trim(cache);
+}
+
+int kvs_pool_bufvec_alloc(struct m0_bufvec *vec, uint32_t nr, size_t size)
+{
+	char *data;
+	uint32_t i;
+
+	/* Pointers and counts in one block, buffers in another */
+	vec->ov_buf = kvs_pool_alloc(nr * (sizeof(void *) +
+					   sizeof(m0_bcount_t)));
+	if (vec->ov_buf == NULL)
+		return -ENOMEM;
+	vec->ov_vec.v_count = (m0_bcount_t *)(vec->ov_buf + nr);
+	vec->ov_vec.v_nr = nr;
+
+	if (nr == 0)
+		return 0;
+
+	data = kvs_pool_alloc(nr * size);
+	if (data == NULL) {
+		kvs_pool_free(vec->ov_buf);
+		vec->ov_buf = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr; i++) {
+		vec->ov_buf[i] = data + i * size;
+		vec->ov_vec.v_count[i] = size;
+	}
+	return 0;
+}
+
+void kvs_pool_bufvec_free(struct m0_bufvec *vec)
+{
+	if (vec->ov_buf == NULL)
+		return;
+
+	if (vec->ov_vec.v_nr != 0)
+		kvs_pool_free(vec->ov_buf[0]);
+	kvs_pool_free(vec->ov_buf);
+	vec->ov_buf = NULL;
+	vec->ov_vec.v_count = NULL;
+	vec->ov_vec.v_nr = 0;
+}
+
+void kvs_pool_thread_fini(void)
+{
+	if (!pool_cache.pc_registered)
+		return;
+
+	pthread_setspecific(pool_key, NULL);
+	cache_release(&pool_cache);
+}
+
+void kvs_pool_stats_get(struct kvs_pool_stats *stats)
+{
+	struct kvs_pool_cache *cache = &pool_cache;
+
+	pthread_mutex_lock(&pool_lock);
+	*stats = pool_released;
+	pthread_mutex_unlock(&pool_lock);
+
+	stats->allocs += cache->pc_stats.allocs;
+	stats->hits += cache->pc_stats.hits;
+	stats->trimmed += cache->pc_stats.trimmed;
+	stats->cached = cache->pc_cached;
+}
+
+void kvs_pool_stats_print(const char *msg)
+{
+	struct kvs_pool_stats stats;
+
+	kvs_pool_stats_get(&stats);
+	printf("%s: %lu pool allocations, %lu from free lists (%.1f%%),"
+	       " %lu trimmed, %zu bytes cached\n", msg,
+	       (unsigned long)stats.allocs, (unsigned long)stats.hits,
+	       stats.allocs != 0 ? 100.0 * stats.hits / stats.allocs : 0.0,
+	       (unsigned long)stats.trimmed, stats.cached);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,99 @@
+/*
+ * Filename:         kvs_pool.h
+ * Description:      Per-thread pools of KV request buffers
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Every index operation used to allocate its rcs array, its bufvecs (an
+ * array of pointers, an array of counts and a buffer per record) and its
+ * m0_op, and to free them once stable. kvs_pool_alloc() recycles them
+ * instead:
+ *
+ * - Requests are rounded up to a size class, a power of two from
+ *   KVS_POOL_MIN_SIZE to KVS_POOL_MAX_SIZE. Larger ones go to malloc().
+ * - Every thread keeps the blocks it frees in per-class free lists, and
+ *   allocates from them without locking. A block may be freed by another
+ *   thread than the one that allocated it.
+ * - Once a thread caches more than KVS_POOL_HIGH_WATER bytes, its largest
+ *   blocks are released down to KVS_POOL_LOW_WATER, so that a burst does
+ *   not pin memory for good. The cache of a thread is released when it
+ *   exits or calls kvs_pool_thread_fini().
+ *
+ * In the steady state of a metadata workload, operations then neither
+ * malloc() nor free(). The m0_op of md_kvs_op() is recycled per thread by
+ * md_kvs.c itself.
+ *
+ * A bufvec from kvs_pool_bufvec_alloc() is a block of pointers and counts
+ * and a block of buffers, not one allocation per record: it must not be
+ * passed to GET, whose values are allocated by the store (kvs_vec_fill()
+ * in kvs_vec.h), and its buffers must be large enough for what NEXT
+ * returns. NEXT also replaces a start key too short for the first record
+ * with a buffer of its own: the caller must free that one and put its
+ * own buffer back in ov_buf[0] before kvs_pool_bufvec_free().
+ */
+
+#ifndef _KVS_POOL_H
+#define _KVS_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "motr/client.h"
+
+#define KVS_POOL_MIN_SIZE 64
+#define KVS_POOL_MAX_SIZE (256 * 1024)
+#define KVS_POOL_HIGH_WATER (4 * 1024 * 1024)
+#define KVS_POOL_LOW_WATER (KVS_POOL_HIGH_WATER / 2)
+
+struct kvs_pool_stats {
+	uint64_t allocs;
+	/* Allocations served from a free list */
+	uint64_t hits;
+	/* Blocks released by the high-water trimming */
+	uint64_t trimmed;
+	/* Bytes cached in free lists, by the calling thread */
+	size_t cached;
+};
+
+void *kvs_pool_alloc(size_t size);
+
+/**
+ * Like kvs_pool_alloc(), zeroed.
+ */
+void *kvs_pool_zalloc(size_t size);
+
+void kvs_pool_free(void *ptr);
+
+/**
+ * Allocate nr buffers of size bytes each, see m0_bufvec_alloc().
+ */
+int kvs_pool_bufvec_alloc(struct m0_bufvec *vec, uint32_t nr, size_t size);
+
+void kvs_pool_bufvec_free(struct m0_bufvec *vec);
+
+/**
+ * Release the cache of the calling thread.
+ */
+void kvs_pool_thread_fini(void);
+
+/**
+ * Counters of the calling thread, plus those of the threads that released
+ * their cache.
+ */
+void kvs_pool_stats_get(struct kvs_pool_stats *stats);
+
+void kvs_pool_stats_print(const char *msg);
+
+#endif /* _KVS_POOL_H */
@@ -0,0 +1,111 @@
+/*
+ * Filename:         kvs_vec.h
+ * Description:      Zero-copy bufvecs over caller buffers
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* m0_bufvec_alloc() allocates a buffer per record, which the caller then
+ * fills with a copy of its keys and values. An index operation only needs
+ * the addresses and lengths of the records, so the helpers below describe
+ * buffers the caller already has instead:
+ *
+ * - kvs_vec_wrap(): a bufvec over caller buffers (keys built in an array on
+ *   the stack, values pointing into the caller's data). Nothing is
+ *   allocated or copied, the vector must not be passed to m0_bufvec_free().
+ * - kvs_vec_borrow(): a bufvec of NULL buffers, that GET fills with buffers
+ *   allocated by the store (Motr, mem_kvs.c). The caller reads the values
+ *   in place and hands them back with kvs_vec_release().
+ *
+ * NEXT replaces a start key too small for the first record with a buffer
+ * of its own, the start key of a NEXT must therefore not be wrapped.
+ */
+
+#ifndef _KVS_VEC_H
+#define _KVS_VEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "motr/client.h"
+
+/**
+ * Describe the nr buffers bufs[i] of counts[i] bytes as vec.
+ * bufs and counts must stay valid as long as vec is used.
+ */
+static inline void kvs_vec_wrap(struct m0_bufvec *vec, void **bufs,
+				m0_bcount_t *counts, uint32_t nr)
+{
+	vec->ov_vec.v_nr = nr;
+	vec->ov_vec.v_count = counts;
+	vec->ov_buf = bufs;
+}
+
+/**
+ * Prepare vec to receive nr values allocated by the store.
+ */
+static inline void kvs_vec_borrow(struct m0_bufvec *vec, void **bufs,
+				  m0_bcount_t *counts, uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		bufs[i] = NULL;
+		counts[i] = 0;
+	}
+	kvs_vec_wrap(vec, bufs, counts, nr);
+}
+
+/**
+ * Hand out data, len bytes, as the i-th buffer of vec on behalf of a store
+ * without Motr (mem_kvs.c, redis_kvs.c):
+ * - alloc: in a new m0_alloc() buffer, as Motr does for GET and for a NEXT
+ *   start key too small for the first record. A caller buffer is replaced,
+ *   neither filled nor freed: GET vectors must be borrowed.
+ * - otherwise (other NEXT records): copied into the caller buffer,
+ *   -ERANGE when it is too small.
+ */
+static inline int kvs_vec_fill(struct m0_bufvec *vec, uint32_t i,
+			       const void *data, size_t len, bool alloc)
+{
+	if (alloc) {
+		vec->ov_buf[i] = m0_alloc(len != 0 ? len : 1);
+		if (vec->ov_buf[i] == NULL)
+			return -ENOMEM;
+	} else if (vec->ov_buf[i] == NULL || vec->ov_vec.v_count[i] < len) {
+		return -ERANGE;
+	}
+
+	memcpy(vec->ov_buf[i], data, len);
+	vec->ov_vec.v_count[i] = len;
+	return 0;
+}
+
+/**
+ * Release the values of a borrowed vec, whether the operation filled them
+ * or not.
+ */
+static inline void kvs_vec_release(struct m0_bufvec *vec)
+{
+	uint32_t i;
+
+	for (i = 0; i < vec->ov_vec.v_nr; i++) {
+		m0_free(vec->ov_buf[i]);
+		vec->ov_buf[i] = NULL;
+	}
+}
+
+#endif /* _KVS_VEC_H */
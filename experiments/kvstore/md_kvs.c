@@ -0,0 +1,665 @@
+/*
+ * Filename:         md_kvs.c
+ * Description:      Common helpers for the metadata KVS experiments.
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c0appz.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "md_kvs.h"
+#include "mem_kvs.h"
+#ifdef MD_KVS_REDIS
+#include "redis_kvs.h"
+#endif
+#include "kvs_pool.h"
+#include "../perf/perf_stats.h"
+#include "../perf/trace.h"
+
+#define MEM_KVS_SHARDS 16
+#define MD_KVS_TRACE_FILE "md_kvs.trace.json"
+
+static struct m0_fid ifid;
+static struct m0_ufid_generator md_ufid_generator;
+static struct m0_idx idx;
+static struct md_kvs_iter_stats iter_stats;
+/* Set by md_kvs_init() when the in-memory backend is used */
+static struct mem_kvs *mem_kvs;
+static struct mem_kvs mem_kvs_store;
+#ifdef MD_KVS_REDIS
+static struct redis_kvs *redis_kvs;
+static struct redis_kvs redis_kvs_store;
+#endif
+/* Set by md_kvs_init() for the backends that need no Motr cluster */
+static bool kvs_local;
+/* Operation of the last md_kvs_op() of the thread, finalised and reused by
+ * the next one instead of allocating a new one.
+ */
+static __thread struct m0_op *kvs_op_cache;
+
+bool md_kvs_backend_is_mem(void)
+{
+	const char *backend = getenv("MD_KVS_BACKEND");
+
+	return backend != NULL && strcmp(backend, "mem") == 0;
+}
+
+static bool md_kvs_backend_is_redis(void)
+{
+	const char *backend = getenv("MD_KVS_BACKEND");
+
+	return backend != NULL && strcmp(backend, "redis") == 0;
+}
+
+bool md_kvs_backend_is_local(void)
+{
+	return md_kvs_backend_is_mem() || md_kvs_backend_is_redis();
+}
+
+/**
+ * Connect to the server of MD_KVS_REDIS, "host:port".
+ */
+static int md_kvs_redis_init(void)
+{
+#ifdef MD_KVS_REDIS
+	const char *addr = getenv("MD_KVS_REDIS");
+	const char *conns = getenv("MD_KVS_REDIS_CONNS");
+	char host[256] = "127.0.0.1";
+	int port = 6379;
+	int rc;
+
+	if (addr != NULL && sscanf(addr, "%255[^:]:%d", host, &port) < 1) {
+		fprintf(stderr, "Invalid MD_KVS_REDIS %s\n", addr);
+		return -EINVAL;
+	}
+
+	rc = redis_kvs_init(&redis_kvs_store, host, port,
+			    conns != NULL ? strtoul(conns, NULL, 0) :
+			    REDIS_KVS_CONNS);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to initialise redis_kvs: %d\n", rc);
+		return rc;
+	}
+	redis_kvs = &redis_kvs_store;
+	kvs_local = true;
+	return 0;
+#else
+	fprintf(stderr, "Built without MD_KVS_REDIS\n");
+	return -EPROTONOSUPPORT;
+#endif
+}
+
+static void md_kvs_trace_init(void)
+{
+	const char *sample = getenv("MD_KVS_TRACE_SAMPLE");
+
+	if (sample != NULL)
+		trace_init(strtoul(sample, NULL, 0), 0);
+}
+
+static void md_kvs_trace_fini(void)
+{
+	const char *path = getenv("MD_KVS_TRACE_FILE");
+	int rc;
+
+	if (getenv("MD_KVS_TRACE_SAMPLE") == NULL)
+		return;
+
+	rc = trace_dump_file(path != NULL ? path : MD_KVS_TRACE_FILE);
+	if (rc != 0)
+		fprintf(stderr, "Failed to write the trace: %d\n", rc);
+	trace_fini();
+}
+
+int md_kvs_init(const char *fid_str)
+{
+	char tmpfid[255];
+	const char *latency;
+	uint64_t latency_us = 0;
+	int rc;
+
+	md_kvs_trace_init();
+
+	if (md_kvs_backend_is_mem()) {
+		latency = getenv("MD_KVS_MEM_LATENCY_US");
+		if (latency != NULL)
+			latency_us = strtoull(latency, NULL, 0);
+
+		rc = mem_kvs_init(&mem_kvs_store, MEM_KVS_SHARDS, latency_us);
+		if (rc != 0) {
+			fprintf(stderr, "Failed to initialise mem_kvs: %d\n", rc);
+			return rc;
+		}
+		mem_kvs = &mem_kvs_store;
+		kvs_local = true;
+		return 0;
+	}
+
+	if (md_kvs_backend_is_redis())
+		return md_kvs_redis_init();
+
+	memset(&ifid, 0, sizeof(struct m0_fid));
+	rc = m0_fid_sscanf(fid_str, &ifid);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to parse index fid %s\n", fid_str);
+		goto err_exit;
+	}
+
+	rc = m0_fid_print(tmpfid, sizeof(tmpfid), &ifid);
+	if (rc < 0) {
+		fprintf(stderr, "Failed to print index fid %s\n", fid_str);
+		goto err_exit;
+	}
+
+	m0_idx_init(&idx, &motr_container.co_realm,
+		    (struct m0_uint128 *)&ifid);
+
+	rc = m0_ufid_init(motr_instance, &md_ufid_generator);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to initialise fid generator: %d\n", rc);
+		m0_idx_fini(&idx);
+		goto err_exit;
+	}
+
+	return 0;
+
+err_exit:
+	return rc;
+}
+
+static void md_kvs_thread_release(void)
+{
+	if (kvs_op_cache != NULL) {
+		m0_op_free(kvs_op_cache);
+		kvs_op_cache = NULL;
+	}
+	kvs_pool_thread_fini();
+}
+
+void md_kvs_fini(void)
+{
+	md_kvs_trace_fini();
+	md_kvs_thread_release();
+
+	if (mem_kvs != NULL) {
+		mem_kvs_fini(mem_kvs);
+		mem_kvs = NULL;
+	}
+#ifdef MD_KVS_REDIS
+	if (redis_kvs != NULL) {
+		redis_kvs_stats_print(redis_kvs, "redis");
+		redis_kvs_fini(redis_kvs);
+		redis_kvs = NULL;
+	}
+#endif
+	if (kvs_local) {
+		kvs_local = false;
+		return;
+	}
+	m0_idx_fini(&idx);
+}
+
+int md_kvs_thread_enter(struct m0_thread *thread)
+{
+	memset(thread, 0, sizeof(*thread));
+	if (kvs_local)
+		return 0;
+	return m0_thread_adopt(thread, motr_instance->m0c_motr);
+}
+
+void md_kvs_thread_leave(void)
+{
+	md_kvs_thread_release();
+	if (!kvs_local)
+		m0_thread_shun();
+}
+
+/**
+ * Launch an operation in *op, a new one when *op is NULL, otherwise a
+ * finalised one that m0_idx_op() initialises again.
+ */
+static int kvs_op_launch(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+			 struct m0_bufvec *vals, int *rcs, uint32_t flags,
+			 struct m0_op **op)
+{
+	int rc;
+
+	/* Executed right away, there is nothing left to wait for */
+	if (mem_kvs != NULL)
+		return mem_kvs_op(mem_kvs, opcode, keys, vals, rcs, flags);
+#ifdef MD_KVS_REDIS
+	if (redis_kvs != NULL)
+		return redis_kvs_op(redis_kvs, opcode, keys, vals, rcs, flags);
+#endif
+
+	rc = m0_idx_op(&idx, opcode, keys, vals, rcs, flags, op);
+	if (rc != 0) {
+		fprintf(stderr, "error(%d): m0_idx_op\n", rc);
+		return rc;
+	}
+
+	m0_op_launch(op, 1);
+	return 0;
+}
+
+/**
+ * Wait for an operation launched by kvs_op_launch() and finalise it.
+ */
+static int kvs_op_wait(struct m0_op *op)
+{
+	int rc;
+
+	if (kvs_local)
+		return 0;
+
+	rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE, M0_OS_FAILED),
+			M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(op);
+	if (rc != 0)
+		fprintf(stderr, "error(%d): m0_op_wait\n", rc);
+
+	m0_op_fini(op);
+	return rc;
+}
+
+int md_kvs_op_launch(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+		     struct m0_bufvec *vals, int *rcs, uint32_t flags,
+		     struct m0_op **op)
+{
+	*op = NULL;
+	return kvs_op_launch(opcode, keys, vals, rcs, flags, op);
+}
+
+int md_kvs_op_wait(struct m0_op *op)
+{
+	int rc;
+
+	if (kvs_local)
+		return 0;
+
+	rc = kvs_op_wait(op);
+	m0_op_free(op);
+	return rc;
+}
+
+static enum perf_op kvs_perf_op(enum m0_idx_opcode opcode)
+{
+	switch (opcode) {
+	case M0_IC_GET:
+		return PERF_OP_KVS_GET;
+	case M0_IC_PUT:
+		return PERF_OP_KVS_PUT;
+	case M0_IC_DEL:
+		return PERF_OP_KVS_DEL;
+	case M0_IC_NEXT:
+		return PERF_OP_KVS_NEXT;
+	default:
+		return PERF_OP_NR;
+	}
+}
+
+static const char *kvs_trace_name(enum m0_idx_opcode opcode)
+{
+	switch (opcode) {
+	case M0_IC_GET:
+		return "kvs.get";
+	case M0_IC_PUT:
+		return "kvs.put";
+	case M0_IC_DEL:
+		return "kvs.del";
+	case M0_IC_NEXT:
+		return "kvs.next";
+	default:
+		return "kvs.op";
+	}
+}
+
+int md_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+	      struct m0_bufvec *vals, int *rcs, uint32_t flags)
+{
+	struct m0_op *op = kvs_op_cache;
+	int *op_rcs = rcs;
+	uint32_t nr = keys->ov_vec.v_nr;
+	uint64_t start = perf_stats_start();
+	uint64_t trace_start = trace_request_begin();
+	uint32_t i;
+	int rc;
+
+	if (op_rcs == NULL) {
+		op_rcs = kvs_pool_alloc(nr * sizeof(int));
+		if (op_rcs == NULL)
+			return -ENOMEM;
+	}
+
+	kvs_op_cache = NULL;
+	rc = kvs_op_launch(opcode, keys, vals, op_rcs, flags, &op);
+	if (rc != 0) {
+		/* Not sure what a failed m0_idx_op() left behind */
+		if (op != NULL)
+			m0_op_free(op);
+		goto out;
+	}
+
+	rc = kvs_op_wait(op);
+	kvs_op_cache = op;
+
+	/* Check rcs array even if op is succesful */
+	for (i = 0; rcs == NULL && rc == 0 && i < nr; i++)
+		rc = op_rcs[i];
+
+out:
+	if (rcs == NULL)
+		kvs_pool_free(op_rcs);
+	perf_stats_record(kvs_perf_op(opcode), start, rc);
+	trace_request_end(kvs_trace_name(opcode), trace_start);
+	return rc;
+}
+
+int md_kvs_iter_init(struct md_kvs_iter *it, const void *start,
+		     size_t start_len, size_t prefix_len, uint32_t cap,
+		     size_t klen, size_t vlen)
+{
+	int rc;
+
+	memset(it, 0, sizeof(*it));
+
+	if (start_len > klen || prefix_len > start_len || cap == 0)
+		return -EINVAL;
+
+	rc = m0_bufvec_alloc(&it->keys, cap, klen);
+	if (rc != 0)
+		goto out;
+
+	rc = m0_bufvec_alloc(&it->vals, cap, vlen);
+	if (rc != 0)
+		goto free_keys;
+
+	M0_ALLOC_ARR(it->rcs, cap);
+	it->start = m0_alloc(klen);
+	if (it->rcs == NULL || it->start == NULL) {
+		rc = -ENOMEM;
+		goto free_vals;
+	}
+
+	it->key0 = it->keys.ov_buf[0];
+	it->cap = cap;
+	it->batch = cap < MD_KVS_ITER_BATCH_MIN ? cap : MD_KVS_ITER_BATCH_MIN;
+	it->klen = klen;
+	it->vlen = vlen;
+	it->prefix_len = prefix_len;
+	md_kvs_iter_seek(it, start, start_len, false);
+	return 0;
+
+free_vals:
+	m0_free(it->start);
+	m0_free(it->rcs);
+	m0_bufvec_free(&it->vals);
+free_keys:
+	m0_bufvec_free(&it->keys);
+out:
+	return rc;
+}
+
+/**
+ * A store handing out buffers of its own may have replaced the first key
+ * buffer, too small for the first record: it is released and the start key
+ * buffer of the iterator put back.
+ */
+static void key0_restore(struct md_kvs_iter *it)
+{
+	if (it->keys.ov_buf[0] != it->key0) {
+		m0_free(it->keys.ov_buf[0]);
+		it->keys.ov_buf[0] = it->key0;
+	}
+}
+
+void md_kvs_iter_fini(struct md_kvs_iter *it)
+{
+	if (it->pending)
+		(void)md_kvs_op_wait(it->op);
+
+	iter_stats.scans++;
+	iter_stats.round_trips += it->round_trips;
+
+	/* Launch shrinks the vectors to the batch size */
+	it->keys.ov_vec.v_nr = it->cap;
+	it->vals.ov_vec.v_nr = it->cap;
+	key0_restore(it);
+	m0_free(it->start);
+	m0_free(it->rcs);
+	m0_bufvec_free(&it->vals);
+	m0_bufvec_free(&it->keys);
+}
+
+void md_kvs_iter_seek(struct md_kvs_iter *it, const void *key, size_t len,
+		      bool exclusive)
+{
+	memmove(it->start, key, len);
+	it->start_len = len;
+	it->flags = exclusive ? M0_OIF_EXCLUDE_START_KEY : 0;
+	it->nr = 0;
+	it->eof = false;
+}
+
+int md_kvs_iter_launch(struct md_kvs_iter *it)
+{
+	uint32_t i;
+	int rc;
+
+	/* The same buffers serve every batch, NEXT fills the first
+	 * it->batch ones and overwrites their counts with the sizes of the
+	 * returned records.
+	 */
+	it->keys.ov_vec.v_nr = it->batch;
+	it->vals.ov_vec.v_nr = it->batch;
+	for (i = 0; i < it->batch; i++) {
+		it->keys.ov_vec.v_count[i] = it->klen;
+		it->vals.ov_vec.v_count[i] = it->vlen;
+		it->rcs[i] = 0;
+	}
+
+	key0_restore(it);
+	memcpy(it->keys.ov_buf[0], it->start, it->start_len);
+	it->keys.ov_vec.v_count[0] = it->start_len;
+
+	it->launched_ns = perf_stats_start();
+	it->traced_ns = trace_start();
+	rc = md_kvs_op_launch(M0_IC_NEXT, &it->keys, &it->vals, it->rcs,
+			      it->flags, &it->op);
+	if (rc != 0) {
+		it->op = NULL;
+	} else {
+		it->pending = true;
+		it->round_trips++;
+	}
+	return rc;
+}
+
+int md_kvs_iter_wait(struct md_kvs_iter *it)
+{
+	uint32_t i;
+	int rc;
+
+	rc = md_kvs_op_wait(it->op);
+	perf_stats_record(PERF_OP_KVS_NEXT, it->launched_ns, rc);
+	trace_end("kvs.next", it->traced_ns);
+	it->op = NULL;
+	it->pending = false;
+	it->nr = 0;
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < it->batch; i++) {
+		if (it->rcs[i] != 0 ||
+		    it->keys.ov_vec.v_count[i] < it->prefix_len ||
+		    memcmp(it->keys.ov_buf[i], it->start, it->prefix_len) != 0)
+			break;
+	}
+
+	/* The next batch continues after the last record of this one */
+	if (i > 0)
+		md_kvs_iter_seek(it, it->keys.ov_buf[i - 1],
+				 it->keys.ov_vec.v_count[i - 1], true);
+
+	it->nr = i;
+	it->eof = i < it->batch;
+	iter_stats.records += i;
+
+	if (!it->eof)
+		it->batch = it->batch * 2 < it->cap ? it->batch * 2 : it->cap;
+	return 0;
+}
+
+int md_kvs_iter_next(struct md_kvs_iter *it)
+{
+	int rc;
+
+	rc = md_kvs_iter_launch(it);
+	if (rc == 0)
+		rc = md_kvs_iter_wait(it);
+	return rc;
+}
+
+void md_kvs_iter_stats_get(struct md_kvs_iter_stats *stats)
+{
+	*stats = iter_stats;
+}
+
+void md_kvs_iter_stats_reset(void)
+{
+	memset(&iter_stats, 0, sizeof(iter_stats));
+}
+
+void md_kvs_iter_stats_print(const char *msg)
+{
+	struct md_kvs_iter_stats *st = &iter_stats;
+
+	printf("%s: %llu scans, %llu NEXT round trips (%.1f per scan),"
+	       " %llu records (%.1f per round trip)\n", msg,
+	       (unsigned long long)st->scans,
+	       (unsigned long long)st->round_trips,
+	       st->scans ? (double)st->round_trips / st->scans : 0.0,
+	       (unsigned long long)st->records,
+	       st->round_trips ? (double)st->records / st->round_trips : 0.0);
+}
+
+int md_dentry_iter_init(struct md_kvs_iter *it, cfs_ino_t dir, uint32_t cap)
+{
+	struct md_dentry_key dkey;
+
+	MD_DENTRY_KEY_INIT(&dkey, dir, "", 0);
+
+	return md_kvs_iter_init(it, &dkey, MD_DENTRY_KEY_PREFIX_LEN,
+				MD_DENTRY_KEY_PREFIX_LEN, cap,
+				sizeof(struct md_dentry_key), sizeof(cfs_ino_t));
+}
+
+void md_dentry_decode(const struct md_kvs_iter *it, uint32_t i, char *name,
+		      cfs_ino_t *ino)
+{
+	size_t len = it->keys.ov_vec.v_count[i] - MD_DENTRY_KEY_PREFIX_LEN;
+
+	memcpy(name, ((struct md_dentry_key *)it->keys.ov_buf[i])->name, len);
+	name[len] = '\0';
+	memcpy(ino, it->vals.ov_buf[i], sizeof(*ino));
+}
+
+/* Files created per md_kvs_dir_populate() operation */
+#define POPULATE_BATCH 100
+
+/* The records of a file, built in place and wrapped by kvs_vec_wrap() */
+struct populate_recs {
+	struct md_dentry_key dkey;
+	struct md_stat_key skey;
+	cfs_ino_t ino;
+	struct stat st;
+};
+
+int md_kvs_dir_populate(enum m0_idx_opcode opcode, cfs_ino_t dir,
+			cfs_ino_t first_ino, int nr)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	struct populate_recs *recs, *r;
+	void *kbufs[2 * POPULATE_BATCH], *vbufs[2 * POPULATE_BATCH];
+	m0_bcount_t klens[2 * POPULATE_BATCH], vlens[2 * POPULATE_BATCH];
+	char name[NAME_MAX + 1];
+	int rc = 0, i, cnt, done, len;
+
+	recs = malloc(POPULATE_BATCH * sizeof(*recs));
+	if (recs == NULL)
+		return -ENOMEM;
+
+	for (done = 0; rc == 0 && done < nr; done += cnt) {
+		cnt = nr - done < POPULATE_BATCH ? nr - done : POPULATE_BATCH;
+
+		/* A dentry and a stat record for each file */
+		for (i = 0; i < cnt; i++) {
+			r = &recs[i];
+			r->ino = first_ino + done + i;
+			len = snprintf(name, sizeof(name), "%d", done + i);
+
+			MD_DENTRY_KEY_INIT(&r->dkey, dir, name, len);
+			kbufs[2 * i] = &r->dkey;
+			klens[2 * i] = MD_DENTRY_KEY_LEN(len);
+			vbufs[2 * i] = &r->ino;
+			vlens[2 * i] = sizeof(r->ino);
+
+			MD_STAT_KEY_INIT(&r->skey, r->ino);
+			kbufs[2 * i + 1] = &r->skey;
+			klens[2 * i + 1] = sizeof(r->skey);
+			memset(&r->st, 0, sizeof(r->st));
+			r->st.st_ino = r->ino;
+			r->st.st_mode = S_IFREG | 0644;
+			r->st.st_nlink = 1;
+			r->st.st_size = done + i;
+			vbufs[2 * i + 1] = &r->st;
+			vlens[2 * i + 1] = sizeof(r->st);
+		}
+
+		kvs_vec_wrap(&key, kbufs, klens, 2 * cnt);
+		kvs_vec_wrap(&val, vbufs, vlens, 2 * cnt);
+
+		rc = md_kvs_op(opcode, &key, opcode == M0_IC_PUT ? &val : NULL,
+			       NULL, M0_OIF_OVERWRITE);
+		if (rc != 0)
+			fprintf(stderr, "error(%d): md_kvs_op\n", rc);
+	}
+
+	free(recs);
+	return rc;
+}
+
+long md_kvs_elapsed_us(const struct timeval *start, const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000L +
+		(end->tv_usec - start->tv_usec);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,279 @@
+/*
+ * Filename:         md_kvs.h
+ * Description:      Common helpers for the metadata KVS experiments.
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* The experiments in this directory talk to a Motr index directly (like the
+ * ones in experiments/xattr) but model the records cortxfs keeps for every
+ * inode, so that new metadata access patterns can be measured before they
+ * are implemented behind the cfs_* API.
+ *
+ * Every program is linked with md_kvs.c, mem_kvs.c, kvs_pool.c and the
+ * latency histograms and tracing of experiments/perf, which record every
+ * operation:
+ *   gcc -o getattr_batch getattr_batch.c md_kvs.c mem_kvs.c kvs_pool.c
+ *       ../perf/perf_stats.c ../perf/lat_hist.c ../perf/trace.c
+ *       <c0appz/motr flags>
+ *
+ * The records live in the Motr index MD_KVS_IDX_FID, or in memory
+ * (mem_kvs.h) when the environment variable MD_KVS_BACKEND is "mem".
+ * MD_KVS_MEM_LATENCY_US then delays every operation by that many usecs.
+ * MD_KVS_BACKEND "redis" keeps them in a Redis server (redis_kvs.h), for
+ * programs also built with -DMD_KVS_REDIS redis_kvs.c -lhiredis.
+ * These backends need no cluster: c0appz_init() is skipped.
+ *
+ * MD_KVS_TRACE_SAMPLE=N traces one operation out of N per thread
+ * (experiments/perf/trace.h), the spans are written to MD_KVS_TRACE_FILE
+ * (md_kvs.trace.json) by md_kvs_fini().
+ */
+
+#ifndef _MD_KVS_H
+#define _MD_KVS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "motr/client.h"
+#include "lib/thread.h"
+#include "kvs_vec.h"
+
+/* Index used by all experiments, same as KVS_GLOBAL_FID in motr_lib_init.sh */
+#define MD_KVS_IDX_FID "<0x780000000000000b:1>"
+
+typedef unsigned long long int cfs_ino_t;
+
+/* Record types, stored right after the inode number in every key */
+enum md_key_type {
+	MD_KEY_TYPE_DIRENT = 'D',
+	MD_KEY_TYPE_STAT = 'S',
+	/* Hash-sharded directory entries and their layout (dentry_shard.h) */
+	MD_KEY_TYPE_HDIRENT = 'H',
+	MD_KEY_TYPE_DIR_SHARDS = 'K',
+	/* Entry counts and sizes of a directory (dir_stats.h) */
+	MD_KEY_TYPE_DIR_STATS = 'T',
+};
+
+/* Key of the "struct stat" record of an inode */
+struct md_stat_key {
+	cfs_ino_t ino;
+	char type;
+} __attribute((packed));
+
+#define MD_STAT_KEY_INIT(key, ino2)		\
+{						\
+	(key)->ino = ino2;			\
+	(key)->type = MD_KEY_TYPE_STAT;		\
+}
+
+/* Key of a directory entry, the value is the cfs_ino_t of the child.
+ * Only MD_DENTRY_KEY_LEN() bytes are stored: the name is not padded, so
+ * that all entries of a directory share a MD_DENTRY_KEY_PREFIX_LEN prefix
+ * and come back from NEXT in name order.
+ */
+struct md_dentry_key {
+	cfs_ino_t pino;
+	char type;
+	char name[NAME_MAX];
+} __attribute((packed));
+
+#define MD_DENTRY_KEY_PREFIX_LEN offsetof(struct md_dentry_key, name)
+#define MD_DENTRY_KEY_LEN(name_len) (MD_DENTRY_KEY_PREFIX_LEN + (name_len))
+
+#define MD_DENTRY_KEY_INIT(key, pino2, xname, xlen)	\
+{							\
+	(key)->pino = pino2;				\
+	(key)->type = MD_KEY_TYPE_DIRENT;		\
+	memcpy((key)->name, xname, xlen);		\
+}
+
+/* First NEXT of an iteration asks for that many records, every following
+ * one for twice as many as the previous, up to the cap of the iterator.
+ * Small directories are then listed with small replies while large ones
+ * quickly reach full-sized batches.
+ */
+#define MD_KVS_ITER_BATCH_MIN 8
+
+/* NEXT iterator over the records sharing a key prefix */
+struct md_kvs_iter {
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	int *rcs;
+	/* Max records fetched per NEXT, keys/vals are allocated for that */
+	uint32_t cap;
+	/* Records asked for by the next NEXT */
+	uint32_t batch;
+	/* NEXT requests sent so far */
+	uint32_t round_trips;
+	size_t klen;
+	size_t vlen;
+	/* Key to continue from, the last key of the previous batch */
+	void *start;
+	size_t start_len;
+	size_t prefix_len;
+	uint32_t flags;
+	/* Number of valid records in keys/vals after md_kvs_iter_wait() */
+	uint32_t nr;
+	bool eof;
+	/* A NEXT was launched and not waited for yet */
+	bool pending;
+	/* klen bytes buffer for the start key, in keys.ov_buf[0] unless
+	 * the store replaced it with a buffer of its own.
+	 */
+	void *key0;
+	/* Start of the NEXT in flight, for perf_stats_record() */
+	uint64_t launched_ns;
+	/* Same, when the NEXT is traced (trace_start()) */
+	uint64_t traced_ns;
+	struct m0_op *op;
+};
+
+/* Iteration counters, accumulated by md_kvs_iter_fini() */
+struct md_kvs_iter_stats {
+	uint64_t scans;
+	uint64_t round_trips;
+	uint64_t records;
+};
+
+/**
+ * Whether MD_KVS_BACKEND selects the in-memory backend.
+ */
+bool md_kvs_backend_is_mem(void);
+
+/**
+ * Whether MD_KVS_BACKEND selects a backend without Motr (mem or redis).
+ */
+bool md_kvs_backend_is_local(void);
+
+/**
+ * Initialize the index identified by fid_str, or the in-memory store.
+ * c0appz_init() must have been called before, unless
+ * md_kvs_backend_is_local().
+ */
+int md_kvs_init(const char *fid_str);
+
+void md_kvs_fini(void);
+
+/**
+ * Threads not created by Motr must be adopted before their first md_kvs_*
+ * call and call md_kvs_thread_leave() before they exit.
+ * thread must stay valid in between. md_kvs_thread_leave() also releases
+ * the m0_op and the buffers the thread recycles (kvs_pool.h).
+ */
+int md_kvs_thread_enter(struct m0_thread *thread);
+void md_kvs_thread_leave(void);
+
+/**
+ * Execute a (multi-key) index operation and wait until it becomes stable.
+ * When rcs is NULL the per-record return codes are checked internally and
+ * the first failure is returned. Otherwise the caller owns rcs
+ * (keys->ov_vec.v_nr entries) and only the operation status is returned.
+ */
+int md_kvs_op(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+	      struct m0_bufvec *vals, int *rcs, uint32_t flags);
+
+/**
+ * Launch an index operation without waiting for it, see md_kvs_op_wait().
+ * The in-memory backend executes it right away and sets *op to NULL.
+ */
+int md_kvs_op_launch(enum m0_idx_opcode opcode, struct m0_bufvec *keys,
+		     struct m0_bufvec *vals, int *rcs, uint32_t flags,
+		     struct m0_op **op);
+
+/**
+ * Wait for an operation started by md_kvs_op_launch() to become stable and
+ * release it. Per-record return codes are left to the caller.
+ */
+int md_kvs_op_wait(struct m0_op *op);
+
+/**
+ * Prepare an iterator returning up to cap records of at most klen/vlen
+ * bytes per NEXT (see MD_KVS_ITER_BATCH_MIN), starting from (and
+ * including) the key start, as long as the keys match the first prefix_len
+ * bytes of start.
+ */
+int md_kvs_iter_init(struct md_kvs_iter *it, const void *start,
+		     size_t start_len, size_t prefix_len, uint32_t cap,
+		     size_t klen, size_t vlen);
+
+void md_kvs_iter_fini(struct md_kvs_iter *it);
+
+/**
+ * Continue the iteration from key, excluding it when exclusive is set.
+ */
+void md_kvs_iter_seek(struct md_kvs_iter *it, const void *key, size_t len,
+		      bool exclusive);
+
+/**
+ * md_kvs_iter_launch() sends the next NEXT request and md_kvs_iter_wait()
+ * collects it, so that other operations can be in flight meanwhile.
+ * md_kvs_iter_next() does both.
+ * On success it->nr records are available and it->eof tells whether the
+ * prefix is exhausted.
+ */
+int md_kvs_iter_launch(struct md_kvs_iter *it);
+int md_kvs_iter_wait(struct md_kvs_iter *it);
+int md_kvs_iter_next(struct md_kvs_iter *it);
+
+void md_kvs_iter_stats_get(struct md_kvs_iter_stats *stats);
+void md_kvs_iter_stats_reset(void);
+void md_kvs_iter_stats_print(const char *msg);
+
+/**
+ * Borrow the i-th record of the current batch of an iterator: the buffers
+ * belong to the iterator and are overwritten by the next NEXT.
+ */
+static inline void md_kvs_iter_rec(const struct md_kvs_iter *it, uint32_t i,
+				   const void **key, size_t *klen,
+				   const void **val, size_t *vlen)
+{
+	*key = it->keys.ov_buf[i];
+	*klen = it->keys.ov_vec.v_count[i];
+	*val = it->vals.ov_buf[i];
+	*vlen = it->vals.ov_vec.v_count[i];
+}
+
+/**
+ * Prepare an iterator over the entries of directory dir, cap per NEXT.
+ */
+int md_dentry_iter_init(struct md_kvs_iter *it, cfs_ino_t dir, uint32_t cap);
+
+/**
+ * Decode the i-th dentry of the current batch of a dentry iterator.
+ * name must have room for NAME_MAX + 1 bytes.
+ */
+void md_dentry_decode(const struct md_kvs_iter *it, uint32_t i, char *name,
+		      cfs_ino_t *ino);
+
+/**
+ * Create (M0_IC_PUT) or remove (M0_IC_DEL) nr entries of directory dir,
+ * named after their index ("0", "1", ...) and pointing to inodes
+ * first_ino + index, together with the stat records of those inodes.
+ * st_size of each inode is set to its index.
+ */
+int md_kvs_dir_populate(enum m0_idx_opcode opcode, cfs_ino_t dir,
+			cfs_ino_t first_ino, int nr);
+
+/**
+ * Elapsed time between two gettimeofday() samples, in microseconds.
+ */
+long md_kvs_elapsed_us(const struct timeval *start, const struct timeval *end);
+
+#endif /* _MD_KVS_H */
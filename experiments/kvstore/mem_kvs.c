@@ -0,0 +1,392 @@
+/*
+ * Filename:         mem_kvs.c
+ * Description:      In-memory KV store
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "motr/client.h"
+#include "kvs_vec.h"
+#include "mem_kvs.h"
+
+#define SKIPLIST_LEVELS 16
+
+struct mem_kvs_node {
+	void *key;
+	size_t klen;
+	void *val;
+	size_t vlen;
+	int levels;
+	struct mem_kvs_node *next[];
+};
+
+struct mem_kvs_shard {
+	pthread_mutex_t lock;
+	/* Sentinel, next[] of all levels */
+	struct mem_kvs_node *head;
+	int levels;
+	unsigned int seed;
+};
+
+static int key_cmp(const void *k1, size_t l1, const void *k2, size_t l2)
+{
+	int rc = memcmp(k1, k2, l1 < l2 ? l1 : l2);
+
+	if (rc != 0)
+		return rc;
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+/* FNV-1a */
+static uint64_t key_hash(const void *key, size_t len)
+{
+	const unsigned char *p = key;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static struct mem_kvs_shard *shard_of(struct mem_kvs *kvs, const void *key,
+				      size_t len)
+{
+	return &kvs->mk_shards[key_hash(key, len) % kvs->mk_nr_shards];
+}
+
+/**
+ * Find the last node of every level whose key is lower than key (or equal
+ * to it when past_equal), return the node following it at level 0.
+ * Called with the shard lock held.
+ */
+static struct mem_kvs_node *node_seek(struct mem_kvs_shard *shard,
+				      const void *key, size_t len,
+				      bool past_equal,
+				      struct mem_kvs_node **prev)
+{
+	struct mem_kvs_node *node = shard->head;
+	struct mem_kvs_node *next;
+	int level, rc;
+
+	for (level = shard->levels - 1; level >= 0; level--) {
+		for (;;) {
+			next = node->next[level];
+			if (next == NULL)
+				break;
+			rc = key_cmp(next->key, next->klen, key, len);
+			if (rc > 0 || (rc == 0 && !past_equal))
+				break;
+			node = next;
+		}
+		if (prev != NULL)
+			prev[level] = node;
+	}
+
+	return node->next[0];
+}
+
+/* Called with the shard lock held */
+static struct mem_kvs_node *node_find(struct mem_kvs_shard *shard,
+				      const void *key, size_t len,
+				      struct mem_kvs_node **prev)
+{
+	struct mem_kvs_node *node;
+
+	node = node_seek(shard, key, len, false, prev);
+	if (node != NULL && key_cmp(node->key, node->klen, key, len) == 0)
+		return node;
+	return NULL;
+}
+
+static void node_free(struct mem_kvs_node *node)
+{
+	free(node->key);
+	free(node->val);
+	free(node);
+}
+
+static int val_set(struct mem_kvs_node *node, const void *val, size_t len)
+{
+	void *copy = malloc(len != 0 ? len : 1);
+
+	if (copy == NULL)
+		return -ENOMEM;
+
+	memcpy(copy, val, len);
+	free(node->val);
+	node->val = copy;
+	node->vlen = len;
+	return 0;
+}
+
+static int shard_put(struct mem_kvs_shard *shard, const void *key, size_t klen,
+		     const void *val, size_t vlen, bool overwrite)
+{
+	struct mem_kvs_node *prev[SKIPLIST_LEVELS];
+	struct mem_kvs_node *node;
+	int levels = 1, i, rc;
+
+	node = node_find(shard, key, klen, prev);
+	if (node != NULL)
+		return overwrite ? val_set(node, val, vlen) : -EEXIST;
+
+	/* Each level holds a quarter of the nodes of the one below */
+	while (levels < SKIPLIST_LEVELS && (rand_r(&shard->seed) & 3) == 0)
+		levels++;
+
+	node = calloc(1, sizeof(*node) + levels * sizeof(node->next[0]));
+	if (node == NULL)
+		return -ENOMEM;
+
+	node->levels = levels;
+	node->klen = klen;
+	node->key = malloc(klen != 0 ? klen : 1);
+	rc = node->key == NULL ? -ENOMEM : val_set(node, val, vlen);
+	if (rc != 0) {
+		node_free(node);
+		return rc;
+	}
+	memcpy(node->key, key, klen);
+
+	for (i = shard->levels; i < levels; i++)
+		prev[i] = shard->head;
+	if (levels > shard->levels)
+		shard->levels = levels;
+
+	for (i = 0; i < levels; i++) {
+		node->next[i] = prev[i]->next[i];
+		prev[i]->next[i] = node;
+	}
+	return 0;
+}
+
+static int shard_del(struct mem_kvs_shard *shard, const void *key, size_t len)
+{
+	struct mem_kvs_node *prev[SKIPLIST_LEVELS];
+	struct mem_kvs_node *node;
+	int i;
+
+	node = node_find(shard, key, len, prev);
+	if (node == NULL)
+		return -ENOENT;
+
+	for (i = 0; i < node->levels; i++)
+		prev[i]->next[i] = node->next[i];
+	while (shard->levels > 1 && shard->head->next[shard->levels - 1] == NULL)
+		shard->levels--;
+
+	node_free(node);
+	return 0;
+}
+
+/**
+ * NEXT: merge the shards from the start key in keys->ov_buf[0].
+ */
+static int mem_kvs_next(struct mem_kvs *kvs, struct m0_bufvec *keys,
+			struct m0_bufvec *vals, int *rcs, uint32_t flags)
+{
+	struct mem_kvs_node **cursor;
+	struct mem_kvs_node *node;
+	void *start = keys->ov_buf[0];
+	size_t start_len = keys->ov_vec.v_count[0];
+	bool exclude = flags & M0_OIF_EXCLUDE_START_KEY;
+	uint32_t nr = keys->ov_vec.v_nr;
+	uint32_t i, s, min;
+	int rc = 0;
+
+	/* The start key is overwritten by the first record */
+	start = malloc(start_len != 0 ? start_len : 1);
+	cursor = calloc(kvs->mk_nr_shards, sizeof(*cursor));
+	if (start == NULL || cursor == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	memcpy(start, keys->ov_buf[0], start_len);
+
+	/* Shards are always locked in the same order */
+	for (s = 0; s < kvs->mk_nr_shards; s++) {
+		pthread_mutex_lock(&kvs->mk_shards[s].lock);
+		cursor[s] = node_seek(&kvs->mk_shards[s], start, start_len,
+				      exclude, NULL);
+	}
+
+	for (i = 0; i < nr; i++) {
+		min = kvs->mk_nr_shards;
+		for (s = 0; s < kvs->mk_nr_shards; s++)
+			if (cursor[s] != NULL &&
+			    (min == kvs->mk_nr_shards ||
+			     key_cmp(cursor[s]->key, cursor[s]->klen,
+				     cursor[min]->key, cursor[min]->klen) < 0))
+				min = s;
+
+		if (min == kvs->mk_nr_shards) {
+			rcs[i] = -ENOENT;
+			continue;
+		}
+
+		node = cursor[min];
+		cursor[min] = node->next[0];
+		/* Only the start key may be replaced, see kvs_vec.h */
+		rcs[i] = kvs_vec_fill(keys, i, node->key, node->klen,
+				      i == 0 &&
+				      keys->ov_vec.v_count[0] < node->klen);
+		if (rcs[i] == 0)
+			rcs[i] = kvs_vec_fill(vals, i, node->val,
+					      node->vlen, false);
+	}
+
+	for (s = kvs->mk_nr_shards; s > 0; s--)
+		pthread_mutex_unlock(&kvs->mk_shards[s - 1].lock);
+
+out:
+	free(cursor);
+	free(start);
+	return rc;
+}
+
+int mem_kvs_init(struct mem_kvs *kvs, uint32_t nr_shards,
+		 uint64_t latency_us)
+{
+	struct mem_kvs_shard *shard;
+	uint32_t i;
+	int rc;
+
+	if (nr_shards == 0)
+		return -EINVAL;
+
+	memset(kvs, 0, sizeof(*kvs));
+	kvs->mk_latency_us = latency_us;
+
+	kvs->mk_shards = calloc(nr_shards, sizeof(*kvs->mk_shards));
+	if (kvs->mk_shards == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_shards; i++) {
+		shard = &kvs->mk_shards[i];
+		shard->levels = 1;
+		shard->seed = i + 1;
+		shard->head = calloc(1, sizeof(*shard->head) +
+				     SKIPLIST_LEVELS * sizeof(shard->head->next[0]));
+		if (shard->head == NULL) {
+			rc = -ENOMEM;
+			goto err;
+		}
+
+		rc = -pthread_mutex_init(&shard->lock, NULL);
+		if (rc != 0) {
+			free(shard->head);
+			goto err;
+		}
+		kvs->mk_nr_shards++;
+	}
+
+	return 0;
+
+err:
+	mem_kvs_fini(kvs);
+	return rc;
+}
+
+void mem_kvs_fini(struct mem_kvs *kvs)
+{
+	struct mem_kvs_shard *shard;
+	struct mem_kvs_node *node, *next;
+	uint32_t i;
+
+	for (i = 0; i < kvs->mk_nr_shards; i++) {
+		shard = &kvs->mk_shards[i];
+		for (node = shard->head->next[0]; node != NULL; node = next) {
+			next = node->next[0];
+			node_free(node);
+		}
+		free(shard->head);
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(kvs->mk_shards);
+	kvs->mk_shards = NULL;
+	kvs->mk_nr_shards = 0;
+}
+
+int mem_kvs_op(struct mem_kvs *kvs, enum m0_idx_opcode opcode,
+	       struct m0_bufvec *keys, struct m0_bufvec *vals, int *rcs,
+	       uint32_t flags)
+{
+	struct mem_kvs_shard *shard;
+	struct mem_kvs_node *node;
+	void *key;
+	size_t len;
+	uint32_t i;
+
+	if (keys == NULL || keys->ov_vec.v_nr == 0 ||
+	    (vals == NULL && opcode != M0_IC_DEL) ||
+	    (vals != NULL && vals->ov_vec.v_nr != keys->ov_vec.v_nr))
+		return -EINVAL;
+
+	if (kvs->mk_latency_us != 0)
+		usleep(kvs->mk_latency_us);
+
+	if (opcode == M0_IC_NEXT)
+		return mem_kvs_next(kvs, keys, vals, rcs, flags);
+
+	for (i = 0; i < keys->ov_vec.v_nr; i++) {
+		key = keys->ov_buf[i];
+		len = keys->ov_vec.v_count[i];
+		shard = shard_of(kvs, key, len);
+
+		pthread_mutex_lock(&shard->lock);
+		switch (opcode) {
+		case M0_IC_GET:
+			node = node_find(shard, key, len, NULL);
+			rcs[i] = node == NULL ? -ENOENT :
+				kvs_vec_fill(vals, i, node->val, node->vlen,
+					     true);
+			break;
+		case M0_IC_PUT:
+			rcs[i] = shard_put(shard, key, len, vals->ov_buf[i],
+					   vals->ov_vec.v_count[i],
+					   flags & M0_OIF_OVERWRITE);
+			break;
+		case M0_IC_DEL:
+			rcs[i] = shard_del(shard, key, len);
+			break;
+		default:
+			rcs[i] = -EOPNOTSUPP;
+			break;
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,66 @@
+/*
+ * Filename:         mem_kvs.h
+ * Description:      In-memory KV store
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* An in-process replacement for the Motr index behind md_kvs.c, so that
+ * the experiments can run without a cluster and measure the CPU cost of
+ * the code above the KV store.
+ *
+ * - mem_kvs_op() takes the same arguments as m0_idx_op() and follows the
+ *   same conventions: per-record rcs, GET allocates the values and NEXT
+ *   copies into ov_buf[i] (see kvs_vec_fill()), PUT fails
+ *   with -EEXIST unless M0_OIF_OVERWRITE, NEXT honours
+ *   M0_OIF_EXCLUDE_START_KEY and reports -ENOENT past the last key.
+ * - Keys are ordered like in a Motr index: memcmp() of the common bytes,
+ *   then the shorter key first.
+ * - Records are hashed over shards, each a skip list with its own lock.
+ *   NEXT merges the shards.
+ * - Every operation can be delayed by latency_us to model the network and
+ *   the stability of a real store.
+ */
+
+#ifndef _MEM_KVS_H
+#define _MEM_KVS_H
+
+#include <stdint.h>
+#include "motr/client.h"
+
+struct mem_kvs_shard;
+
+struct mem_kvs {
+	struct mem_kvs_shard *mk_shards;
+	uint32_t mk_nr_shards;
+	/* Injected latency of every operation */
+	uint64_t mk_latency_us;
+};
+
+int mem_kvs_init(struct mem_kvs *kvs, uint32_t nr_shards,
+		 uint64_t latency_us);
+
+void mem_kvs_fini(struct mem_kvs *kvs);
+
+/**
+ * Execute an index operation, see m0_idx_op().
+ * Return the status of the operation as a whole, the status of each record
+ * is in rcs.
+ */
+int mem_kvs_op(struct mem_kvs *kvs, enum m0_idx_opcode opcode,
+	       struct m0_bufvec *keys, struct m0_bufvec *vals, int *rcs,
+	       uint32_t flags);
+
+#endif /* _MEM_KVS_H */
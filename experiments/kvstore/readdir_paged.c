@@ -0,0 +1,366 @@
+/*
+ * Filename:         readdir_paged.c
+ * Description:      Resumable, cookie based paginated readdir
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Create a directory with NUM_FILES entries
+ * - Read it page by page (PAGE_SIZE entries) the way an NFS client does:
+ *   a) rescanning from the first key and skipping the entries already
+ *      returned, which is all cfs_readdir() allows today
+ *   b) with readdir_from(), which resumes after the cookie of the previous
+ *      page using M0_OIF_EXCLUDE_START_KEY, like m0_search_pattern() in
+ *      experiments/xattr/approach1.c continues from its last key
+ * - Calculate time taken and round trips of both
+ *
+ * Usage: readdir_paged [number of entries] [page size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+
+#define NUM_FILES 10000
+#define PAGE_SIZE 100
+#define READDIR_BATCH 100
+#define DIR_INO 0x2000ULL
+#define FIRST_INO 0x20000ULL
+
+typedef bool (*readdir_cb_t)(void *ctx, const char *name,
+			     const cfs_ino_t *ino);
+
+/* Position in a directory, the name of the last entry returned.
+ * An empty cookie (len == 0) stands for the beginning of the directory.
+ * The cookie stays valid when entries are added or removed: the next page
+ * starts at the first name following it.
+ */
+struct readdir_cookie {
+	uint8_t len;
+	char name[NAME_MAX];
+};
+
+struct readdir_ctx {
+	int index;
+	cfs_ino_t *inos;
+};
+
+static int round_trips;
+
+/**
+ * Return up to max_entries entries of dir that follow cookie.
+ * When cb returns false the entry it was given is not consumed and will be
+ * the first one of the next page.
+ * On return cookie points to the last consumed entry and eof tells whether
+ * the end of the directory was reached.
+ */
+static int readdir_from(cfs_ino_t dir, struct readdir_cookie *cookie,
+			int max_entries, readdir_cb_t cb, void *ctx, bool *eof)
+{
+	struct md_kvs_iter it;
+	struct md_dentry_key dkey;
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	int count = 0;
+	uint32_t i;
+	int rc;
+
+	*eof = false;
+	if (max_entries <= 0)
+		return -EINVAL;
+
+	rc = md_dentry_iter_init(&it, dir, max_entries < READDIR_BATCH ?
+				 max_entries : READDIR_BATCH);
+	if (rc != 0)
+		return rc;
+
+	/* The page size is known, no need to start with small batches */
+	it.batch = it.cap;
+
+	if (cookie->len != 0) {
+		MD_DENTRY_KEY_INIT(&dkey, dir, cookie->name, cookie->len);
+		md_kvs_iter_seek(&it, &dkey, MD_DENTRY_KEY_LEN(cookie->len),
+				 true);
+	}
+
+	while (count < max_entries) {
+		rc = md_kvs_iter_next(&it);
+		round_trips++;
+		if (rc != 0)
+			break;
+
+		for (i = 0; i < it.nr && count < max_entries; i++) {
+			md_dentry_decode(&it, i, name, &ino);
+			if (!cb(ctx, name, &ino))
+				goto out;
+
+			cookie->len = strlen(name);
+			memcpy(cookie->name, name, cookie->len);
+			count++;
+		}
+
+		/* Entries fetched past the page are simply read again */
+		if (it.eof && i == it.nr) {
+			*eof = true;
+			break;
+		}
+	}
+
+out:
+	md_kvs_iter_fini(&it);
+	return rc;
+}
+
+/**
+ * Pagination without cookies: rescan from the beginning and skip the
+ * first position entries.
+ */
+static int readdir_skip(cfs_ino_t dir, int position, int max_entries,
+			readdir_cb_t cb, void *ctx, bool *eof)
+{
+	struct md_kvs_iter it;
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	int seen = 0;
+	uint32_t i;
+	int rc;
+
+	*eof = false;
+	rc = md_dentry_iter_init(&it, dir, READDIR_BATCH);
+	if (rc != 0)
+		return rc;
+
+	while (seen < position + max_entries) {
+		rc = md_kvs_iter_next(&it);
+		round_trips++;
+		if (rc != 0)
+			break;
+
+		for (i = 0; i < it.nr && seen < position + max_entries; i++) {
+			if (seen++ < position)
+				continue;
+			md_dentry_decode(&it, i, name, &ino);
+			if (!cb(ctx, name, &ino))
+				goto out;
+		}
+
+		if (it.eof && i == it.nr) {
+			*eof = true;
+			break;
+		}
+	}
+
+out:
+	md_kvs_iter_fini(&it);
+	return rc;
+}
+
+static bool test_readdir_cb(void *ctx, const char *name, const cfs_ino_t *ino)
+{
+	struct readdir_ctx *readdir_ctx = ctx;
+
+	readdir_ctx->inos[readdir_ctx->index++] = *ino;
+	return true;
+}
+
+/**
+ * Verify that every inode was returned once, in name order.
+ */
+static int verify_inos(struct readdir_ctx *ctx, int nr)
+{
+	char name[NAME_MAX + 1], prev[NAME_MAX + 1] = "";
+	bool *seen;
+	int i, rc = 0;
+
+	if (ctx->index != nr)
+		return -EINVAL;
+
+	seen = calloc(nr, sizeof(bool));
+	if (seen == NULL)
+		return -ENOMEM;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		if (ctx->inos[i] < FIRST_INO || ctx->inos[i] >= FIRST_INO + nr ||
+		    seen[ctx->inos[i] - FIRST_INO]) {
+			rc = -EINVAL;
+			break;
+		}
+		seen[ctx->inos[i] - FIRST_INO] = true;
+
+		snprintf(name, sizeof(name), "%llu", ctx->inos[i] - FIRST_INO);
+		if (strcmp(prev, name) >= 0)
+			rc = -EINVAL;
+		strcpy(prev, name);
+	}
+
+	free(seen);
+	return rc;
+}
+
+static int readdir_pages_compare(int nr, int page_size)
+{
+	struct readdir_ctx ctx = { .index = 0 };
+	struct readdir_cookie cookie = { .len = 0 };
+	struct timeval start1, end1;
+	long elapsed;
+	int rc, pages;
+	bool eof = false;
+
+	/* Room for one extra page, in case of a bug returning too much */
+	ctx.inos = calloc(nr + page_size, sizeof(cfs_ino_t));
+	if (ctx.inos == NULL)
+		return -ENOMEM;
+
+	rc = md_kvs_dir_populate(M0_IC_PUT, DIR_INO, FIRST_INO, nr);
+	if (rc != 0)
+		goto out;
+
+	round_trips = 0;
+	md_kvs_iter_stats_reset();
+	gettimeofday(&start1, NULL);
+	for (pages = 0; rc == 0 && !eof && ctx.index < nr; pages++)
+		rc = readdir_skip(DIR_INO, ctx.index, page_size,
+				  test_readdir_cb, &ctx, &eof);
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	if (rc == 0)
+		rc = verify_inos(&ctx, nr);
+	if (rc != 0) {
+		fprintf(stderr, "readdir_skip failed rc=%d entries=%d\n",
+			rc, ctx.index);
+		goto cleanup;
+	}
+	printf("rescan and skip: %d entries, %d pages in %ld usecs,"
+	       " %d round trips\n", nr, pages, elapsed, round_trips);
+	md_kvs_iter_stats_print("rescan and skip");
+
+	ctx.index = 0;
+	eof = false;
+	round_trips = 0;
+	md_kvs_iter_stats_reset();
+	gettimeofday(&start1, NULL);
+	for (pages = 0; rc == 0 && !eof; pages++)
+		rc = readdir_from(DIR_INO, &cookie, page_size,
+				  test_readdir_cb, &ctx, &eof);
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	if (rc == 0)
+		rc = verify_inos(&ctx, nr);
+	if (rc != 0) {
+		fprintf(stderr, "readdir_from failed rc=%d entries=%d\n",
+			rc, ctx.index);
+		goto cleanup;
+	}
+	printf("readdir_from:    %d entries, %d pages in %ld usecs,"
+	       " %d round trips\n", nr, pages, elapsed, round_trips);
+	md_kvs_iter_stats_print("readdir_from");
+
+cleanup:
+	if (md_kvs_dir_populate(M0_IC_DEL, DIR_INO, FIRST_INO, nr) != 0)
+		fprintf(stderr, "failed to remove directory entries\n");
+out:
+	free(ctx.inos);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int nr = NUM_FILES;
+	int page_size = PAGE_SIZE;
+	int rc;
+
+	if (argc > 3) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [number of entries] [page size]\n",
+			basename(argv[0]));
+		return -1;
+	}
+
+	if (argc > 1)
+		nr = atoi(argv[1]);
+	if (argc > 2)
+		page_size = atoi(argv[2]);
+	if (nr <= 0 || page_size <= 0) {
+		fprintf(stderr, "invalid number of entries or page size\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = readdir_pages_compare(nr, page_size);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,415 @@
+/*
+ * Filename:         readdir_plus.c
+ * Description:      readdir returning attributes alongside names
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Create a directory with NUM_FILES entries (dentry + stat records)
+ * - List it the way READDIRPLUS is served today: readdir, then one
+ *   getattr per entry
+ * - List it with readdir_plus(): every NEXT batch of dentries is followed
+ *   by one multi-key GET of their stat records, and that GET is in flight
+ *   together with the NEXT for the following batch
+ * - Calculate time taken and round trips of both
+ *
+ * Usage: readdir_plus [number of entries]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include "md_kvs.h"
+
+#define NUM_FILES 1000
+#define READDIR_BATCH 100
+#define DIR_INO 0x1000ULL
+#define FIRST_INO 0x10000ULL
+
+/**
+ * Call-back function for readdir_plus, same as the cfs_readdir() one plus
+ * the attributes of the entry.
+ */
+typedef bool (*readdir_plus_cb_t)(void *ctx, const char *name,
+				  const cfs_ino_t *ino,
+				  const struct stat *stat);
+
+typedef bool (*readdir_cb_t)(void *ctx, const char *name,
+			     const cfs_ino_t *ino);
+
+struct readdir_ctx {
+	int index;
+	cfs_ino_t *inos;
+	unsigned long long size_sum;
+};
+
+static int round_trips;
+
+/**
+ * Plain readdir: NEXT batches, name and inode only.
+ */
+static int readdir_plain(cfs_ino_t dir, readdir_cb_t cb, void *ctx)
+{
+	struct md_kvs_iter it;
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	bool more = true;
+	uint32_t i;
+	int rc;
+
+	rc = md_dentry_iter_init(&it, dir, READDIR_BATCH);
+	if (rc != 0)
+		return rc;
+
+	while (more && !it.eof) {
+		rc = md_kvs_iter_next(&it);
+		round_trips++;
+		if (rc != 0)
+			break;
+
+		for (i = 0; more && i < it.nr; i++) {
+			md_dentry_decode(&it, i, name, &ino);
+			more = cb(ctx, name, &ino);
+		}
+	}
+
+	md_kvs_iter_fini(&it);
+	return rc;
+}
+
+/**
+ * Fetch attributes of a single inode, one round trip.
+ */
+static int getattr(cfs_ino_t ino, struct stat *st)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int rc;
+
+	rc = m0_bufvec_alloc(&key, 1, sizeof(struct md_stat_key));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_empty_alloc(&val, 1);
+	if (rc != 0) {
+		m0_bufvec_free(&key);
+		return rc;
+	}
+
+	MD_STAT_KEY_INIT((struct md_stat_key *)key.ov_buf[0], ino);
+
+	rc = md_kvs_op(M0_IC_GET, &key, &val, NULL, 0);
+	round_trips++;
+	if (rc == 0 && val.ov_vec.v_count[0] != sizeof(struct stat))
+		rc = -EINVAL;
+	if (rc == 0)
+		memcpy(st, val.ov_buf[0], sizeof(struct stat));
+
+	m0_bufvec_free(&key);
+	m0_bufvec_free(&val);
+	return rc;
+}
+
+/**
+ * Release the values returned by a GET so that the bufvec can be reused.
+ */
+static void vals_release(struct m0_bufvec *vals)
+{
+	uint32_t i;
+
+	for (i = 0; i < vals->ov_vec.v_nr; i++) {
+		m0_free(vals->ov_buf[i]);
+		vals->ov_buf[i] = NULL;
+		vals->ov_vec.v_count[i] = 0;
+	}
+}
+
+/**
+ * readdir that hands every entry to cb together with its attributes.
+ * Two dentry iterators are used in turn: while the callbacks for batch N
+ * wait for the stat GET, the NEXT for batch N + 1 is already in flight.
+ */
+static int readdir_plus(cfs_ino_t dir, readdir_plus_cb_t cb, void *ctx)
+{
+	struct md_kvs_iter it[2];
+	struct m0_bufvec skeys;
+	struct m0_bufvec svals;
+	struct m0_op *get_op;
+	int srcs[READDIR_BATCH];
+	char name[NAME_MAX + 1];
+	cfs_ino_t ino;
+	struct stat *st;
+	bool more = true;
+	int cur = 0, nxt;
+	uint32_t i;
+	int rc, rc2;
+
+	rc = md_dentry_iter_init(&it[0], dir, READDIR_BATCH);
+	if (rc != 0)
+		goto out;
+
+	rc = md_dentry_iter_init(&it[1], dir, READDIR_BATCH);
+	if (rc != 0)
+		goto fini_it0;
+
+	rc = m0_bufvec_alloc(&skeys, READDIR_BATCH,
+			     sizeof(struct md_stat_key));
+	if (rc != 0)
+		goto fini_it1;
+
+	rc = m0_bufvec_empty_alloc(&svals, READDIR_BATCH);
+	if (rc != 0)
+		goto free_skeys;
+
+	rc = md_kvs_iter_next(&it[cur]);
+	round_trips++;
+
+	while (rc == 0 && more && it[cur].nr > 0) {
+		nxt = 1 - cur;
+
+		skeys.ov_vec.v_nr = it[cur].nr;
+		svals.ov_vec.v_nr = it[cur].nr;
+		for (i = 0; i < it[cur].nr; i++) {
+			md_dentry_decode(&it[cur], i, name, &ino);
+			MD_STAT_KEY_INIT((struct md_stat_key *)skeys.ov_buf[i],
+					 ino);
+			skeys.ov_vec.v_count[i] = sizeof(struct md_stat_key);
+		}
+
+		rc = md_kvs_op_launch(M0_IC_GET, &skeys, &svals, srcs, 0,
+				      &get_op);
+		round_trips++;
+		if (rc != 0)
+			break;
+
+		if (!it[cur].eof) {
+			md_kvs_iter_seek(&it[nxt], it[cur].start,
+					 it[cur].start_len, true);
+			/* Keep growing the batch across both iterators */
+			it[nxt].batch = it[cur].batch;
+			rc = md_kvs_iter_launch(&it[nxt]);
+			round_trips++;
+		}
+
+		rc2 = md_kvs_op_wait(get_op);
+		if (rc == 0)
+			rc = rc2;
+
+		for (i = 0; rc == 0 && more && i < it[cur].nr; i++) {
+			md_dentry_decode(&it[cur], i, name, &ino);
+			st = svals.ov_buf[i];
+			if (srcs[i] != 0 ||
+			    svals.ov_vec.v_count[i] != sizeof(*st)) {
+				fprintf(stderr, "no attributes for %s (%d)\n",
+					name, srcs[i]);
+				rc = srcs[i] != 0 ? srcs[i] : -EINVAL;
+				break;
+			}
+			more = cb(ctx, name, &ino, st);
+		}
+		vals_release(&svals);
+
+		if (it[cur].eof)
+			break;
+
+		/* Collect the NEXT even when stopping, it owns an op */
+		if (it[nxt].pending) {
+			rc2 = md_kvs_iter_wait(&it[nxt]);
+			if (rc == 0)
+				rc = rc2;
+		}
+		cur = nxt;
+	}
+
+	skeys.ov_vec.v_nr = READDIR_BATCH;
+	svals.ov_vec.v_nr = READDIR_BATCH;
+	m0_bufvec_free(&svals);
+free_skeys:
+	m0_bufvec_free(&skeys);
+fini_it1:
+	md_kvs_iter_fini(&it[1]);
+fini_it0:
+	md_kvs_iter_fini(&it[0]);
+out:
+	return rc;
+}
+
+static bool test_readdir_cb(void *ctx, const char *name, const cfs_ino_t *ino)
+{
+	struct readdir_ctx *readdir_ctx = ctx;
+
+	readdir_ctx->inos[readdir_ctx->index++] = *ino;
+	return true;
+}
+
+static bool test_readdir_plus_cb(void *ctx, const char *name,
+				 const cfs_ino_t *ino, const struct stat *stat)
+{
+	struct readdir_ctx *readdir_ctx = ctx;
+
+	readdir_ctx->inos[readdir_ctx->index++] = *ino;
+	readdir_ctx->size_sum += stat->st_size;
+	return true;
+}
+
+static int readdir_compare(int nr)
+{
+	struct readdir_ctx ctx = { .index = 0 };
+	struct timeval start1, end1;
+	unsigned long long expected = (unsigned long long)nr * (nr - 1) / 2;
+	struct stat st;
+	long elapsed;
+	int rc, i;
+
+	ctx.inos = calloc(nr, sizeof(cfs_ino_t));
+	if (ctx.inos == NULL)
+		return -ENOMEM;
+
+	rc = md_kvs_dir_populate(M0_IC_PUT, DIR_INO, FIRST_INO, nr);
+	if (rc != 0)
+		goto out;
+
+	/* readdir + getattr of every entry */
+	round_trips = 0;
+	md_kvs_iter_stats_reset();
+	gettimeofday(&start1, NULL);
+	rc = readdir_plain(DIR_INO, test_readdir_cb, &ctx);
+	for (i = 0; rc == 0 && i < ctx.index; i++) {
+		rc = getattr(ctx.inos[i], &st);
+		ctx.size_sum += st.st_size;
+	}
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	if (rc != 0 || ctx.index != nr || ctx.size_sum != expected) {
+		fprintf(stderr, "readdir+getattr failed rc=%d entries=%d\n",
+			rc, ctx.index);
+		rc = rc ?: -EINVAL;
+		goto cleanup;
+	}
+	printf("readdir + getattr: %d entries in %ld usecs, %d round trips\n",
+	       nr, elapsed, round_trips);
+	md_kvs_iter_stats_print("readdir + getattr");
+
+	/* readdir_plus */
+	ctx.index = 0;
+	ctx.size_sum = 0;
+	round_trips = 0;
+	md_kvs_iter_stats_reset();
+	gettimeofday(&start1, NULL);
+	rc = readdir_plus(DIR_INO, test_readdir_plus_cb, &ctx);
+	gettimeofday(&end1, NULL);
+	elapsed = md_kvs_elapsed_us(&start1, &end1);
+	if (rc != 0 || ctx.index != nr || ctx.size_sum != expected) {
+		fprintf(stderr, "readdir_plus failed rc=%d entries=%d\n",
+			rc, ctx.index);
+		rc = rc ?: -EINVAL;
+		goto cleanup;
+	}
+	printf("readdir_plus:      %d entries in %ld usecs, %d round trips\n",
+	       nr, elapsed, round_trips);
+	md_kvs_iter_stats_print("readdir_plus");
+
+cleanup:
+	if (md_kvs_dir_populate(M0_IC_DEL, DIR_INO, FIRST_INO, nr) != 0)
+		fprintf(stderr, "failed to remove directory entries\n");
+out:
+	free(ctx.inos);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	int nr = NUM_FILES;
+	int rc;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [number of entries]\n", basename(argv[0]));
+		return -1;
+	}
+
+	if (argc == 2)
+		nr = atoi(argv[1]);
+	if (nr <= 0) {
+		fprintf(stderr, "invalid number of entries\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = readdir_compare(nr);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,536 @@
+/*
+ * Filename:         redis_kvs.c
+ * Description:      Pipelined Redis backend of md_kvs
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <hiredis/hiredis.h>
+#include "motr/client.h"
+#include "kvs_pool.h"
+#include "kvs_vec.h"
+#include "redis_kvs.h"
+
+#define REDIS_KVS_TIMEOUT_S 5
+
+/* NEXT: up to ARGV[2] keys from ARGV[1] ("[key" or "(key" to exclude it)
+ * and their values.
+ */
+static const char next_script[] =
+	"local k = redis.call('ZRANGEBYLEX', KEYS[1], ARGV[1], '+', "
+	"'LIMIT', 0, tonumber(ARGV[2]))\n"
+	"if #k == 0 then return {} end\n"
+	"return {k, redis.call('MGET', unpack(k))}\n";
+
+/* A caller's operation, lives on its stack */
+struct redis_kvs_req {
+	enum m0_idx_opcode rq_opcode;
+	struct m0_bufvec *rq_keys;
+	struct m0_bufvec *rq_vals;
+	int *rq_rcs;
+	uint32_t rq_flags;
+	/* Commands sent, as many replies to read */
+	uint32_t rq_nr_cmds;
+	int rq_rc;
+	bool rq_done;
+	struct redis_kvs_req *rq_next;
+};
+
+struct redis_kvs_conn {
+	/* NULL after an error, connected again by the next batch */
+	redisContext *rc_ctx;
+	pthread_mutex_t rc_lock;
+	/* Broadcast when a batch is done */
+	pthread_cond_t rc_cond;
+	/* Requests waiting for the next batch */
+	struct redis_kvs_req *rc_head;
+	struct redis_kvs_req **rc_tail;
+	/* A caller is sending a batch */
+	bool rc_busy;
+};
+
+static int conn_connect(struct redis_kvs *kvs, struct redis_kvs_conn *conn)
+{
+	struct timeval timeout = { .tv_sec = REDIS_KVS_TIMEOUT_S };
+	redisContext *ctx;
+
+	ctx = redisConnectWithTimeout(kvs->rk_host, kvs->rk_port, timeout);
+	if (ctx == NULL || ctx->err != 0) {
+		fprintf(stderr, "Failed to connect to redis %s:%d: %s\n",
+			kvs->rk_host, kvs->rk_port,
+			ctx != NULL ? ctx->errstr : "out of memory");
+		if (ctx != NULL)
+			redisFree(ctx);
+		return -ECONNREFUSED;
+	}
+
+	conn->rc_ctx = ctx;
+	return 0;
+}
+
+static int cmd_append(redisContext *ctx, struct redis_kvs_req *req, int argc,
+		      const char **argv, const size_t *lens)
+{
+	if (redisAppendCommandArgv(ctx, argc, argv, lens) != REDIS_OK)
+		return -EIO;
+	req->rq_nr_cmds++;
+	return 0;
+}
+
+static void arg_set(const char **argv, size_t *lens, int i, const void *arg,
+		    size_t len)
+{
+	argv[i] = arg;
+	lens[i] = len;
+}
+
+#define ARG_STR(argv, lens, i, str) arg_set(argv, lens, i, str, strlen(str))
+
+/**
+ * Add the keys of req to the index, or remove them, with cmd.
+ */
+static int index_append(redisContext *ctx, struct redis_kvs_req *req,
+			const char *cmd, const char **argv, size_t *lens)
+{
+	struct m0_bufvec *keys = req->rq_keys;
+	uint32_t i, nr = keys->ov_vec.v_nr;
+	int argc = 0;
+	bool zadd = strcmp(cmd, "ZADD") == 0;
+
+	ARG_STR(argv, lens, argc++, cmd);
+	ARG_STR(argv, lens, argc++, REDIS_KVS_INDEX);
+	for (i = 0; i < nr; i++) {
+		/* Same score for all, ordered by the bytes of the key */
+		if (zadd)
+			ARG_STR(argv, lens, argc++, "0");
+		arg_set(argv, lens, argc++, keys->ov_buf[i],
+			keys->ov_vec.v_count[i]);
+	}
+	return cmd_append(ctx, req, argc, argv, lens);
+}
+
+/**
+ * Append the commands of req to the output buffer of ctx.
+ */
+static int req_append(redisContext *ctx, struct redis_kvs_req *req)
+{
+	struct m0_bufvec *keys = req->rq_keys;
+	struct m0_bufvec *vals = req->rq_vals;
+	uint32_t i, nr = keys->ov_vec.v_nr;
+	const char **argv;
+	size_t *lens;
+	char *start = NULL;
+	char count[16];
+	int rc = 0, argc = 0;
+
+	/* MSET and ZADD take 2 * nr + 2 arguments at most */
+	argv = kvs_pool_alloc((2 * nr + 6) * sizeof(*argv));
+	lens = kvs_pool_alloc((2 * nr + 6) * sizeof(*lens));
+	if (argv == NULL || lens == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	switch (req->rq_opcode) {
+	case M0_IC_GET:
+		ARG_STR(argv, lens, argc++, "MGET");
+		for (i = 0; i < nr; i++)
+			arg_set(argv, lens, argc++, keys->ov_buf[i],
+				keys->ov_vec.v_count[i]);
+		rc = cmd_append(ctx, req, argc, argv, lens);
+		break;
+
+	case M0_IC_PUT:
+		ARG_STR(argv, lens, 0, "MULTI");
+		rc = cmd_append(ctx, req, 1, argv, lens);
+		if (rc == 0 && (req->rq_flags & M0_OIF_OVERWRITE)) {
+			ARG_STR(argv, lens, argc++, "MSET");
+			for (i = 0; i < nr; i++) {
+				arg_set(argv, lens, argc++, keys->ov_buf[i],
+					keys->ov_vec.v_count[i]);
+				arg_set(argv, lens, argc++, vals->ov_buf[i],
+					vals->ov_vec.v_count[i]);
+			}
+			rc = cmd_append(ctx, req, argc, argv, lens);
+		}
+		/* MSETNX would fail all the records if one exists */
+		for (i = 0; rc == 0 && !(req->rq_flags & M0_OIF_OVERWRITE) &&
+		     i < nr; i++) {
+			ARG_STR(argv, lens, 0, "SET");
+			arg_set(argv, lens, 1, keys->ov_buf[i],
+				keys->ov_vec.v_count[i]);
+			arg_set(argv, lens, 2, vals->ov_buf[i],
+				vals->ov_vec.v_count[i]);
+			ARG_STR(argv, lens, 3, "NX");
+			rc = cmd_append(ctx, req, 4, argv, lens);
+		}
+		if (rc == 0)
+			rc = index_append(ctx, req, "ZADD", argv, lens);
+		if (rc == 0) {
+			ARG_STR(argv, lens, 0, "EXEC");
+			rc = cmd_append(ctx, req, 1, argv, lens);
+		}
+		break;
+
+	case M0_IC_DEL:
+		ARG_STR(argv, lens, 0, "MULTI");
+		rc = cmd_append(ctx, req, 1, argv, lens);
+		/* One UNLINK per key, for the rc of each record */
+		for (i = 0; rc == 0 && i < nr; i++) {
+			ARG_STR(argv, lens, 0, "UNLINK");
+			arg_set(argv, lens, 1, keys->ov_buf[i],
+				keys->ov_vec.v_count[i]);
+			rc = cmd_append(ctx, req, 2, argv, lens);
+		}
+		if (rc == 0)
+			rc = index_append(ctx, req, "ZREM", argv, lens);
+		if (rc == 0) {
+			ARG_STR(argv, lens, 0, "EXEC");
+			rc = cmd_append(ctx, req, 1, argv, lens);
+		}
+		break;
+
+	case M0_IC_NEXT:
+		start = kvs_pool_alloc(keys->ov_vec.v_count[0] + 1);
+		if (start == NULL) {
+			rc = -ENOMEM;
+			break;
+		}
+		start[0] = req->rq_flags & M0_OIF_EXCLUDE_START_KEY ? '(' : '[';
+		memcpy(start + 1, keys->ov_buf[0], keys->ov_vec.v_count[0]);
+		snprintf(count, sizeof(count), "%u", nr);
+
+		ARG_STR(argv, lens, argc++, "EVAL");
+		ARG_STR(argv, lens, argc++, next_script);
+		ARG_STR(argv, lens, argc++, "1");
+		ARG_STR(argv, lens, argc++, REDIS_KVS_INDEX);
+		arg_set(argv, lens, argc++, start,
+			keys->ov_vec.v_count[0] + 1);
+		ARG_STR(argv, lens, argc++, count);
+		rc = cmd_append(ctx, req, argc, argv, lens);
+		break;
+
+	default:
+		rc = -EOPNOTSUPP;
+		break;
+	}
+
+out:
+	kvs_pool_free(start);
+	kvs_pool_free(lens);
+	kvs_pool_free(argv);
+	return rc;
+}
+
+/**
+ * Set the rcs of req from the reply of its last command, an EXEC for PUT
+ * and DEL.
+ */
+static int req_parse(struct redis_kvs_req *req, redisReply *reply)
+{
+	struct m0_bufvec *keys = req->rq_keys;
+	struct m0_bufvec *vals = req->rq_vals;
+	redisReply *elem, *found_keys, *found_vals;
+	uint32_t i, nr = keys->ov_vec.v_nr;
+	bool nx = !(req->rq_flags & M0_OIF_OVERWRITE);
+	int *rcs = req->rq_rcs;
+
+	/* An EXEC aborted by the server replies NIL */
+	if (reply->type != REDIS_REPLY_ARRAY)
+		return -EIO;
+
+	switch (req->rq_opcode) {
+	case M0_IC_GET:
+		if (reply->elements != nr)
+			return -EIO;
+		for (i = 0; i < nr; i++) {
+			elem = reply->element[i];
+			rcs[i] = elem->type == REDIS_REPLY_NIL ? -ENOENT :
+				elem->type != REDIS_REPLY_STRING ? -EIO :
+				kvs_vec_fill(vals, i, elem->str, elem->len,
+					     true);
+		}
+		return 0;
+
+	case M0_IC_PUT:
+		/* MSET or the SET NX of each record, then ZADD */
+		if (reply->elements != (nx ? nr : 1) + 1)
+			return -EIO;
+		for (i = 0; i < nr; i++)
+			rcs[i] = !nx ? 0 :
+				reply->element[i]->type == REDIS_REPLY_NIL ?
+				-EEXIST : 0;
+		return 0;
+
+	case M0_IC_DEL:
+		/* The UNLINK of each record, then ZREM */
+		if (reply->elements != nr + 1)
+			return -EIO;
+		for (i = 0; i < nr; i++) {
+			elem = reply->element[i];
+			rcs[i] = elem->type != REDIS_REPLY_INTEGER ? -EIO :
+				elem->integer == 0 ? -ENOENT : 0;
+		}
+		return 0;
+
+	case M0_IC_NEXT:
+		found_keys = found_vals = NULL;
+		if (reply->elements == 2) {
+			found_keys = reply->element[0];
+			found_vals = reply->element[1];
+			if (found_keys->type != REDIS_REPLY_ARRAY ||
+			    found_vals->type != REDIS_REPLY_ARRAY ||
+			    found_keys->elements != found_vals->elements)
+				return -EIO;
+		} else if (reply->elements != 0) {
+			return -EIO;
+		}
+
+		for (i = 0; i < nr; i++) {
+			elem = found_keys != NULL && i < found_keys->elements ?
+				found_vals->element[i] : NULL;
+			/* Past the last key, or removed since ZRANGEBYLEX */
+			if (elem == NULL || elem->type != REDIS_REPLY_STRING) {
+				rcs[i] = -ENOENT;
+				continue;
+			}
+			elem = found_keys->element[i];
+			/* Only the start key may be replaced, see kvs_vec.h */
+			rcs[i] = kvs_vec_fill(keys, i, elem->str, elem->len,
+					      i == 0 &&
+					      keys->ov_vec.v_count[0] <
+					      elem->len);
+			elem = found_vals->element[i];
+			if (rcs[i] == 0)
+				rcs[i] = kvs_vec_fill(vals, i, elem->str,
+						      elem->len, false);
+		}
+		return 0;
+
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+/**
+ * Read the replies to the commands of req.
+ */
+static int req_reply(redisContext *ctx, struct redis_kvs_req *req)
+{
+	redisReply *reply = NULL;
+	uint32_t i;
+	int rc = 0;
+
+	for (i = 0; i < req->rq_nr_cmds; i++) {
+		if (reply != NULL)
+			freeReplyObject(reply);
+		/* The first call writes the whole batch */
+		if (redisGetReply(ctx, (void **)&reply) != REDIS_OK)
+			return -EIO;
+		if (reply->type == REDIS_REPLY_ERROR) {
+			fprintf(stderr, "redis error: %.*s\n",
+				(int)reply->len, reply->str);
+			rc = -EIO;
+		}
+	}
+
+	if (rc == 0 && reply != NULL)
+		rc = req_parse(req, reply);
+	if (reply != NULL)
+		freeReplyObject(reply);
+	return rc;
+}
+
+/**
+ * Send the requests of batch in one write, then read their replies.
+ */
+static void batch_exec(struct redis_kvs *kvs, struct redis_kvs_conn *conn,
+		       struct redis_kvs_req *batch)
+{
+	struct redis_kvs_req *req, *unanswered = batch;
+	int rc = 0;
+
+	if (conn->rc_ctx == NULL) {
+		__atomic_add_fetch(&kvs->rk_reconnects, 1, __ATOMIC_RELAXED);
+		rc = conn_connect(kvs, conn);
+	}
+
+	for (req = batch; rc == 0 && req != NULL; req = req->rq_next) {
+		req->rq_nr_cmds = 0;
+		rc = req_append(conn->rc_ctx, req);
+	}
+
+	/* Only sent when every request was appended: one appended in part
+	 * would leave a MULTI open, the connection is dropped instead.
+	 */
+	for (req = batch; rc == 0 && req != NULL; req = req->rq_next) {
+		req->rq_rc = req_reply(conn->rc_ctx, req);
+		unanswered = req->rq_next;
+		if (conn->rc_ctx->err != 0) {
+			fprintf(stderr, "redis connection lost: %s\n",
+				conn->rc_ctx->errstr);
+			rc = -EIO;
+		}
+	}
+	__atomic_add_fetch(&kvs->rk_batches, 1, __ATOMIC_RELAXED);
+
+	if (rc == 0)
+		return;
+
+	/* A new connection is made by the next batch */
+	for (req = unanswered; req != NULL; req = req->rq_next)
+		req->rq_rc = rc;
+	if (conn->rc_ctx != NULL) {
+		redisFree(conn->rc_ctx);
+		conn->rc_ctx = NULL;
+	}
+}
+
+int redis_kvs_op(struct redis_kvs *kvs, enum m0_idx_opcode opcode,
+		 struct m0_bufvec *keys, struct m0_bufvec *vals, int *rcs,
+		 uint32_t flags)
+{
+	struct redis_kvs_req req = {
+		.rq_opcode = opcode,
+		.rq_keys = keys,
+		.rq_vals = vals,
+		.rq_rcs = rcs,
+		.rq_flags = flags,
+	};
+	struct redis_kvs_conn *conn;
+	struct redis_kvs_req *batch;
+
+	if (keys == NULL || keys->ov_vec.v_nr == 0 ||
+	    (vals == NULL && opcode != M0_IC_DEL) ||
+	    (vals != NULL && vals->ov_vec.v_nr != keys->ov_vec.v_nr))
+		return -EINVAL;
+
+	__atomic_add_fetch(&kvs->rk_requests, 1, __ATOMIC_RELAXED);
+	conn = &kvs->rk_conns[__atomic_fetch_add(&kvs->rk_next, 1,
+						 __ATOMIC_RELAXED) %
+			      kvs->rk_nr_conns];
+
+	pthread_mutex_lock(&conn->rc_lock);
+	*conn->rc_tail = &req;
+	conn->rc_tail = &req.rq_next;
+
+	while (!req.rq_done) {
+		if (conn->rc_busy) {
+			pthread_cond_wait(&conn->rc_cond, &conn->rc_lock);
+			continue;
+		}
+
+		/* Send whatever was queued, this request included */
+		batch = conn->rc_head;
+		conn->rc_head = NULL;
+		conn->rc_tail = &conn->rc_head;
+		conn->rc_busy = true;
+		pthread_mutex_unlock(&conn->rc_lock);
+
+		batch_exec(kvs, conn, batch);
+
+		pthread_mutex_lock(&conn->rc_lock);
+		for (; batch != NULL; batch = batch->rq_next)
+			batch->rq_done = true;
+		conn->rc_busy = false;
+		pthread_cond_broadcast(&conn->rc_cond);
+	}
+	pthread_mutex_unlock(&conn->rc_lock);
+
+	return req.rq_rc;
+}
+
+int redis_kvs_init(struct redis_kvs *kvs, const char *host, int port,
+		   uint32_t nr_conns)
+{
+	struct redis_kvs_conn *conn;
+	uint32_t i;
+	int rc = 0;
+
+	if (nr_conns == 0)
+		return -EINVAL;
+
+	memset(kvs, 0, sizeof(*kvs));
+	kvs->rk_port = port;
+	kvs->rk_host = strdup(host);
+	kvs->rk_conns = calloc(nr_conns, sizeof(*kvs->rk_conns));
+	if (kvs->rk_host == NULL || kvs->rk_conns == NULL) {
+		rc = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; rc == 0 && i < nr_conns; i++) {
+		conn = &kvs->rk_conns[i];
+		pthread_mutex_init(&conn->rc_lock, NULL);
+		pthread_cond_init(&conn->rc_cond, NULL);
+		conn->rc_tail = &conn->rc_head;
+		kvs->rk_nr_conns++;
+		rc = conn_connect(kvs, conn);
+	}
+	if (rc == 0)
+		return 0;
+
+err:
+	redis_kvs_fini(kvs);
+	return rc;
+}
+
+void redis_kvs_fini(struct redis_kvs *kvs)
+{
+	struct redis_kvs_conn *conn;
+	uint32_t i;
+
+	for (i = 0; i < kvs->rk_nr_conns; i++) {
+		conn = &kvs->rk_conns[i];
+		if (conn->rc_ctx != NULL)
+			redisFree(conn->rc_ctx);
+		pthread_cond_destroy(&conn->rc_cond);
+		pthread_mutex_destroy(&conn->rc_lock);
+	}
+	free(kvs->rk_conns);
+	free(kvs->rk_host);
+	memset(kvs, 0, sizeof(*kvs));
+}
+
+void redis_kvs_stats_print(struct redis_kvs *kvs, const char *msg)
+{
+	uint64_t requests, batches;
+
+	requests = __atomic_load_n(&kvs->rk_requests, __ATOMIC_RELAXED);
+	batches = __atomic_load_n(&kvs->rk_batches, __ATOMIC_RELAXED);
+	printf("%s: %llu requests in %llu round trips (%.1f per round trip),"
+	       " %llu reconnects\n", msg, (unsigned long long)requests,
+	       (unsigned long long)batches,
+	       batches != 0 ? (double)requests / batches : 0.0,
+	       (unsigned long long)__atomic_load_n(&kvs->rk_reconnects,
+						   __ATOMIC_RELAXED));
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
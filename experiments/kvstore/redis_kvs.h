@@ -0,0 +1,91 @@
+/*
+ * Filename:         redis_kvs.h
+ * Description:      Pipelined Redis backend of md_kvs
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* A Redis backend behind md_kvs.c, like mem_kvs.h, for local development
+ * and small deployments (build.sh -k redis). Selected with
+ * MD_KVS_BACKEND=redis, MD_KVS_REDIS=host:port (127.0.0.1:6379) and
+ * MD_KVS_REDIS_CONNS connections (REDIS_KVS_CONNS), in programs built with
+ * -DMD_KVS_REDIS redis_kvs.c -lhiredis.
+ *
+ * - redis_kvs_op() takes the same arguments as m0_idx_op() and follows
+ *   the conventions of mem_kvs_op(): per-record rcs, GET allocates the
+ *   values and NEXT copies into ov_buf[i], PUT fails with -EEXIST unless
+ *   M0_OIF_OVERWRITE, -ENOENT for missing records and past the last key.
+ * - GET is one MGET. PUT is one MSET, or a SET NX per record without
+ *   M0_OIF_OVERWRITE, and DEL an UNLINK per record, in a MULTI/EXEC.
+ * - Redis keys have no order, SCAN can neither return them sorted nor
+ *   resume from a key. Every key is therefore also a member of the sorted
+ *   set REDIS_KVS_INDEX (same score, so ordered by memcmp() like Motr
+ *   keys), updated in the same MULTI/EXEC as the records. NEXT is one
+ *   EVAL of a ZRANGEBYLEX from the start key, LIMIT the number of records
+ *   asked for, and an MGET of the keys found.
+ * - Callers are spread over the connections. A caller finding its
+ *   connection idle sends the commands of every caller queued on it in
+ *   one write and reads all the replies back, then wakes the others up:
+ *   concurrent requests share round trips instead of waiting in turn.
+ *
+ * Every program of this directory then runs against a local
+ * redis-server, e.g. dentry_shard_bench checks the order of NEXT.
+ */
+
+#ifndef _REDIS_KVS_H
+#define _REDIS_KVS_H
+
+#include <stdint.h>
+#include "motr/client.h"
+
+#define REDIS_KVS_CONNS 4
+#define REDIS_KVS_INDEX "md_kvs:index"
+
+struct redis_kvs_conn;
+
+struct redis_kvs {
+	struct redis_kvs_conn *rk_conns;
+	uint32_t rk_nr_conns;
+	/* Connection of the next request */
+	uint32_t rk_next;
+	char *rk_host;
+	int rk_port;
+	/* Counters, updated atomically */
+	uint64_t rk_requests;
+	/* Writes of pipelined requests */
+	uint64_t rk_batches;
+	uint64_t rk_reconnects;
+};
+
+/**
+ * Connect nr_conns connections to the server at host:port.
+ */
+int redis_kvs_init(struct redis_kvs *kvs, const char *host, int port,
+		   uint32_t nr_conns);
+
+void redis_kvs_fini(struct redis_kvs *kvs);
+
+/**
+ * Execute an index operation, see m0_idx_op().
+ * Return the status of the operation as a whole, the status of each record
+ * is in rcs.
+ */
+int redis_kvs_op(struct redis_kvs *kvs, enum m0_idx_opcode opcode,
+		 struct m0_bufvec *keys, struct m0_bufvec *vals, int *rcs,
+		 uint32_t flags);
+
+void redis_kvs_stats_print(struct redis_kvs *kvs, const char *msg);
+
+#endif /* _REDIS_KVS_H */
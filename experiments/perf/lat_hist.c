@@ -0,0 +1,124 @@
+/*
+ * Filename:         lat_hist.c
+ * Description:      Latency histograms
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <string.h>
+#include "lat_hist.h"
+
+static unsigned int bucket_of(uint64_t ns)
+{
+	unsigned int shift;
+
+	if (ns < LAT_HIST_SUB)
+		return ns;
+
+	/* Keep the LAT_HIST_SUB_BITS bits below the most significant one */
+	shift = 63 - __builtin_clzll(ns) - LAT_HIST_SUB_BITS;
+	return (shift + 1) * LAT_HIST_SUB +
+		((ns >> shift) & (LAT_HIST_SUB - 1));
+}
+
+/* Largest value falling into bucket b */
+static uint64_t bucket_max(unsigned int b)
+{
+	unsigned int shift;
+
+	if (b < LAT_HIST_SUB)
+		return b;
+
+	shift = b / LAT_HIST_SUB - 1;
+	return (((uint64_t)(LAT_HIST_SUB + b % LAT_HIST_SUB) + 1) << shift) - 1;
+}
+
+void lat_hist_reset(struct lat_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min_ns = UINT64_MAX;
+}
+
+void lat_hist_record(struct lat_hist *hist, uint64_t ns)
+{
+	hist->buckets[bucket_of(ns)]++;
+	hist->count++;
+	hist->sum_ns += ns;
+	if (ns < hist->min_ns)
+		hist->min_ns = ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	unsigned int b;
+
+	for (b = 0; b < LAT_HIST_BUCKETS; b++)
+		dst->buckets[b] += src->buckets[b];
+	dst->count += src->count;
+	dst->sum_ns += src->sum_ns;
+	if (src->min_ns < dst->min_ns)
+		dst->min_ns = src->min_ns;
+	if (src->max_ns > dst->max_ns)
+		dst->max_ns = src->max_ns;
+}
+
+uint64_t lat_hist_percentile(const struct lat_hist *hist, double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned int b;
+
+	if (hist->count == 0)
+		return 0;
+
+	/* Rank of the sample, 1 based, rounded up */
+	rank = (uint64_t)(pct / 100.0 * hist->count);
+	if (rank < pct / 100.0 * hist->count)
+		rank++;
+	if (rank == 0)
+		rank = 1;
+
+	for (b = 0; b < LAT_HIST_BUCKETS; b++) {
+		seen += hist->buckets[b];
+		if (seen >= rank)
+			break;
+	}
+
+	/* Never report more than what was recorded */
+	return bucket_max(b) < hist->max_ns ? bucket_max(b) : hist->max_ns;
+}
+
+void lat_hist_print(const struct lat_hist *hist, FILE *out, const char *msg)
+{
+	fprintf(out, "%s: %llu ops, mean %.1f, p50 %.1f, p99 %.1f,"
+		" p999 %.1f, max %.1f usecs\n", msg,
+		(unsigned long long)hist->count,
+		hist->count != 0 ? hist->sum_ns / 1000.0 / hist->count : 0.0,
+		lat_hist_percentile(hist, 50) / 1000.0,
+		lat_hist_percentile(hist, 99) / 1000.0,
+		lat_hist_percentile(hist, 99.9) / 1000.0,
+		hist->max_ns / 1000.0);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,78 @@
+/*
+ * Filename:         lat_hist.h
+ * Description:      Latency histograms
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Log-linear latency histogram in nanoseconds: every power of two is split
+ * into LAT_HIST_SUB buckets, so that percentiles are within ~6% of the
+ * recorded values from 1ns to hours, in a fixed 8KB.
+ *
+ * A histogram is not thread-safe: each thread records into its own and they
+ * are merged with lat_hist_merge() to report.
+ */
+
+#ifndef _LAT_HIST_H
+#define _LAT_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LAT_HIST_SUB_BITS 4
+#define LAT_HIST_SUB (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS ((64 - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB)
+
+struct lat_hist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t buckets[LAT_HIST_BUCKETS];
+};
+
+void lat_hist_reset(struct lat_hist *hist);
+
+void lat_hist_record(struct lat_hist *hist, uint64_t ns);
+
+/**
+ * Add the samples of src to dst.
+ */
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+
+/**
+ * Latency below which pct percent of the samples are, 0 < pct <= 100.
+ * The upper bound of the bucket holding that sample is returned.
+ */
+uint64_t lat_hist_percentile(const struct lat_hist *hist, double pct);
+
+/**
+ * Print count, mean, p50/p99/p999 and max in usecs on one line.
+ */
+void lat_hist_print(const struct lat_hist *hist, FILE *out, const char *msg);
+
+/**
+ * Nanoseconds from a monotonic clock, to time operations with.
+ */
+static inline uint64_t lat_hist_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* _LAT_HIST_H */
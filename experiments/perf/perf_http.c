@@ -0,0 +1,268 @@
+/*
+ * Filename:         perf_http.c
+ * Description:      HTTP endpoint serving the perf_stats histograms
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <evhtp.h>
+#include <event2/thread.h>
+#include <json-c/json.h>
+#include "perf_stats.h"
+#include "perf_http.h"
+
+#define PERF_HTTP_BACKLOG 128
+
+struct perf_http {
+	struct event_base *evbase;
+	evhtp_t *htp;
+	pthread_t thread;
+};
+
+static struct perf_http http;
+
+static double usecs(uint64_t ns)
+{
+	return ns / 1000.0;
+}
+
+static void reply(evhtp_request_t *req, const char *content_type)
+{
+	evhtp_headers_add_header(req->headers_out,
+				 evhtp_header_new("Content-Type",
+						  content_type, 0, 0));
+	evhtp_send_reply(req, EVHTP_RES_OK);
+}
+
+static struct perf_stats_snapshot *snapshot_get(evhtp_request_t *req)
+{
+	struct perf_stats_snapshot *snap;
+
+	if (evhtp_request_get_method(req) != htp_method_GET) {
+		evhtp_send_reply(req, EVHTP_RES_METHNALLOWED);
+		return NULL;
+	}
+
+	/* Too large for the stack of the event loop */
+	snap = malloc(sizeof(*snap));
+	if (snap == NULL) {
+		evhtp_send_reply(req, EVHTP_RES_SERVERR);
+		return NULL;
+	}
+
+	perf_stats_snapshot(snap);
+	return snap;
+}
+
+static void stats_cb(evhtp_request_t *req, void *arg)
+{
+	struct perf_stats_snapshot *snap;
+	struct json_object *root, *ops, *obj;
+	const struct lat_hist *hist;
+	const char *json_string;
+	int op;
+
+	snap = snapshot_get(req);
+	if (snap == NULL)
+		return;
+
+	root = json_object_new_object();
+	json_object_object_add(root, "threads",
+			       json_object_new_int64(snap->threads));
+	ops = json_object_new_array();
+	for (op = 0; op < PERF_OP_NR; op++) {
+		hist = &snap->ops[op].hist;
+		obj = json_object_new_object();
+		json_object_object_add(obj, "layer",
+				json_object_new_string(perf_stats_op_layer(op)));
+		json_object_object_add(obj, "op",
+				json_object_new_string(perf_stats_op_name(op)));
+		json_object_object_add(obj, "count",
+				       json_object_new_int64(hist->count));
+		json_object_object_add(obj, "errors",
+				json_object_new_int64(snap->ops[op].errors));
+		json_object_object_add(obj, "mean_usecs",
+				json_object_new_double(hist->count ?
+				usecs(hist->sum_ns / hist->count) : 0));
+		json_object_object_add(obj, "p50_usecs",
+				json_object_new_double(
+				usecs(lat_hist_percentile(hist, 50))));
+		json_object_object_add(obj, "p99_usecs",
+				json_object_new_double(
+				usecs(lat_hist_percentile(hist, 99))));
+		json_object_object_add(obj, "p999_usecs",
+				json_object_new_double(
+				usecs(lat_hist_percentile(hist, 99.9))));
+		json_object_object_add(obj, "max_usecs",
+				json_object_new_double(usecs(hist->max_ns)));
+		json_object_array_add(ops, obj);
+	}
+	json_object_object_add(root, "ops", ops);
+
+	json_string = json_object_to_json_string(root);
+	evbuffer_add(req->buffer_out, json_string, strlen(json_string));
+	reply(req, "application/json");
+
+	json_object_put(root);
+	free(snap);
+}
+
+static void metrics_cb(evhtp_request_t *req, void *arg)
+{
+	static const double quantiles[] = { 0.5, 0.99, 0.999 };
+	struct perf_stats_snapshot *snap;
+	const struct lat_hist *hist;
+	const char *layer, *name;
+	size_t q;
+	int op;
+
+	snap = snapshot_get(req);
+	if (snap == NULL)
+		return;
+
+	evbuffer_add_printf(req->buffer_out,
+		"# HELP cortxfs_op_latency_seconds Latency of cortxfs, DSAL "
+		"and KVS operations.\n"
+		"# TYPE cortxfs_op_latency_seconds summary\n");
+	for (op = 0; op < PERF_OP_NR; op++) {
+		hist = &snap->ops[op].hist;
+		layer = perf_stats_op_layer(op);
+		name = perf_stats_op_name(op);
+		for (q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+			evbuffer_add_printf(req->buffer_out,
+				"cortxfs_op_latency_seconds{layer=\"%s\","
+				"op=\"%s\",quantile=\"%g\"} %.9f\n",
+				layer, name, quantiles[q],
+				lat_hist_percentile(hist, quantiles[q] * 100) /
+				1e9);
+		evbuffer_add_printf(req->buffer_out,
+			"cortxfs_op_latency_seconds_sum{layer=\"%s\","
+			"op=\"%s\"} %.9f\n"
+			"cortxfs_op_latency_seconds_count{layer=\"%s\","
+			"op=\"%s\"} %llu\n",
+			layer, name, hist->sum_ns / 1e9, layer, name,
+			(unsigned long long)hist->count);
+	}
+
+	evbuffer_add_printf(req->buffer_out,
+		"# HELP cortxfs_op_errors_total Operations that failed.\n"
+		"# TYPE cortxfs_op_errors_total counter\n");
+	for (op = 0; op < PERF_OP_NR; op++)
+		evbuffer_add_printf(req->buffer_out,
+			"cortxfs_op_errors_total{layer=\"%s\",op=\"%s\"} "
+			"%llu\n", perf_stats_op_layer(op),
+			perf_stats_op_name(op),
+			(unsigned long long)snap->ops[op].errors);
+
+	reply(req, "text/plain; version=0.0.4");
+	free(snap);
+}
+
+static void reset_cb(evhtp_request_t *req, void *arg)
+{
+	/* Not on a GET: a browser prefetch must not clear the stats */
+	if (evhtp_request_get_method(req) != htp_method_POST) {
+		evhtp_send_reply(req, EVHTP_RES_METHNALLOWED);
+		return;
+	}
+
+	perf_stats_reset();
+	evbuffer_add_printf(req->buffer_out, "ok\n");
+	reply(req, "text/plain");
+}
+
+static void *perf_http_run(void *arg)
+{
+	event_base_loop(http.evbase, 0);
+	return NULL;
+}
+
+int perf_http_start(const char *addr, uint16_t port)
+{
+	int rc;
+
+	/* perf_http_stop() breaks the loop from another thread */
+	rc = evthread_use_pthreads();
+	if (rc != 0)
+		return -EINVAL;
+
+	http.evbase = event_base_new();
+	if (http.evbase == NULL)
+		return -ENOMEM;
+
+	http.htp = evhtp_new(http.evbase, NULL);
+	if (http.htp == NULL) {
+		rc = -ENOMEM;
+		goto free_base;
+	}
+
+	if (evhtp_set_cb(http.htp, "/stats", stats_cb, NULL) == NULL ||
+	    evhtp_set_cb(http.htp, "/metrics", metrics_cb, NULL) == NULL ||
+	    evhtp_set_cb(http.htp, "/reset", reset_cb, NULL) == NULL) {
+		rc = -ENOMEM;
+		goto free_htp;
+	}
+
+	rc = evhtp_bind_socket(http.htp, addr, port, PERF_HTTP_BACKLOG);
+	if (rc != 0) {
+		fprintf(stderr, "cannot bind %s:%u\n", addr, port);
+		rc = -EADDRINUSE;
+		goto free_htp;
+	}
+
+	rc = -pthread_create(&http.thread, NULL, perf_http_run, NULL);
+	if (rc != 0)
+		goto unbind;
+
+	return 0;
+
+unbind:
+	evhtp_unbind_socket(http.htp);
+free_htp:
+	evhtp_free(http.htp);
+free_base:
+	event_base_free(http.evbase);
+	http.evbase = NULL;
+	return rc;
+}
+
+void perf_http_stop(void)
+{
+	if (http.evbase == NULL)
+		return;
+
+	event_base_loopbreak(http.evbase);
+	pthread_join(http.thread, NULL);
+
+	evhtp_unbind_socket(http.htp);
+	evhtp_free(http.htp);
+	event_base_free(http.evbase);
+	http.evbase = NULL;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,42 @@
+/*
+ * Filename:         perf_http.h
+ * Description:      HTTP endpoint serving the perf_stats histograms
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Serves perf_stats_snapshot() over HTTP with libevhtp (see
+ * scripts/build-libevhtp.sh), from a thread of its own:
+ *   GET /stats    JSON, one object per operation with counts and
+ *                 mean/p50/p99/p999/max latencies in usecs
+ *   GET /metrics  Prometheus text format, one summary per operation
+ *   POST /reset   clear the histograms (perf_stats_reset())
+ *
+ * Link with -levhtp -levent -levent_pthreads -ljson-c.
+ */
+
+#ifndef _PERF_HTTP_H
+#define _PERF_HTTP_H
+
+#include <stdint.h>
+
+/**
+ * Start serving on addr:port, addr "127.0.0.1" keeps it local.
+ */
+int perf_http_start(const char *addr, uint16_t port);
+
+void perf_http_stop(void);
+
+#endif /* _PERF_HTTP_H */
@@ -0,0 +1,202 @@
+/*
+ * Filename:         perf_stats.c
+ * Description:      Per-thread latency histograms of metadata and data operations
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "perf_stats.h"
+
+struct perf_stats_slot {
+	struct perf_stats_op ops[PERF_OP_NR];
+	struct perf_stats_slot *next;
+} __attribute__((aligned(64)));
+
+static const struct {
+	const char *name;
+	const char *layer;
+} op_desc[PERF_OP_NR] = {
+	[PERF_OP_LOOKUP] = { "lookup", "cfs" },
+	[PERF_OP_GETATTR] = { "getattr", "cfs" },
+	[PERF_OP_SETATTR] = { "setattr", "cfs" },
+	[PERF_OP_READDIR] = { "readdir", "cfs" },
+	[PERF_OP_CREATE] = { "create", "cfs" },
+	[PERF_OP_MKDIR] = { "mkdir", "cfs" },
+	[PERF_OP_UNLINK] = { "unlink", "cfs" },
+	[PERF_OP_RMDIR] = { "rmdir", "cfs" },
+	[PERF_OP_GETXATTR] = { "getxattr", "cfs" },
+	[PERF_OP_SETXATTR] = { "setxattr", "cfs" },
+	[PERF_OP_LISTXATTR] = { "listxattr", "cfs" },
+	[PERF_OP_REMOVEXATTR] = { "removexattr", "cfs" },
+	[PERF_OP_READ] = { "read", "dsal" },
+	[PERF_OP_WRITE] = { "write", "dsal" },
+	[PERF_OP_KVS_GET] = { "get", "kvs" },
+	[PERF_OP_KVS_PUT] = { "put", "kvs" },
+	[PERF_OP_KVS_DEL] = { "del", "kvs" },
+	[PERF_OP_KVS_NEXT] = { "next", "kvs" },
+};
+
+/* All the slots ever allocated, protected by slots_lock */
+static struct perf_stats_slot *slots;
+static uint32_t slots_nr;
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Bumped by perf_stats_fini(): slots of older generations are gone */
+static unsigned int generation;
+
+static __thread struct perf_stats_slot *thread_slot;
+static __thread unsigned int thread_generation;
+
+static struct perf_stats_slot *slot_get(void)
+{
+	struct perf_stats_slot *slot;
+	int op;
+
+	if (thread_slot != NULL && thread_generation == generation)
+		return thread_slot;
+
+	slot = aligned_alloc(64, sizeof(*slot));
+	if (slot == NULL)
+		return NULL;
+
+	for (op = 0; op < PERF_OP_NR; op++) {
+		lat_hist_reset(&slot->ops[op].hist);
+		slot->ops[op].errors = 0;
+	}
+
+	pthread_mutex_lock(&slots_lock);
+	slot->next = slots;
+	slots = slot;
+	slots_nr++;
+	thread_generation = generation;
+	pthread_mutex_unlock(&slots_lock);
+
+	thread_slot = slot;
+	return slot;
+}
+
+void perf_stats_fini(void)
+{
+	struct perf_stats_slot *slot;
+
+	pthread_mutex_lock(&slots_lock);
+	while ((slot = slots) != NULL) {
+		slots = slot->next;
+		free(slot);
+	}
+	slots_nr = 0;
+	generation++;
+	pthread_mutex_unlock(&slots_lock);
+}
+
+const char *perf_stats_op_name(enum perf_op op)
+{
+	return op < PERF_OP_NR ? op_desc[op].name : "unknown";
+}
+
+const char *perf_stats_op_layer(enum perf_op op)
+{
+	return op < PERF_OP_NR ? op_desc[op].layer : "unknown";
+}
+
+void perf_stats_record(enum perf_op op, uint64_t start, int rc)
+{
+	uint64_t end = lat_hist_now_ns();
+	struct perf_stats_slot *slot;
+
+	if (op >= PERF_OP_NR)
+		return;
+
+	slot = slot_get();
+	if (slot == NULL)
+		return;
+
+	lat_hist_record(&slot->ops[op].hist, end - start);
+	if (rc < 0)
+		slot->ops[op].errors++;
+}
+
+void perf_stats_snapshot(struct perf_stats_snapshot *snap)
+{
+	struct perf_stats_slot *slot;
+	int op;
+
+	for (op = 0; op < PERF_OP_NR; op++) {
+		lat_hist_reset(&snap->ops[op].hist);
+		snap->ops[op].errors = 0;
+	}
+
+	pthread_mutex_lock(&slots_lock);
+	for (slot = slots; slot != NULL; slot = slot->next) {
+		for (op = 0; op < PERF_OP_NR; op++) {
+			lat_hist_merge(&snap->ops[op].hist,
+				       &slot->ops[op].hist);
+			snap->ops[op].errors += slot->ops[op].errors;
+		}
+	}
+	snap->threads = slots_nr;
+	pthread_mutex_unlock(&slots_lock);
+}
+
+void perf_stats_reset(void)
+{
+	struct perf_stats_slot *slot;
+	int op;
+
+	pthread_mutex_lock(&slots_lock);
+	for (slot = slots; slot != NULL; slot = slot->next) {
+		for (op = 0; op < PERF_OP_NR; op++) {
+			lat_hist_reset(&slot->ops[op].hist);
+			slot->ops[op].errors = 0;
+		}
+	}
+	pthread_mutex_unlock(&slots_lock);
+}
+
+void perf_stats_print(FILE *out)
+{
+	struct perf_stats_snapshot *snap;
+	char msg[64];
+	int op;
+
+	snap = malloc(sizeof(*snap));
+	if (snap == NULL)
+		return;
+
+	perf_stats_snapshot(snap);
+	for (op = 0; op < PERF_OP_NR; op++) {
+		if (snap->ops[op].hist.count == 0)
+			continue;
+		snprintf(msg, sizeof(msg), "%-4s %-12s %llu errors",
+			 perf_stats_op_layer(op), perf_stats_op_name(op),
+			 (unsigned long long)snap->ops[op].errors);
+		lat_hist_print(&snap->ops[op].hist, out, msg);
+	}
+
+	free(snap);
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,119 @@
+/*
+ * Filename:         perf_stats.h
+ * Description:      Per-thread latency histograms of metadata and data operations
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Latency and error counters of the cfs_*, DSAL and KVS entry points.
+ *
+ * Each thread records into a slot of its own (a struct lat_hist and an
+ * error counter per operation), allocated on its first record and kept
+ * until perf_stats_fini() so that the samples of finished threads are not
+ * lost. Recording takes no lock and shares no cache line with the other
+ * threads.
+ * perf_stats_snapshot() merges all the slots while they are being updated:
+ * a sample in progress may be counted but not yet be in its bucket, which
+ * is good enough for monitoring.
+ *
+ * Usage at an entry point:
+ *	uint64_t start = perf_stats_start();
+ *	rc = ...;
+ *	perf_stats_record(PERF_OP_GETATTR, start, rc);
+ *
+ * perf_http.h serves the snapshots over HTTP.
+ */
+
+#ifndef _PERF_STATS_H
+#define _PERF_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lat_hist.h"
+
+enum perf_op {
+	/* cortxfs */
+	PERF_OP_LOOKUP,
+	PERF_OP_GETATTR,
+	PERF_OP_SETATTR,
+	PERF_OP_READDIR,
+	PERF_OP_CREATE,
+	PERF_OP_MKDIR,
+	PERF_OP_UNLINK,
+	PERF_OP_RMDIR,
+	PERF_OP_GETXATTR,
+	PERF_OP_SETXATTR,
+	PERF_OP_LISTXATTR,
+	PERF_OP_REMOVEXATTR,
+	/* DSAL */
+	PERF_OP_READ,
+	PERF_OP_WRITE,
+	/* KVS */
+	PERF_OP_KVS_GET,
+	PERF_OP_KVS_PUT,
+	PERF_OP_KVS_DEL,
+	PERF_OP_KVS_NEXT,
+	PERF_OP_NR,
+};
+
+struct perf_stats_op {
+	struct lat_hist hist;
+	uint64_t errors;
+};
+
+struct perf_stats_snapshot {
+	struct perf_stats_op ops[PERF_OP_NR];
+	/* Threads that recorded something */
+	uint32_t threads;
+};
+
+/**
+ * Release the slots of all threads, no thread may record anymore.
+ */
+void perf_stats_fini(void);
+
+/**
+ * Operation name ("getattr") and layer ("cfs", "dsal" or "kvs").
+ */
+const char *perf_stats_op_name(enum perf_op op);
+const char *perf_stats_op_layer(enum perf_op op);
+
+static inline uint64_t perf_stats_start(void)
+{
+	return lat_hist_now_ns();
+}
+
+/**
+ * Record an operation started at start (perf_stats_start()) that returned
+ * rc, negative values are counted as errors.
+ */
+void perf_stats_record(enum perf_op op, uint64_t start, int rc);
+
+/**
+ * Merge the slots of all threads into snap.
+ */
+void perf_stats_snapshot(struct perf_stats_snapshot *snap);
+
+/**
+ * Clear the slots of all threads. Records made meanwhile may be lost.
+ */
+void perf_stats_reset(void);
+
+/**
+ * Print one lat_hist_print() line per operation that was recorded.
+ */
+void perf_stats_print(FILE *out);
+
+#endif /* _PERF_STATS_H */
@@ -0,0 +1,262 @@
+/*
+ * Filename:         trace.c
+ * Description:      Sampled request tracing to Chrome trace JSON
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+struct trace_event {
+	const char *name;
+	uint64_t trace_id;
+	uint64_t start_ns;
+	uint64_t dur_ns;
+};
+
+/* Written by its thread only. Entry i % entries holds the i-th span,
+ * head is the number of spans ever written.
+ */
+struct trace_ring {
+	uint64_t head;
+	uint32_t tid;
+	uint32_t index;
+	struct trace_ring *next;
+	struct trace_event events[];
+};
+
+__thread struct trace_ctx trace_thread_ctx;
+
+static __thread struct trace_ring *thread_ring;
+static __thread unsigned int thread_generation;
+static __thread uint32_t thread_depth;
+static __thread uint64_t thread_requests;
+static __thread uint64_t thread_traces;
+
+static uint32_t sample_rate;
+static uint32_t ring_entries = TRACE_RING_ENTRIES;
+static struct trace_ring *rings;
+static uint32_t rings_nr;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Bumped by trace_fini(): rings of older generations are gone */
+static unsigned int generation;
+
+static struct trace_ring *ring_get(void)
+{
+	struct trace_ring *ring;
+
+	if (thread_ring != NULL && thread_generation == generation)
+		return thread_ring;
+
+	ring = malloc(sizeof(*ring) + ring_entries * sizeof(ring->events[0]));
+	if (ring == NULL)
+		return NULL;
+
+	ring->head = 0;
+	ring->tid = syscall(SYS_gettid);
+
+	pthread_mutex_lock(&rings_lock);
+	ring->index = rings_nr++;
+	ring->next = rings;
+	rings = ring;
+	thread_generation = generation;
+	pthread_mutex_unlock(&rings_lock);
+
+	thread_ring = ring;
+	thread_traces = 0;
+	return ring;
+}
+
+int trace_init(uint32_t rate, uint32_t entries)
+{
+	sample_rate = rate;
+	ring_entries = entries != 0 ? entries : TRACE_RING_ENTRIES;
+	return 0;
+}
+
+void trace_fini(void)
+{
+	struct trace_ring *ring;
+
+	pthread_mutex_lock(&rings_lock);
+	while ((ring = rings) != NULL) {
+		rings = ring->next;
+		free(ring);
+	}
+	rings_nr = 0;
+	sample_rate = 0;
+	generation++;
+	pthread_mutex_unlock(&rings_lock);
+}
+
+uint64_t trace_request_begin(void)
+{
+	struct trace_ring *ring;
+
+	if (trace_thread_ctx.active) {
+		thread_depth++;
+		return trace_start();
+	}
+
+	trace_thread_ctx.active = true;
+	trace_thread_ctx.trace_id = 0;
+	thread_depth = 1;
+
+	if (sample_rate == 0 || ++thread_requests % sample_rate != 0)
+		return 0;
+
+	ring = ring_get();
+	if (ring == NULL)
+		return 0;
+
+	/* Unique in the process: ring index and traces of that thread */
+	trace_thread_ctx.trace_id = ((uint64_t)(ring->index + 1) << 40) |
+		++thread_traces;
+	return lat_hist_now_ns();
+}
+
+void trace_request_end(const char *name, uint64_t start)
+{
+	trace_end(name, start);
+
+	if (thread_depth > 0 && --thread_depth == 0) {
+		trace_thread_ctx.active = false;
+		trace_thread_ctx.trace_id = 0;
+	}
+}
+
+void trace_record(const char *name, uint64_t start)
+{
+	uint64_t end = lat_hist_now_ns();
+	struct trace_ring *ring;
+	struct trace_event *event;
+
+	ring = ring_get();
+	if (ring == NULL)
+		return;
+
+	/* Pairs with the fence of ring_copy(): a reader that sees any of
+	 * these stores sees the head of the previous event as well.
+	 */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	event = &ring->events[ring->head % ring_entries];
+	event->name = name;
+	event->trace_id = trace_thread_ctx.trace_id;
+	event->start_ns = start;
+	event->dur_ns = end - start;
+	/* Publish the event to trace_dump() */
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_ctx_set(struct trace_ctx ctx)
+{
+	trace_thread_ctx = ctx;
+	thread_depth = ctx.active ? 1 : 0;
+}
+
+/**
+ * Copy the events of ring that are not being overwritten into events,
+ * return their number.
+ */
+static uint64_t ring_copy(struct trace_ring *ring, struct trace_event *events)
+{
+	uint64_t head, first, valid, i, nr = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	first = head > ring_entries ? head - ring_entries : 0;
+	for (i = first; i < head; i++)
+		events[i - first] = ring->events[i % ring_entries];
+
+	/* The thread went on meanwhile: the events of the slots it wrote
+	 * again, and of the one it may be writing now, are discarded. The
+	 * fence keeps the copy above from being done after the load of the
+	 * head.
+	 */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	valid = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+	valid = valid > ring_entries ? valid - ring_entries : 0;
+	for (i = first; i < head; i++) {
+		if (i >= valid)
+			events[nr++] = events[i - first];
+	}
+
+	return nr;
+}
+
+int trace_dump(FILE *out)
+{
+	struct trace_ring *ring;
+	struct trace_event *events;
+	uint64_t nr, i;
+	bool first = true;
+	int pid = getpid();
+
+	events = malloc(ring_entries * sizeof(*events));
+	if (events == NULL)
+		return -ENOMEM;
+
+	fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+	pthread_mutex_lock(&rings_lock);
+	for (ring = rings; ring != NULL; ring = ring->next) {
+		nr = ring_copy(ring, events);
+		for (i = 0; i < nr; i++) {
+			fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"X\", "
+				"\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, "
+				"\"tid\": %u, \"args\": {\"trace_id\": "
+				"\"%llx\"}}", first ? "" : ",\n",
+				events[i].name, events[i].start_ns / 1000.0,
+				events[i].dur_ns / 1000.0, pid, ring->tid,
+				(unsigned long long)events[i].trace_id);
+			first = false;
+		}
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	fprintf(out, "\n]}\n");
+	free(events);
+	return ferror(out) ? -EIO : 0;
+}
+
+int trace_dump_file(const char *path)
+{
+	FILE *out;
+	int rc;
+
+	out = fopen(path, "w");
+	if (out == NULL)
+		return -errno;
+
+	rc = trace_dump(out);
+	if (fclose(out) != 0 && rc == 0)
+		rc = -errno;
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
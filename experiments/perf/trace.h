@@ -0,0 +1,119 @@
+/*
+ * Filename:         trace.h
+ * Description:      Sampled request tracing to Chrome trace JSON
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Request-scoped tracing: where did the time of one slow request go.
+ *
+ * A request (an NFS op entering the FSAL, a cfs_* call, a KVS operation
+ * called on its own) is sampled when it begins, once every sample_rate
+ * requests of a thread. The trace context of the thread then says whether
+ * the spans of the calls it makes are recorded:
+ *
+ *	uint64_t start = trace_request_begin();
+ *	...
+ *	trace_request_end("cfs.getattr", start);
+ *
+ * A request begun inside another one is only a span of it. Work done on
+ * behalf of a request by another thread carries its context there with
+ * trace_ctx_get()/trace_ctx_set() (see group_commit.c).
+ *
+ * Spans are stored in a ring of each thread, the oldest being overwritten,
+ * and dumped as Chrome trace / Perfetto JSON ("X" events, one track per
+ * thread). Span names must be string literals, they are not copied.
+ *
+ * With sampling off, or outside sampled requests, a span costs a thread
+ * local load and a branch.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "lat_hist.h"
+
+#define TRACE_RING_ENTRIES 4096
+
+struct trace_ctx {
+	/* 0 when the request is not sampled */
+	uint64_t trace_id;
+	/* Inside a request */
+	bool active;
+};
+
+extern __thread struct trace_ctx trace_thread_ctx;
+
+/**
+ * Sample one request out of sample_rate per thread, 0 disables tracing.
+ * Every thread keeps its last ring_entries spans (0: TRACE_RING_ENTRIES).
+ */
+int trace_init(uint32_t sample_rate, uint32_t ring_entries);
+
+/**
+ * Release the rings, no thread may trace anymore.
+ */
+void trace_fini(void);
+
+/**
+ * Begin a request, or a span of the current one.
+ * Return the start time to pass to trace_request_end(), 0 if not sampled.
+ */
+uint64_t trace_request_begin(void);
+
+/**
+ * End what trace_request_begin() began, even when it returned 0.
+ */
+void trace_request_end(const char *name, uint64_t start);
+
+/**
+ * Span of the current request that is not a request itself, such as an
+ * operation launched now and waited for later.
+ */
+static inline uint64_t trace_start(void)
+{
+	return trace_thread_ctx.trace_id != 0 ? lat_hist_now_ns() : 0;
+}
+
+void trace_record(const char *name, uint64_t start);
+
+static inline void trace_end(const char *name, uint64_t start)
+{
+	if (start != 0)
+		trace_record(name, start);
+}
+
+static inline struct trace_ctx trace_ctx_get(void)
+{
+	return trace_thread_ctx;
+}
+
+/**
+ * Act on behalf of the request of ctx until trace_ctx_set() is called with
+ * an inactive context.
+ */
+void trace_ctx_set(struct trace_ctx ctx);
+
+/**
+ * Write the spans of all threads as Chrome trace JSON.
+ */
+int trace_dump(FILE *out);
+
+int trace_dump_file(const char *path);
+
+#endif /* _TRACE_H */
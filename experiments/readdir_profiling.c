@@ -23,18 +23,35 @@
  * - Delete files
  * - Calculate time taken for above operation
  * - NUM_FILES defines number of files to run the experiment for
+ * - Walk a PATH_DEPTH deep path WALKS times, probing a missing name at every
+ *   level, with and without the dentry cache (cache/dentry_cache.c)
 */
 #include "ut_cortxfs_helper.h"
+#include <sys/time.h>
+#include "cache/dentry_cache.h"
 #define NUM_FILES 1000
 #define MAX_FILENAME_LENGTH 16
+#define PATH_DEPTH 16
+#define WALKS 100
+#define MISSING_NAME "missing.h"
+#define DENTRY_CACHE_SHARDS 16
+#define DENTRY_CACHE_SIZE 4096
+#define DENTRY_CACHE_TTL_US 30000000
+#define DENTRY_CACHE_NEGATIVE_TTL_US 5000000
 #define DIR_ENV_FROM_STATE(__state) (*((struct ut_dir_env **)__state))
 
 struct ut_dir_env {
 	struct ut_cfs_params ut_cfs_obj;
 	char **name_list;
 	int entry_cnt;
+	/* Directories of the path walk, path_inode[0] is the root */
+	char path_name[PATH_DEPTH][MAX_FILENAME_LENGTH];
+	cfs_ino_t path_inode[PATH_DEPTH + 1];
 };
 
+/* NULL for lookups straight from the KV store */
+static struct dentry_cache *dentry_cache;
+
 struct readdir_ctx {
 	int index;
 	char *readdir_array[NUM_FILES+1];
@@ -78,6 +95,34 @@ static void verify_dentries(struct readdir_ctx *ctx, struct ut_dir_env *env,
 	}
 }
 
+/**
+ * cfs_lookup(), served by the dentry cache when possible.
+ */
+static int dentry_lookup(struct ut_cfs_params *ut_cfs_obj, cfs_ino_t *parent,
+			 const char *name, cfs_ino_t *ino)
+{
+	uint64_t cached;
+	uint64_t gen = 0;
+	int rc;
+
+	if (dentry_cache != NULL) {
+		rc = dentry_cache_lookup(dentry_cache, *parent, name, &cached);
+		if (rc == 0)
+			*ino = cached;
+		if (rc != -ENODATA)
+			return rc;
+		/* Before the lookup, a change made meanwhile bumps it */
+		gen = dentry_cache_gen(dentry_cache, *parent, name);
+	}
+
+	rc = cfs_lookup(ut_cfs_obj->cfs_fs, &ut_cfs_obj->cred, parent, name,
+			ino);
+	if (dentry_cache != NULL && (rc == 0 || rc == -ENOENT))
+		dentry_cache_add(dentry_cache, *parent, name,
+				 rc == 0 ? *ino : 0, gen);
+	return rc;
+}
+
 /**
  * Setup for dir_ops test group
  */
@@ -233,6 +278,136 @@ static void read_files(void **state)
 
 	readdir_ctx_fini(readdir_ctx);
 }
+/**
+ * Create PATH_DEPTH nested directories under root.
+ */
+static int path_walk_setup(void **state)
+{
+	int rc = 0, i;
+	struct ut_dir_env *ut_dir_obj = DIR_ENV_FROM_STATE(state);
+	struct ut_cfs_params *ut_cfs_obj = &ut_dir_obj->ut_cfs_obj;
+
+	ut_dir_obj->path_inode[0] = CFS_ROOT_INODE;
+	for (i = 0; i < PATH_DEPTH; i++) {
+		snprintf(ut_dir_obj->path_name[i], MAX_FILENAME_LENGTH,
+			 "Walk_Dir%d", i);
+		ut_cfs_obj->parent_inode = ut_dir_obj->path_inode[i];
+		ut_cfs_obj->file_name = ut_dir_obj->path_name[i];
+		rc = ut_dir_create(state);
+		ut_assert_int_equal(rc, 0);
+		ut_dir_obj->path_inode[i + 1] = ut_cfs_obj->file_inode;
+	}
+
+	return rc;
+}
+
+static int path_walk_teardown(void **state)
+{
+	int rc = 0, i;
+	struct ut_dir_env *ut_dir_obj = DIR_ENV_FROM_STATE(state);
+	struct ut_cfs_params *ut_cfs_obj = &ut_dir_obj->ut_cfs_obj;
+
+	for (i = PATH_DEPTH - 1; i >= 0; i--) {
+		ut_cfs_obj->parent_inode = ut_dir_obj->path_inode[i];
+		ut_cfs_obj->file_name = ut_dir_obj->path_name[i];
+		rc = ut_dir_delete(state);
+		ut_assert_int_equal(rc, 0);
+	}
+
+	return rc;
+}
+
+/**
+ * Walk the path WALKS times, looking a missing name up at every level.
+ * Return the time taken in usecs.
+ */
+static long path_walk(struct ut_dir_env *ut_dir_obj)
+{
+	struct ut_cfs_params *ut_cfs_obj = &ut_dir_obj->ut_cfs_obj;
+	struct timeval st, et;
+	cfs_ino_t dir, ino;
+	int rc, i, walk;
+
+	gettimeofday(&st, NULL);
+	for (walk = 0; walk < WALKS; walk++) {
+		dir = CFS_ROOT_INODE;
+		for (i = 0; i < PATH_DEPTH; i++) {
+			rc = dentry_lookup(ut_cfs_obj, &dir, MISSING_NAME,
+					   &ino);
+			ut_assert_int_equal(rc, -ENOENT);
+
+			rc = dentry_lookup(ut_cfs_obj, &dir,
+					   ut_dir_obj->path_name[i], &ino);
+			ut_assert_int_equal(rc, 0);
+			ut_assert_true(ino == ut_dir_obj->path_inode[i + 1]);
+			dir = ino;
+		}
+	}
+	gettimeofday(&et, NULL);
+
+	return ((et.tv_sec - st.tv_sec) * 1000000) + (et.tv_usec - st.tv_usec);
+}
+
+/**
+ * Create and remove the missing name at the bottom of the path, the cache
+ * must follow.
+ */
+static void path_walk_invalidate(void **state)
+{
+	struct ut_dir_env *ut_dir_obj = DIR_ENV_FROM_STATE(state);
+	struct ut_cfs_params *ut_cfs_obj = &ut_dir_obj->ut_cfs_obj;
+	cfs_ino_t dir = ut_dir_obj->path_inode[PATH_DEPTH];
+	cfs_ino_t ino;
+	int rc;
+
+	ut_cfs_obj->parent_inode = dir;
+	ut_cfs_obj->file_name = MISSING_NAME;
+	rc = ut_file_create(state);
+	ut_assert_int_equal(rc, 0);
+	dentry_cache_on_create(dentry_cache, dir, MISSING_NAME,
+			       ut_cfs_obj->file_inode);
+
+	rc = dentry_lookup(ut_cfs_obj, &dir, MISSING_NAME, &ino);
+	ut_assert_int_equal(rc, 0);
+	ut_assert_true(ino == ut_cfs_obj->file_inode);
+
+	rc = ut_file_delete(state);
+	ut_assert_int_equal(rc, 0);
+	dentry_cache_on_unlink(dentry_cache, dir, MISSING_NAME);
+
+	rc = dentry_lookup(ut_cfs_obj, &dir, MISSING_NAME, &ino);
+	ut_assert_int_equal(rc, -ENOENT);
+}
+
+static void walk_paths(void **state)
+{
+	struct ut_dir_env *ut_dir_obj = DIR_ENV_FROM_STATE(state);
+	struct dentry_cache cache;
+	long uncached, cached;
+	int rc;
+
+	dentry_cache = NULL;
+	uncached = path_walk(ut_dir_obj);
+
+	rc = dentry_cache_init(&cache, DENTRY_CACHE_SHARDS, DENTRY_CACHE_SIZE,
+			       DENTRY_CACHE_TTL_US,
+			       DENTRY_CACHE_NEGATIVE_TTL_US);
+	ut_assert_int_equal(rc, 0);
+	dentry_cache = &cache;
+
+	cached = path_walk(ut_dir_obj);
+
+	printf("Path walk: %d walks of depth %d (%d lookups) took %ld usecs"
+	       " uncached, %ld usecs cached\n", WALKS, PATH_DEPTH,
+	       2 * WALKS * PATH_DEPTH, uncached, cached);
+	dentry_cache_stats_print(dentry_cache, "dentry cache");
+
+	path_walk_invalidate(state);
+
+	dentry_cache = NULL;
+	dentry_cache_fini(&cache);
+}
+
 int main(void)
 {
 	int rc = 0;
@@ -256,6 +431,7 @@ int main(void)
 
 	struct test_case test_list[] = {
 		ut_test_case(read_files, create_files_setup, create_files_teardown),
+		ut_test_case(walk_paths, path_walk_setup, path_walk_teardown),
 	};
 
 	int test_count = sizeof(test_list)/sizeof(test_list[0]);
@@ -24,7 +24,7 @@
 #include "helpers/helpers.h"
 #include "motr/client.h"
 #include "motr/client_internal.h"
-#include "motr/idx.h
+#include "motr/idx.h"
 #include "lib/thread.h"
 #include <json-c/json.h>
 #include <sys/time.h>	
@@ -36,31 +36,26 @@
 #define MAXVAL 70000 
 #define CNT 100 
 
-struct cortxfs_xattr{
-	unsigned long long int ino;
-	char type;
-	char name[256];
-}__attribute((packed));
-
-
-#define XATTR_KEY_INIT(key, ino2, xname)	\
-{						\
-        key->ino = ino2;			\
-	key->type = '7';			\
-	memset(key->name, 0, 256);		\
-        memcpy(key->name, xname, strlen(xname));\
-}
+#include "xattr_key.h"
+/* Build with -I../kvstore and ../kvstore/kvs_pool.c */
+#include "kvs_vec.h"
+#include "kvs_pool.h"
 
 static struct m0_fid ifid;
 static struct m0_ufid_generator cortxfs_ufid_generator;
 static struct m0_idx idx;
+/* Operation of the previous m0_op_kvs()/NEXT, finalised and reused */
+static struct m0_op *op_cache;
 
+/* Released with kvs_pool_free() */
 static int *rcs_alloc(int count)
 {
         int  i;
         int *rcs;
 
-        M0_ALLOC_ARR(rcs, count);
+        rcs = kvs_pool_alloc(count * sizeof(int));
+        if (rcs == NULL)
+                return NULL;
         for (i = 0; i < count; i++)
                 rcs[i] = 0xdb;
         return rcs;
@@ -76,22 +71,42 @@ void timer(struct timeval start1, struct timeval end1, char *msg)
 
 }
 
-static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0_bufvec *val)
+static void op_cache_free(void)
 {
-	struct m0_op	 *op = NULL;
+	if (op_cache != NULL)
+		m0_op_free(op_cache);
+	op_cache = NULL;
+}
+
+/**
+ * Run an operation. When rcs_out is not NULL the rcs of the records are
+ * copied there and left to the caller, otherwise the first failed record
+ * fails the call.
+ */
+static int m0_op_kvs_rcs(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+			 struct m0_bufvec *val, int *rcs_out)
+{
+	struct m0_op	 *op = op_cache;
 	int *rcs;
 	int rc;
 
 	struct m0_idx     *index = NULL;
 
 	index = &idx;
-	rcs = rcs_alloc(CNT);
+	rcs = rcs_alloc(key->ov_vec.v_nr);
+	if (rcs == NULL)
+		return -ENOMEM;
 
+	op_cache = NULL;
 	rc = m0_idx_op(index, opcode, key, val, rcs, M0_OIF_OVERWRITE, &op);
 
 	if (rc)
 	{
                printf("\nerror(%d): m0_idx_op", rc); 
+	       /* The reused op is in an unknown state, do not cache it */
+	       if (op != NULL)
+		       m0_op_free(op);
+	       kvs_pool_free(rcs);
 	       return rc;
 	}
 	m0_op_launch(&op, 1);
@@ -104,10 +119,16 @@ static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0
 		printf("\nerror(%d): m0_op_wait", rc);
 		goto out;
 	}
+	if (rcs_out != NULL)
+	{
+		memcpy(rcs_out, rcs, key->ov_vec.v_nr * sizeof(int));
+		goto out;
+	}
+
 	/* Check rcs array even if op is succesful */
 //	rc = rcs[0];
 	int j;
-	for (j = 0; rc == 0 && j < CNT; j++)
+	for (j = 0; rc == 0 && j < key->ov_vec.v_nr; j++)
 		rc = rcs[j];
 
 	if (rc)
@@ -118,14 +139,29 @@ static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0
 
 out:
 	m0_op_fini(op);
-	/* it seems like 0_free(&op) is not needed */
+	op_cache = op;
+	kvs_pool_free(rcs);
 	return rc;
 }
 
+static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0_bufvec *val)
+{
+	return m0_op_kvs_rcs(opcode, key, val, NULL);
+}
+
 int delete_batch(char *k1, char *ino)
 {
-	struct cortxfs_xattr *xkey[CNT];
-	size_t klen;
+	/*
+	 * Keys built in place and wrapped, nothing allocated or copied.
+	 * Both formats are removed: an xattr not migrated yet only has its
+	 * version 1 key, see xattr_key_migrate.c.
+	 */
+	struct cortxfs_xattr_v2 xkey[CNT];
+	struct cortxfs_xattr okey[CNT];
+	struct cortxfs_xattr *ok;
+	void *kbufs[2 * CNT];
+	m0_bcount_t klen[2 * CNT];
+	int rcs[2 * CNT];
 	int rc, i;
 	struct m0_bufvec key;
 
@@ -133,90 +169,101 @@ int delete_batch(char *k1, char *ino)
 	ino2 = atoll(ino);
 
 	char tmpkey[256];
-        struct timeval start1, end1;
-
-        klen = sizeof(struct cortxfs_xattr);
+	struct timeval start1, end1;
 
-        for (i = 0; i < CNT; i++)
-        {
-                xkey[i] = calloc(1, sizeof( struct cortxfs_xattr));
-                snprintf(tmpkey, 256, "%s_%d", k1, i);
-                XATTR_KEY_INIT(xkey[i], ino2, tmpkey);
-	}
-	
-        gettimeofday(&start1, NULL);
-	
-	rc = m0_bufvec_alloc(&key, CNT, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
 	for (i = 0; i < CNT; i++)
-        	memcpy(key.ov_buf[i], xkey[i], klen);
+	{
+		snprintf(tmpkey, 256, "%s_%d", k1, i);
+		klen[i] = xattr_key_v2_init(&xkey[i], ino2, tmpkey,
+					    strlen(tmpkey));
+		kbufs[i] = &xkey[i];
+		ok = &okey[i];
+		XATTR_KEY_INIT(ok, ino2, tmpkey);
+		klen[CNT + i] = sizeof(okey[i]);
+		kbufs[CNT + i] = ok;
+	}
 
-	rc = m0_op_kvs(M0_IC_DEL, &key, NULL);
+	gettimeofday(&start1, NULL);
+
+	kvs_vec_wrap(&key, kbufs, klen, 2 * CNT);
+
+	rc = m0_op_kvs_rcs(M0_IC_DEL, &key, NULL, rcs);
+	/* The xattr existed if either of its keys did */
+	for (i = 0; rc == 0 && i < CNT; i++)
+	{
+		if (rcs[i] == -ENOENT && rcs[CNT + i] == -ENOENT)
+			rc = -ENOENT;
+		else if (rcs[i] != 0 && rcs[i] != -ENOENT)
+			rc = rcs[i];
+		else if (rcs[CNT + i] != 0 && rcs[CNT + i] != -ENOENT)
+			rc = rcs[CNT + i];
+	}
 	if (rc)
-        {
 		printf("\nerror(%d): m0_op_kvs", rc);
-		goto out;
-	}
 
-  out:
-       	for (i = 0; i < CNT; i ++)        	
-		free(xkey[i]);
-	
-	m0_bufvec_free(&key);
-        gettimeofday(&end1, NULL);
+	gettimeofday(&end1, NULL);
 	timer(start1, end1, "del 100 batch  keys  (nfs)");
-	
+
 	return rc;
 }
 
 int get_keyval(char *name, char *v, unsigned long long int ino2)
 {
-	struct cortxfs_xattr *xkey = NULL;
-
-	size_t klen;
-	size_t vlen = 256;
-
+	struct cortxfs_xattr_v2 xkey;
+	struct cortxfs_xattr old_key;
+	struct cortxfs_xattr *okey = &old_key;
+	void *kbuf = &xkey, *vbuf;
+	m0_bcount_t klen, vlen;
 	struct m0_bufvec key;
 	struct m0_bufvec val;
 	int rc;
 
-	xkey = calloc(1, sizeof(*xkey));
-
-	XATTR_KEY_INIT(xkey, ino2, name);
-
-	klen = sizeof(*xkey);
-	rc = m0_bufvec_alloc(&key, 1, klen);
-	rc = m0_bufvec_empty_alloc(&val, 1);
-
-	memcpy(key.ov_buf[0], xkey, klen);
+	klen = xattr_key_v2_init(&xkey, ino2, name, strlen(name));
+	kvs_vec_wrap(&key, &kbuf, &klen, 1);
+	/* The value is allocated by the store and read in place */
+	kvs_vec_borrow(&val, &vbuf, &vlen, 1);
 
 	rc = m0_op_kvs(M0_IC_GET, &key, &val);
+	if (rc == -ENOENT)
+	{
+		/* Not migrated yet, see xattr_key_migrate.c */
+		XATTR_KEY_INIT(okey, ino2, name);
+		kbuf = okey;
+		klen = sizeof(old_key);
+		kvs_vec_release(&val);
+		rc = m0_op_kvs(M0_IC_GET, &key, &val);
+	}
 	if (rc)
 	{
 		printf("\nerror(%d): m0_op_kvs", rc);
 		goto out;
 	}
 
-	rc = memcmp(key.ov_buf[0], xkey, key.ov_vec.v_count[0]);
-
-	vlen = (size_t)val.ov_vec.v_count[0];
-	memcpy(v, (char *)val.ov_buf[0], vlen);
+	memcpy(v, (char *)val.ov_buf[0], val.ov_vec.v_count[0]);
 
 out:
-	free(xkey);
-	m0_bufvec_free(&key);
-	m0_bufvec_free(&val);
+	kvs_vec_release(&val);
 	return rc;
 }
 
+/*
+ * While xattr_key_migrate may run, the version 1 key of an xattr is written
+ * along with its version 2 key, see there.
+ */
+#ifdef XATTR_KEY_MIGRATION
+#define KEY_FORMATS 2
+#else
+#define KEY_FORMATS 1
+#endif
+
 int set_batch(char *k1, char *v1, char *ino)
 {
-	struct cortxfs_xattr *xkey[CNT];
-	size_t klen, vlen;
+	/* Keys built in place, every value points to v1 */
+	struct cortxfs_xattr_v2 xkey[CNT];
+	struct cortxfs_xattr okey[CNT];
+	struct cortxfs_xattr *ok;
+	void *kbufs[KEY_FORMATS * CNT], *vbufs[KEY_FORMATS * CNT];
+	m0_bcount_t klen[KEY_FORMATS * CNT], vlen[KEY_FORMATS * CNT];
 	int rc, i;
 	struct m0_bufvec key;
 	struct m0_bufvec val;
@@ -225,62 +272,48 @@ int set_batch(char *k1, char *v1, char *ino)
 	ino2 = atoll(ino);
 
 	char tmpkey[256];
-        struct timeval start1, end1;
+	struct timeval start1, end1;
 
-        for (i = 0; i < CNT; i++)
-        {
-                xkey[i] = calloc(1, sizeof( struct cortxfs_xattr));
-                snprintf(tmpkey, 256, "%s_%d", k1, i);
-                XATTR_KEY_INIT(xkey[i], ino2, tmpkey);
+	for (i = 0; i < CNT; i++)
+	{
+		snprintf(tmpkey, 256, "%s_%d", k1, i);
+		klen[i] = xattr_key_v2_init(&xkey[i], ino2, tmpkey,
+					    strlen(tmpkey));
+		kbufs[i] = &xkey[i];
+		vbufs[i] = v1;
+		vlen[i] = strlen(v1) + 1;
+		if (KEY_FORMATS == 1)
+			continue;
+		ok = &okey[i];
+		XATTR_KEY_INIT(ok, ino2, tmpkey);
+		kbufs[CNT + i] = ok;
+		klen[CNT + i] = sizeof(*ok);
+		vbufs[CNT + i] = v1;
+		vlen[CNT + i] = vlen[i];
 	}
-	klen = sizeof( struct cortxfs_xattr);
-        vlen = strlen(v1) + 1;
 	gettimeofday(&start1, NULL);
 
-	rc = m0_bufvec_alloc(&key, CNT, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	rc = m0_bufvec_alloc(&val, CNT, vlen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	for (i = 0; i< CNT; i++)
-	{
-        	memcpy(key.ov_buf[i], xkey[i], klen);
-		memcpy(val.ov_buf[i], v1, vlen);
-	}
+	kvs_vec_wrap(&key, kbufs, klen, KEY_FORMATS * CNT);
+	kvs_vec_wrap(&val, vbufs, vlen, KEY_FORMATS * CNT);
 
 	rc = m0_op_kvs(M0_IC_PUT, &key, &val);
 	if (rc)
-        {
 		printf("\nerror(%d): m0_op_kvs", rc);
-		goto out;
-	}
 
-  out:
-       	for (i = 0; i < CNT; i ++)        	
-		free(xkey[i]);
-	
-	m0_bufvec_free(&key);
-        m0_bufvec_free(&val);
-        gettimeofday(&end1, NULL);
+	gettimeofday(&end1, NULL);
 	timer(start1, end1, "set 100 batch  keys  (nfs)");
-	
+
 	return rc;
 }
 
 
 int store_keyval(char *name, char *v, char *ino)
 {
-	struct cortxfs_xattr *xkey = NULL;
-	size_t klen, vlen;
+	struct cortxfs_xattr_v2 xkey;
+	struct cortxfs_xattr old_key;
+	struct cortxfs_xattr *okey = &old_key;
+	void *kbuf[KEY_FORMATS] = { &xkey }, *vbuf[KEY_FORMATS] = { v };
+	m0_bcount_t klen[KEY_FORMATS], vlen[KEY_FORMATS];
 	int rc;
 	struct m0_bufvec key;
 	struct m0_bufvec val;
@@ -288,40 +321,24 @@ int store_keyval(char *name, char *v, char *ino)
 	unsigned long long int ino2;
 	ino2 = atoll(ino);
 
-        xkey = calloc(1, sizeof(*xkey));
-	XATTR_KEY_INIT(xkey, ino2, name);
-	klen = sizeof(struct cortxfs_xattr);
-	vlen = strlen(v) + 1;
-
-	rc = m0_bufvec_alloc(&key, 1, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	rc = m0_bufvec_alloc(&val, 1, vlen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
+	klen[0] = xattr_key_v2_init(&xkey, ino2, name, strlen(name));
+	vlen[0] = strlen(v) + 1;
+	if (KEY_FORMATS == 2) {
+		XATTR_KEY_INIT(okey, ino2, name);
+		kbuf[KEY_FORMATS - 1] = okey;
+		klen[KEY_FORMATS - 1] = sizeof(old_key);
+		vbuf[KEY_FORMATS - 1] = v;
+		vlen[KEY_FORMATS - 1] = vlen[0];
 	}
 
-        memcpy(key.ov_buf[0], xkey, klen);
-	memcpy(val.ov_buf[0], v, vlen);
+	kvs_vec_wrap(&key, kbuf, klen, KEY_FORMATS);
+	kvs_vec_wrap(&val, vbuf, vlen, KEY_FORMATS);
 
 	rc = m0_op_kvs(M0_IC_PUT, &key, &val);
 	if (rc)
-        {
 		printf("\nerror(%d): m0_op_kvs", rc);
-		goto out;
-	}
 
-  out:
-         free(xkey);
-	 m0_bufvec_free(&key);
-         m0_bufvec_free(&val);
-         return rc;
+	return rc;
 }
 
 int set_fid()
@@ -358,84 +375,208 @@ int set_fid()
          return rc;
 }
 
-int m0_search_pattern(struct cortxfs_xattr *xkey)
+/* NEXT starts with NEXT_BATCH_MIN records and doubles the batch on every
+ * round trip up to CNT, reusing the same buffers.
+ */
+#define NEXT_BATCH_MIN 4
+
+/* Counters over all m0_search_pattern() calls */
+static int next_scans;
+static int next_round_trips;
+
+/* Version 2 keys listed by a scan, in key order */
+struct listed_keys {
+	struct cortxfs_xattr_v2 *keys;
+	uint32_t nr;
+	uint32_t max;
+};
+
+/* Key order of the version 2 keys of an inode */
+static int listed_cmp(const void *a, const void *b)
+{
+	const struct cortxfs_xattr_v2 *ka = a;
+	const struct cortxfs_xattr_v2 *kb = b;
+
+	if (ka->nlen != kb->nlen)
+		return ka->nlen - kb->nlen;
+	return memcmp(ka->name, kb->name, ka->nlen);
+}
+
+/**
+ * Whether the record of key is an xattr not listed yet by the scan. The
+ * version 2 keys of an inode come before its version 1 keys, a version 1
+ * key whose xattr also has a version 2 key is a copy not removed yet.
+ * Return 1, 0 or -ENOMEM.
+ */
+static int key_listed(struct listed_keys *listed, const void *key, size_t len)
+{
+	struct cortxfs_xattr_v2 v2;
+	void *keys;
+
+	if (xattr_key_is_v2(key, len)) {
+		if (listed->nr == listed->max) {
+			listed->max = listed->max != 0 ? 2 * listed->max : CNT;
+			keys = realloc(listed->keys,
+				       listed->max * sizeof(v2));
+			if (keys == NULL)
+				return -ENOMEM;
+			listed->keys = keys;
+		}
+		memcpy(&listed->keys[listed->nr++], key, len);
+		return 1;
+	}
+
+	if (!xattr_key_is_v1(key, len) || xattr_key_v1_to_v2(key, &v2) < 0)
+		return 0;
+	return bsearch(&v2, listed->keys, listed->nr, sizeof(v2),
+		       listed_cmp) == NULL;
+}
+
+/**
+ * Free the start key NEXT put in keys in place of key0, if any.
+ */
+static void key0_restore(struct m0_bufvec *keys, void *key0)
+{
+	if (keys->ov_buf[0] != key0) {
+		m0_free(keys->ov_buf[0]);
+		keys->ov_buf[0] = key0;
+	}
+}
+
+int m0_search_pattern(struct cortxfs_xattr_v2 *xkey)
 {
 
 	int rc;
 	int *rcs;
 	struct m0_bufvec keys;
 	struct m0_bufvec vals;
-	struct m0_op *op = NULL;
-
+	struct m0_op *op = op_cache;
+	struct listed_keys listed = { NULL, 0, 0 };
+	void *key0;
+	/* Keys of both versions, see xattr_key_migrate.c */
+	size_t plen = XATTR_KEY_PREFIX_LEN;
+	uint32_t batch = NEXT_BATCH_MIN;
+	uint32_t nr, j;
 	int flags = 0;
+	int counter = 0, records = 0;
 
 	rcs = rcs_alloc(CNT);
-	rc = m0_bufvec_alloc(&keys, CNT, KLEN);
+	if (rcs == NULL)
+		return -ENOMEM;
+
+	/* Recycled from one scan to the next, no allocation per scan */
+	rc = kvs_pool_bufvec_alloc(&keys, CNT,
+				   sizeof(struct cortxfs_xattr_v2));
 	if (rc != 0)
 	{
-		printf("\n line 386");
-		goto out;
+		printf("\nerror(%d): kvs_pool_bufvec_alloc", rc);
+		goto free_rcs;
 	}
 
-	rc = m0_bufvec_alloc(&vals, CNT, VALINPUT);
+	rc = kvs_pool_bufvec_alloc(&vals, CNT, VALINPUT);
 	if (rc != 0)
 	{
-		printf("\n line 386");
-		goto out;
+		printf("\nerror(%d): kvs_pool_bufvec_alloc", rc);
+		goto free_keys;
 	}
 
-	keys.ov_vec.v_count[0] = sizeof(*xkey) - sizeof(xkey->name);
-
-	memcpy(keys.ov_buf[0], xkey, sizeof(*xkey) - sizeof(xkey->name));
+	op_cache = NULL;
 
-	int counter = 0;
+	/*
+	 * NEXT replaces a start key too short for the first record with a
+	 * buffer of its own (kvs_vec.h): the pool block must be put back
+	 * before kvs_pool_bufvec_free().
+	 */
+	key0 = keys.ov_buf[0];
+	memcpy(key0, xkey, plen);
+	keys.ov_vec.v_count[0] = plen;
 
 	do{
 		counter ++;
 
+		/* NEXT overwrites the counts with the record sizes */
+		keys.ov_vec.v_nr = batch;
+		vals.ov_vec.v_nr = batch;
+		for (j = 0; j < batch; j++) {
+			if (j > 0)
+				keys.ov_vec.v_count[j] =
+					sizeof(struct cortxfs_xattr_v2);
+			vals.ov_vec.v_count[j] = VALINPUT;
+			rcs[j] = 0;
+		}
+
 		rc = m0_idx_op(&idx, M0_IC_NEXT, &keys, &vals,
 			       rcs, flags,  &op);
 		if (rc != 0) {
-			printf("\n line 375");
+			printf("\nerror(%d): m0_idx_op", rc);
+			if (op != NULL)
+				m0_op_free(op);
+			op = NULL;
 			goto out;
 		}
 
 		m0_op_launch(&op, 1);
 		rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE),
 				M0_TIME_NEVER);
+		m0_op_fini(op);
 		if (rc != 0) {
-			printf("\n line 428");
-			goto out;
-		}
-		rc = memcmp(keys.ov_buf[0], xkey, sizeof(*xkey) - sizeof(xkey->name));
-		if (rc != 0) {
-			printf("\n line 386");
+			printf("\nerror(%d): m0_op_wait", rc);
 			goto out;
 		}
-		//for (i = 0; i < keys.ov_vec.v_nr; i++)
+
+		/* Records of this inode, the rest belong to the next one */
+		for (nr = 0; nr < batch; nr++)
+			if (rcs[nr] != 0 ||
+			    memcmp(keys.ov_buf[nr], xkey, plen) != 0)
+				break;
+
+		//for (i = 0; i < nr; i++)
 		//	printf("\nvalue %s",(char *)vals.ov_buf[i]);
 
+		for (j = 0; j < nr; j++) {
+			rc = key_listed(&listed, keys.ov_buf[j],
+					keys.ov_vec.v_count[j]);
+			if (rc < 0)
+				goto out;
+			records += rc;
+		}
+		rc = 0;
+		if (nr < batch) {
+			rc = -ENOENT;
+			break;
+		}
 
 		flags = M0_OIF_EXCLUDE_START_KEY;
 
-		int j;
-
-		for (j = 0; rc == 0 && j < CNT; j++)
-			rc = rcs[j];
+		/* Record nr - 1 may be the buffer of the store itself */
+		memmove(key0, keys.ov_buf[nr - 1],
+			keys.ov_vec.v_count[nr - 1]);
+		keys.ov_vec.v_count[0] = keys.ov_vec.v_count[nr - 1];
+		key0_restore(&keys, key0);
 
-		m0_op_fini(op);
-		memcpy(keys.ov_buf[0], keys.ov_buf[CNT-1], keys.ov_vec.v_count[CNT-1]);
+		batch = batch * 2 < CNT ? batch * 2 : CNT;
 	} while (rc == 0);
 out:
-	printf("\n counter %d\n\n", counter);
+	next_scans++;
+	next_round_trips += counter;
+	printf("\n counter %d, %d records, %d round trips in %d scans\n\n",
+	       counter, records, next_round_trips, next_scans);
 
 	if (rc == -ENOENT)
 		printf("\nno more entries");
 	else if (rc != 0)
 		printf("\ninternal error");
 
-	m0_bufvec_free(&keys);
-	m0_bufvec_free(&vals);
+	free(listed.keys);
+	op_cache = op;
+	key0_restore(&keys, key0);
+	keys.ov_vec.v_nr = CNT;
+	vals.ov_vec.v_nr = CNT;
+	kvs_pool_bufvec_free(&vals);
+free_keys:
+	kvs_pool_bufvec_free(&keys);
+free_rcs:
+	kvs_pool_free(rcs);
 	return rc;
 }
 
@@ -443,11 +584,14 @@ int pattern_search(char *ino)
 {
 	unsigned long long int ino2;
 	ino2 = atoll(ino);
-	struct cortxfs_xattr *xkey = NULL;
+	struct cortxfs_xattr_v2 *xkey = NULL;
+	int rc;
 	xkey = calloc(1, sizeof(*xkey));
-	XATTR_KEY_INIT(xkey, ino2, "");
+	xattr_key_v2_init(xkey, ino2, "", 0);
 
-	return  m0_search_pattern(xkey);
+	rc = m0_search_pattern(xkey);
+	free(xkey);
+	return rc;
 
 }
 
@@ -515,6 +659,7 @@ int main(int argc, char **argv)
 	if ((rc = set_batch(key, val, ino)) != 0)
 	{
 		fprintf(stderr, "%d: error in storing", rc);
+		op_cache_free();
 		c0appz_free();
 		return -3;
 	}
@@ -547,6 +692,7 @@ int main(int argc, char **argv)
 	if ((rc = delete_batch(key, ino)) != 0)
 	{
 		fprintf(stderr, "%d: error in deleting batch", rc);
+		op_cache_free();
 		c0appz_free();
 		return -3;
 	}
@@ -567,6 +713,8 @@ int main(int argc, char **argv)
 	timer(start1, end1, "update 1 keys one at a time (nfs)");
 */
 	/* free resources*/
+	op_cache_free();
+	kvs_pool_thread_fini();
 	c0appz_free();
 
 	/* time out */
@@ -33,43 +33,24 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <sys/syscall.h>
-#include <math.h>
-#define KLEN 256
-#define VLEN 256
+#include "xattr_key.h"
+#include "../kvstore/kvs_async.h"
 #define VALINPUT 512
-#define MAXVAL 70000
 #define CALLS 100	//no of keys
 #define CNT 100		//batch size
-#define BATCH ((int) ceil(CALLS/CNT))
-
-struct cortxfs_xattr{
-	unsigned long long int ino;
-	char type;
-	char name[256];
-}__attribute((packed));
-
-
-#define XATTR_KEY_INIT(key, ino2, xname)	\
-{											\
-	key->ino = ino2;						\
-	key->type = '7';						\
-	memset(key->name, 0, 256);				\
-	memcpy(key->name, xname, strlen(xname));\
-}
+#define WINDOW 32	//operations in flight
+#define BATCH ((CALLS + CNT - 1) / CNT)
 
 static struct m0_fid ifid;
 static struct m0_ufid_generator cortxfs_ufid_generator;
 static struct m0_idx idx;
 
-/* for one by one key and value calls */
-struct m0_bufvec key[100];
-struct m0_bufvec val[100];
-struct m0_op *op_arr[100];
-int *rcs;
-
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-int done = 0;
+/* Keys and values of one operation, owned until its callback ran */
+struct xattr_batch {
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	int rc;
+};
 
 void timer(struct timeval start1, struct timeval end1, char *msg)
 {
@@ -80,184 +61,153 @@ void timer(struct timeval start1, struct timeval end1, char *msg)
 	printf("\nElapsed time for %s: %ld millisecs\n", msg, mtime);
 }
 
-static void callback(struct m0_op *op)
+static void xattr_op_done(void *arg, int rc, const int *rcs, uint32_t nr)
 {
-	//printf("(Callback) The thread id is %u \n", (unsigned int) syscall( __NR_gettid ));
-
-	pthread_mutex_lock(&mutex);
-
-	done++;
-	if (done == BATCH)
-		pthread_cond_signal(&cond);
+	struct xattr_batch *batch = arg;
+	uint32_t i;
 
-	pthread_mutex_unlock(&mutex);
+	for (i = 0; rc == 0 && i < nr; i++)
+		rc = rcs[i];
 
-	//m0_semaphore_up(&sem);
+	batch->rc = rc;
 }
 
-static int  m0_op_kvs_async(enum m0_idx_opcode opcode, struct m0_bufvec *key, struct m0_bufvec *val, struct m0_op **op)
+static void batches_free(struct xattr_batch *batch)
 {
-	int rc;
-	rcs = (int*) m0_alloc(sizeof(int) * CNT);
-
-	struct m0_idx     *index = NULL;
-	struct m0_op_ops   op_ops;
+	int i;
 
-	index = &idx;
-	rc = m0_idx_op(index, opcode, key, val, rcs, M0_OIF_OVERWRITE, op);
-
-	if (rc) 
-	{
-		printf("\nerror(%d): m0_idx_op", rc);
-		return rc;
+	for (i = 0; i < BATCH; i++) {
+		m0_bufvec_free(&batch[i].key);
+		m0_bufvec_free(&batch[i].val);
 	}
-
-	op_ops.oop_executed = NULL;
-	op_ops.oop_stable = callback;
-	op_ops.oop_failed = callback;
-
-	m0_op_setup(*op, &op_ops, 0);
-
-	//printf("Before launch thread id is %u \n", (unsigned int) syscall( __NR_gettid ));
-	m0_op_launch(op, 1);
-
-	return rc;
+	free(batch);
 }
 
-static int setAttr()
+/**
+ * Build BATCH operations of up to CNT xattrs named k1_<n> of inode ino2.
+ * Values are only set up when v1 is not NULL.
+ */
+static struct xattr_batch *batches_alloc(const char *k1, const char *v1,
+					 unsigned long long int ino2)
 {
-	char *k1 = "1name_of_key";
-	char *v1 = malloc(sizeof(char)* VALINPUT);
-
-	struct cortxfs_xattr *xkey[CALLS];
-	size_t klen, vlen;
-	int rc, i, j, index;
-
-	unsigned long long int ino2;
-
-	memset(v1, '*', VALINPUT);
-	ino2 = atoll("123456");
-
+	struct xattr_batch *batch;
 	char tmpkey[256];
-	struct timeval start1, end1;
+	size_t vlen = v1 != NULL ? strlen(v1) + 1 : 0;
+	int rc = 0, i, j, n, cnt;
 
-	klen = sizeof(struct cortxfs_xattr);
-	vlen = strlen(v1) + 1;
-	for (i = 0; i < BATCH; i ++)
-	{
-		index = i * CNT;
-		for (j = 0; j < CNT; j++)
-		{
-			xkey[index + j] = calloc(1, sizeof( struct cortxfs_xattr));
-			snprintf(tmpkey, 256, "%s_%d", k1, index + j);
-			XATTR_KEY_INIT(xkey[index + j], ino2, tmpkey);
-		}
+	batch = calloc(BATCH, sizeof(*batch));
+	if (batch == NULL)
+		return NULL;
 
-		rc = m0_bufvec_alloc(&key[i], CNT, klen);
-		if (rc != 0)
-			printf("error(%d): m0_bufvec_alloc", rc);
+	for (i = 0; rc == 0 && i < BATCH; i++) {
+		cnt = CALLS - i * CNT < CNT ? CALLS - i * CNT : CNT;
 
-		rc = m0_bufvec_alloc(&val[i], CNT, vlen);
-		if (rc != 0)
+		rc = m0_bufvec_alloc(&batch[i].key, cnt,
+				     sizeof(struct cortxfs_xattr_v2));
+		if (rc == 0 && v1 != NULL)
+			rc = m0_bufvec_alloc(&batch[i].val, cnt, vlen);
+		if (rc != 0) {
 			printf("error(%d): m0_bufvec_alloc", rc);
+			break;
+		}
 
-		for (j = 0; j < CNT; j++)
-		{
-			memcpy(key[i].ov_buf[j], xkey[index + j], klen);
-			memcpy(val[i].ov_buf[j], v1, vlen);
+		for (j = 0; j < cnt; j++) {
+			snprintf(tmpkey, 256, "%s_%d", k1, i * CNT + j);
+			n = xattr_key_v2_init(batch[i].key.ov_buf[j], ino2,
+					      tmpkey, strlen(tmpkey));
+			batch[i].key.ov_vec.v_count[j] = n;
+			if (v1 != NULL)
+				memcpy(batch[i].val.ov_buf[j], v1, vlen);
 		}
 	}
 
-	gettimeofday(&start1, NULL);
-	for (i = 0; i < BATCH; i++)
-	{
-		m0_op_kvs_async(M0_IC_PUT, &key[i], &val[i], &op_arr[i]);
-		//m0_semaphore_down(&sem);
+	if (rc != 0) {
+		batches_free(batch);
+		batch = NULL;
 	}
+	return batch;
+}
 
-	while (done < BATCH)
-	{
-		pthread_cond_wait( & cond, & mutex );
-	}
+/**
+ * Pipeline all the operations through the engine, WINDOW at a time.
+ */
+static int batches_run(enum m0_idx_opcode opcode, struct xattr_batch *batch,
+		       char *msg)
+{
+	struct kvs_async_engine eng;
+	struct timeval start1, end1;
+	int rc, i;
 
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "stored keys one at a time async");
+	rc = kvs_async_init(&eng, &idx, WINDOW);
+	if (rc != 0)
+		return rc;
 
-	for (i = 0; i < BATCH; i++)
-	{
-		m0_op_fini(op_arr[i]);
-		m0_bufvec_free(&key[i]);
-		m0_bufvec_free(&val[i]);
+	gettimeofday(&start1, NULL);
+	for (i = 0; i < BATCH; i++) {
+		batch[i].rc = -EINPROGRESS;
+		rc = kvs_async_submit(&eng, opcode, &batch[i].key,
+				      opcode == M0_IC_PUT ? &batch[i].val : NULL,
+				      M0_OIF_OVERWRITE, xattr_op_done,
+				      &batch[i]);
+		if (rc != 0) {
+			printf("error(%d): kvs_async_submit", rc);
+			break;
+		}
 	}
 
-	for (i = 0; i < CALLS; i++)
-		free(xkey[i]);
+	kvs_async_drain(&eng);
+	gettimeofday(&end1, NULL);
+	timer(start1, end1, msg);
+
+	/* Operations never submitted keep -EINPROGRESS */
+	for (i = 0; rc == 0 && i < BATCH; i++)
+		rc = batch[i].rc;
+	if (rc != 0)
+		printf("error(%d): %s\n", rc, msg);
 
-    free(v1);
+	kvs_async_fini(&eng);
 	return rc;
 }
 
-static int delAttr()
+static int setAttr()
 {
 	char *k1 = "1name_of_key";
-	struct cortxfs_xattr *xkey[CALLS];
-	size_t klen;
-	int rc, i, j, index;
-
-	unsigned long long int ino2;
-
-	ino2 = atoll("123456");
-
-	char tmpkey[256];
-	struct timeval start1, end1;
+	char *v1 = malloc(sizeof(char)* VALINPUT);
+	struct xattr_batch *batch;
+	int rc;
 
-	klen = sizeof(struct cortxfs_xattr);
-	for (i = 0; i < BATCH; i ++)
-	{
-		index = i * CNT;
-		for (j = 0; j < CNT; j++)
-		{
-			xkey[index + j] = calloc(1, sizeof( struct cortxfs_xattr));
-			snprintf(tmpkey, 256, "%s_%d", k1, index + j);
-			XATTR_KEY_INIT(xkey[index + j], ino2, tmpkey);
-		}
+	if (v1 == NULL)
+		return -ENOMEM;
 
-		rc = m0_bufvec_alloc(&key[i], CNT, klen);
-		if (rc != 0)
-			printf("error(%d): m0_bufvec_alloc", rc);
+	memset(v1, '*', VALINPUT - 1);
+	v1[VALINPUT - 1] = '\0';
 
-		for (j = 0; j < CNT; j++)
-		{
-			memcpy(key[i].ov_buf[j], xkey[index + j], klen);
-		}
+	batch = batches_alloc(k1, v1, atoll("123456"));
+	if (batch == NULL) {
+		free(v1);
+		return -ENOMEM;
 	}
 
-	gettimeofday(&start1, NULL);
-	for (i = 0; i < BATCH; i++)
-	{
-		m0_op_kvs_async(M0_IC_DEL, &key[i], NULL, &op_arr[i]);
-		//m0_semaphore_down(&sem);
-	}
+	rc = batches_run(M0_IC_PUT, batch, "stored keys one at a time async");
 
-	while (done < BATCH)
-	{
-		pthread_cond_wait( & cond, & mutex );
-	}
+	batches_free(batch);
+	free(v1);
+	return rc;
+}
 
-	gettimeofday(&end1, NULL);
-	timer(start1, end1, "deleted keys one at a time async");
+static int delAttr()
+{
+	char *k1 = "1name_of_key";
+	struct xattr_batch *batch;
+	int rc;
 
-	for (i = 0; i < BATCH; i++)
-	{
-		m0_op_fini(op_arr[i]);
-		m0_bufvec_free(&key[i]);
-	}
+	batch = batches_alloc(k1, NULL, atoll("123456"));
+	if (batch == NULL)
+		return -ENOMEM;
 
-	for (i = 0; i < CALLS; i++)
-	{
-		free(xkey[i]);
-	}
+	rc = batches_run(M0_IC_DEL, batch, "deleted keys one at a time async");
 
+	batches_free(batch);
 	return rc;
 }
 
@@ -323,13 +273,9 @@ int main(int argc, char **argv)
 	if (rc != 0)
 		fprintf(stderr, "error in fid initialization");	
 
-	//m0_semaphore_init(&sem, 0);
-
-	setAttr();
-
-	//m0_semaphore_fini(&sem);
-
-	delAttr();
+	rc = setAttr();
+	if (rc == 0)
+		rc = delAttr();
 
 	/* free resources*/
 	c0appz_free();
@@ -344,10 +290,6 @@ int main(int argc, char **argv)
 }
 
 
-static test(void) {
-
-}
-
 /*
  *  Local variables:
  *  c-indentation-style: "K&R"
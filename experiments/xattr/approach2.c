@@ -31,6 +31,8 @@
 #include <sys/time.h>	
 #include <unistd.h>
 #include <fnmatch.h>
+/* Header only, build with -I../kvstore */
+#include "kvs_vec.h"
 #define KLEN 256
 #define VLEN 256
 #define MAXVAL 70000
@@ -94,30 +96,17 @@ int parse(char *v)
 
 int json_get(char *k, char *v)
 {
-	size_t klen;
-	size_t vlen;
-
+	void *kbuf = k, *vbuf;
+	m0_bcount_t klen, vlen;
 	struct m0_bufvec	 key;
 	struct m0_bufvec	 val;
 	int rc;
 
 	klen = strnlen(k, KLEN)+1;
 
-	rc = m0_bufvec_alloc(&key, 1, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	rc = m0_bufvec_empty_alloc(&val, 1);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_empty_alloc", rc);
-		goto out;
-	}
-
-	memcpy(key.ov_buf[0], k, klen);
+	/* The key is the caller's, the value is read in place */
+	kvs_vec_wrap(&key, &kbuf, &klen, 1);
+	kvs_vec_borrow(&val, &vbuf, &vlen, 1);
 
 	rc = m0_op_kvs(M0_IC_GET, &key, &val);
 	if (rc)
@@ -126,49 +115,29 @@ int json_get(char *k, char *v)
 		goto out;
 	}
 
-	vlen = (size_t)val.ov_vec.v_count[0];
-
-	memcpy(v, (char *)val.ov_buf[0], vlen);
+	memcpy(v, (char *)val.ov_buf[0], val.ov_vec.v_count[0]);
 
 out:
-	m0_bufvec_free(&key);
-	m0_bufvec_free(&val);
+	kvs_vec_release(&val);
 	return rc;
 
 }
 
 int in_motr(char *k, const char *v)
 {
-	size_t klen, vlen;
-        int rc;
+	void *kbuf = k, *vbuf = (void *)v;
+	m0_bcount_t klen, vlen;
 	struct m0_bufvec key;
 	struct m0_bufvec val;
 
 	klen = strnlen(k, 255) + 1;
 	vlen = strlen(v) + 1;
 
-	rc = m0_bufvec_alloc(&key, 1, klen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	rc = m0_bufvec_alloc(&val, 1, vlen);
-	if (rc)
-        {
-		printf("\nerror(%d): m0_bufvec_alloc", rc);
-		goto out;
-	}
-
-	memcpy(key.ov_buf[0], k, klen);
-        memcpy(val.ov_buf[0], v, vlen);
+	/* The JSON document is written from the caller's string */
+	kvs_vec_wrap(&key, &kbuf, &klen, 1);
+	kvs_vec_wrap(&val, &vbuf, &vlen, 1);
 
-        rc = m0_op_kvs(M0_IC_PUT, &key, &val);
-  out:
-        m0_bufvec_free(&key);
-        m0_bufvec_free(&val);
-        return rc;
+	return m0_op_kvs(M0_IC_PUT, &key, &val);
 }
 
 int json_store(char *k, char *v, char *ino)
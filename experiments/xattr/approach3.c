@@ -0,0 +1,689 @@
+/*
+ * Filename:         approach3.c
+ * Description:      Small xattrs inline in the inode stat record
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment.
+ * - Give N inodes the xattrs most of our files carry (security.selinux,
+ *   a POSIX ACL and a user tag, all well under XATTR_INLINE_VALUE_MAX) and
+ *   every SPILL_EVERY-th inode one large value as well
+ * - Layout 1: a struct stat record plus one version 2 key per xattr, the
+ *   way approach1.c stores them
+ * - Layout 3: the small xattrs inline in the stat record (xattr_inline.h),
+ *   the large ones spilled to version 2 keys
+ * - Compare the round trips and time taken by setxattr, by a getattr
+ *   followed by a getxattr of every xattr, and by listxattr
+ *
+ * Build with the metadata KVS helpers:
+ *   gcc -I../kvstore -o approach3 approach3.c xattr_inline.c
+ *       ../kvstore/md_kvs.c ../kvstore/mem_kvs.c ../kvstore/kvs_pool.c
+ *       ../perf/perf_stats.c ../perf/lat_hist.c ../perf/trace.c
+ *       <c0appz/motr flags>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include <sys/time.h>
+#include "md_kvs.h"
+#include "xattr_key.h"
+#include "xattr_inline.h"
+
+#define FIRST_INO_KEYS 0x50000ULL
+#define FIRST_INO_INLINE 0x60000ULL
+#define SPILL_EVERY 10
+#define LARGE_VALUE_LEN 1024
+#define LIST_BATCH 16
+
+struct xattr_desc {
+	const char *name;
+	size_t vlen;
+};
+
+static const struct xattr_desc small_xattrs[] = {
+	{ "security.selinux", 36 },
+	{ "system.posix_acl_access", 44 },
+	{ "user.tag", 16 },
+};
+
+#define SMALL_XATTRS ((int)(sizeof(small_xattrs) / sizeof(small_xattrs[0])))
+
+static const struct xattr_desc large_xattr = { "user.blob", LARGE_VALUE_LEN };
+
+static const int test_sizes[] = { 100, 1000 };
+
+/* Index operations issued, NEXT included */
+static unsigned long round_trips;
+
+static void value_fill(char *value, size_t vlen, cfs_ino_t ino, int j)
+{
+	size_t i;
+
+	for (i = 0; i < vlen; i++)
+		value[i] = 'a' + (ino + j + i) % 26;
+}
+
+static void stat_fill(struct stat *st, cfs_ino_t ino)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_ino = ino;
+	st->st_mode = S_IFREG | 0644;
+	st->st_nlink = 1;
+}
+
+/* Xattrs of inode i of a test, the large one last */
+static int xattrs_of(int i)
+{
+	return SMALL_XATTRS + (i % SPILL_EVERY == 0);
+}
+
+static const struct xattr_desc *xattr_of(int j)
+{
+	return j < SMALL_XATTRS ? &small_xattrs[j] : &large_xattr;
+}
+
+/**
+ * Run one single-record operation on key/val (val is NULL for DEL),
+ * a GET allocates the value and returns it in *val_out.
+ */
+static int kvs_op1(enum m0_idx_opcode opcode, void *kbuf, size_t klen,
+		   void *vbuf, size_t vlen, void **val_out, size_t *vlen_out)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	m0_bcount_t kcount = klen;
+	m0_bcount_t vcount = vlen;
+	int rc;
+
+	kvs_vec_wrap(&key, &kbuf, &kcount, 1);
+	if (opcode == M0_IC_GET)
+		kvs_vec_borrow(&val, &vbuf, &vcount, 1);
+	else
+		kvs_vec_wrap(&val, &vbuf, &vcount, 1);
+
+	round_trips++;
+	rc = md_kvs_op(opcode, &key, opcode == M0_IC_DEL ? NULL : &val, NULL,
+		       opcode == M0_IC_PUT ? M0_OIF_OVERWRITE : 0);
+	if (opcode != M0_IC_GET)
+		return rc;
+
+	/* The borrowed value goes to the caller, who m0_free()s it */
+	if (rc == 0) {
+		*val_out = vbuf;
+		*vlen_out = vcount;
+	} else {
+		kvs_vec_release(&val);
+	}
+	return rc;
+}
+
+static int stat_rec_get(cfs_ino_t ino, void **val, size_t *vlen)
+{
+	struct md_stat_key skey;
+
+	MD_STAT_KEY_INIT(&skey, ino);
+	return kvs_op1(M0_IC_GET, &skey, sizeof(skey), NULL, 0, val, vlen);
+}
+
+static int xattr_key_op(enum m0_idx_opcode opcode, cfs_ino_t ino,
+			const char *name, void *value, size_t vlen,
+			void **val_out, size_t *vlen_out)
+{
+	struct cortxfs_xattr_v2 xkey;
+	int klen;
+
+	klen = xattr_key_v2_init(&xkey, ino, name, strlen(name));
+	if (klen < 0)
+		return klen;
+
+	return kvs_op1(opcode, &xkey, klen, value, vlen, val_out, vlen_out);
+}
+
+/**
+ * Count the version 2 keys of ino with one or more NEXT.
+ */
+static int xattr_keys_count(cfs_ino_t ino, int *count)
+{
+	struct md_kvs_iter it;
+	struct cortxfs_xattr_v2 start;
+	int rc;
+
+	xattr_key_v2_init(&start, ino, "", 0);
+	rc = md_kvs_iter_init(&it, &start, XATTR_KEY_V2_LEN(0),
+			      XATTR_KEY_V2_PREFIX_LEN, LIST_BATCH,
+			      sizeof(struct cortxfs_xattr_v2), LARGE_VALUE_LEN);
+	if (rc != 0)
+		return rc;
+
+	*count = 0;
+	do {
+		rc = md_kvs_iter_next(&it);
+		*count += it.nr;
+	} while (rc == 0 && !it.eof);
+
+	round_trips += it.round_trips;
+	md_kvs_iter_fini(&it);
+	return rc;
+}
+
+/* Layout 3: inline xattrs and spilled keys */
+
+static int inline_rec_put(cfs_ino_t ino, struct xattr_inline_rec *rec)
+{
+	struct md_stat_key skey;
+
+	MD_STAT_KEY_INIT(&skey, ino);
+	return kvs_op1(M0_IC_PUT, &skey, sizeof(skey), rec,
+		       xattr_inline_rec_len(rec), NULL, NULL);
+}
+
+/**
+ * getattr: a single GET brings the attributes and the inline xattrs.
+ */
+static int inline_rec_load(cfs_ino_t ino, struct xattr_inline_rec *rec)
+{
+	void *val = NULL;
+	size_t vlen = 0;
+	int rc;
+
+	rc = stat_rec_get(ino, &val, &vlen);
+	if (rc == 0)
+		rc = xattr_inline_decode(rec, val, vlen);
+
+	m0_free(val);
+	return rc;
+}
+
+/**
+ * setxattr on an inode whose record rec was loaded: an inline value costs
+ * the PUT of the record, and the DEL of the value it replaces if that one
+ * may have been spilled; a spilled one is PUT with the record in the same
+ * operation, when the record changed.
+ */
+static int inline_setxattr(cfs_ino_t ino, struct xattr_inline_rec *rec,
+			   const char *name, void *value, size_t vlen)
+{
+	struct xattr_inline_rec old = *rec;
+	struct md_stat_key skey;
+	struct cortxfs_xattr_v2 xkey;
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	m0_bcount_t counts[4];
+	void *bufs[4];
+	size_t nlen = strlen(name);
+	size_t size;
+	/* A name inline in the record is never spilled as well */
+	bool spilled = (rec->flags & XATTR_INLINE_SPILLED) &&
+		xattr_inline_get(rec, name, nlen, NULL, &size) == -ENODATA;
+	int rc, nr = 0;
+
+	rc = xattr_inline_set(rec, name, nlen, value, vlen);
+	if (rc == 0) {
+		rc = inline_rec_put(ino, rec);
+		if (rc != 0)
+			goto err;
+		/*
+		 * Only once the record holds the new value: a previous value
+		 * of this xattr may have been spilled. Left behind, it is
+		 * shadowed by the inline one.
+		 */
+		if (spilled) {
+			rc = xattr_key_op(M0_IC_DEL, ino, name, NULL, 0, NULL,
+					  NULL);
+			if (rc == -ENOENT)
+				rc = 0;
+		}
+		return rc;
+	}
+
+	if (rc != -EFBIG)
+		goto err;
+
+	rc = xattr_key_v2_init(&xkey, ino, name, nlen);
+	if (rc < 0)
+		goto err;
+	counts[nr] = rc;
+	bufs[nr] = &xkey;
+	counts[nr + 2] = vlen;
+	bufs[nr + 2] = value;
+	nr++;
+
+	rec->flags |= XATTR_INLINE_SPILLED;
+	if (rec->flags != old.flags || rec->len != old.len) {
+		MD_STAT_KEY_INIT(&skey, ino);
+		counts[nr] = sizeof(skey);
+		bufs[nr] = &skey;
+		counts[nr + 2] = xattr_inline_rec_len(rec);
+		bufs[nr + 2] = rec;
+		nr++;
+	}
+
+	/* Values follow the keys in counts/bufs */
+	if (nr == 1) {
+		counts[1] = counts[2];
+		bufs[1] = bufs[2];
+	}
+
+	key.ov_vec.v_nr = nr;
+	key.ov_vec.v_count = counts;
+	key.ov_buf = bufs;
+	val.ov_vec.v_nr = nr;
+	val.ov_vec.v_count = counts + nr;
+	val.ov_buf = bufs + nr;
+
+	round_trips++;
+	rc = md_kvs_op(M0_IC_PUT, &key, &val, NULL, M0_OIF_OVERWRITE);
+	if (rc != 0)
+		goto err;
+	return 0;
+
+err:
+	*rec = old;
+	return rc;
+}
+
+/**
+ * getxattr on an inode whose record rec was loaded: no round trip unless
+ * the xattr may be spilled.
+ */
+static int inline_getxattr(cfs_ino_t ino, const struct xattr_inline_rec *rec,
+			   const char *name, void *value, size_t *size)
+{
+	void *val = NULL;
+	size_t vlen = 0;
+	int rc;
+
+	rc = xattr_inline_get(rec, name, strlen(name), value, size);
+	if (rc != -ENODATA || !(rec->flags & XATTR_INLINE_SPILLED))
+		return rc;
+
+	rc = xattr_key_op(M0_IC_GET, ino, name, NULL, 0, &val, &vlen);
+	if (rc == -ENOENT)
+		rc = -ENODATA;
+	if (rc != 0)
+		goto out;
+
+	if (vlen > *size) {
+		rc = -ERANGE;
+		goto out;
+	}
+
+	memcpy(value, val, vlen);
+	*size = vlen;
+
+out:
+	m0_free(val);
+	return rc;
+}
+
+static int inline_removexattr(cfs_ino_t ino, struct xattr_inline_rec *rec,
+			      const char *name)
+{
+	int rc;
+
+	rc = xattr_inline_remove(rec, name, strlen(name));
+	if (rc == 0)
+		return inline_rec_put(ino, rec);
+
+	if (!(rec->flags & XATTR_INLINE_SPILLED))
+		return -ENODATA;
+
+	rc = xattr_key_op(M0_IC_DEL, ino, name, NULL, 0, NULL, NULL);
+	return rc == -ENOENT ? -ENODATA : rc;
+}
+
+static int inline_listxattr(cfs_ino_t ino, const struct xattr_inline_rec *rec,
+			    int *count)
+{
+	const char *name;
+	const void *value;
+	size_t pos = 0, nlen, vlen;
+	int spilled = 0, rc = 0;
+
+	*count = 0;
+	while (xattr_inline_next(rec, &pos, &name, &nlen, &value, &vlen))
+		(*count)++;
+
+	if (rec->flags & XATTR_INLINE_SPILLED) {
+		rc = xattr_keys_count(ino, &spilled);
+		*count += spilled;
+	}
+
+	return rc;
+}
+
+/* Experiment */
+
+static void report(const char *msg, int nr, const struct timeval *start,
+		   const struct timeval *end, unsigned long rts)
+{
+	printf("%-32s %8ld usecs, %6.2f round trips per inode\n", msg,
+	       md_kvs_elapsed_us(start, end), (double)rts / nr);
+}
+
+static int keys_setxattr(int nr)
+{
+	char value[LARGE_VALUE_LEN];
+	struct md_stat_key skey;
+	struct stat st;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_KEYS + i;
+		stat_fill(&st, ino);
+		MD_STAT_KEY_INIT(&skey, ino);
+		rc = kvs_op1(M0_IC_PUT, &skey, sizeof(skey), &st, sizeof(st),
+			     NULL, NULL);
+
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++) {
+			value_fill(value, xattr_of(j)->vlen, ino, j);
+			rc = xattr_key_op(M0_IC_PUT, ino, xattr_of(j)->name,
+					  value, xattr_of(j)->vlen, NULL, NULL);
+		}
+	}
+
+	return rc;
+}
+
+static int inline_setxattrs(int nr)
+{
+	char value[LARGE_VALUE_LEN];
+	struct xattr_inline_rec rec;
+	struct stat st;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_INLINE + i;
+		stat_fill(&st, ino);
+		xattr_inline_init(&rec, &st);
+		rc = inline_rec_put(ino, &rec);
+
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++) {
+			value_fill(value, xattr_of(j)->vlen, ino, j);
+			rc = inline_setxattr(ino, &rec, xattr_of(j)->name,
+					     value, xattr_of(j)->vlen);
+		}
+	}
+
+	return rc;
+}
+
+static int value_check(const char *value, size_t vlen, cfs_ino_t ino, int j)
+{
+	char expected[LARGE_VALUE_LEN];
+
+	if (vlen != xattr_of(j)->vlen)
+		return -EINVAL;
+
+	value_fill(expected, vlen, ino, j);
+	return memcmp(value, expected, vlen) == 0 ? 0 : -EINVAL;
+}
+
+/**
+ * getattr followed by a getxattr of every xattr, layout 1.
+ */
+static int keys_getxattrs(int nr)
+{
+	void *val;
+	size_t vlen;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_KEYS + i;
+		val = NULL;
+		rc = stat_rec_get(ino, &val, &vlen);
+		if (rc == 0 && vlen != sizeof(struct stat))
+			rc = -EINVAL;
+		m0_free(val);
+
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++) {
+			val = NULL;
+			rc = xattr_key_op(M0_IC_GET, ino, xattr_of(j)->name,
+					  NULL, 0, &val, &vlen);
+			if (rc == 0)
+				rc = value_check(val, vlen, ino, j);
+			m0_free(val);
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * getattr followed by a getxattr of every xattr, layout 3.
+ */
+static int inline_getxattrs(int nr)
+{
+	char value[LARGE_VALUE_LEN];
+	struct xattr_inline_rec rec;
+	size_t size;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_INLINE + i;
+		rc = inline_rec_load(ino, &rec);
+
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++) {
+			size = sizeof(value);
+			rc = inline_getxattr(ino, &rec, xattr_of(j)->name,
+					     value, &size);
+			if (rc == 0)
+				rc = value_check(value, size, ino, j);
+		}
+	}
+
+	return rc;
+}
+
+static int keys_listxattrs(int nr)
+{
+	int rc = 0, i, count;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		rc = xattr_keys_count(FIRST_INO_KEYS + i, &count);
+		if (rc == 0 && count != xattrs_of(i))
+			rc = -EINVAL;
+	}
+
+	return rc;
+}
+
+static int inline_listxattrs(int nr)
+{
+	struct xattr_inline_rec rec;
+	cfs_ino_t ino;
+	int rc = 0, i, count;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_INLINE + i;
+		rc = inline_rec_load(ino, &rec);
+		if (rc == 0)
+			rc = inline_listxattr(ino, &rec, &count);
+		if (rc == 0 && count != xattrs_of(i))
+			rc = -EINVAL;
+	}
+
+	return rc;
+}
+
+static int keys_cleanup(int nr)
+{
+	struct md_stat_key skey;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_KEYS + i;
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++)
+			rc = xattr_key_op(M0_IC_DEL, ino, xattr_of(j)->name,
+					  NULL, 0, NULL, NULL);
+		MD_STAT_KEY_INIT(&skey, ino);
+		if (rc == 0)
+			rc = kvs_op1(M0_IC_DEL, &skey, sizeof(skey), NULL, 0,
+				     NULL, NULL);
+	}
+
+	return rc;
+}
+
+static int inline_cleanup(int nr)
+{
+	struct xattr_inline_rec rec;
+	struct md_stat_key skey;
+	cfs_ino_t ino;
+	int rc = 0, i, j;
+
+	for (i = 0; rc == 0 && i < nr; i++) {
+		ino = FIRST_INO_INLINE + i;
+		rc = inline_rec_load(ino, &rec);
+		for (j = 0; rc == 0 && j < xattrs_of(i); j++)
+			rc = inline_removexattr(ino, &rec, xattr_of(j)->name);
+		/* The small ones were all inline */
+		if (rc == 0 && rec.count != 0)
+			rc = -EINVAL;
+		MD_STAT_KEY_INIT(&skey, ino);
+		if (rc == 0)
+			rc = kvs_op1(M0_IC_DEL, &skey, sizeof(skey), NULL, 0,
+				     NULL, NULL);
+	}
+
+	return rc;
+}
+
+typedef int (*xattr_test_t)(int nr);
+
+static int run(const char *msg, xattr_test_t test, int nr)
+{
+	struct timeval start, end;
+	unsigned long rts = round_trips;
+	int rc;
+
+	gettimeofday(&start, NULL);
+	rc = test(nr);
+	gettimeofday(&end, NULL);
+
+	if (rc != 0)
+		fprintf(stderr, "error(%d): %s\n", rc, msg);
+	else
+		report(msg, nr, &start, &end, round_trips - rts);
+	return rc;
+}
+
+static int xattr_compare(int nr)
+{
+	int rc;
+
+	printf("\n%d inodes, %d small xattrs each, one of %d bytes every %d\n",
+	       nr, SMALL_XATTRS, LARGE_VALUE_LEN, SPILL_EVERY);
+
+	rc = run("setxattr (keys)", keys_setxattr, nr);
+	if (rc != 0)
+		goto cleanup_keys;
+	rc = run("setxattr (inline)", inline_setxattrs, nr);
+	if (rc != 0)
+		goto cleanup;
+
+	rc = run("getattr + getxattr (keys)", keys_getxattrs, nr) ?:
+		run("getattr + getxattr (inline)", inline_getxattrs, nr) ?:
+		run("listxattr (keys)", keys_listxattrs, nr) ?:
+		run("getattr + listxattr (inline)", inline_listxattrs, nr);
+
+cleanup:
+	if (inline_cleanup(nr) != 0 && rc == 0)
+		rc = -EIO;
+cleanup_keys:
+	if (keys_cleanup(nr) != 0 && rc == 0)
+		rc = -EIO;
+	return rc;
+}
+int main(int argc, char **argv)
+{
+	int rc = 0;
+	size_t i;
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	for (i = 0; i < sizeof(test_sizes) / sizeof(test_sizes[0]); i++) {
+		rc = xattr_compare(test_sizes[i]);
+		if (rc != 0)
+			break;
+	}
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,761 @@
+/*
+ * Filename:         approach4.c
+ * Description:      Binary per-inode xattr container compared with approach1/2
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* This file has the implementation for the following experiment, with the
+ * workload of approach2.c: 100 xattrs "<key>_<i>" of VALINPUT bytes on one
+ * inode.
+ * - keys:      one version 2 key per xattr (approach1.c)
+ * - json:      one JSON blob per inode, fetched, parsed, updated and stored
+ *              again for every change (approach2.c)
+ * - container: one binary container per inode plus delta records merged
+ *              lazily (xattr_container.h)
+ * For each layout: store the 100 xattrs at once, update each of them with a
+ * setxattr, get each of them with a getxattr, remove each of them; report
+ * the time taken and the index round trips.
+ *
+ * Usage: approach4 <key> <ino>
+ * Build with the metadata KVS helpers:
+ *   gcc -I../kvstore -o approach4 approach4.c xattr_container.c
+ *       ../kvstore/md_kvs.c ../kvstore/mem_kvs.c ../kvstore/kvs_pool.c
+ *       ../perf/perf_stats.c ../perf/lat_hist.c ../perf/trace.c
+ *       <c0appz/motr flags> -ljson-c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include <json-c/json.h>
+#include <sys/time.h>
+#include "md_kvs.h"
+#include "xattr_key.h"
+#include "xattr_container.h"
+
+#define XATTRS 100
+#define VALINPUT 512
+#define NAME_LEN 256
+/* Largest JSON blob or container of the workload */
+#define MAXVAL 70000
+
+/* Index operations issued, NEXT included */
+static unsigned long round_trips;
+
+/* Base record and deltas of the inode, see container_load() */
+struct container_state {
+	struct md_kvs_iter it;
+	cfs_ino_t ino;
+	const void *base;
+	struct xattr_delta deltas[XATTR_CONTAINER_MAX_DELTAS];
+	uint64_t seqs[XATTR_CONTAINER_MAX_DELTAS];
+	int nr;
+	uint64_t next_seq;
+};
+
+struct layout {
+	const char *name;
+	int (*store)(cfs_ino_t ino, const char *key, const char *value);
+	int (*set)(cfs_ino_t ino, const char *name, const char *value);
+	int (*get)(cfs_ino_t ino, const char *name, char *value,
+		   size_t *vlen);
+	int (*remove)(cfs_ino_t ino, const char *name);
+};
+
+static struct container_state container;
+
+static void xattr_name(char *name, const char *key, int i)
+{
+	snprintf(name, NAME_LEN, "%s_%d", key, i);
+}
+
+/**
+ * One single-record operation, a GET allocates the value in *val_out.
+ */
+static int kvs_op1(enum m0_idx_opcode opcode, void *kbuf, size_t klen,
+		   void *vbuf, size_t vlen, void **val_out, size_t *vlen_out)
+{
+	struct m0_bufvec key;
+	struct m0_bufvec val;
+	m0_bcount_t kcount = klen;
+	m0_bcount_t vcount = vlen;
+	int rc;
+
+	kvs_vec_wrap(&key, &kbuf, &kcount, 1);
+	if (opcode == M0_IC_GET)
+		kvs_vec_borrow(&val, &vbuf, &vcount, 1);
+	else
+		kvs_vec_wrap(&val, &vbuf, &vcount, 1);
+
+	round_trips++;
+	rc = md_kvs_op(opcode, &key, opcode == M0_IC_DEL ? NULL : &val, NULL,
+		       opcode == M0_IC_PUT ? M0_OIF_OVERWRITE : 0);
+	if (opcode != M0_IC_GET)
+		return rc;
+
+	/* The borrowed value goes to the caller, who m0_free()s it */
+	if (rc == 0) {
+		*val_out = vbuf;
+		*vlen_out = vcount;
+	} else {
+		kvs_vec_release(&val);
+	}
+	return rc;
+}
+
+/* keys: one record per xattr */
+
+static int keys_store(cfs_ino_t ino, const char *key, const char *value)
+{
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	char name[NAME_LEN];
+	int rc, i;
+
+	rc = m0_bufvec_alloc(&keys, XATTRS, sizeof(struct cortxfs_xattr_v2));
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_alloc(&vals, XATTRS, VALINPUT);
+	if (rc != 0)
+		goto free_keys;
+
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(name, key, i);
+		keys.ov_vec.v_count[i] = xattr_key_v2_init(keys.ov_buf[i], ino,
+							   name, strlen(name));
+		memcpy(vals.ov_buf[i], value, VALINPUT);
+	}
+
+	round_trips++;
+	rc = md_kvs_op(M0_IC_PUT, &keys, &vals, NULL, M0_OIF_OVERWRITE);
+
+	m0_bufvec_free(&vals);
+free_keys:
+	m0_bufvec_free(&keys);
+	return rc;
+}
+
+static int keys_set(cfs_ino_t ino, const char *name, const char *value)
+{
+	struct cortxfs_xattr_v2 xkey;
+	int klen = xattr_key_v2_init(&xkey, ino, name, strlen(name));
+
+	return kvs_op1(M0_IC_PUT, &xkey, klen, (void *)value, VALINPUT, NULL,
+		       NULL);
+}
+
+static int keys_get(cfs_ino_t ino, const char *name, char *value,
+		    size_t *vlen)
+{
+	struct cortxfs_xattr_v2 xkey;
+	int klen = xattr_key_v2_init(&xkey, ino, name, strlen(name));
+	void *val = NULL;
+	size_t len = 0;
+	int rc;
+
+	rc = kvs_op1(M0_IC_GET, &xkey, klen, NULL, 0, &val, &len);
+	if (rc == 0 && len > *vlen)
+		rc = -ERANGE;
+	if (rc == 0) {
+		memcpy(value, val, len);
+		*vlen = len;
+	}
+
+	m0_free(val);
+	return rc;
+}
+
+static int keys_remove(cfs_ino_t ino, const char *name)
+{
+	struct cortxfs_xattr_v2 xkey;
+	int klen = xattr_key_v2_init(&xkey, ino, name, strlen(name));
+
+	return kvs_op1(M0_IC_DEL, &xkey, klen, NULL, 0, NULL, NULL);
+}
+
+/* json: one blob per inode, as in approach2.c */
+
+static int json_blob_put(cfs_ino_t ino, struct json_object *obj)
+{
+	struct md_stat_key skey;
+	const char *json_string = json_object_to_json_string(obj);
+
+	/* Same key as the stat record, the blob takes its place */
+	MD_STAT_KEY_INIT(&skey, ino);
+	return kvs_op1(M0_IC_PUT, &skey, sizeof(skey), (void *)json_string,
+		       strlen(json_string) + 1, NULL, NULL);
+}
+
+static int json_blob_get(cfs_ino_t ino, struct json_object **obj)
+{
+	struct md_stat_key skey;
+	void *val = NULL;
+	size_t vlen = 0;
+	int rc;
+
+	MD_STAT_KEY_INIT(&skey, ino);
+	rc = kvs_op1(M0_IC_GET, &skey, sizeof(skey), NULL, 0, &val, &vlen);
+	if (rc != 0)
+		return rc;
+
+	*obj = vlen > 0 ? json_tokener_parse(val) : NULL;
+	m0_free(val);
+	return *obj != NULL ? 0 : -EINVAL;
+}
+
+static int json_store(cfs_ino_t ino, const char *key, const char *value)
+{
+	struct json_object *obj;
+	char name[NAME_LEN];
+	int rc, i;
+
+	obj = json_object_new_object();
+	if (obj == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(name, key, i);
+		json_object_object_add(obj, name,
+				       json_object_new_string(value));
+	}
+
+	rc = json_blob_put(ino, obj);
+	json_object_put(obj);
+	return rc;
+}
+
+static int json_set(cfs_ino_t ino, const char *name, const char *value)
+{
+	struct json_object *obj;
+	int rc;
+
+	rc = json_blob_get(ino, &obj);
+	if (rc != 0)
+		return rc;
+
+	json_object_object_add(obj, name, json_object_new_string(value));
+	rc = json_blob_put(ino, obj);
+	json_object_put(obj);
+	return rc;
+}
+
+static int json_get(cfs_ino_t ino, const char *name, char *value,
+		    size_t *vlen)
+{
+	struct json_object *obj;
+	struct json_object *val;
+	size_t len;
+	int rc;
+
+	rc = json_blob_get(ino, &obj);
+	if (rc != 0)
+		return rc;
+
+	if (!json_object_object_get_ex(obj, name, &val)) {
+		rc = -ENODATA;
+		goto out;
+	}
+
+	len = json_object_get_string_len(val);
+	if (len > *vlen) {
+		rc = -ERANGE;
+		goto out;
+	}
+
+	memcpy(value, json_object_get_string(val), len);
+	*vlen = len;
+
+out:
+	json_object_put(obj);
+	return rc;
+}
+
+static int json_remove(cfs_ino_t ino, const char *name)
+{
+	struct json_object *obj;
+	int rc;
+
+	rc = json_blob_get(ino, &obj);
+	if (rc != 0)
+		return rc;
+
+	json_object_object_del(obj, name);
+	rc = json_blob_put(ino, obj);
+	json_object_put(obj);
+	return rc;
+}
+
+/* container: base record and deltas */
+
+/**
+ * Fetch the base record and the deltas of ino with a single NEXT.
+ */
+static int container_load(cfs_ino_t ino)
+{
+	struct container_state *cs = &container;
+	struct xattr_container_key start;
+	const struct xattr_container_key *ckey;
+	uint32_t i;
+	int rc;
+
+	xattr_container_key_init(&start, ino, 0);
+	md_kvs_iter_seek(&cs->it, &start, sizeof(start), false);
+	/* One NEXT for the whole container, merges keep it in one batch */
+	cs->it.batch = cs->it.cap;
+	cs->it.eof = false;
+
+	rc = md_kvs_iter_next(&cs->it);
+	round_trips++;
+	if (rc != 0)
+		return rc;
+	if (!cs->it.eof)
+		return -E2BIG;
+
+	cs->ino = ino;
+	cs->base = NULL;
+	cs->nr = 0;
+	cs->next_seq = 1;
+	for (i = 0; i < cs->it.nr; i++) {
+		ckey = cs->it.keys.ov_buf[i];
+		if (cs->it.keys.ov_vec.v_count[i] != sizeof(*ckey))
+			return -EINVAL;
+
+		if (xattr_container_key_seq(ckey) == 0) {
+			rc = xattr_container_check(cs->it.vals.ov_buf[i],
+						   cs->it.vals.ov_vec.v_count[i]);
+			if (rc != 0)
+				return rc;
+			cs->base = cs->it.vals.ov_buf[i];
+			continue;
+		}
+
+		rc = xattr_delta_decode(cs->it.vals.ov_buf[i],
+					cs->it.vals.ov_vec.v_count[i],
+					&cs->deltas[cs->nr]);
+		if (rc != 0)
+			return rc;
+		cs->seqs[cs->nr] = xattr_container_key_seq(ckey);
+		cs->next_seq = cs->seqs[cs->nr] + 1;
+		cs->nr++;
+	}
+
+	return 0;
+}
+
+/**
+ * Replace the loaded base and deltas with a merged base record.
+ */
+static int container_merge(void)
+{
+	struct container_state *cs = &container;
+	struct xattr_container_key bkey;
+	struct m0_bufvec keys;
+	void *base;
+	size_t len;
+	int rc, i;
+
+	rc = xattr_container_merge(cs->base, cs->deltas, cs->nr, &base, &len);
+	if (rc != 0)
+		return rc;
+
+	xattr_container_key_init(&bkey, cs->ino, 0);
+	rc = kvs_op1(M0_IC_PUT, &bkey, sizeof(bkey), base, len, NULL, NULL);
+	free(base);
+	if (rc != 0 || cs->nr == 0)
+		return rc;
+
+	rc = m0_bufvec_alloc(&keys, cs->nr, sizeof(bkey));
+	if (rc != 0)
+		return rc;
+	for (i = 0; i < cs->nr; i++)
+		xattr_container_key_init(keys.ov_buf[i], cs->ino,
+					 cs->seqs[i]);
+
+	round_trips++;
+	rc = md_kvs_op(M0_IC_DEL, &keys, NULL, NULL, 0);
+	m0_bufvec_free(&keys);
+	return rc;
+}
+
+static int container_store(cfs_ino_t ino, const char *key, const char *value)
+{
+	struct xattr_delta *sets;
+	char (*names)[NAME_LEN];
+	struct xattr_container_key bkey;
+	void *base;
+	size_t len;
+	int rc, i;
+
+	sets = calloc(XATTRS, sizeof(*sets));
+	names = calloc(XATTRS, NAME_LEN);
+	if (sets == NULL || names == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(names[i], key, i);
+		sets[i].op = XATTR_DELTA_SET;
+		sets[i].name = names[i];
+		sets[i].nlen = strlen(names[i]);
+		sets[i].value = value;
+		sets[i].vlen = VALINPUT;
+	}
+
+	rc = xattr_container_merge(NULL, sets, XATTRS, &base, &len);
+	if (rc != 0)
+		goto out;
+
+	xattr_container_key_init(&bkey, ino, 0);
+	rc = kvs_op1(M0_IC_PUT, &bkey, sizeof(bkey), base, len, NULL, NULL);
+	free(base);
+
+	/* Writers continue from the loaded sequence */
+	if (rc == 0)
+		rc = container_load(ino);
+out:
+	free(names);
+	free(sets);
+	return rc;
+}
+
+/**
+ * Append a delta record, after merging the deltas already there if needed.
+ * container.next_seq is the writer state, cortxfs would keep it with the
+ * inode.
+ */
+static int container_update(cfs_ino_t ino, const struct xattr_delta *delta)
+{
+	struct container_state *cs = &container;
+	struct xattr_container_key dkey;
+	char buf[XATTR_DELTA_LEN(NAME_LEN, VALINPUT)];
+	int rc;
+
+	if (cs->nr + 1 >= XATTR_CONTAINER_MAX_DELTAS) {
+		rc = container_load(ino) ?: container_merge();
+		if (rc != 0)
+			return rc;
+		cs->nr = 0;
+	}
+
+	xattr_delta_encode(buf, delta);
+	xattr_container_key_init(&dkey, ino, cs->next_seq);
+	rc = kvs_op1(M0_IC_PUT, &dkey, sizeof(dkey), buf,
+		     XATTR_DELTA_LEN(delta->nlen, delta->vlen), NULL, NULL);
+	if (rc != 0)
+		return rc;
+
+	cs->next_seq++;
+	cs->nr++;
+	return 0;
+}
+
+static int container_set(cfs_ino_t ino, const char *name, const char *value)
+{
+	struct xattr_delta delta = {
+		.op = XATTR_DELTA_SET,
+		.name = name,
+		.nlen = strlen(name),
+		.value = value,
+		.vlen = VALINPUT,
+	};
+
+	return container_update(ino, &delta);
+}
+
+static int container_get(cfs_ino_t ino, const char *name, char *value,
+			 size_t *vlen)
+{
+	struct container_state *cs = &container;
+	size_t nlen = strlen(name), len;
+	const void *val;
+	int rc, i;
+
+	rc = container_load(ino);
+	if (rc != 0)
+		return rc;
+
+	rc = -ENODATA;
+	for (i = cs->nr - 1; i >= 0; i--) {
+		if (cs->deltas[i].nlen != nlen ||
+		    memcmp(cs->deltas[i].name, name, nlen) != 0)
+			continue;
+		if (cs->deltas[i].op == XATTR_DELTA_DEL)
+			return -ENODATA;
+		val = cs->deltas[i].value;
+		len = cs->deltas[i].vlen;
+		rc = 0;
+		break;
+	}
+
+	if (rc != 0 && cs->base != NULL)
+		rc = xattr_container_lookup(cs->base, name, nlen, &val, &len);
+	if (rc != 0)
+		return rc;
+
+	if (len > *vlen)
+		return -ERANGE;
+	memcpy(value, val, len);
+	*vlen = len;
+	return 0;
+}
+
+static int container_remove(cfs_ino_t ino, const char *name)
+{
+	struct xattr_delta delta = {
+		.op = XATTR_DELTA_DEL,
+		.name = name,
+		.nlen = strlen(name),
+	};
+
+	return container_update(ino, &delta);
+}
+
+/* Experiment */
+
+static const struct layout layouts[] = {
+	{ "keys", keys_store, keys_set, keys_get, keys_remove },
+	{ "json", json_store, json_set, json_get, json_remove },
+	{ "container", container_store, container_set, container_get,
+	  container_remove },
+};
+
+static void report(const char *layout, const char *msg,
+		   const struct timeval *start, unsigned long rts)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	printf("%-10s %-24s %8ld usecs, %5lu round trips\n", layout, msg,
+	       md_kvs_elapsed_us(start, &end), round_trips - rts);
+}
+
+static int layout_run(const struct layout *layout, cfs_ino_t ino,
+		      const char *key)
+{
+	/* Null-terminated for the json layout */
+	char value[VALINPUT + 1] = "";
+	char got[VALINPUT];
+	char name[NAME_LEN];
+	struct timeval start;
+	unsigned long rts;
+	size_t vlen;
+	int rc, i;
+
+	memset(value, '*', VALINPUT);
+	gettimeofday(&start, NULL);
+	rts = round_trips;
+	rc = layout->store(ino, key, value);
+	if (rc != 0)
+		goto err;
+	report(layout->name, "store 100 xattrs", &start, rts);
+
+	memset(value, '#', VALINPUT);
+	gettimeofday(&start, NULL);
+	rts = round_trips;
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(name, key, i);
+		rc = layout->set(ino, name, value);
+		if (rc != 0)
+			goto err;
+	}
+	report(layout->name, "setxattr x 100", &start, rts);
+
+	gettimeofday(&start, NULL);
+	rts = round_trips;
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(name, key, i);
+		vlen = sizeof(got);
+		rc = layout->get(ino, name, got, &vlen);
+		if (rc == 0 && (vlen != VALINPUT ||
+				memcmp(got, value, VALINPUT) != 0))
+			rc = -EINVAL;
+		if (rc != 0)
+			goto err;
+	}
+	report(layout->name, "getxattr x 100", &start, rts);
+
+	gettimeofday(&start, NULL);
+	rts = round_trips;
+	for (i = 0; i < XATTRS; i++) {
+		xattr_name(name, key, i);
+		rc = layout->remove(ino, name);
+		if (rc != 0)
+			goto err;
+	}
+	report(layout->name, "removexattr x 100", &start, rts);
+
+	/* Nothing must be left */
+	vlen = sizeof(got);
+	rc = layout->get(ino, name, got, &vlen);
+	if (rc != -ENODATA && rc != -ENOENT) {
+		rc = -EINVAL;
+		goto err;
+	}
+	return 0;
+
+err:
+	fprintf(stderr, "error(%d): %s layout\n", rc, layout->name);
+	return rc;
+}
+
+/**
+ * Remove what is left of the json blob and of the container.
+ */
+static int cleanup(cfs_ino_t ino)
+{
+	struct container_state *cs = &container;
+	struct md_stat_key skey;
+	struct m0_bufvec keys;
+	int rc, i, nr;
+
+	MD_STAT_KEY_INIT(&skey, ino);
+	rc = kvs_op1(M0_IC_DEL, &skey, sizeof(skey), NULL, 0, NULL, NULL);
+	if (rc != 0)
+		return rc;
+
+	rc = container_load(ino);
+	if (rc != 0)
+		return rc;
+
+	nr = cs->nr + (cs->base != NULL);
+	if (nr == 0)
+		return 0;
+
+	rc = m0_bufvec_alloc(&keys, nr, sizeof(struct xattr_container_key));
+	if (rc != 0)
+		return rc;
+	for (i = 0; i < cs->nr; i++)
+		xattr_container_key_init(keys.ov_buf[i], ino, cs->seqs[i]);
+	if (cs->base != NULL)
+		xattr_container_key_init(keys.ov_buf[i], ino, 0);
+
+	rc = md_kvs_op(M0_IC_DEL, &keys, NULL, NULL, 0);
+	m0_bufvec_free(&keys);
+	return rc;
+}
+
+static int xattr_compare(cfs_ino_t ino, const char *key)
+{
+	struct xattr_container_key start;
+	size_t i;
+	int rc;
+
+	xattr_container_key_init(&start, ino, 0);
+	rc = md_kvs_iter_init(&container.it, &start, sizeof(start),
+			      XATTR_CONTAINER_PREFIX_LEN,
+			      XATTR_CONTAINER_MAX_DELTAS + 1,
+			      sizeof(struct xattr_container_key), MAXVAL);
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+		rc = layout_run(&layouts[i], ino, key);
+		if (rc != 0)
+			break;
+	}
+
+	if (cleanup(ino) != 0 && rc == 0)
+		rc = -EIO;
+
+	md_kvs_iter_fini(&container.it);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	cfs_ino_t ino;
+	int rc = 0;
+
+	/* check input */
+	if (argc != 3) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s key ino\n", basename(argv[0]));
+		return -1;
+	}
+
+	ino = strtoull(argv[2], NULL, 0);
+	if (ino == 0 || strlen(argv[1]) > NAME_LEN - 8) {
+		fprintf(stderr, "invalid key or ino\n");
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources, no cluster needed in memory or redis */
+	if (!md_kvs_backend_is_local() && c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = md_kvs_init(MD_KVS_IDX_FID);
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		if (!md_kvs_backend_is_local())
+			c0appz_free();
+		return -3;
+	}
+
+	rc = xattr_compare(ino, argv[1]);
+
+	md_kvs_fini();
+
+	/* free resources*/
+	if (!md_kvs_backend_is_local())
+		c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0)
+		return -3;
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -0,0 +1,282 @@
+/*
+ * Filename:         xattr_container.c
+ * Description:      Binary per-inode xattr container with delta records
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include "xattr_container.h"
+
+/* Entry header: uint8_t nlen | uint32_t vlen */
+#define ENTRY_HDR 5
+
+struct merge_entry {
+	const char *name;
+	size_t nlen;
+	const void *value;
+	size_t vlen;
+	/* 0 for the base, 1 + index of the delta otherwise */
+	int order;
+	bool del;
+};
+
+static int name_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int rc = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (rc != 0)
+		return rc;
+	return alen < blen ? -1 : alen > blen;
+}
+
+static const struct xattr_container_hdr *hdr_of(const void *buf)
+{
+	return buf;
+}
+
+static uint32_t off_at(const void *buf, uint32_t i)
+{
+	uint32_t off;
+
+	memcpy(&off, (const char *)buf + sizeof(struct xattr_container_hdr) +
+	       i * sizeof(off), sizeof(off));
+	return off;
+}
+
+static void entry_at(const void *buf, uint32_t i, struct merge_entry *entry)
+{
+	const unsigned char *p = (const unsigned char *)buf + off_at(buf, i);
+	uint32_t vlen;
+
+	memcpy(&vlen, p + 1, sizeof(vlen));
+	entry->nlen = p[0];
+	entry->vlen = vlen;
+	entry->name = (const char *)p + ENTRY_HDR;
+	entry->value = entry->name + entry->nlen;
+	entry->order = 0;
+	entry->del = false;
+}
+
+void xattr_container_key_init(struct xattr_container_key *key,
+			      unsigned long long int ino, uint64_t seq)
+{
+	key->ino = ino;
+	key->type = XATTR_CONTAINER_KEY_TYPE;
+	key->seq = htobe64(seq);
+}
+
+uint64_t xattr_container_key_seq(const struct xattr_container_key *key)
+{
+	return be64toh(key->seq);
+}
+
+int xattr_container_check(const void *buf, size_t len)
+{
+	const struct xattr_container_hdr *hdr = hdr_of(buf);
+	const unsigned char *p;
+	size_t table_end;
+	uint32_t i, off, vlen;
+
+	if (len < sizeof(*hdr) || hdr->magic != XATTR_CONTAINER_MAGIC ||
+	    hdr->len != len)
+		return -EINVAL;
+
+	table_end = sizeof(*hdr) + (size_t)hdr->count * sizeof(uint32_t);
+	if (table_end > len)
+		return -EINVAL;
+
+	for (i = 0; i < hdr->count; i++) {
+		off = off_at(buf, i);
+		if (off < table_end || off + ENTRY_HDR > len)
+			return -EINVAL;
+		p = (const unsigned char *)buf + off;
+		memcpy(&vlen, p + 1, sizeof(vlen));
+		if (off + ENTRY_HDR + p[0] + (size_t)vlen > len)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+uint32_t xattr_container_count(const void *buf)
+{
+	return hdr_of(buf)->count;
+}
+
+int xattr_container_lookup(const void *buf, const char *name, size_t nlen,
+			   const void **value, size_t *vlen)
+{
+	struct merge_entry entry;
+	uint32_t lo = 0, hi = hdr_of(buf)->count, mid;
+	int rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		entry_at(buf, mid, &entry);
+		rc = name_cmp(name, nlen, entry.name, entry.nlen);
+		if (rc == 0) {
+			*value = entry.value;
+			*vlen = entry.vlen;
+			return 0;
+		}
+		if (rc < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return -ENODATA;
+}
+
+void xattr_delta_encode(void *buf, const struct xattr_delta *delta)
+{
+	unsigned char *p = buf;
+
+	p[0] = delta->op;
+	p[1] = delta->nlen;
+	memcpy(p + XATTR_DELTA_HDR, delta->name, delta->nlen);
+	if (delta->op == XATTR_DELTA_SET)
+		memcpy(p + XATTR_DELTA_HDR + delta->nlen, delta->value,
+		       delta->vlen);
+}
+
+int xattr_delta_decode(const void *buf, size_t len,
+		       struct xattr_delta *delta)
+{
+	const unsigned char *p = buf;
+
+	if (len < XATTR_DELTA_HDR || len < (size_t)XATTR_DELTA_LEN(p[1], 0) ||
+	    (p[0] != XATTR_DELTA_SET && p[0] != XATTR_DELTA_DEL))
+		return -EINVAL;
+
+	delta->op = p[0];
+	delta->nlen = p[1];
+	delta->name = (const char *)p + XATTR_DELTA_HDR;
+	delta->value = delta->name + delta->nlen;
+	delta->vlen = len - XATTR_DELTA_LEN(delta->nlen, 0);
+
+	return 0;
+}
+
+/* By name, newest first */
+static int merge_entry_cmp(const void *a, const void *b)
+{
+	const struct merge_entry *ea = a;
+	const struct merge_entry *eb = b;
+	int rc;
+
+	rc = name_cmp(ea->name, ea->nlen, eb->name, eb->nlen);
+	return rc != 0 ? rc : eb->order - ea->order;
+}
+
+int xattr_container_merge(const void *base, const struct xattr_delta *deltas,
+			  uint32_t nr, void **out, size_t *out_len)
+{
+	struct xattr_container_hdr *hdr;
+	struct merge_entry *entries;
+	unsigned char *p;
+	uint32_t base_nr = base != NULL ? hdr_of(base)->count : 0;
+	uint32_t total = base_nr + nr, count = 0, kept, i, vlen, off;
+	size_t len;
+	int rc = 0;
+
+	entries = calloc(total > 0 ? total : 1, sizeof(*entries));
+	if (entries == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < base_nr; i++)
+		entry_at(base, i, &entries[i]);
+
+	for (i = 0; i < nr; i++) {
+		if (deltas[i].nlen == 0 || deltas[i].nlen > UINT8_MAX ||
+		    deltas[i].vlen > UINT32_MAX) {
+			rc = -EINVAL;
+			goto out;
+		}
+		entries[base_nr + i].name = deltas[i].name;
+		entries[base_nr + i].nlen = deltas[i].nlen;
+		entries[base_nr + i].value = deltas[i].value;
+		entries[base_nr + i].vlen = deltas[i].vlen;
+		entries[base_nr + i].order = i + 1;
+		entries[base_nr + i].del = deltas[i].op == XATTR_DELTA_DEL;
+	}
+
+	qsort(entries, total, sizeof(*entries), merge_entry_cmp);
+
+	/* Keep the newest version of each name, unless it is a deletion */
+	len = sizeof(*hdr);
+	for (kept = 0, i = 0; i < total; i++) {
+		if (i > 0 && name_cmp(entries[i].name, entries[i].nlen,
+				      entries[i - 1].name,
+				      entries[i - 1].nlen) == 0)
+			continue;
+		if (entries[i].del)
+			continue;
+		entries[kept++] = entries[i];
+		len += sizeof(uint32_t) + ENTRY_HDR + entries[i].nlen +
+			entries[i].vlen;
+	}
+	count = kept;
+
+	if (len > UINT32_MAX) {
+		rc = -EFBIG;
+		goto out;
+	}
+
+	hdr = malloc(len);
+	if (hdr == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	hdr->magic = XATTR_CONTAINER_MAGIC;
+	hdr->count = count;
+	hdr->len = len;
+
+	off = sizeof(*hdr) + count * sizeof(uint32_t);
+	for (i = 0; i < count; i++) {
+		memcpy((char *)hdr + sizeof(*hdr) + i * sizeof(off), &off,
+		       sizeof(off));
+		p = (unsigned char *)hdr + off;
+		vlen = entries[i].vlen;
+		p[0] = entries[i].nlen;
+		memcpy(p + 1, &vlen, sizeof(vlen));
+		memcpy(p + ENTRY_HDR, entries[i].name, entries[i].nlen);
+		memcpy(p + ENTRY_HDR + entries[i].nlen, entries[i].value,
+		       entries[i].vlen);
+		off += ENTRY_HDR + entries[i].nlen + entries[i].vlen;
+	}
+
+	*out = hdr;
+	*out_len = len;
+
+out:
+	free(entries);
+	return rc;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
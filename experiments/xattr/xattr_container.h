@@ -0,0 +1,126 @@
+/*
+ * Filename:         xattr_container.h
+ * Description:      Binary per-inode xattr container with delta records
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* All the xattrs of an inode in one binary record (approach4.c), replacing
+ * the JSON blob of approach2.c.
+ *
+ * Base record, key {ino, XATTR_CONTAINER_KEY_TYPE, seq 0}:
+ *   struct xattr_container_hdr
+ *   uint32_t offs[count]     offsets of the entries, sorted by name
+ *   entries                  uint8_t nlen | uint32_t vlen | name | value
+ * A lookup is a binary search over offs, nothing is parsed.
+ *
+ * Updates do not rewrite the base: each setxattr/removexattr PUTs a small
+ * delta record (struct xattr_delta) under the next sequence number. The
+ * keys of an inode share a XATTR_CONTAINER_PREFIX_LEN prefix and a single
+ * NEXT returns the base followed by its deltas, oldest first; the newest
+ * delta of a name wins over older ones and over the base.
+ * Once an inode has XATTR_CONTAINER_MAX_DELTAS deltas they are merged into
+ * a new base (xattr_container_merge()) and removed. Merges of an inode must
+ * be serialized, cortxfs holds the inode lock for that.
+ *
+ * All integers are in host order except the seq of keys, big-endian so
+ * that records sort by sequence.
+ */
+
+#ifndef _XATTR_CONTAINER_H
+#define _XATTR_CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define XATTR_CONTAINER_KEY_TYPE 'C'
+#define XATTR_CONTAINER_MAGIC 0x58415443
+/* Deltas kept before they are merged into the base */
+#define XATTR_CONTAINER_MAX_DELTAS 16
+
+struct xattr_container_key {
+	unsigned long long int ino;
+	char type;
+	/* Big-endian, 0 for the base record */
+	uint64_t seq;
+} __attribute((packed));
+
+#define XATTR_CONTAINER_PREFIX_LEN offsetof(struct xattr_container_key, seq)
+
+struct xattr_container_hdr {
+	uint32_t magic;
+	uint32_t count;
+	/* Length of the whole record */
+	uint32_t len;
+} __attribute((packed));
+
+enum xattr_delta_op {
+	XATTR_DELTA_SET = 1,
+	XATTR_DELTA_DEL = 2,
+};
+
+/* Decoded delta record, name and value point into the record */
+struct xattr_delta {
+	enum xattr_delta_op op;
+	const char *name;
+	size_t nlen;
+	const void *value;
+	size_t vlen;
+};
+
+/* Encoded delta record: uint8_t op | uint8_t nlen | name | value */
+#define XATTR_DELTA_HDR 2
+#define XATTR_DELTA_LEN(nlen, vlen) (XATTR_DELTA_HDR + (nlen) + (vlen))
+
+void xattr_container_key_init(struct xattr_container_key *key,
+			      unsigned long long int ino, uint64_t seq);
+
+uint64_t xattr_container_key_seq(const struct xattr_container_key *key);
+
+/**
+ * Check that buf holds a well-formed base record of len bytes.
+ */
+int xattr_container_check(const void *buf, size_t len);
+
+/**
+ * Binary search of name in a checked base record.
+ * Return -ENODATA if it is not there.
+ */
+int xattr_container_lookup(const void *buf, const char *name, size_t nlen,
+			   const void **value, size_t *vlen);
+
+/**
+ * Number of xattrs of a checked base record.
+ */
+uint32_t xattr_container_count(const void *buf);
+
+/**
+ * Encode a delta into buf, XATTR_DELTA_LEN(nlen, vlen) bytes long.
+ */
+void xattr_delta_encode(void *buf, const struct xattr_delta *delta);
+
+int xattr_delta_decode(const void *buf, size_t len,
+		       struct xattr_delta *delta);
+
+/**
+ * Apply nr deltas, oldest first, to base (NULL for none) and encode the
+ * result as a new base record, allocated with malloc(), in *out.
+ * With no base, this builds a container from a list of XATTR_DELTA_SET.
+ */
+int xattr_container_merge(const void *base, const struct xattr_delta *deltas,
+			  uint32_t nr, void **out, size_t *out_len);
+
+#endif /* _XATTR_CONTAINER_H */
@@ -0,0 +1,192 @@
+/*
+ * Filename:         xattr_inline.c
+ * Description:      Small xattrs stored inline in the inode stat record
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "xattr_inline.h"
+
+struct xattr_inline_entry {
+	size_t off;
+	size_t nlen;
+	size_t vlen;
+	const char *name;
+	const char *value;
+};
+
+static size_t entry_len(const struct xattr_inline_entry *entry)
+{
+	return XATTR_INLINE_ENTRY_HDR + entry->nlen + entry->vlen;
+}
+
+/* Decode the entry at off, false at the end of the area or if corrupted */
+static bool entry_decode(const struct xattr_inline_rec *rec, size_t off,
+			 struct xattr_inline_entry *entry)
+{
+	const unsigned char *p = (const unsigned char *)rec->data + off;
+	uint16_t vlen;
+
+	if (off + XATTR_INLINE_ENTRY_HDR > rec->len)
+		return false;
+
+	memcpy(&vlen, p + 1, sizeof(vlen));
+	entry->off = off;
+	entry->nlen = p[0];
+	entry->vlen = vlen;
+	entry->name = (const char *)p + XATTR_INLINE_ENTRY_HDR;
+	entry->value = entry->name + entry->nlen;
+
+	return off + entry_len(entry) <= rec->len;
+}
+
+static bool entry_find(const struct xattr_inline_rec *rec, const char *name,
+		       size_t nlen, struct xattr_inline_entry *entry)
+{
+	size_t off = 0;
+
+	while (entry_decode(rec, off, entry)) {
+		if (entry->nlen == nlen && memcmp(entry->name, name, nlen) == 0)
+			return true;
+		off += entry_len(entry);
+	}
+
+	return false;
+}
+
+void xattr_inline_init(struct xattr_inline_rec *rec, const struct stat *st)
+{
+	rec->st = *st;
+	rec->len = 0;
+	rec->count = 0;
+	rec->flags = 0;
+}
+
+size_t xattr_inline_rec_len(const struct xattr_inline_rec *rec)
+{
+	return XATTR_INLINE_REC_LEN(rec->len);
+}
+
+int xattr_inline_decode(struct xattr_inline_rec *rec, const void *buf,
+			size_t len)
+{
+	if (len == sizeof(struct stat)) {
+		xattr_inline_init(rec, buf);
+		rec->flags = XATTR_INLINE_SPILLED;
+		return 0;
+	}
+
+	if (len < XATTR_INLINE_REC_LEN(0) || len > sizeof(*rec))
+		return -EINVAL;
+
+	memcpy(rec, buf, len);
+	if (xattr_inline_rec_len(rec) != len)
+		return -EINVAL;
+
+	return 0;
+}
+
+int xattr_inline_get(const struct xattr_inline_rec *rec, const char *name,
+		     size_t nlen, void *value, size_t *size)
+{
+	struct xattr_inline_entry entry;
+
+	if (!entry_find(rec, name, nlen, &entry))
+		return -ENODATA;
+
+	if (value != NULL) {
+		if (*size < entry.vlen)
+			return -ERANGE;
+		memcpy(value, entry.value, entry.vlen);
+	}
+
+	*size = entry.vlen;
+	return 0;
+}
+
+int xattr_inline_remove(struct xattr_inline_rec *rec, const char *name,
+			size_t nlen)
+{
+	struct xattr_inline_entry entry;
+	size_t len, end;
+
+	if (!entry_find(rec, name, nlen, &entry))
+		return -ENODATA;
+
+	len = entry_len(&entry);
+	end = entry.off + len;
+	memmove(rec->data + entry.off, rec->data + end, rec->len - end);
+	rec->len -= len;
+	rec->count--;
+
+	return 0;
+}
+
+int xattr_inline_set(struct xattr_inline_rec *rec, const char *name,
+		     size_t nlen, const void *value, size_t vlen)
+{
+	unsigned char *p;
+	uint16_t len16 = vlen;
+
+	if (nlen == 0 || nlen > UINT8_MAX)
+		return -EINVAL;
+
+	/* Replaced values are appended again, whatever their new size */
+	xattr_inline_remove(rec, name, nlen);
+
+	if (vlen > XATTR_INLINE_VALUE_MAX || rec->count == UINT8_MAX ||
+	    rec->len + XATTR_INLINE_ENTRY_HDR + nlen + vlen > XATTR_INLINE_AREA)
+		return -EFBIG;
+
+	p = (unsigned char *)rec->data + rec->len;
+	p[0] = nlen;
+	memcpy(p + 1, &len16, sizeof(len16));
+	memcpy(p + XATTR_INLINE_ENTRY_HDR, name, nlen);
+	memcpy(p + XATTR_INLINE_ENTRY_HDR + nlen, value, vlen);
+	rec->len += XATTR_INLINE_ENTRY_HDR + nlen + vlen;
+	rec->count++;
+
+	return 0;
+}
+
+bool xattr_inline_next(const struct xattr_inline_rec *rec, size_t *pos,
+		       const char **name, size_t *nlen, const void **value,
+		       size_t *vlen)
+{
+	struct xattr_inline_entry entry;
+
+	if (!entry_decode(rec, *pos, &entry))
+		return false;
+
+	*name = entry.name;
+	*nlen = entry.nlen;
+	*value = entry.value;
+	*vlen = entry.vlen;
+	*pos += entry_len(&entry);
+
+	return true;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
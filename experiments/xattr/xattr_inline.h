@@ -0,0 +1,116 @@
+/*
+ * Filename:         xattr_inline.h
+ * Description:      Small xattrs stored inline in the inode stat record
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Small xattrs live in the stat record of their inode, after the struct
+ * stat, so that the GET done by getattr also brings them (approach3.c).
+ *
+ * Inline area: a sequence of entries, each one
+ *   uint8_t nlen | uint16_t vlen | name (nlen bytes) | value (vlen bytes)
+ * Only the used part of the area is stored: an inode without inline xattrs
+ * costs XATTR_INLINE_REC_LEN(0) bytes, 4 more than a bare struct stat.
+ *
+ * Values longer than XATTR_INLINE_VALUE_MAX, or xattrs that no longer fit in
+ * the area, are spilled to their own version 2 key (xattr_key.h) and the
+ * record is flagged with XATTR_INLINE_SPILLED. Without that flag a name
+ * that is not inline does not exist: no other lookup is needed.
+ *
+ * A record holding just a struct stat (written before this format) has no
+ * inline xattrs and is decoded as XATTR_INLINE_SPILLED, its xattrs being
+ * all in per-key records.
+ */
+
+#ifndef _XATTR_INLINE_H
+#define _XATTR_INLINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/* Largest value kept inline */
+#define XATTR_INLINE_VALUE_MAX 256
+/* Room for the inline xattrs of an inode */
+#define XATTR_INLINE_AREA 1024
+
+/* Some xattrs of the inode may be stored in per-key records */
+#define XATTR_INLINE_SPILLED 0x01
+
+struct xattr_inline_rec {
+	struct stat st;
+	/* Bytes used in data */
+	uint16_t len;
+	uint8_t count;
+	uint8_t flags;
+	char data[XATTR_INLINE_AREA];
+} __attribute((packed));
+
+#define XATTR_INLINE_REC_LEN(area_len) \
+	(offsetof(struct xattr_inline_rec, data) + (area_len))
+
+/* Entry header size, see the format above */
+#define XATTR_INLINE_ENTRY_HDR 3
+
+/**
+ * Start a record with no xattr for st.
+ */
+void xattr_inline_init(struct xattr_inline_rec *rec, const struct stat *st);
+
+/**
+ * Number of bytes of rec to store.
+ */
+size_t xattr_inline_rec_len(const struct xattr_inline_rec *rec);
+
+/**
+ * Decode a stat record value of len bytes, in either format.
+ * Return -EINVAL if it is none of them.
+ */
+int xattr_inline_decode(struct xattr_inline_rec *rec, const void *buf,
+			size_t len);
+
+/**
+ * Copy the value of xattr name into value, *size bytes available.
+ * Return 0 and the value length in *size, -ERANGE if it does not fit or
+ * -ENODATA if the xattr is not inline. A NULL value only returns the size.
+ */
+int xattr_inline_get(const struct xattr_inline_rec *rec, const char *name,
+		     size_t nlen, void *value, size_t *size);
+
+/**
+ * Add or replace xattr name. Return -EFBIG when the value is too large to be
+ * inline or does not fit in the area: the caller must spill it, any inline
+ * copy of it has then been removed.
+ */
+int xattr_inline_set(struct xattr_inline_rec *rec, const char *name,
+		     size_t nlen, const void *value, size_t vlen);
+
+/**
+ * Remove xattr name, return -ENODATA if it is not inline.
+ */
+int xattr_inline_remove(struct xattr_inline_rec *rec, const char *name,
+			size_t nlen);
+
+/**
+ * Iterate over the inline xattrs: *pos starts at 0. Return false at the end.
+ * name and value point into rec, name is not null-terminated.
+ */
+bool xattr_inline_next(const struct xattr_inline_rec *rec, size_t *pos,
+		       const char **name, size_t *nlen, const void **value,
+		       size_t *vlen);
+
+#endif /* _XATTR_INLINE_H */
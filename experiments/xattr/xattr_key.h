@@ -0,0 +1,120 @@
+/*
+ * Filename:         xattr_key.h
+ * Description:      On-disk formats of the xattr keys
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+#ifndef _XATTR_KEY_H
+#define _XATTR_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#define XATTR_KEY_TYPE '7'
+#define XATTR_NAME_LEN_MAX 255
+
+/* Version 1: name zero-padded to 256 bytes, every key is 265 bytes long */
+struct cortxfs_xattr{
+	unsigned long long int ino;
+	char type;
+	char name[256];
+}__attribute((packed));
+
+/* All the xattr keys of an inode, of both versions, share this prefix */
+#define XATTR_KEY_PREFIX_LEN offsetof(struct cortxfs_xattr, name)
+
+#define XATTR_KEY_INIT(key, ino2, xname)	\
+{						\
+	key->ino = ino2;			\
+	key->type = XATTR_KEY_TYPE;		\
+	memset(key->name, 0, 256);		\
+	memcpy(key->name, xname, strlen(xname));\
+}
+
+/* Version 2: version tag followed by a length-prefixed, unpadded name.
+ * "user.a" takes 17 bytes instead of 265.
+ *
+ * The version byte sits where a version 1 key has the first character of
+ * the name, XATTR_KEY_V2 is not a valid character there. Together with the
+ * length byte this tells both formats apart, see xattr_key_is_v2().
+ *
+ * All the version 2 keys of an inode share a XATTR_KEY_V2_PREFIX_LEN prefix
+ * and sort before its version 1 keys.
+ */
+#define XATTR_KEY_V2 0x02
+
+struct cortxfs_xattr_v2 {
+	unsigned long long int ino;
+	char type;
+	uint8_t version;
+	uint8_t nlen;
+	char name[XATTR_NAME_LEN_MAX];
+} __attribute((packed));
+
+#define XATTR_KEY_V2_PREFIX_LEN offsetof(struct cortxfs_xattr_v2, nlen)
+#define XATTR_KEY_V2_LEN(name_len) \
+	(offsetof(struct cortxfs_xattr_v2, name) + (name_len))
+
+/**
+ * Encode a version 2 key, return its length or -ENAMETOOLONG.
+ */
+static inline int xattr_key_v2_init(struct cortxfs_xattr_v2 *key,
+				    unsigned long long int ino,
+				    const char *name, size_t nlen)
+{
+	if (nlen > XATTR_NAME_LEN_MAX)
+		return -ENAMETOOLONG;
+
+	key->ino = ino;
+	key->type = XATTR_KEY_TYPE;
+	key->version = XATTR_KEY_V2;
+	key->nlen = nlen;
+	memcpy(key->name, name, nlen);
+
+	return XATTR_KEY_V2_LEN(nlen);
+}
+
+static inline bool xattr_key_is_v2(const void *buf, size_t len)
+{
+	const struct cortxfs_xattr_v2 *key = buf;
+
+	return len >= XATTR_KEY_V2_LEN(0) && key->type == XATTR_KEY_TYPE &&
+		key->version == XATTR_KEY_V2 &&
+		len == XATTR_KEY_V2_LEN(key->nlen);
+}
+
+static inline bool xattr_key_is_v1(const void *buf, size_t len)
+{
+	const struct cortxfs_xattr *key = buf;
+
+	return len == sizeof(struct cortxfs_xattr) &&
+		key->type == XATTR_KEY_TYPE && !xattr_key_is_v2(buf, len);
+}
+
+/**
+ * Convert a version 1 key into a version 2 one, return the new key length.
+ */
+static inline int xattr_key_v1_to_v2(const struct cortxfs_xattr *old,
+				     struct cortxfs_xattr_v2 *key)
+{
+	return xattr_key_v2_init(key, old->ino, old->name,
+				 strnlen(old->name, sizeof(old->name)));
+}
+
+#endif /* _XATTR_KEY_H */
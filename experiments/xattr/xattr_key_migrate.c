@@ -0,0 +1,467 @@
+/*
+ * Filename:         xattr_key_migrate.c
+ * Description:      Online migration of xattr keys to the version 2 format
+ *
+ * Copyright (c) 2020 Seagate Technology LLC and/or its Affiliates
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * For any questions about this software or licensing,
+ * please email opensource@seagate.com or cortx-questions@seagate.com.
+ */
+
+/* Rewrites every version 1 xattr key (struct cortxfs_xattr, 265 bytes) of
+ * the index as a version 2 key (struct cortxfs_xattr_v2), see xattr_key.h.
+ *
+ * The index is scanned with NEXT; for each batch the converted records are
+ * PUT, the old keys are read again and then deleted. The tool runs online:
+ * while it may run, clients of the index must
+ * - write both keys of an xattr (approach1.c built with
+ *   -DXATTR_KEY_MIGRATION),
+ * - read the version 2 key first and fall back to the version 1 key,
+ * - remove both keys of an xattr,
+ * and once it has run, clients go back to writing version 2 keys only.
+ *
+ * None of the steps is atomic with the xattr operations of cortxfs:
+ * - A version 2 key that already exists was written by a client after the
+ *   old one, so it is kept (the PUT is done without M0_OIF_OVERWRITE) and
+ *   only the old key is removed.
+ * - A removexattr landing between the NEXT and the PUT would be undone by
+ *   the PUT. Its old key is gone when read again after the PUT, and the
+ *   copy just made is deleted. A removexattr after that read deletes the
+ *   copy itself.
+ * - A setxattr after such a removexattr writes the old key again, the copy
+ *   is then not deleted but overwritten.
+ * New keys of an inode sort before its old ones, that is before the scan
+ * position, and are never visited twice. The tool can be interrupted and
+ * restarted at any time.
+ *
+ * Usage: xattr_key_migrate [-n] [-b batch]
+ *   -n  dry run, only count the keys to migrate
+ *   -b  records per NEXT (default MIGRATE_BATCH)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <getopt.h>
+#include "c0appz.h"
+#include "helpers/helpers.h"
+#include "motr/client.h"
+#include "motr/client_internal.h"
+#include "motr/idx.h"
+#include "lib/thread.h"
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include "xattr_key.h"
+#include "../kvstore/kvs_vec.h"
+
+#define MIGRATE_BATCH 100
+/* Any key of the index must fit, dentry keys included */
+#define KLEN_MAX 1024
+/* Values of the shared index go up to the approach2 JSON blobs */
+#define VLEN_MAX 70000
+
+struct migrate_stats {
+	unsigned long long scanned;
+	unsigned long long old_keys;
+	unsigned long long migrated;
+	unsigned long long already_new;
+	/* Copies deleted, their xattr was removed during the migration */
+	unsigned long long undone;
+	unsigned long long old_bytes;
+	unsigned long long new_bytes;
+};
+
+static struct m0_fid ifid;
+static struct m0_ufid_generator cortxfs_ufid_generator;
+static struct m0_idx idx;
+
+void timer(struct timeval start1, struct timeval end1, char *msg)
+{
+	long mtime, secs, usecs;
+	secs  = end1.tv_sec  - start1.tv_sec;
+	usecs = end1.tv_usec - start1.tv_usec;
+	mtime = ((secs) * 1000 + usecs/1000.0) + 0.5;
+	printf("Elapsed time for %s: %ld millisecs\n", msg, mtime);
+}
+
+static int m0_op_kvs(enum m0_idx_opcode opcode, struct m0_bufvec *key,
+		     struct m0_bufvec *val, int *rcs, uint32_t flags)
+{
+	struct m0_op *op = NULL;
+	int rc;
+
+	rc = m0_idx_op(&idx, opcode, key, val, rcs, flags, &op);
+	if (rc) {
+		printf("\nerror(%d): m0_idx_op", rc);
+		return rc;
+	}
+
+	m0_op_launch(&op, 1);
+	rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE, M0_OS_FAILED),
+			M0_TIME_NEVER);
+	if (rc == 0)
+		rc = m0_rc(op);
+	if (rc)
+		printf("\nerror(%d): m0_op_wait", rc);
+
+	m0_op_fini(op);
+	m0_op_free(op);
+	return rc;
+}
+
+int set_fid()
+{
+	char tmpfid[255];
+	int rc = 0;
+
+	memset(&ifid, 0, sizeof(struct m0_fid));
+	rc = m0_fid_sscanf("<0x780000000000000b:1>", &ifid);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to read ifid value from conf\n");
+		goto err_exit;
+	}
+
+	rc = m0_fid_print(tmpfid, 255, &ifid);
+	if (rc < 0) {
+		fprintf(stderr, "Failed to read ifid value from conf\n");
+		goto err_exit;
+	}
+
+	m0_idx_init(&idx, &motr_container.co_realm,
+		    (struct m0_uint128 *)&ifid);
+
+	rc = m0_ufid_init(motr_instance, &cortxfs_ufid_generator);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to initialise fid generator: %d\n", rc);
+		goto err_exit;
+	}
+
+	return 0;
+
+err_exit:
+	return rc;
+}
+
+/**
+ * Read the n old_keys again after the PUT of their new_keys, and delete the
+ * new keys created (created[i]) for old keys removed since the NEXT.
+ */
+static int removed_undo(struct m0_bufvec *old_keys, struct m0_bufvec *new_keys,
+			const bool *created, uint32_t n, int *rcs,
+			struct migrate_stats *stats)
+{
+	void *vbuf[n], *undo_buf[n];
+	m0_bcount_t vcnt[n], undo_cnt[n];
+	struct m0_bufvec vals;
+	struct m0_bufvec undo;
+	uint32_t i, nr = 0;
+	int rc;
+
+	kvs_vec_borrow(&vals, vbuf, vcnt, n);
+	rc = m0_op_kvs(M0_IC_GET, old_keys, &vals, rcs, 0);
+	kvs_vec_release(&vals);
+	if (rc != 0)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		if (rcs[i] == 0 || !created[i])
+			continue;
+		if (rcs[i] != -ENOENT) {
+			fprintf(stderr, "error(%d): GET of an old key\n", rcs[i]);
+			return rcs[i];
+		}
+		undo_buf[nr] = new_keys->ov_buf[i];
+		undo_cnt[nr] = new_keys->ov_vec.v_count[i];
+		nr++;
+	}
+	if (nr == 0)
+		return 0;
+
+	kvs_vec_wrap(&undo, undo_buf, undo_cnt, nr);
+	rc = m0_op_kvs(M0_IC_DEL, &undo, NULL, rcs, 0);
+	for (i = 0; rc == 0 && i < nr; i++)
+		/* Removed by the client as well */
+		if (rcs[i] != 0 && rcs[i] != -ENOENT)
+			rc = rcs[i];
+	if (rc == 0) {
+		stats->migrated -= nr;
+		stats->undone += nr;
+	}
+
+	return rc;
+}
+
+/**
+ * Migrate the old keys found in one NEXT batch.
+ * put/del are views on the NEXT buffers and on new_keys, no value is copied.
+ */
+static int migrate_batch(struct m0_bufvec *keys, struct m0_bufvec *vals,
+			 uint32_t nr, struct cortxfs_xattr_v2 *new_keys,
+			 int *rcs, bool dry_run, struct migrate_stats *stats)
+{
+	void *put_kbuf[nr], *put_vbuf[nr], *del_buf[nr];
+	m0_bcount_t put_kcnt[nr], put_vcnt[nr], del_cnt[nr];
+	bool created[nr];
+	struct m0_bufvec put_keys = {
+		.ov_vec = { .v_nr = 0, .v_count = put_kcnt },
+		.ov_buf = put_kbuf,
+	};
+	struct m0_bufvec put_vals = {
+		.ov_vec = { .v_nr = 0, .v_count = put_vcnt },
+		.ov_buf = put_vbuf,
+	};
+	struct m0_bufvec del_keys = {
+		.ov_vec = { .v_nr = 0, .v_count = del_cnt },
+		.ov_buf = del_buf,
+	};
+	uint32_t i, n = 0;
+	int len, rc;
+
+	for (i = 0; i < nr; i++) {
+		if (!xattr_key_is_v1(keys->ov_buf[i], keys->ov_vec.v_count[i]))
+			continue;
+
+		len = xattr_key_v1_to_v2(keys->ov_buf[i], &new_keys[n]);
+		if (len < 0) {
+			fprintf(stderr, "skipping key with invalid name\n");
+			continue;
+		}
+
+		stats->old_keys++;
+		stats->old_bytes += keys->ov_vec.v_count[i];
+		stats->new_bytes += len;
+
+		put_kbuf[n] = &new_keys[n];
+		put_kcnt[n] = len;
+		put_vbuf[n] = vals->ov_buf[i];
+		put_vcnt[n] = vals->ov_vec.v_count[i];
+		del_buf[n] = keys->ov_buf[i];
+		del_cnt[n] = keys->ov_vec.v_count[i];
+		n++;
+	}
+
+	if (n == 0 || dry_run)
+		return 0;
+
+	put_keys.ov_vec.v_nr = n;
+	put_vals.ov_vec.v_nr = n;
+	rc = m0_op_kvs(M0_IC_PUT, &put_keys, &put_vals, rcs, 0);
+	if (rc != 0)
+		return rc;
+
+	/* Only drop the old keys that now have a version 2 copy */
+	for (i = 0; i < n; i++) {
+		created[i] = rcs[i] == 0;
+		if (rcs[i] == -EEXIST) {
+			stats->already_new++;
+		} else if (rcs[i] != 0) {
+			fprintf(stderr, "error(%d): PUT of a new key\n", rcs[i]);
+			return rcs[i];
+		} else {
+			stats->migrated++;
+		}
+	}
+
+	del_keys.ov_vec.v_nr = n;
+	rc = removed_undo(&del_keys, &put_keys, created, n, rcs, stats);
+	if (rc != 0)
+		return rc;
+
+	rc = m0_op_kvs(M0_IC_DEL, &del_keys, NULL, rcs, 0);
+	for (i = 0; rc == 0 && i < n; i++)
+		/* Deleted by a client in the meantime */
+		if (rcs[i] != 0 && rcs[i] != -ENOENT)
+			rc = rcs[i];
+
+	return rc;
+}
+
+static int migrate(uint32_t batch, bool dry_run, struct migrate_stats *stats)
+{
+	struct m0_bufvec keys;
+	struct m0_bufvec vals;
+	struct cortxfs_xattr_v2 *new_keys = NULL;
+	struct m0_op *op = NULL;
+	int *rcs = NULL;
+	uint32_t flags = 0;
+	uint32_t i, nr;
+	int rc;
+
+	rc = m0_bufvec_alloc(&keys, batch, KLEN_MAX);
+	if (rc != 0)
+		return rc;
+
+	rc = m0_bufvec_alloc(&vals, batch, VLEN_MAX);
+	if (rc != 0)
+		goto free_keys;
+
+	M0_ALLOC_ARR(rcs, batch);
+	M0_ALLOC_ARR(new_keys, batch);
+	if (rcs == NULL || new_keys == NULL) {
+		rc = -ENOMEM;
+		goto free_vals;
+	}
+
+	/* Smallest possible key, the scan covers the whole index */
+	memset(keys.ov_buf[0], 0, 1);
+	keys.ov_vec.v_count[0] = 1;
+
+	do {
+		for (i = 0; i < batch; i++) {
+			if (i > 0)
+				keys.ov_vec.v_count[i] = KLEN_MAX;
+			vals.ov_vec.v_count[i] = VLEN_MAX;
+			rcs[i] = 0;
+		}
+
+		rc = m0_idx_op(&idx, M0_IC_NEXT, &keys, &vals, rcs, flags,
+			       &op);
+		if (rc != 0)
+			break;
+
+		m0_op_launch(&op, 1);
+		rc = m0_op_wait(op, M0_BITS(M0_OS_STABLE, M0_OS_FAILED),
+				M0_TIME_NEVER);
+		if (rc == 0)
+			rc = m0_rc(op);
+		m0_op_fini(op);
+		m0_op_free(op);
+		op = NULL;
+		if (rc != 0) {
+			printf("\nerror(%d): NEXT", rc);
+			break;
+		}
+
+		for (nr = 0; nr < batch && rcs[nr] == 0; nr++)
+			;
+		stats->scanned += nr;
+		if (nr == 0)
+			break;
+
+		rc = migrate_batch(&keys, &vals, nr, new_keys, rcs, dry_run,
+				   stats);
+		if (rc != 0)
+			break;
+
+		flags = M0_OIF_EXCLUDE_START_KEY;
+		memmove(keys.ov_buf[0], keys.ov_buf[nr - 1],
+			keys.ov_vec.v_count[nr - 1]);
+		keys.ov_vec.v_count[0] = keys.ov_vec.v_count[nr - 1];
+	} while (nr == batch);
+
+free_vals:
+	m0_free(new_keys);
+	m0_free(rcs);
+	m0_bufvec_free(&vals);
+free_keys:
+	m0_bufvec_free(&keys);
+	return rc;
+}
+
+/* main */
+int main(int argc, char **argv)
+{
+	struct migrate_stats stats = { 0 };
+	struct timeval start1, end1;
+	uint32_t batch = MIGRATE_BATCH;
+	bool dry_run = false;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "nb:")) != -1) {
+		switch (opt) {
+		case 'n':
+			dry_run = true;
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		default:
+			batch = 0;
+			break;
+		}
+	}
+
+	if (batch == 0 || optind != argc) {
+		fprintf(stderr, "Usage:\n");
+		fprintf(stderr, "%s [-n] [-b batch]\n", basename(argv[0]));
+		return -1;
+	}
+
+	/* time in */
+	c0appz_timein();
+
+	/* c0rcfile
+	 * overwrite .cappzrc to a .[app]rc file.
+	 */
+	char str[256];
+	sprintf(str, ".%src", basename(argv[0]));
+	c0appz_setrc(str);
+	c0appz_putrc();
+
+	/* initialize resources */
+	if (c0appz_init(0) != 0) {
+		fprintf(stderr, "error! motr initialization failed.\n");
+		return -2;
+	}
+
+	c0appz_timeout(0);
+	c0appz_timein();
+
+	rc = set_fid();
+	if (rc != 0) {
+		fprintf(stderr, "error in fid initialization");
+		c0appz_free();
+		return -3;
+	}
+
+	gettimeofday(&start1, NULL);
+	rc = migrate(batch, dry_run, &stats);
+	gettimeofday(&end1, NULL);
+	timer(start1, end1, dry_run ? "scanning the index" :
+	      "migrating the index");
+
+	printf("%llu records scanned, %llu old xattr keys (%llu bytes,"
+	       " %llu bytes once converted)\n", stats.scanned, stats.old_keys,
+	       stats.old_bytes, stats.new_bytes);
+	if (!dry_run)
+		printf("%llu migrated, %llu already had a new key, %llu removed"
+		       " meanwhile\n", stats.migrated, stats.already_new,
+		       stats.undone);
+
+	/* free resources*/
+	c0appz_free();
+
+	/* time out */
+	fprintf(stderr, "%4s", "free");
+	c0appz_timeout(0);
+
+	if (rc != 0) {
+		fprintf(stderr, "%d: migration failed\n", rc);
+		return -3;
+	}
+
+	/* success */
+	fprintf(stderr, "%s success\n", basename(argv[0]));
+	return 0;
+}
+
+/*
+ *  Local variables:
+ *  c-indentation-style: "K&R"
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ *  fill-column: 80
+ *  scroll-step: 1
+ *  End:
+ */
@@ -4,6 +4,7 @@ set -e
 
 MODULES=(utils dsal nsal cortxfs kvsfs)
 BUILD_DIR=/tmp/cortxfs
+SRC_ROOT=$(realpath $(dirname "$0")/..)
 TEST_GRP=all
 LOG_ROOT="/var/log/cortx"
 UT_LOG_ROOT="$LOG_ROOT/test/ut"
@@ -72,6 +73,44 @@ execute_ut_dsal () {
 	done
 }
 
+# cfsbench is not built by the component builds: build it against the
+# CORTXFS sources (for the ut helper) and build tree. $CFSBENCH_CFLAGS and
+# $CFSBENCH_LIBS override the defaults.
+build_ut_perf () {
+	local cortxfs_src=${CORTXFS_SOURCE_ROOT:-$SRC_ROOT/cortxfs}
+	local exp_dir=$SRC_ROOT/experiments
+
+	[ ! -d $BUILD_DIR/build-cortxfs ] && die "CORTXFS is not built"
+
+	mkdir -p $PERF_TEST_DIR
+	gcc -O2 -o $PERF_TEST_DIR/cfsbench \
+		-I$exp_dir -I$cortxfs_src/test/ut -I$cortxfs_src/src/include \
+		$CFSBENCH_CFLAGS \
+		$exp_dir/cfsbench/cfsbench.c $exp_dir/perf/lat_hist.c \
+		$exp_dir/perf/perf_stats.c $exp_dir/perf/perf_http.c \
+		$exp_dir/perf/trace.c $cortxfs_src/test/ut/ut_cortxfs_helper.c \
+		-L$BUILD_DIR/build-cortxfs \
+		${CFSBENCH_LIBS:--lcortx-fs -lcmocka -ljson-c -levhtp -levent \
+		 -levent_pthreads -lpthread} || die "cfsbench build failed"
+}
+
+# Not part of "all": cfsbench (experiments/cfsbench) measures, it does not
+# check anything. Results are kept in $PERF_LOG_ROOT/cfsbench.json.
+execute_ut_perf () {
+	echo "CORTXFS performance tests"
+
+	PERF_LOG_ROOT="$LOG_ROOT/test/perf"
+	mkdir -p $PERF_LOG_ROOT
+	cd $PERF_LOG_ROOT
+
+	PERF_TEST_DIR=$BUILD_DIR/build-cortxfs/test/perf
+
+	build_ut_perf
+
+	$PERF_TEST_DIR/cfsbench $CFSBENCH_ARGS -j $PERF_LOG_ROOT/cfsbench.json
+	echo
+}
+
 execute_ut_utils () {
 	# Do nothing. To be implemented
 	echo "${FUNCNAME[0]}: NotImplemented"
@@ -105,6 +144,7 @@ options:
 Test group list:
 nsal          NSAL unit tests
 cortxfs           CORTXFS unit tests
+perf          cfsbench metadata/data benchmark, options from \$CFSBENCH_ARGS
 EOM
 	exit 1
 }